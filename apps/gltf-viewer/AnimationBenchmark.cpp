@@ -0,0 +1,249 @@
+#include "AnimationBenchmark.hpp"
+
+#include "utils/animation.hpp"
+#include "utils/gltf.hpp"
+#include "utils/scenegraph.hpp"
+#include "utils/skinning.hpp"
+#include "utils/threadpool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+    const size_t kSyntheticJointCount = 64;
+    const size_t kSyntheticKeyCount = 30;
+    const float kFrameDuration = 1.f / 60.f;
+
+    // Append a copy of src at the end of dst, returns the flat index of its first node
+    int appendSceneGraph(SceneGraph &dst, const SceneGraph &src) {
+        const auto offset = int(dst.size());
+        const auto weightOffset = uint32_t(dst.weights.size());
+        if (dst.flatIndices.empty()) {
+            dst.flatIndices = src.flatIndices;
+        }
+        dst.nodes.insert(end(dst.nodes), begin(src.nodes), end(src.nodes));
+        for (size_t i = 0; i < src.size(); ++i) {
+            dst.parents.push_back(src.parents[i] >= 0 ? src.parents[i] + offset : -1);
+            dst.subtreeEnd.push_back(src.subtreeEnd[i] + offset);
+            dst.weightOffsets.push_back(src.weightOffsets[i] + weightOffset);
+        }
+        dst.translations.insert(end(dst.translations), begin(src.translations), end(src.translations));
+        dst.rotations.insert(end(dst.rotations), begin(src.rotations), end(src.rotations));
+        dst.scales.insert(end(dst.scales), begin(src.scales), end(src.scales));
+        dst.matrices.insert(end(dst.matrices), begin(src.matrices), end(src.matrices));
+        dst.hasMatrix.insert(end(dst.hasMatrix), begin(src.hasMatrix), end(src.hasMatrix));
+        dst.weights.insert(end(dst.weights), begin(src.weights), end(src.weights));
+        dst.weightCounts.insert(end(dst.weightCounts), begin(src.weightCounts), end(src.weightCounts));
+        dst.worldMatrices.insert(end(dst.worldMatrices), begin(src.worldMatrices), end(src.worldMatrices));
+        dst.dirty.insert(end(dst.dirty), begin(src.dirty), end(src.dirty));
+        return offset;
+    }
+
+    // A chain of kSyntheticJointCount nodes, animated by a single clip
+    void makeSyntheticClip(SceneGraph &graph, AnimationClip &clip) {
+        const auto root = int(graph.size());
+        for (size_t j = 0; j < kSyntheticJointCount; ++j) {
+            const auto flatIdx = root + int(j);
+            graph.nodes.push_back(-1);
+            graph.parents.push_back(j == 0 ? -1 : flatIdx - 1);
+            graph.subtreeEnd.push_back(root + int(kSyntheticJointCount));
+            graph.translations.emplace_back(0, 1, 0);
+            graph.rotations.emplace_back(1, 0, 0, 0);
+            graph.scales.emplace_back(1);
+            graph.matrices.emplace_back(1);
+            graph.hasMatrix.push_back(0);
+            graph.weightOffsets.push_back(uint32_t(graph.weights.size()));
+            graph.weightCounts.push_back(0);
+            graph.worldMatrices.emplace_back(1);
+            graph.dirty.push_back(1);
+        }
+
+        AnimationTrack rotation, translation, scale;
+        rotation.interpolation = AnimationInterpolation::Linear;
+        rotation.components = 4;
+        translation.interpolation = AnimationInterpolation::CubicSpline;
+        translation.components = 3;
+        scale.interpolation = AnimationInterpolation::Step;
+        scale.components = 3;
+        for (size_t k = 0; k < kSyntheticKeyCount; ++k) {
+            const auto time = float(k) / (kSyntheticKeyCount - 1);
+            const auto q = glm::angleAxis(6.28f * time, glm::normalize(glm::vec3(1, 1, 0)));
+            rotation.times.push_back(time);
+            rotation.values.insert(end(rotation.values), {q.x, q.y, q.z, q.w});
+            translation.times.push_back(time);
+            // in-tangent, value, out-tangent
+            translation.values.insert(end(translation.values), {0, 1, 0, std::sin(time), 1, 0, 0, 1, 0});
+            scale.times.push_back(time);
+            scale.values.insert(end(scale.values), {1, 1 + 0.1f * (k % 2), 1});
+        }
+        clip.duration = 1.f;
+        clip.tracks = {rotation, translation, scale};
+        for (size_t j = 0; j < kSyntheticJointCount; ++j) {
+            const auto flatIdx = root + int(j);
+            clip.channels.push_back({flatIdx, AnimationPath::Rotation, 0});
+            clip.channels.push_back({flatIdx, AnimationPath::Translation, 1});
+            if (j % 4 == 0) {
+                clip.channels.push_back({flatIdx, AnimationPath::Scale, 2});
+            }
+        }
+    }
+
+    // Bind pose of a skinned primitive, joints being indices in the whole palette
+    struct SkinnedPrimitive {
+        uint32_t paletteOffset;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::uvec4> joints;
+        std::vector<glm::vec4> weights;
+    };
+
+    void gatherSkinnedPrimitives(const tinygltf::Model &model, const SceneGraph &instance, std::vector<SkinnedPrimitive> &primitives) {
+        for (const auto nodeIdx : instance.nodes) {
+            const auto &node = model.nodes[nodeIdx];
+            if (node.mesh < 0 || node.skin < 0 || model.skins[node.skin].joints.empty()) {
+                continue;
+            }
+            for (const auto &primitive : model.meshes[node.mesh].primitives) {
+                const auto positionIt = primitive.attributes.find("POSITION");
+                const auto jointsIt = primitive.attributes.find("JOINTS_0");
+                const auto weightsIt = primitive.attributes.find("WEIGHTS_0");
+                if (positionIt == end(primitive.attributes) || jointsIt == end(primitive.attributes) || weightsIt == end(primitive.attributes)) {
+                    continue;
+                }
+                const auto count = model.accessors[positionIt->second].count;
+                if (count == 0) {
+                    continue;
+                }
+                SkinnedPrimitive skinned;
+                skinned.paletteOffset = 0;
+                skinned.positions.resize(count);
+                skinned.joints.resize(count);
+                skinned.weights.resize(count);
+                readAccessorAsFloat(model, model.accessors[positionIt->second], &skinned.positions[0].x);
+                readAccessorAsUint(model, model.accessors[jointsIt->second], &skinned.joints[0].x);
+                readAccessorAsFloat(model, model.accessors[weightsIt->second], &skinned.weights[0].x);
+                // Skins are compiled in order so the offset of skin i is the sum of the previous joint counts
+                for (int s = 0; s < node.skin; ++s) {
+                    skinned.paletteOffset += uint32_t(model.skins[s].joints.size());
+                }
+                const auto jointCount = uint32_t(model.skins[node.skin].joints.size());
+                for (auto &j : skinned.joints) {
+                    j = glm::min(j, glm::uvec4(jointCount - 1)) + glm::uvec4(skinned.paletteOffset);
+                }
+                primitives.push_back(std::move(skinned));
+            }
+        }
+    }
+}
+
+int runAnimationBenchmark(const fs::path &gltfFile, size_t clipCount, size_t frameCount, size_t threadCount) {
+    SceneGraph graph;
+    std::vector<AnimationClip> clips;
+    // Skins of all instances, and the bind pose of the skinned primitives of one instance
+    std::vector<Skin> skins;
+    size_t instanceJointCount = 0;
+    std::vector<SkinnedPrimitive> skinnedPrimitives;
+
+    if (gltfFile.empty()) {
+        clips.resize(clipCount);
+        for (auto &clip : clips) {
+            makeSyntheticClip(graph, clip);
+        }
+    }
+    else {
+        tinygltf::Model model;
+        if (!loadGltfFile(gltfFile, model)) {
+            return -1;
+        }
+        const auto instance = buildSceneGraph(model, model.defaultScene >= 0 ? model.defaultScene : 0);
+        const auto sourceClips = compileAnimations(model, instance);
+        if (sourceClips.empty()) {
+            std::cerr << "No animation in " << gltfFile << std::endl;
+            return -1;
+        }
+        const auto instanceSkins = compileSkins(model, instance);
+        instanceJointCount = getPaletteSize(instanceSkins);
+        gatherSkinnedPrimitives(model, instance, skinnedPrimitives);
+
+        // Each clip drives its own instance of the scene
+        for (size_t i = 0; i < clipCount; ++i) {
+            const auto offset = appendSceneGraph(graph, instance);
+            clips.push_back(sourceClips[i % sourceClips.size()]);
+            for (auto &channel : clips.back().channels) {
+                channel.flatNode += offset;
+            }
+            for (auto skin : instanceSkins) {
+                skin.paletteOffset += uint32_t(i * instanceJointCount);
+                for (auto &joint : skin.joints) {
+                    joint = joint >= 0 ? joint + offset : joint;
+                }
+                skins.push_back(std::move(skin));
+            }
+        }
+    }
+
+    Animator animator(std::move(clips));
+    std::vector<size_t> activeClips(clipCount);
+    for (size_t i = 0; i < clipCount; ++i) {
+        activeClips[i] = i;
+    }
+    animator.setActiveClips(activeClips);
+
+    ThreadPool pool(threadCount);
+    std::cout << "Animation benchmark: " << clipCount << " clips, " << animator.activeChannelCount() << " channels, "
+              << graph.size() << " nodes, " << frameCount << " frames" << std::endl;
+
+    const auto run = [&](ThreadPool *pPool, const char *label) {
+        using clock = std::chrono::steady_clock;
+        std::chrono::duration<double> sampleTime{0}, updateTime{0};
+        size_t updatedMatrices = 0;
+        animator.setActiveClips(activeClips); // Reset key caches
+        for (size_t frame = 0; frame < frameCount; ++frame) {
+            const auto start = clock::now();
+            animator.sample(frame * kFrameDuration, graph, pPool);
+            const auto sampled = clock::now();
+            updatedMatrices += graph.updateWorldMatrices();
+            updateTime += clock::now() - sampled;
+            sampleTime += sampled - start;
+        }
+        const auto channelSamples = double(animator.activeChannelCount()) * frameCount;
+        std::cout << std::fixed << std::setprecision(3) << "  " << label << ": sample "
+                  << 1e3 * sampleTime.count() << " ms (" << 1e6 * sampleTime.count() / frameCount << " us/frame, "
+                  << 1e-6 * channelSamples / sampleTime.count() << " M channels/s), world matrices "
+                  << 1e3 * updateTime.count() << " ms (" << updatedMatrices << " updated)" << std::endl;
+    };
+    run(nullptr, "1 thread");
+    run(&pool, std::to_string(pool.threadCount()).append(" threads").c_str());
+
+    if (!skins.empty()) {
+        using clock = std::chrono::steady_clock;
+        std::vector<glm::mat4> palette;
+        std::vector<glm::vec3> skinnedPositions;
+        std::chrono::duration<double> paletteTime{0}, skinningTime{0};
+        size_t skinnedVertices = 0;
+        for (size_t frame = 0; frame < frameCount; ++frame) {
+            animator.sample(frame * kFrameDuration, graph, &pool);
+            graph.updateWorldMatrices();
+            const auto start = clock::now();
+            computeJointPalettes(skins, graph, palette, &pool);
+            const auto palettesDone = clock::now();
+            // Software pipeline: every instance skinned on the CPU
+            for (size_t instance = 0; instance < clipCount; ++instance) {
+                const auto *pPalette = palette.data() + instance * instanceJointCount;
+                for (const auto &primitive : skinnedPrimitives) {
+                    skinnedPositions.resize(primitive.positions.size());
+                    skinPositions(primitive.positions.size(), primitive.positions.data(), primitive.joints.data(),
+                                  primitive.weights.data(), pPalette, skinnedPositions.data());
+                    skinnedVertices += primitive.positions.size();
+                }
+            }
+            skinningTime += clock::now() - palettesDone;
+            paletteTime += palettesDone - start;
+        }
+        std::cout << std::fixed << std::setprecision(3) << "  skinning: palettes " << 1e3 * paletteTime.count() << " ms ("
+                  << palette.size() << " joints), CPU skinning " << 1e3 * skinningTime.count() << " ms ("
+                  << 1e-6 * skinnedVertices / std::max(1e-9, skinningTime.count()) << " M vertices/s)" << std::endl;
+    }
+    return 0;
+}
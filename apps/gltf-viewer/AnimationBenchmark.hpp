@@ -0,0 +1,17 @@
+#pragma once
+
+#include "utils/filesystem.hpp"
+
+#include <cstddef>
+
+// Headless benchmark of the animation system: samples clipCount clips during
+// frameCount frames and updates the world matrices, without any GL context.
+//
+// If gltfFile is empty, clips are generated (one 64 joints chain per clip,
+// with LINEAR rotations, CUBICSPLINE translations and STEP scales).
+// Otherwise the clips of the file are used, the scene being instanced as many
+// times as needed so that each clip drives its own copy of the nodes. Skinned
+// files also measure the joint palettes and CPU skinning of all instances.
+// threadCount == 0 uses one thread per hardware thread.
+int runAnimationBenchmark(const fs::path &gltfFile, size_t clipCount,
+                          size_t frameCount, size_t threadCount);
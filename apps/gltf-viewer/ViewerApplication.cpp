@@ -1,16 +1,45 @@
 #include "ViewerApplication.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
 #include <numeric>
+#include <thread>
+#include <tuple>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/io.hpp>
 
+#include "utils/animation.hpp"
+#include "utils/arena.hpp"
 #include "utils/cameras.hpp"
+#include "utils/environment.hpp"
+#include "utils/filewatcher.hpp"
+#include "utils/frameprofiler.hpp"
+#include "utils/gbuffer.hpp"
 #include "utils/gltf.hpp"
 #include "utils/images.hpp"
+#include "utils/lights.hpp"
+#include "utils/loadprofiler.hpp"
+#include "utils/morphing.hpp"
+#include "utils/programcache.hpp"
+#include "utils/radixsort.hpp"
+#include "utils/renderbench.hpp"
+#include "utils/runtimescene.hpp"
+#include "utils/scenegraph.hpp"
+#include "utils/shadervariants.hpp"
+#include "utils/shadows.hpp"
+#include "utils/skinning.hpp"
+#include "utils/streaming.hpp"
+#include "utils/texturestreaming.hpp"
+#include "utils/threadpool.hpp"
+#include "utils/trace.hpp"
+#include "utils/transparency.hpp"
+#include "utils/uploader.hpp"
 
 #include <stb_image_write.h>
 #include <tiny_gltf.h>
@@ -21,44 +50,75 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
     if (key == GLFW_KEY_ESCAPE && action == GLFW_RELEASE) {
         glfwSetWindowShouldClose(window, 1);
     }
-}
-
-bool ViewerApplication::loadGltfFile(tinygltf::Model &model) {  // TODO Loading the glTF file
-    std::clog << "Loading file " << m_gltfFilePath << std::endl;
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-
-    // m_gltfFilePath.string() au lieu de argv[1]
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, m_gltfFilePath.string());
-
-    if (!warn.empty()) {
-        std::cerr << warn << std::endl;
-    }
-
-    if (!err.empty()) {
-        std::cerr << err << std::endl;
-    }
-
-    if (!ret) {
-        std::cerr << "Failed to parse glTF file" << std::endl;
-        return false;
+    // Write the trace recorded so far, so that it can be opened while running
+    if (key == GLFW_KEY_F12 && action == GLFW_RELEASE && globalTracer()) {
+        globalTracer()->flush();
+        std::clog << "Trace flushed" << std::endl;
     }
-
-    return true;
 }
 
-std::vector<GLuint> ViewerApplication::createBufferObjects(const tinygltf::Model &model) {  // TODO Creation of Buffer Objects
-    std::vector<GLuint> bufferObjects(model.buffers.size(), 0);
+bool ViewerApplication::loadGltfFile(tinygltf::Model &model, GltfSources &sources, std::pmr::memory_resource *arena) {  // TODO Loading the glTF file
+    // Only the document, buffers and images are streamed in by run()
+    return loadGltfStructure(m_gltfFilePath, model, sources, m_LoadOptions, arena);
+}
 
-    glGenBuffers(GLsizei(model.buffers.size()), bufferObjects.data());
-    for (size_t i = 0; i < model.buffers.size(); ++i) {
-        glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[i]);
-        glBufferStorage(GL_ARRAY_BUFFER, model.buffers[i].data.size(), model.buffers[i].data.data(), 0);
-    }
+GLuint ViewerApplication::createBufferObject(const tinygltf::Buffer &buffer) {  // TODO Creation of Buffer Objects
+    // Only the storage, the content is copied by the GpuUploader
+    GLuint bufferObject = 0;
+    glGenBuffers(1, &bufferObject);
+    glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
+    glBufferStorage(GL_ARRAY_BUFFER, buffer.data.size(), nullptr, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return bufferObject;
+}
 
-    return bufferObjects;
+size_t ViewerApplication::createAccessorBufferObjects(const tinygltf::Model &model, const tinygltf::Mesh &mesh, const std::vector<GLuint> &bufferObjects, std::vector<GLuint> &accessorBufferObjects) {
+    // Sparse accessors and accessors without bufferView get their own buffer
+    // object, shared by all the primitives referencing them
+    size_t resolvedCount = 0;
+    const auto resolveAccessor = [&](int accessorIdx) {
+        if (accessorIdx < 0 || accessorBufferObjects[accessorIdx]) {
+            return;
+        }
+        const auto &accessor = model.accessors[accessorIdx];
+        if (!accessor.sparse.isSparse && accessor.bufferView >= 0) {
+            return;
+        }
+        const auto byteStride = getAccessorByteStride(model, accessor);
+        const auto elementSize = size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type));
+        if (accessor.count == 0) {
+            return;
+        }
+        const auto byteSize = (accessor.count - 1) * byteStride + elementSize;
+
+        auto &bufferObject = accessorBufferObjects[accessorIdx];
+        glGenBuffers(1, &bufferObject);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, bufferObject);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, byteSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        if (accessor.bufferView >= 0) {
+            // Copy on write of the base bufferView, from the buffer object already on the GPU
+            const auto &bufferView = model.bufferViews[accessor.bufferView];
+            glBindBuffer(GL_COPY_READ_BUFFER, bufferObjects[bufferView.buffer]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, bufferView.byteOffset + accessor.byteOffset, 0, byteSize);
+        }
+        else {
+            glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+        }
+        // Only the ranges touched by the sparse elements are densified on the CPU
+        for (const auto &range : resolveSparseAccessor(model, accessor)) {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstElement * byteStride, range.data.size(), range.data.data());
+        }
+        ++resolvedCount;
+    };
+    for (const auto &primitive : mesh.primitives) {
+        for (const auto &attribute : primitive.attributes) {
+            resolveAccessor(attribute.second);
+        }
+        resolveAccessor(primitive.indices);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return resolvedCount;
 }
 
 std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshToVertexArrays) {   // TODO Creation of Vertex Array Objects
@@ -165,269 +225,108 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
     return vertexArrayObjects;
 }
 
-std::vector<glm::vec4> computeTangent(const tinygltf::Model &model) {
-    int nbpos = 0;
-    auto posloc = std::vector<glm::vec3>(3, glm::vec3(0, 0, 0));
-    auto texloc = std::vector<glm::vec2>(3, glm::vec2(0, 0));
-    std::vector<glm::vec4> alltangent;
-    glm::vec4 tangent;
-
-    std::vector<glm::vec4> resTan;
-    // Compute Tangente from attributes POSITION and TextCoord_0
-    // todo refactor with scene drawing
-    // todo need a visitScene generic function that takes a accept() functor
-    if (model.defaultScene >= 0) {
-        const std::function<void(int, const glm::mat4 &)> computeTan =
-            [&](int nodeIdx, const glm::mat4 &parentMatrix)
-        {
-            const auto &node = model.nodes[nodeIdx];
-            const glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
-            if (node.mesh >= 0) {
-                const auto &mesh = model.meshes[node.mesh];
-                for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx)  {
-                    const auto &primitive = mesh.primitives[pIdx];
-                    /// Attrib Position
-                    const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
-                    if (positionAttrIdxIt == end(primitive.attributes)) {
-                        continue;
-                    }
-                    const auto &positionAccessor = model.accessors[(*positionAttrIdxIt).second];
-                    if (positionAccessor.type != 3) {
-                        std::cerr << "Position accessor with type != VEC3, skipping" << std::endl;
-                        continue;
-                    }
-                    const auto &positionBufferView = model.bufferViews[positionAccessor.bufferView];
-                    const auto posbyteOffset = positionAccessor.byteOffset + positionBufferView.byteOffset;
-                    const auto &positionBuffer = model.buffers[positionBufferView.buffer];
-                    const auto positionByteStride = positionBufferView.byteStride ? positionBufferView.byteStride : 3 * sizeof(float);
-
-                    /// Attrib TextCoord_0
-                    const auto texAttrIdxIt = primitive.attributes.find("TEXCOORD_0");
-                    if (texAttrIdxIt == end(primitive.attributes)) {
-                        continue;
-                    }
-                    const auto &texAccessor = model.accessors[(*texAttrIdxIt).second];
-                    if (texAccessor.type != 2) {
-                        std::cerr << "Position accessor with type != VEC3, skipping" << std::endl;
-                        continue;
-                    }
-                    const auto &texBufferView = model.bufferViews[texAccessor.bufferView];
-                    const auto texbyteOffset = texAccessor.byteOffset + texBufferView.byteOffset;
-                    const auto &texBuffer = model.buffers[texBufferView.buffer];
-                    const auto texByteStride = texBufferView.byteStride ? texBufferView.byteStride : 2 * sizeof(float);
-                    ///
-
-                    if (primitive.indices >= 0) {
-                        const auto &indexAccessor = model.accessors[primitive.indices];
-                        const auto &indexBufferView = model.bufferViews[indexAccessor.bufferView];
-                        const auto indexByteOffset = indexAccessor.byteOffset + indexBufferView.byteOffset;
-                        const auto &indexBuffer = model.buffers[indexBufferView.buffer];
-                        auto indexByteStride = indexBufferView.byteStride;
-
-                        switch (indexAccessor.componentType) {
-                            default:
-                                std::cerr << "Primitive index accessor with bad componentType " << indexAccessor.componentType << ", skipping it." << std::endl;
-                                continue;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                                indexByteStride = indexByteStride ? indexByteStride : sizeof(uint8_t);
-                                break;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                                indexByteStride = indexByteStride ? indexByteStride : sizeof(uint16_t);
-                                break;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                                indexByteStride = indexByteStride ? indexByteStride : sizeof(uint32_t);
-                                break;
-                        }
-
-                        for (size_t i = 0; i < indexAccessor.count; ++i) {
-                            uint32_t index = 0;
-                            switch (indexAccessor.componentType) {
-                                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                                    index = *((const uint8_t *)&indexBuffer.data[indexByteOffset + indexByteStride * i]);
-                                    break;
-                                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                                    index = *((const uint16_t *)&indexBuffer.data[indexByteOffset + indexByteStride * i]);
-                                    break;
-                                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                                    index = *((const uint32_t *)&indexBuffer.data[indexByteOffset + indexByteStride * i]);
-                                    break;
-                            }
-                            const auto &localPosition = *((const glm::vec3 *)&positionBuffer.data[posbyteOffset + positionByteStride * index]);
-                            const auto worldPosition = glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                            const auto texCoord = *((const glm::vec2 *)&texBuffer.data[texbyteOffset + texByteStride * index]);
-
-                            posloc[2] = posloc[1];
-                            posloc[1] = posloc[0];
-                            posloc[0] = localPosition;
-
-                            texloc[2] = texloc[1];
-                            texloc[1] = texloc[0];
-                            texloc[0] = texCoord;
-                            if ((nbpos + 1) % 3 == 0) {
-                                glm::vec3 edge1 = posloc[1] - posloc[0];
-                                glm::vec3 edge2 = posloc[2] - posloc[0];
-                                glm::vec2 deltaUV1 = texloc[1] - texloc[0];
-                                glm::vec2 deltaUV2 = texloc[2] - texloc[0];
-                                GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-                                tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-                                tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-                                tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-                                tangent.w = 1.0f;
-                                tangent = glm::normalize(tangent);
-                                alltangent.push_back(tangent);
-                                alltangent.push_back(tangent);
-                                alltangent.push_back(tangent);
-                            }
-                            nbpos += 1;
-                        }
-                    }
-                    else {
-                        for (size_t i = 0; i < positionAccessor.count; ++i) {
-                            const auto &localPosition = *((const glm::vec3 *)&positionBuffer.data[posbyteOffset + positionByteStride * i]);
-                            const auto worldPosition = glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                            const auto texCoord = *((const glm::vec2 *)&texBuffer.data[texbyteOffset + texByteStride * i]);
-                            posloc[2] = posloc[1];
-                            posloc[1] = posloc[0];
-                            posloc[0] = localPosition;
-
-                            texloc[2] = texloc[1];
-                            texloc[1] = texloc[0];
-                            texloc[0] = texCoord;
-                            if ((nbpos + 1) % 3 == 0) {
-                                glm::vec3 edge1 = posloc[1] - posloc[0];
-                                glm::vec3 edge2 = posloc[2] - posloc[0];
-                                glm::vec2 deltaUV1 = texloc[1] - texloc[0];
-                                glm::vec2 deltaUV2 = texloc[2] - texloc[0];
-                                GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-                                tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-                                tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-                                tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-                                tangent.w = 1.0f;
-                                tangent = glm::normalize(tangent);
-                                alltangent.push_back(tangent);
-                                alltangent.push_back(tangent);
-                                alltangent.push_back(tangent);
-                            }
-                            nbpos += 1;
-                        }
-                    }
-                }
-            }
-            for (const auto childNodeIdx : node.children) {
-                computeTan(childNodeIdx, modelMatrix);
-            }
-        };
-        for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-            computeTan(nodeIdx, glm::mat4(1));
-        }
+size_t getAccessorByteOffset(const tinygltf::Model &model, int accessorIdx, const std::vector<GLuint> &accessorBufferObjects) {
+    // Resolved accessors start their own buffer object
+    if (accessorBufferObjects[accessorIdx]) {
+        return 0;
     }
-    resTan = alltangent;
-    return resTan;
+    const auto &accessor = model.accessors[accessorIdx];
+    return accessor.byteOffset + model.bufferViews[accessor.bufferView].byteOffset;
 }
 
-std::vector<GLuint> ViewerApplication::createVertexArrayObjects_T_B(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshToVertexArrays) {    // TODO Creation of Vertex Array Objects
-    std::vector<GLuint> vertexArrayObjects; // We don't know the size yet
-
-    // For each mesh of model we keep its range of VAOs
-    meshToVertexArrays.resize(model.meshes.size());
+// Bind the buffer object holding an accessor to target and return the byte
+// offset of its first element in it
+size_t bindAccessorBuffer(const tinygltf::Model &model, int accessorIdx, const std::vector<GLuint> &bufferObjects, const std::vector<GLuint> &accessorBufferObjects, GLenum target) {
+    if (accessorBufferObjects[accessorIdx]) {
+        glBindBuffer(target, accessorBufferObjects[accessorIdx]);
+    }
+    else {
+        const auto &accessor = model.accessors[accessorIdx];
+        glBindBuffer(target, bufferObjects[model.bufferViews[accessor.bufferView].buffer]);
+    }
+    return getAccessorByteOffset(model, accessorIdx, accessorBufferObjects);
+}
 
+void ViewerApplication::createVertexArrayObjects_T_B(const tinygltf::Model &model, const tinygltf::Mesh &mesh, const std::vector<GLuint> &bufferObjects, const std::vector<GLuint> &accessorBufferObjects, GLuint *vertexArrayObjects, LoadProfiler *profiler) {    // TODO Creation of Vertex Array Objects
     const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
     const GLuint VERTEX_ATTRIB_NORMAL_IDX = 1;
     const GLuint VERTEX_ATTRIB_TEXCOORD0_IDX = 2;
     const GLuint VERTEX_ATTRIB_TANGENT = 3;
+    const GLuint VERTEX_ATTRIB_JOINTS0_IDX = 4;
+    const GLuint VERTEX_ATTRIB_WEIGHTS0_IDX = 5;
 
-    //std::vector<glm::vec3> Posloc =  std::vector(2,glm::vec3(0,0,0));
+    // One VAO for each primitive
+    glGenVertexArrays(GLsizei(mesh.primitives.size()), vertexArrayObjects);
+    for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
+        const auto vao = vertexArrayObjects[pIdx];
+        const auto &primitive = mesh.primitives[pIdx];
 
-    for (size_t i = 0; i < model.meshes.size(); ++i) {
-        const auto &mesh = model.meshes[i];
-        auto &vaoRange = meshToVertexArrays[i];
-        vaoRange.begin = GLsizei(vertexArrayObjects.size()); // Range for this mesh will be at
-        // the end of vertexArrayObjects
-        vaoRange.count = GLsizei(mesh.primitives.size()); // One VAO for each primitive
-
-        // Add enough elements to store our VAOs identifiers
-        vertexArrayObjects.resize(vertexArrayObjects.size() + mesh.primitives.size());
-
-        glGenVertexArrays(vaoRange.count, &vertexArrayObjects[vaoRange.begin]);
-        for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
-            const auto vao = vertexArrayObjects[vaoRange.begin + pIdx];
-            const auto &primitive = mesh.primitives[pIdx];
-
-            glBindVertexArray(vao);
-            {
-                // POSITION attribute
-                // scope, so we can declare const variable with the same name on each
-                // scope
-                const auto iterator = primitive.attributes.find("POSITION");
-                if (iterator != end(primitive.attributes)) {
-                    const auto accessorIdx = (*iterator).second;
-                    const auto &accessor = model.accessors[accessorIdx];
-                    const auto &bufferView = model.bufferViews[accessor.bufferView];
-                    const auto bufferIdx = bufferView.buffer;
+        glBindVertexArray(vao);
+        {
+            // POSITION attribute
+            // scope, so we can declare const variable with the same name on each
+            // scope
+            const auto iterator = primitive.attributes.find("POSITION");
+            if (iterator != end(primitive.attributes)) {
+                const auto accessorIdx = (*iterator).second;
+                const auto &accessor = model.accessors[accessorIdx];
 
-                    glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION_IDX);
-                    assert(GL_ARRAY_BUFFER == bufferView.target);
-                    // Theorically we could also use bufferView.target, but it is safer
-                    // Here it is important to know that the next call
-                    // (glVertexAttribPointer) use what is currently bound
-                    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[bufferIdx]);
+                glEnableVertexAttribArray(VERTEX_ATTRIB_POSITION_IDX);
+                // Here it is important to know that the next call
+                // (glVertexAttribPointer) use what is currently bound
+                const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
 
-                    // tinygltf converts strings type like "VEC3, "VEC2" to the number of
-                    // components, stored in accessor.type
-                    const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
-                    glVertexAttribPointer(VERTEX_ATTRIB_POSITION_IDX, accessor.type, accessor.componentType, GL_FALSE, GLsizei(bufferView.byteStride), (const GLvoid *)byteOffset);
-                }
+                // tinygltf converts strings type like "VEC3, "VEC2" to the number of
+                // components, stored in accessor.type
+                glVertexAttribPointer(VERTEX_ATTRIB_POSITION_IDX, accessor.type, accessor.componentType, GL_FALSE, GLsizei(getAccessorByteStride(model, accessor)), (const GLvoid *)byteOffset);
             }
-            // todo Refactor to remove code duplication (loop over "POSITION",
-            // "NORMAL" and their corresponding VERTEX_ATTRIB_*)
-            {
-                // NORMAL attribute
-                const auto iterator = primitive.attributes.find("NORMAL");
-                if (iterator != end(primitive.attributes)) {
-                    const auto accessorIdx = (*iterator).second;
-                    const auto &accessor = model.accessors[accessorIdx];
-                    const auto &bufferView = model.bufferViews[accessor.bufferView];
-                    const auto bufferIdx = bufferView.buffer;
+        }
+        // todo Refactor to remove code duplication (loop over "POSITION",
+        // "NORMAL" and their corresponding VERTEX_ATTRIB_*)
+        {
+            // NORMAL attribute
+            const auto iterator = primitive.attributes.find("NORMAL");
+            if (iterator != end(primitive.attributes)) {
+                const auto accessorIdx = (*iterator).second;
+                const auto &accessor = model.accessors[accessorIdx];
 
-                    glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL_IDX);
-                    assert(GL_ARRAY_BUFFER == bufferView.target);
-                    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[bufferIdx]);
-                    glVertexAttribPointer(VERTEX_ATTRIB_NORMAL_IDX, accessor.type, accessor.componentType, GL_FALSE, GLsizei(bufferView.byteStride), (const GLvoid *)(accessor.byteOffset + bufferView.byteOffset));
-                }
+                glEnableVertexAttribArray(VERTEX_ATTRIB_NORMAL_IDX);
+                const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
+                glVertexAttribPointer(VERTEX_ATTRIB_NORMAL_IDX, accessor.type, accessor.componentType, GL_FALSE, GLsizei(getAccessorByteStride(model, accessor)), (const GLvoid *)byteOffset);
             }
-            {
-                // TEXCOORD_0 attribute
-                const auto iterator = primitive.attributes.find("TEXCOORD_0");
-                if (iterator != end(primitive.attributes)) {
-                    const auto accessorIdx = (*iterator).second;
-                    const auto &accessor = model.accessors[accessorIdx];
-                    const auto &bufferView = model.bufferViews[accessor.bufferView];
-                    const auto bufferIdx = bufferView.buffer;
+        }
+        {
+            // TEXCOORD_0 attribute
+            const auto iterator = primitive.attributes.find("TEXCOORD_0");
+            if (iterator != end(primitive.attributes)) {
+                const auto accessorIdx = (*iterator).second;
+                const auto &accessor = model.accessors[accessorIdx];
 
-                    glEnableVertexAttribArray(VERTEX_ATTRIB_TEXCOORD0_IDX);
-                    assert(GL_ARRAY_BUFFER == bufferView.target);
-                    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[bufferIdx]);
-                    glVertexAttribPointer(VERTEX_ATTRIB_TEXCOORD0_IDX, accessor.type, accessor.componentType, GL_FALSE, GLsizei(bufferView.byteStride), (const GLvoid *)(accessor.byteOffset + bufferView.byteOffset));
-                }
+                glEnableVertexAttribArray(VERTEX_ATTRIB_TEXCOORD0_IDX);
+                const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
+                glVertexAttribPointer(VERTEX_ATTRIB_TEXCOORD0_IDX, accessor.type, accessor.componentType, GL_FALSE, GLsizei(getAccessorByteStride(model, accessor)), (const GLvoid *)byteOffset);
             }
-            {
-                // TANGENT attribute
-                const auto iterator = primitive.attributes.find("TANGENT");
-                if (iterator != end(primitive.attributes)) {
-                    /// Attribut TANGENT présent dans le gltf
-                    const auto accessorIdx = (*iterator).second;
-                    const auto &accessor = model.accessors[accessorIdx];
-                    const auto &bufferView = model.bufferViews[accessor.bufferView];
-                    const auto bufferIdx = bufferView.buffer;
+        }
+        {
+            // TANGENT attribute
+            const auto iterator = primitive.attributes.find("TANGENT");
+            if (iterator != end(primitive.attributes)) {
+                /// Attribut TANGENT présent dans le gltf
+                const auto accessorIdx = (*iterator).second;
+                const auto &accessor = model.accessors[accessorIdx];
 
-                    glEnableVertexAttribArray(VERTEX_ATTRIB_TANGENT);
-                    assert(GL_ARRAY_BUFFER == bufferView.target);
-                    glBindBuffer(GL_ARRAY_BUFFER, bufferObjects[bufferIdx]);
-                    glVertexAttribPointer(VERTEX_ATTRIB_TANGENT, accessor.type, accessor.componentType, GL_FALSE, GLsizei(bufferView.byteStride), (const GLvoid *)(accessor.byteOffset + bufferView.byteOffset));
+                glEnableVertexAttribArray(VERTEX_ATTRIB_TANGENT);
+                const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
+                glVertexAttribPointer(VERTEX_ATTRIB_TANGENT, accessor.type, accessor.componentType, GL_FALSE, GLsizei(getAccessorByteStride(model, accessor)), (const GLvoid *)byteOffset);
+            }
+            else {
+                /// Attribut TANGENT non présent dans le gltf necessite de le calculé
+                std::vector<glm::vec4> tangente;
+                {
+                    LoadProfiler::Scope scope(profiler, LoadPhase::TangentGeneration);
+                    tangente = computeTangent(model, primitive);
                 }
-                else {
-                    /// Attribut TANGENT non présent dans le gltf necessite de le calculé
-                    std::vector<glm::vec4> tangente = computeTangent(model);
+                if (!tangente.empty()) {
                     /// bind vbo contenant les tangents
                     GLuint vbo;
                     glGenBuffers(1, &vbo);
@@ -442,64 +341,94 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects_T_B(const tinygl
                     glBindBuffer(GL_ARRAY_BUFFER, 0);
                 }
             }
+        }
+        {
+            // JOINTS_0 attribute, integer attribute so it needs glVertexAttribIPointer
+            const auto iterator = primitive.attributes.find("JOINTS_0");
+            if (iterator != end(primitive.attributes)) {
+                const auto accessorIdx = (*iterator).second;
+                const auto &accessor = model.accessors[accessorIdx];
 
-            // Index array if defined
-            if (primitive.indices >= 0) {
-                const auto accessorIdx = primitive.indices;
+                glEnableVertexAttribArray(VERTEX_ATTRIB_JOINTS0_IDX);
+                const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
+                glVertexAttribIPointer(VERTEX_ATTRIB_JOINTS0_IDX, accessor.type, accessor.componentType, GLsizei(getAccessorByteStride(model, accessor)), (const GLvoid *)byteOffset);
+            }
+        }
+        {
+            // WEIGHTS_0 attribute, can be normalized unsigned byte or short
+            const auto iterator = primitive.attributes.find("WEIGHTS_0");
+            if (iterator != end(primitive.attributes)) {
+                const auto accessorIdx = (*iterator).second;
                 const auto &accessor = model.accessors[accessorIdx];
-                const auto &bufferView = model.bufferViews[accessor.bufferView];
-                const auto bufferIdx = bufferView.buffer;
 
-                assert(GL_ELEMENT_ARRAY_BUFFER == bufferView.target);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObjects[bufferIdx]); // Binding the index buffer to
-                // GL_ELEMENT_ARRAY_BUFFER while the VAO
-                // is bound is enough to tell OpenGL we
-                // want to use that index buffer for that
-                // VAO
+                glEnableVertexAttribArray(VERTEX_ATTRIB_WEIGHTS0_IDX);
+                const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
+                glVertexAttribPointer(VERTEX_ATTRIB_WEIGHTS0_IDX, accessor.type, accessor.componentType, accessor.componentType == GL_FLOAT ? GL_FALSE : GL_TRUE, GLsizei(getAccessorByteStride(model, accessor)), (const GLvoid *)byteOffset);
             }
         }
+
+        // Index array if defined
+        if (primitive.indices >= 0) {
+            bindAccessorBuffer(model, primitive.indices, bufferObjects, accessorBufferObjects, GL_ELEMENT_ARRAY_BUFFER); // Binding the index buffer to
+            // GL_ELEMENT_ARRAY_BUFFER while the VAO
+            // is bound is enough to tell OpenGL we
+            // want to use that index buffer for that
+            // VAO
+        }
     }
     glBindVertexArray(0);
-    std::clog << "Number of VAOs: " << vertexArrayObjects.size() << std::endl;
-    return vertexArrayObjects;
 }
 
-std::vector<GLuint> ViewerApplication::createTextureObjects(const tinygltf::Model &model) const {
-    std::vector<GLuint> textureObjects(model.textures.size(), 0);
+// Vertex arrays of the depth prepass: the positions alone, with the joints
+// and weights of the skinned primitives, so that the prepass fetches a
+// fraction of the vertex data of the shading pass
+void ViewerApplication::createDepthVertexArrayObjects(const tinygltf::Model &model, const tinygltf::Mesh &mesh, const std::vector<GLuint> &bufferObjects, const std::vector<GLuint> &accessorBufferObjects, GLuint *vertexArrayObjects) {
+    // Locations of forward.vs.glsl
+    const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
+    const GLuint VERTEX_ATTRIB_JOINTS0_IDX = 4;
+    const GLuint VERTEX_ATTRIB_WEIGHTS0_IDX = 5;
+
+    glGenVertexArrays(GLsizei(mesh.primitives.size()), vertexArrayObjects);
+    for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
+        const auto &primitive = mesh.primitives[pIdx];
+        glBindVertexArray(vertexArrayObjects[pIdx]);
+        for (const auto attribute : {VERTEX_ATTRIB_POSITION_IDX, VERTEX_ATTRIB_JOINTS0_IDX, VERTEX_ATTRIB_WEIGHTS0_IDX}) {
+            const auto name = attribute == VERTEX_ATTRIB_POSITION_IDX ? "POSITION" : attribute == VERTEX_ATTRIB_JOINTS0_IDX ? "JOINTS_0" : "WEIGHTS_0";
+            const auto iterator = primitive.attributes.find(name);
+            if (iterator == end(primitive.attributes)) {
+                continue;
+            }
+            const auto accessorIdx = (*iterator).second;
+            const auto &accessor = model.accessors[accessorIdx];
+
+            glEnableVertexAttribArray(attribute);
+            const auto byteOffset = bindAccessorBuffer(model, accessorIdx, bufferObjects, accessorBufferObjects, GL_ARRAY_BUFFER);
+            const auto stride = GLsizei(getAccessorByteStride(model, accessor));
+            if (attribute == VERTEX_ATTRIB_JOINTS0_IDX) {
+                glVertexAttribIPointer(attribute, accessor.type, accessor.componentType, stride, (const GLvoid *)byteOffset);
+            }
+            else {
+                glVertexAttribPointer(attribute, accessor.type, accessor.componentType, accessor.componentType == GL_FLOAT ? GL_FALSE : GL_TRUE, stride, (const GLvoid *)byteOffset);
+            }
+        }
+        if (primitive.indices >= 0) {
+            bindAccessorBuffer(model, primitive.indices, bufferObjects, accessorBufferObjects, GL_ELEMENT_ARRAY_BUFFER);
+        }
+    }
+    glBindVertexArray(0);
+}
 
+// Filtering and wrapping of a texture, with the glTF defaults
+TextureStreamer::Sampler getTextureSampler(const tinygltf::Model &model, int textureIdx) {
     tinygltf::Sampler defaultSampler;
     defaultSampler.minFilter = GL_LINEAR;
     defaultSampler.magFilter = GL_LINEAR;
     defaultSampler.wrapS = GL_REPEAT;
     defaultSampler.wrapT = GL_REPEAT;
-    defaultSampler.wrapR = GL_REPEAT;
-
-    glActiveTexture(GL_TEXTURE0);
 
-    glGenTextures(GLsizei(model.textures.size()), textureObjects.data());
-    for (int i = 0; i < model.textures.size(); i++) {
-        // Assume a texture object has been created and bound to GL_TEXTURE_2D
-        const auto &texture = model.textures[i]; // get i-th texture
-        assert(texture.source >= 0); // ensure a source image is present
-        const auto &image = model.images[texture.source]; // get the image
-
-        glBindTexture(GL_TEXTURE_2D, textureObjects[i]);
-        // fill the texture object with the data from the image
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, image.pixel_type, image.image.data());
-
-        const auto &sampler = texture.sampler >= 0 ? model.samplers[texture.sampler] : defaultSampler;
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
-
-        if (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST || sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR || sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST || sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR) {
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-    }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return textureObjects;
+    const auto &texture = model.textures[textureIdx];
+    const auto &sampler = texture.sampler >= 0 ? model.samplers[texture.sampler] : defaultSampler;
+    return {sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR, sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR, sampler.wrapS, sampler.wrapT};
 }
 
 GLuint ViewerApplication::initVbocube(GLsizei count_vertex,const std::vector<glimac::ShapeVertex> &vertices) {
@@ -537,47 +466,203 @@ GLuint ViewerApplication::initVaocube(const GLuint &vbo) {
     return vao;
 }
 
-void ViewerApplication::setVec3(const GLProgram &prog,const std::string &name,const glm::vec3 &vec) {
-    glUniform3f(glGetUniformLocation(prog.glId(), name.c_str()), vec[0], vec[1], vec[2]);
-}
-
-void ViewerApplication::setFloat(const GLProgram &prog,const std::string &name, float value) {
-    glUniform1f(glGetUniformLocation(prog.glId(), name.c_str()), value);
-}
-
 int ViewerApplication::run() {
+    if (globalTracer()) {
+        globalTracer()->calibrateGpuClock();
+    }
+    // Temporary structures of the load, freed at once when the scene is streamed in
+    LoadArena loadArena;
+    // Cost of each phase of the load, reported once the scene is streamed in
+    LoadProfiler loadProfiler(&loadArena);
+    // Programs linked by a previous launch are read back from their binaries
+    ProgramCache programCache(ProgramCache::getDefaultDirectory());
+    const auto loadProfiledProgram = [&](const std::vector<fs::path> &shaderPaths) {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::ShaderCompile);
+        bool cacheHit = false;
+        auto program = programCache.load(shaderPaths, &cacheHit);
+        loadProfiler.countProgram(cacheHit);
+        return program;
+    };
+
     // Loader shaders
-    const auto glslProgram = compileProgram({ m_ShadersRootPath / m_AppName / m_vertexShader, m_ShadersRootPath / m_AppName / m_fragmentShader });
-    const auto modelViewProjMatrixLocation = glGetUniformLocation(glslProgram.glId(), "uModelViewProjMatrix");
-    const auto modelViewMatrixLocation = glGetUniformLocation(glslProgram.glId(), "uModelViewMatrix");
-    const auto normalMatrixLocation = glGetUniformLocation(glslProgram.glId(), "uNormalMatrix");
-    // Récupérer les uniform du fragment shader
-    const auto uLightDirectionLocation = glGetUniformLocation(glslProgram.glId(), "uLightDirection");
-    const auto uLightIntensity = glGetUniformLocation(glslProgram.glId(), "uLightIntensity");
-    const auto uBaseColorTexture = glGetUniformLocation(glslProgram.glId(), "uBaseColorTexture");
-    const auto uNormalTexture = glGetUniformLocation(glslProgram.glId(), "uNormalTexture");
-    const auto uNormalScale = glGetUniformLocation(glslProgram.glId(), "uNormalScale");
-    const auto uActiveNormal = glGetUniformLocation(glslProgram.glId(), "uActiveNormal");
-    const auto uBaseColorFactor = glGetUniformLocation(glslProgram.glId(), "uBaseColorFactor");
-    const auto uMetallicRoughnessTexture = glGetUniformLocation(glslProgram.glId(), "uMetallicRoughnessTexture");
-    const auto uMetallicFactor = glGetUniformLocation(glslProgram.glId(), "uMetallicFactor");
-    const auto uRoughnessFactor = glGetUniformLocation(glslProgram.glId(), "uRoughnessFactor");
-    const auto uEmissiveTexture = glGetUniformLocation(glslProgram.glId(), "uEmissiveTexture");
-    const auto uEmissiveFactor = glGetUniformLocation(glslProgram.glId(), "uEmissiveFactor");
-
-    const auto glslCube = compileProgram({ m_ShadersRootPath / m_AppName / m_vertexShader_cube, m_ShadersRootPath / m_AppName / m_fragmentShader_cube });
-    const auto uSize_cube = glGetUniformLocation(glslCube.glId(), "uSize_cube");
-    const auto uVMatrix = glGetUniformLocation(glslCube.glId(), "uVMatrix");
-    const auto uPosCube = glGetUniformLocation(glslCube.glId(), "uPosCube");
-    const auto uPMatrix = glGetUniformLocation(glslCube.glId(), "uPMatrix");
-    const auto uColor = glGetUniformLocation(glslCube.glId(), "uColor");
+    // Drivers with a parallel shader compile extension build the variants
+    // below on as many threads as they see fit
+    typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+    for (const auto &extension : {"KHR", "ARB"}) {
+        if (glfwExtensionSupported((std::string("GL_") + extension + "_parallel_shader_compile").c_str())) {
+            const auto maxShaderCompilerThreads = MaxShaderCompilerThreadsProc(glfwGetProcAddress((std::string("glMaxShaderCompilerThreads") + extension).c_str()));
+            if (maxShaderCompilerThreads) {
+                maxShaderCompilerThreads(0xFFFFFFFF);
+                break;
+            }
+        }
+    }
+    // The forward shaders are compiled for the material and light features of
+    // each draw, the variants of the scene are built once it is parsed
+    const std::vector<fs::path> forwardShaders = { m_ShadersRootPath / m_AppName / m_vertexShader, m_ShadersRootPath / m_AppName / m_fragmentShader };
+    ShaderVariants forwardVariants(programCache, forwardShaders);
+    // The deferred path draws the G-buffer with the forward variants, then
+    // shades it over the screen with these
+    const std::vector<fs::path> deferredShaders = { m_ShadersRootPath / m_AppName / "fullscreen.vs.glsl", m_ShadersRootPath / m_AppName / m_fragmentShader };
+    ShaderVariants deferredVariants(programCache, deferredShaders);
+    const auto buildProfiledVariants = [&](ShaderVariants &variants, const std::vector<ShaderVariantKey> &keys) {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::ShaderCompile);
+        size_t hitCount = 0;
+        const auto builtCount = variants.build(keys, &hitCount);
+        for (size_t i = 0; i < builtCount; ++i) {
+            loadProfiler.countProgram(i < hitCount);
+        }
+    };
+
+    // Replaced along with their uniform locations when their shaders are
+    // edited, see reloadShaders below
+    const std::vector<fs::path> cubeShaders = { m_ShadersRootPath / m_AppName / m_vertexShader_cube, m_ShadersRootPath / m_AppName / m_fragmentShader_cube };
+    auto glslCube = loadProfiledProgram(cubeShaders);
+    GLint uSize_cube, uVMatrix, uPosCube, uPMatrix, uColor;
+    const auto getCubeLocations = [&]() {
+        uSize_cube = glGetUniformLocation(glslCube.glId(), "uSize_cube");
+        uVMatrix = glGetUniformLocation(glslCube.glId(), "uVMatrix");
+        uPosCube = glGetUniformLocation(glslCube.glId(), "uPosCube");
+        uPMatrix = glGetUniformLocation(glslCube.glId(), "uPMatrix");
+        uColor = glGetUniformLocation(glslCube.glId(), "uColor");
+    };
+    getCubeLocations();
+
+    const std::vector<fs::path> placeholderShaders = { m_ShadersRootPath / m_AppName / "placeholder.vs.glsl", m_ShadersRootPath / m_AppName / "placeholder.fs.glsl" };
+    auto glslPlaceholder = loadProfiledProgram(placeholderShaders);
+    GLint uPlaceholderViewProjMatrix, uPlaceholderColor;
+    const auto getPlaceholderLocations = [&]() {
+        uPlaceholderViewProjMatrix = glGetUniformLocation(glslPlaceholder.glId(), "uViewProjMatrix");
+        uPlaceholderColor = glGetUniformLocation(glslPlaceholder.glId(), "uColor");
+    };
+    getPlaceholderLocations();
+
+    // Depth of the scene in the cascades of the shadow map, drawn by the
+    // vertex shader of the forward variants with SHADOW_PASS defined
+    const std::vector<fs::path> shadowShaders = { m_ShadersRootPath / m_AppName / m_vertexShader, m_ShadersRootPath / m_AppName / "shadow.gs.glsl", m_ShadersRootPath / m_AppName / "shadow.fs.glsl" };
+    const std::vector<std::vector<std::string>> shadowDefines = { {"SHADOW_PASS"} };
+    const auto loadShadowProgram = [&](size_t *hitCount) {
+        return std::move(programCache.loadVariants(shadowShaders, shadowDefines, hitCount).front());
+    };
+    GLProgram glslShadow = [&]() {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::ShaderCompile);
+        size_t hitCount = 0;
+        auto program = loadShadowProgram(&hitCount);
+        loadProfiler.countProgram(hitCount > 0);
+        return program;
+    }();
+    ForwardUniforms shadowUniforms(glslShadow);
+
+    // Depth of the scene before it is shaded, with DEPTH_PREPASS defined
+    const std::vector<fs::path> depthPrepassShaders = { m_ShadersRootPath / m_AppName / m_vertexShader, m_ShadersRootPath / m_AppName / "shadow.fs.glsl" };
+    const std::vector<std::vector<std::string>> depthPrepassDefines = { {"DEPTH_PREPASS"} };
+    const auto loadDepthPrepassProgram = [&](size_t *hitCount) {
+        return std::move(programCache.loadVariants(depthPrepassShaders, depthPrepassDefines, hitCount).front());
+    };
+    GLProgram glslDepthPrepass = [&]() {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::ShaderCompile);
+        size_t hitCount = 0;
+        auto program = loadDepthPrepassProgram(&hitCount);
+        loadProfiler.countProgram(hitCount > 0);
+        return program;
+    }();
+    ForwardUniforms depthPrepassUniforms(glslDepthPrepass);
+
+    // Blended draws of the weighted blended transparency over the frame
+    const std::vector<fs::path> oitCompositeShaders = { m_ShadersRootPath / m_AppName / "fullscreen.vs.glsl", m_ShadersRootPath / m_AppName / "oit_composite.fs.glsl" };
+    auto glslOitComposite = loadProfiledProgram(oitCompositeShaders);
+    GLint uOitAccumulation, uOitRevealage;
+    const auto getOitCompositeLocations = [&]() {
+        uOitAccumulation = glGetUniformLocation(glslOitComposite.glId(), "uAccumulation");
+        uOitRevealage = glGetUniformLocation(glslOitComposite.glId(), "uRevealage");
+    };
+    getOitCompositeLocations();
+
+    // Lights of each tile of the deferred path
+    const std::vector<fs::path> lightCullingShaders = { m_ShadersRootPath / m_AppName / "light_culling.cs.glsl" };
+    auto glslLightCulling = loadProfiledProgram(lightCullingShaders);
+    GLint uCullingGBufferDepth, uCullingInverseProjMatrix, uCullingPointLightCount, uCullingHasSpotLight;
+    const auto getLightCullingLocations = [&]() {
+        uCullingGBufferDepth = glGetUniformLocation(glslLightCulling.glId(), "uGBufferDepth");
+        uCullingInverseProjMatrix = glGetUniformLocation(glslLightCulling.glId(), "uInverseProjMatrix");
+        uCullingPointLightCount = glGetUniformLocation(glslLightCulling.glId(), "uPointLightCount");
+        uCullingHasSpotLight = glGetUniformLocation(glslLightCulling.glId(), "uHasSpotLight");
+    };
+    getLightCullingLocations();
+
+    // Compilation errors of the programs since their last reload, shown in
+    // the GUI. No forward variant is built while it has errors.
+    std::map<std::string, std::string> shaderErrors;
 
     tinygltf::Model model;
+    GltfSources sources;
     // TODO Loading the glTF file
-    if (!loadGltfFile(model)) {
-        return -1;
+    // Only the document is parsed here, buffers and images are streamed in
+    // while rendering by streamScene() below
+    {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::JsonParse);
+        if (!loadGltfFile(model, sources, loadArena.resource())) {
+            return -1;
+        }
     }
 
+    // Flattened node hierarchy used for drawing, written by the animations
+    auto sceneGraph = buildSceneGraph(model, model.defaultScene);
+    // Everything drawScene() needs from the model. The index offsets are
+    // patched as the meshes are uploaded.
+    RuntimeScene runtimeScene;
+    {
+        // Most of its cost is reading the bounds of the primitives
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::Bounds);
+        runtimeScene = extractRuntimeScene(model);
+    }
+    std::vector<VaoRange> meshToVertexArrays(model.meshes.size());
+    GLsizei primitiveCount = 0;
+    for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+        meshToVertexArrays[meshIdx] = {primitiveCount, GLsizei(model.meshes[meshIdx].primitives.size())};
+        primitiveCount += meshToVertexArrays[meshIdx].count;
+    }
+
+    // Animations and skins read their buffers, they are compiled by
+    // initAnimation() once all of them are loaded
+    Animator animator;
+    bool playAnimation = false;
+    float animationSpeed = 1.f;
+    float animationTime = 0.f;
+
+    // Joint matrices of all skins, uploaded in a SSBO read by the vertex shader
+    std::vector<Skin> skins;
+    std::vector<glm::mat4> jointPalette;
+    GLuint jointMatricesBuffer = 0;
+    const GLuint JOINT_MATRICES_BINDING = 0;
+    const auto initAnimation = [&]() {
+        animator = Animator(compileAnimations(model, sceneGraph, loadArena.resource()));
+        if (!animator.clips().empty()) {
+            animator.setActiveClips({0});
+        }
+        playAnimation = !animator.clips().empty();
+        skins = compileSkins(model, sceneGraph);
+        computeJointPalettes(skins, sceneGraph, jointPalette, &globalThreadPool());
+        if (!jointPalette.empty()) {
+            glGenBuffers(1, &jointMatricesBuffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, jointMatricesBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, jointPalette.size() * sizeof(glm::mat4), jointPalette.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, JOINT_MATRICES_BINDING, jointMatricesBuffer);
+        }
+    };
+    const auto updateJointMatrices = [&]() {
+        if (jointPalette.empty()) {
+            return;
+        }
+        computeJointPalettes(skins, sceneGraph, jointPalette, &globalThreadPool());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, jointMatricesBuffer);
+        // Orphan the previous storage so we don't wait for draws still using it
+        glBufferData(GL_SHADER_STORAGE_BUFFER, jointPalette.size() * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, jointPalette.size() * sizeof(glm::mat4), jointPalette.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    };
+
     ///init Cube
     glimac::Cube cube(1);
     GLsizei count_vertex = cube.getVertexCount();
@@ -594,16 +679,72 @@ int ViewerApplication::run() {
     GLuint vbocube = initVbocube(count_vertex,vertices);
     GLuint vaocube = initVaocube(vbocube);
 
+    // Bounds from the min and max of the POSITION accessors, so that the
+    // scene is framed before any buffer is loaded. Skinned primitives are
+    // placed by their node until updateSkinnedBounds() below.
+    const auto getAccessorBounds = [&](bool withSkinned, glm::vec3 &outMin, glm::vec3 &outMax) {
+        outMin = glm::vec3(std::numeric_limits<float>::max());
+        outMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (size_t flatIdx = 0; flatIdx < sceneGraph.size(); ++flatIdx) {
+            const auto nodeIdx = sceneGraph.nodes[flatIdx];
+            const auto meshIdx = runtimeScene.nodeMeshes[nodeIdx];
+            if (meshIdx < 0 || (!withSkinned && runtimeScene.nodeSkins[nodeIdx] >= 0 && !skins[runtimeScene.nodeSkins[nodeIdx]].joints.empty())) {
+                continue;
+            }
+            const auto &vaoRange = meshToVertexArrays[meshIdx];
+            for (auto primitiveIdx = vaoRange.begin; primitiveIdx < vaoRange.begin + vaoRange.count; ++primitiveIdx) {
+                const auto &primitive = runtimeScene.primitives[primitiveIdx];
+                if (!primitive.hasBounds) {
+                    continue;
+                }
+                for (int corner = 0; corner < 8; ++corner) {
+                    const glm::vec3 position((corner & 1) ? primitive.boundsMax.x : primitive.boundsMin.x, (corner & 2) ? primitive.boundsMax.y : primitive.boundsMin.y, (corner & 4) ? primitive.boundsMax.z : primitive.boundsMin.z);
+                    const auto worldPosition = glm::vec3(sceneGraph.worldMatrices[flatIdx] * glm::vec4(position, 1));
+                    outMin = glm::min(outMin, worldPosition);
+                    outMax = glm::max(outMax, worldPosition);
+                }
+            }
+        }
+    };
     glm::vec3 bboxMin, bboxMax;
-    computeSceneBounds(model, bboxMin, bboxMax);
+    {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::Bounds);
+        getAccessorBounds(true, bboxMin, bboxMax);
+    }
+    if (bboxMin.x > bboxMax.x) {
+        // No bounds in the file, the camera will be moved by the user anyway
+        bboxMin = glm::vec3(-1);
+        bboxMax = glm::vec3(1);
+    }
     std::vector <glm::vec3> posCube = {bboxMax, bboxMin, glm::vec3(bboxMax[0], bboxMin[1], bboxMax[2]), glm::vec3(bboxMin[0], bboxMax[1], bboxMax[2])};
     float dist = glm::distance(bboxMax, bboxMin);
     float sizeCube[] = {dist * 0.2f, dist * 0.1f, dist * 0.05f, dist * 0.02f};
     // // Build projection matrix
-    const auto diag = bboxMax - bboxMin;
+    auto diag = bboxMax - bboxMin;
     auto maxDistance = glm::length(diag);
     auto projMatrix = glm::perspective(70.f, float(m_nWindowWidth) / m_nWindowHeight, 0.001f * maxDistance, 1000.0f);
 
+    // Once initAnimation() has compiled the skins, skinned primitives are
+    // bounded by their vertices in the pose of the joint palette instead. The
+    // shadow cascades and the camera resets fit the new bounds, the current
+    // camera stays where it is.
+    const auto updateSkinnedBounds = [&]() {
+        if (skins.empty()) {
+            return;
+        }
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::Bounds);
+        glm::vec3 newMin, newMax;
+        getAccessorBounds(false, newMin, newMax);
+        computeSkinnedBounds(model, sceneGraph, skins, jointPalette, newMin, newMax);
+        if (newMin.x > newMax.x) {
+            return;
+        }
+        bboxMin = newMin;
+        bboxMax = newMax;
+        diag = bboxMax - bboxMin;
+        maxDistance = glm::length(diag);
+    };
+
     // TODO Implement a new CameraController model and use it instead. Propose the
     // choice from the GUI
     std::unique_ptr<CameraController> cameraController = std::make_unique<TrackballCameraController>(m_GLFWHandle.window(), 0.5f * maxDistance);
@@ -618,12 +759,37 @@ int ViewerApplication::run() {
         cameraController->setCamera(Camera{eye, center, up});
     }
 
+    // Image based lighting, prefiltered by the workers or read back from the
+    // cache of a previous launch
+    EnvironmentLighting environmentLighting;
+    GLuint specularEnvironmentTexture = 0;
+    GLuint brdfLutTexture = 0;
+    if (!m_ViewerOptions.environment.empty()) {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::Environment);
+        std::string error;
+        if (loadEnvironmentLighting(m_ViewerOptions.environment, getDefaultEnvironmentCacheDirectory(), globalThreadPool(), environmentLighting, error)) {
+            specularEnvironmentTexture = createSpecularEnvironmentTexture(environmentLighting);
+            brdfLutTexture = createBrdfLutTexture(environmentLighting);
+            // The rough levels would show the edges of the faces otherwise
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        }
+        else {
+            std::cerr << error << std::endl;
+        }
+    }
+    const bool hasEnvironment = specularEnvironmentTexture != 0;
+    float environmentIntensity = hasEnvironment ? 1.f : 0.f;
+    float precEnvironmentIntensity = environmentIntensity;
+
     // Initialisation light parameters
     bool lightFromCamera = false;
     ///directional
     glm::vec3 lightDirection(1, 1, 1);
     glm::vec3 lightIntensity(1, 1, 1);
     glm::vec3 prelightIntensity = lightIntensity;
+    // Cascaded shadow maps of the directional light, see utils/shadows.hpp
+    bool shadowsEnabled = true;
+    int shadowCascadeCount = 3;
     ///Ponctual
     const unsigned int NbCube = 4;
     glm::vec3 CubeIntensity[] = {glm::vec3(1, 1, 1), glm::vec3(1, 0, 0), glm::vec3(1, 0.5, 0), glm::vec3(0.5, 0.9, 0.3)};
@@ -635,244 +801,1039 @@ int ViewerApplication::run() {
     std::vector <glm::vec3> CubeColor = {glm::vec3(1, 1, 1), glm::vec3(1, 0, 0), glm::vec3(1, 0.5, 0), glm::vec3(0.5, 0.9, 0.3)};
     std::vector <glm::vec3> preCubeColor = CubeColor;
     float CubeDist[] = {33.f, 21.f, 14.f, 8.f};
+    // Attenuation terms of the distances, resolved when they change
+    glm::vec2 CubeAttenuation[NbCube];
+    for (unsigned int i = 0; i < NbCube; i++) {
+        CubeAttenuation[i] = getLightAttenuation(CubeDist[i]);
+    }
 
     /// Spotlight
     glm::vec3 spotligthIntensity(1, 0.91, 0);
     float spotligthCutOff = 8.5f;
     float spotligthOuterCutOff = 10.5f;
     float spotligthtDistAttenuation = 32;
+    glm::vec2 spotligthAttenuation = getLightAttenuation(spotligthtDistAttenuation);
     bool SpotlightfromCursor = false;
     glm::vec3 precSpotligthIntensity = spotligthIntensity;
 
-    // TODO Creation of Texture Objects
-    const auto textureObjects = createTextureObjects(model);
-    GLuint whiteTexture = 0;
-
-    // Create white texture for object with no base color texture
-    glGenTextures(1, &whiteTexture);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    float white[] = {1, 1, 1, 1};
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_FLOAT, white);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // TODO Creation of Texture Objects
+    // Created by the TextureStreamer as their images are decoded. Until then
+    // the shader variant of a draw samples the factors of its material alone.
+
+    // Point lights with a non zero intensity, the only ones given to the
+    // shaders
+    std::vector<unsigned int> activePointLights;
+    static_assert(NbCube <= kMaxPointLightCount, "The shaders have fewer point lights");
+    const auto getLightVariantKeyOfFrame = [&]() {
+        activePointLights.clear();
+        for (unsigned int i = 0; i < NbCube; ++i) {
+            if (CubeIntensity[i] != glm::vec3(0)) {
+                activePointLights.push_back(i);
+            }
+        }
+        return getLightVariantKey(lightIntensity != glm::vec3(0), activePointLights.size(), spotligthIntensity != glm::vec3(0), environmentIntensity > 0.f, shadowsEnabled);
+    };
+    // Shading in a G-buffer pass then once per pixel, rather than for each
+    // fragment drawn
+    bool deferredShading = m_ViewerOptions.deferred;
+    // Depth of the opaque draws first, then shaded where equal to it: a pixel
+    // is shaded once whatever the order of the draws
+    bool depthPrepass = m_ViewerOptions.depthPrepass;
+    // Draws sorted from front to back rather than by shader variant and
+    // material, so that the depth test rejects the hidden fragments
+    bool frontToBackDraws = false;
+    // Fragments shaded per pixel, counted by the COUNT_OVERDRAW variants
+    bool countOverdraw = false;
+    float overdraw = 0.f;
+    // Blended draws accumulated in any order rather than sorted back to front
+    bool weightedBlendedOit = false;
+    ///Normal map
+    float ActiveNormalMap = 1;
+    const bool normaltexturecheck = std::any_of(begin(runtimeScene.materials), end(runtimeScene.materials), [](const RuntimeMaterial &material) {
+        return material.normalTexture >= 0;
+    });
+    {
+        // Variants of the materials of the scene with the initial lights,
+        // with their textures and before they are streamed in
+        const auto lightKey = getLightVariantKeyOfFrame();
+        // The G-buffer variants have no light, the blended materials are
+        // always shaded forward
+        const auto passKey = deferredShading ? ShaderVariantKey(ShaderFeature_GBufferPass) : lightKey;
+        const auto blendKey = lightKey | (weightedBlendedOit ? ShaderVariantKey(ShaderFeature_WeightedBlendedOit) : 0);
+        std::vector<ShaderVariantKey> keys = {passKey}; // Default material
+        for (const auto &material : runtimeScene.materials) {
+            const auto materialPassKey = material.alphaMode == AlphaMode::Blend ? blendKey : passKey;
+            keys.push_back(getMaterialVariantKey(material, true, [](int textureIdx) { return textureIdx >= 0; }) | materialPassKey);
+            keys.push_back(getMaterialVariantKey(material, true, [](int) { return false; }) | materialPassKey);
+        }
+        buildProfiledVariants(forwardVariants, keys);
+        if (deferredShading) {
+            buildProfiledVariants(deferredVariants, {lightKey | ShaderFeature_DeferredShading});
+        }
+        if (m_ViewerOptions.verbose) {
+            std::clog << "Built " << forwardVariants.size() << " shader variants" << std::endl;
+        }
+    }
+
+    // TODO Creation of Buffer Objects
+    // Created as the buffers they read arrive, 0 until then
+    std::vector<GLuint> bufferObjects(model.buffers.size(), 0);
+    std::vector<GLuint> accessorBufferObjects(model.accessors.size(), 0);
+
+    // TODO Creation of Vertex Array Objects
+    std::vector<GLuint> vertexArrayObjects(primitiveCount, 0);
+    // Positions only, for the depth prepass
+    std::vector<GLuint> depthVertexArrayObjects(primitiveCount, 0);
+
+    // Morph targets of each primitive, indexed like vertexArrayObjects. The
+    // dense deltas are uploaded in a texture buffer read by the vertex shader.
+    const GLuint MORPH_DELTAS_TEXTURE_UNIT = 4;
+    std::vector<MorphTargets> primitiveMorphTargets(vertexArrayObjects.size());
+    std::vector<GLuint> morphDeltaBuffers(vertexArrayObjects.size(), 0);
+    std::vector<GLuint> morphDeltaTextures(vertexArrayObjects.size(), 0);
+    GLint maxTextureBufferSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+    const auto createDeltaTexture = [](const std::vector<glm::vec3> &deltas, GLenum usage, GLuint &buffer, GLuint &texture) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, deltas.size() * sizeof(glm::vec3), deltas.data(), usage);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    };
+
+    // A mesh is uploaded as soon as all the buffers its accessors read are
+    // loaded, until then it is drawn as a placeholder box. The tables only
+    // live until the end of the streaming, meshReady is read by the draws.
+    std::pmr::vector<std::pmr::vector<int>> buffersOfMesh(model.meshes.size(), loadArena.resource());
+    std::pmr::vector<std::pmr::vector<size_t>> meshesOfBuffer(model.buffers.size(), loadArena.resource());
+    std::pmr::vector<size_t> missingBufferCounts(model.meshes.size(), 0, loadArena.resource());
+    std::vector<bool> meshReady(model.meshes.size(), false);
+    for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+        auto &meshBuffers = buffersOfMesh[meshIdx];
+        for (const auto &primitive : model.meshes[meshIdx].primitives) {
+            for (const auto &attribute : primitive.attributes) {
+                getAccessorBuffers(model, attribute.second, meshBuffers);
+            }
+            getAccessorBuffers(model, primitive.indices, meshBuffers);
+            for (const auto &target : primitive.targets) {
+                for (const auto &attribute : target) {
+                    getAccessorBuffers(model, attribute.second, meshBuffers);
+                }
+            }
+        }
+        std::sort(begin(meshBuffers), end(meshBuffers));
+        meshBuffers.erase(std::unique(begin(meshBuffers), end(meshBuffers)), end(meshBuffers));
+        missingBufferCounts[meshIdx] = meshBuffers.size();
+        for (const auto bufferIdx : meshBuffers) {
+            meshesOfBuffer[bufferIdx].push_back(meshIdx);
+        }
+    }
+
+    StreamingLoader loader(std::move(sources), 0, &loadProfiler);
+    const auto streamingStartTime = glfwGetTime();
+    auto firstMeshLatency = -1.;
+    auto streamingDuration = -1.;
+    size_t readyMeshCount = 0;
+    size_t sceneMeshCount = 0;
+    {
+        std::pmr::vector<bool> isSceneMesh(model.meshes.size(), false, loadArena.resource());
+        for (const auto nodeIdx : sceneGraph.nodes) {
+            if (runtimeScene.nodeMeshes[nodeIdx] >= 0) {
+                isSceneMesh[runtimeScene.nodeMeshes[nodeIdx]] = true;
+            }
+        }
+        sceneMeshCount = size_t(std::count(begin(isSceneMesh), end(isSceneMesh), true));
+    }
+
+    const auto uploadMesh = [&](size_t meshIdx) {
+        LoadProfiler::Scope scope(&loadProfiler, LoadPhase::VaoCreation);
+        const auto &mesh = model.meshes[meshIdx];
+        const auto &vaoRange = meshToVertexArrays[meshIdx];
+        createAccessorBufferObjects(model, mesh, bufferObjects, accessorBufferObjects);
+        createVertexArrayObjects_T_B(model, mesh, bufferObjects, accessorBufferObjects, vertexArrayObjects.data() + vaoRange.begin, &loadProfiler);
+        createDepthVertexArrayObjects(model, mesh, bufferObjects, accessorBufferObjects, depthVertexArrayObjects.data() + vaoRange.begin);
+        for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
+            const auto primitiveIdx = vaoRange.begin + pIdx;
+            // The index offsets of the resolved sparse accessors are in their own buffer objects
+            if (mesh.primitives[pIdx].indices >= 0) {
+                runtimeScene.primitives[primitiveIdx].indexByteOffset = getAccessorByteOffset(model, mesh.primitives[pIdx].indices, accessorBufferObjects);
+            }
+            auto &targets = primitiveMorphTargets[primitiveIdx];
+            targets = compileMorphTargets(model, mesh.primitives[pIdx]);
+            if (targets.targetCount == 0) {
+                continue;
+            }
+            if (targets.deltas.size() > size_t(maxTextureBufferSize)) {
+                std::cerr << "Morph targets of mesh " << meshIdx << " are too large for a texture buffer, blending them on the CPU" << std::endl;
+            }
+            else {
+                createDeltaTexture(targets.deltas, GL_STATIC_DRAW, morphDeltaBuffers[primitiveIdx], morphDeltaTextures[primitiveIdx]);
+            }
+            // The GPU only needs its copy of the dense deltas
+            std::vector<glm::vec3>().swap(targets.deltas);
+        }
+        meshReady[meshIdx] = true;
+        if (readyMeshCount++ == 0) {
+            firstMeshLatency = glfwGetTime() - streamingStartTime;
+        }
+    };
+
+    for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+        if (missingBufferCounts[meshIdx] == 0) {
+            uploadMesh(meshIdx);
+        }
+    }
+
+    // Buffers and images are loaded by order of importance: the largest
+    // screen coverage of the primitives reading them, from the current camera
+    std::vector<float> bufferPriorities;
+    std::vector<float> imagePriorities;
+    const auto computePriorities = [&](const Camera &camera) {
+        const auto viewProjMatrix = projMatrix * camera.getViewMatrix();
+        bufferPriorities.assign(model.buffers.size(), 0.f);
+        imagePriorities.assign(model.images.size(), 0.f);
+        for (size_t flatIdx = 0; flatIdx < sceneGraph.size(); ++flatIdx) {
+            const auto meshIdx = runtimeScene.nodeMeshes[sceneGraph.nodes[flatIdx]];
+            if (meshIdx < 0) {
+                continue;
+            }
+            const auto mvpMatrix = viewProjMatrix * sceneGraph.worldMatrices[flatIdx];
+            const auto &vaoRange = meshToVertexArrays[meshIdx];
+            auto meshCoverage = 0.f;
+            for (auto primitiveIdx = vaoRange.begin; primitiveIdx < vaoRange.begin + vaoRange.count; ++primitiveIdx) {
+                const auto &primitive = runtimeScene.primitives[primitiveIdx];
+                // Primitives without bounds come after the visible ones
+                const auto coverage = primitive.hasBounds ? getScreenCoverage(mvpMatrix, primitive.boundsMin, primitive.boundsMax) : 0.f;
+                meshCoverage = std::max(meshCoverage, coverage);
+                if (primitive.material < 0) {
+                    continue;
+                }
+                const auto &material = runtimeScene.materials[primitive.material];
+                for (const auto textureIdx : {material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture, material.emissiveTexture}) {
+                    if (textureIdx >= 0 && model.textures[textureIdx].source >= 0) {
+                        auto &priority = imagePriorities[model.textures[textureIdx].source];
+                        priority = std::max(priority, coverage);
+                    }
+                }
+            }
+            for (const auto bufferIdx : buffersOfMesh[meshIdx]) {
+                bufferPriorities[bufferIdx] = std::max(bufferPriorities[bufferIdx], meshCoverage);
+            }
+        }
+    };
+    computePriorities(cameraController->getCamera());
+    loader.requestBuffers(bufferPriorities);
+    size_t pendingBufferCount = size_t(std::count_if(begin(loader.sources().buffers), end(loader.sources().buffers), [](const DataSource &source) {
+        return !source.uri.empty();
+    }));
+    size_t pendingImageCount = 0;
+    bool imagesRequested = false;
+    bool streamingDone = false;
+
+    // Contents of the buffer and texture objects are copied by a worker
+    // thread with its own GL context. Each upload is swapped in once its
+    // fence has signaled: buffers make their meshes drawable, texture levels
+    // lower GL_TEXTURE_BASE_LEVEL, from the smallest level to the largest.
+    GpuUploader uploader(m_GLFWHandle.window(), 32 << 20, &loadProfiler);
+    std::map<GpuUploader::Ticket, size_t> bufferUploads; // To the buffer index
+    std::vector<GpuUploader::Ticket> completedUploads;
+    // Texture levels resident on the GPU, from what the draws sample
+    TextureStreamer textureStreamer(uploader, m_ViewerOptions.textureBudget, ImageStore::getDefaultDirectory(), m_ViewerOptions.imageBudget);
+    const auto sceneTextureCount = size_t(std::count_if(begin(model.textures), end(model.textures), [&](const tinygltf::Texture &texture) {
+        return texture.source >= 0 && (!loader.sources().images[texture.source].uri.empty() || loader.sources().images[texture.source].bufferView >= 0);
+    }));
+
+    // One step of the streaming, called once per frame. It never waits for
+    // the loader nor for the uploads: what has arrived is submitted to the
+    // uploader, and the completed uploads are swapped in within a time
+    // budget, the rest being left for the next frames. Returns true once
+    // everything is on the GPU.
+    std::vector<StreamingLoader::Item> arrivals;
+    const auto streamScene = [&](const Camera &camera) {
+        const auto SWAP_IN_BUDGET = 0.005; // Seconds per frame
+        const auto startTime = glfwGetTime();
+
+        // Swap in the completed uploads, at least one per frame. The texture
+        // streamer keeps uploading levels once the scene is loaded.
+        uploader.poll(completedUploads);
+        size_t swapCount = 0;
+        for (; swapCount < completedUploads.size() && (swapCount == 0 || glfwGetTime() - startTime < SWAP_IN_BUDGET); ++swapCount) {
+            const auto ticket = completedUploads[swapCount];
+            if (textureStreamer.uploadCompleted(ticket)) {
+                continue;
+            }
+            const auto bufferIt = bufferUploads.find(ticket);
+            if (bufferIt != end(bufferUploads)) {
+                for (const auto meshIdx : meshesOfBuffer[bufferIt->second]) {
+                    if (--missingBufferCounts[meshIdx] == 0) {
+                        uploadMesh(meshIdx);
+                    }
+                }
+                bufferUploads.erase(bufferIt);
+            }
+        }
+        completedUploads.erase(begin(completedUploads), begin(completedUploads) + swapCount);
+
+        if (streamingDone) {
+            return true;
+        }
+
+        computePriorities(camera);
+        loader.setPriorities(StreamingLoader::ItemKind::Buffer, bufferPriorities);
+        loader.setPriorities(StreamingLoader::ItemKind::Image, imagePriorities);
+        loader.takeCompleted(arrivals);
+
+        for (auto &item : arrivals) {
+            if (!item.ok) {
+                std::cerr << item.error << std::endl;
+            }
+            if (item.kind == StreamingLoader::ItemKind::Buffer) {
+                --pendingBufferCount;
+                if (!item.ok) {
+                    continue; // Its meshes stay placeholders
+                }
+                // Kept on the CPU until the end of the streaming, the uploader reads it
+                auto &buffer = model.buffers[item.index];
+                buffer.data = std::move(item.data);
+                bufferObjects[item.index] = createBufferObject(buffer);
+                bufferUploads[uploader.uploadBuffer(bufferObjects[item.index], 0, buffer.data.data(), buffer.data.size())] = size_t(item.index);
+            }
+            else {
+                --pendingImageCount;
+                if (!item.ok) {
+                    continue; // Its textures stay white
+                }
+                // Decoded levels go to the store of the streamer, which uploads them when they are needed
+                const auto image = textureStreamer.addImage(std::move(item.image));
+                for (size_t textureIdx = 0; textureIdx < model.textures.size(); ++textureIdx) {
+                    if (model.textures[textureIdx].source == item.index) {
+                        textureStreamer.addTexture(textureIdx, image, getTextureSampler(model, int(textureIdx)));
+                    }
+                }
+            }
+        }
+        arrivals.clear();
+
+        if (pendingBufferCount == 0 && !imagesRequested) {
+            // Textures fill in last. Images stored in a bufferView are given
+            // encoded since the buffers are released once everything is uploaded.
+            imagesRequested = true;
+            initAnimation();
+            updateSkinnedBounds();
+            const auto &imageSources = loader.sources().images;
+            for (size_t imageIdx = 0; imageIdx < imageSources.size(); ++imageIdx) {
+                const auto &source = imageSources[imageIdx];
+                std::vector<unsigned char> encoded;
+                if (source.bufferView >= 0) {
+                    const auto &bufferView = model.bufferViews[source.bufferView];
+                    const auto &data = model.buffers[bufferView.buffer].data;
+                    if (bufferView.byteOffset + bufferView.byteLength > data.size()) {
+                        std::cerr << "Image " << imageIdx << " is out of its buffer" << std::endl;
+                        continue;
+                    }
+                    encoded.assign(begin(data) + bufferView.byteOffset, begin(data) + bufferView.byteOffset + bufferView.byteLength);
+                }
+                else if (source.uri.empty()) {
+                    continue; // Not used by the loaded scene
+                }
+                loader.requestImage(int(imageIdx), imagePriorities[imageIdx], std::move(encoded));
+                ++pendingImageCount;
+            }
+        }
+
+        // Done once every texture can be sampled, finer levels keep coming
+        if (!imagesRequested || pendingImageCount > 0 || !bufferUploads.empty() || textureStreamer.stats().pendingUploadCount > 0) {
+            return false;
+        }
+        streamingDone = true;
+        streamingDuration = glfwGetTime() - streamingStartTime;
+        // Buffers and images are on the GPU now, drop the CPU copies
+        if (!m_LoadOptions.keepCpuData) {
+            const auto releasedBytes = releaseBulkData(model);
+            if (m_ViewerOptions.verbose) {
+                std::clog << "Released " << releasedBytes / 1024 << " KB of buffer and image data" << std::endl;
+            }
+        }
+        loadProfiler.finish();
+        if (m_ViewerOptions.verbose) {
+            loadProfiler.print(std::clog);
+            std::clog << "Load arena: " << loadArena.allocatedBytes() / 1024 << " KB in " << loadArena.allocationCount() << " allocations" << std::endl;
+        }
+        if (!m_LoadOptions.reportPath.empty() && !loadProfiler.writeJson(m_LoadOptions.reportPath, m_gltfFilePath)) {
+            std::cerr << "Unable to write the load report " << m_LoadOptions.reportPath << std::endl;
+        }
+        loadArena.release();
+        return true;
+    };
 
-    // TODO Creation of Buffer Objects
-    const auto bufferObjects = createBufferObjects(model);
+    // Primitives blended on the CPU, per (flat node, primitive) since each
+    // node instancing the mesh has its own weights
+    struct CpuMorph {
+        std::vector<float> weights; // Weights of the last blend
+        std::vector<glm::vec3> blended;
+        GLuint buffer = 0;
+        GLuint texture = 0;
+    };
+    std::map<std::pair<size_t, size_t>, CpuMorph> cpuMorphs;
+    std::vector<uint32_t> activeMorphTargets;
+    const auto bindMorphTargets = [&](const ForwardUniforms &uniforms, size_t flatIdx, size_t primitiveIdx) {
+        const auto &targets = primitiveMorphTargets[primitiveIdx];
+        const auto *weights = sceneGraph.weights.data() + sceneGraph.weightOffsets[flatIdx];
+        const auto weightCount = size_t(sceneGraph.weightCounts[flatIdx]);
+        getActiveMorphTargets(targets, weights, weightCount, activeMorphTargets);
+        auto path = chooseMorphPath(targets, activeMorphTargets);
+        if (path == MorphPath::GPU && morphDeltaTextures[primitiveIdx] == 0) {
+            path = MorphPath::CPU;
+        }
+        if (path == MorphPath::None) {
+            glUniform1i(uniforms.morphTargetCount, 0);
+            return;
+        }
 
-    // TODO Creation of Vertex Array Objects
-    std::vector<VaoRange> meshToVertexArrays;
-    const auto vertexArrayObjects = createVertexArrayObjects_T_B(model, bufferObjects, meshToVertexArrays);
+        GLint targetIndices[kMaxGpuMorphTargets];
+        GLfloat targetWeights[kMaxGpuMorphTargets];
+        GLsizei targetCount = 0;
+        auto texture = morphDeltaTextures[primitiveIdx];
+        if (path == MorphPath::GPU) {
+            for (const auto t : activeMorphTargets) {
+                targetIndices[targetCount] = GLint(t);
+                targetWeights[targetCount] = weights[t];
+                ++targetCount;
+            }
+        }
+        else {
+            auto &cpuMorph = cpuMorphs[{flatIdx, primitiveIdx}];
+            if (cpuMorph.texture == 0 || !std::equal(begin(cpuMorph.weights), end(cpuMorph.weights), weights, weights + weightCount)) {
+                blendMorphTargets(targets, weights, activeMorphTargets, cpuMorph.blended);
+                if (cpuMorph.texture == 0) {
+                    createDeltaTexture(cpuMorph.blended, GL_DYNAMIC_DRAW, cpuMorph.buffer, cpuMorph.texture);
+                }
+                else {
+                    glBindBuffer(GL_TEXTURE_BUFFER, cpuMorph.buffer);
+                    // Orphan the previous storage so we don't wait for draws still using it
+                    glBufferData(GL_TEXTURE_BUFFER, cpuMorph.blended.size() * sizeof(glm::vec3), cpuMorph.blended.data(), GL_DYNAMIC_DRAW);
+                    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+                }
+                cpuMorph.weights.assign(weights, weights + weightCount);
+            }
+            texture = cpuMorph.texture;
+            // The blended deltas are read as a single target of weight 1
+            targetIndices[0] = 0;
+            targetWeights[0] = 1.f;
+            targetCount = 1;
+        }
 
-    ///Normal map
-    float ActiveNormalMap = 1;
-    bool normaltexturecheck = 0;
+        glActiveTexture(GL_TEXTURE0 + MORPH_DELTAS_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glUniform1i(uniforms.morphDeltas, MORPH_DELTAS_TEXTURE_UNIT);
+        glUniform1i(uniforms.morphTargetCount, targetCount);
+        glUniform1iv(uniforms.morphTargets, targetCount, targetIndices);
+        glUniform1fv(uniforms.morphWeights, targetCount, targetWeights);
+        glUniform1i(uniforms.morphVertexCount, GLint(targets.vertexCount));
+        glUniform1i(uniforms.morphAttributeCount, GLint(targets.attributeCount));
+        glUniform3i(uniforms.morphSlots, targets.positionSlot, targets.normalSlot, targets.tangentSlot);
+    };
 
     // Setup OpenGL state for rendering
     glEnable(GL_DEPTH_TEST);
-    glslProgram.use();
 
-    const auto bindMaterial = [&](const auto materialIndex)
+    // GL calls of the frame, reported by the bench command
+    RenderCounters renderCounters;
+
+    // Texture units of the forward shaders
+    const GLint BASE_COLOR_TEXTURE_UNIT = 0;
+    const GLint METALLIC_ROUGHNESS_TEXTURE_UNIT = 1;
+    const GLint EMISSIVE_TEXTURE_UNIT = 2;
+    const GLint NORMAL_TEXTURE_UNIT = 3;
+    // Unit 4 is MORPH_DELTAS_TEXTURE_UNIT
+    const GLint SPECULAR_ENVIRONMENT_TEXTURE_UNIT = 5;
+    const GLint BRDF_LUT_TEXTURE_UNIT = 6;
+    const GLint SHADOW_MAP_TEXTURE_UNIT = 7;
+    const GLint GBUFFER_BASE_COLOR_METALLIC_TEXTURE_UNIT = 8;
+    const GLint GBUFFER_NORMAL_ROUGHNESS_TEXTURE_UNIT = 9;
+    const GLint GBUFFER_EMISSIVE_TEXTURE_UNIT = 10;
+    const GLint GBUFFER_DEPTH_TEXTURE_UNIT = 11;
+    const GLint OIT_ACCUMULATION_TEXTURE_UNIT = 12;
+    const GLint OIT_REVEALAGE_TEXTURE_UNIT = 13;
+
+    // Material bits of the shader variant of a draw, a texture counts once
+    // streamed in
+    const auto getMaterialVariantKeyOfDraw = [&](int materialIndex) {
+        if (materialIndex < 0) {
+            return ShaderVariantKey(0); // The default material has only factors
+        }
+        return getMaterialVariantKey(runtimeScene.materials[materialIndex], ActiveNormalMap > 0.5f, [&](int textureIdx) {
+            return textureIdx >= 0 && textureStreamer.texture(textureIdx) != 0;
+        });
+    };
+
+    // Binds the textures the variant samples and sets the factors it reads
+    const auto bindMaterial = [&](const ForwardUniforms &uniforms, const auto materialIndex)
     {
+        ++renderCounters.materialBindCount;
+        const auto bindTexture = [&](GLint location, GLint unit, int textureIdx) {
+            if (location >= 0) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                ++renderCounters.textureBindCount;
+                glBindTexture(GL_TEXTURE_2D, textureStreamer.texture(textureIdx));
+            }
+        };
         // Material binding
         if (materialIndex >= 0) {
             // only valid is materialIndex >= 0
-            const auto &material = model.materials[materialIndex];
-            const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
-            const auto &normalTexture = material.normalTexture;
-            //uNormalTexture
-            const auto &emissiveTexture = material.emissiveTexture;
-            const auto &emissiveFactor = material.emissiveFactor;
-
-            if (uBaseColorTexture >= 0) {
-                auto textureObject = whiteTexture;
-                if (pbrMetallicRoughness.baseColorTexture.index >= 0) {
-                    // only valid if pbrMetallicRoughness.baseColorTexture.index >= 0:
-                    const auto &texture = model.textures[pbrMetallicRoughness.baseColorTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uBaseColorTexture, 0);
-            }
+            const auto &material = runtimeScene.materials[materialIndex];
 
+            bindTexture(uniforms.baseColorTexture, BASE_COLOR_TEXTURE_UNIT, material.baseColorTexture);
+            bindTexture(uniforms.metallicRoughnessTexture, METALLIC_ROUGHNESS_TEXTURE_UNIT, material.metallicRoughnessTexture);
+            bindTexture(uniforms.emissiveTexture, EMISSIVE_TEXTURE_UNIT, material.emissiveTexture);
             ///Normal Texture
-            if (uNormalTexture >= 0) {
-                auto textureNormal = whiteTexture;
-                if (normalTexture.index >= 0) {
-                    // only valid if normalTexture..index >= 0:
-                    const auto &texture = model.textures[normalTexture.index];
-                    if (texture.source >= 0) {
-                        textureNormal = textureObjects[texture.source];
-                    }
-                    glUniform1f(uNormalScale,normalTexture.scale);
-                    normaltexturecheck = 1;
-                }
-                else {
-                    normaltexturecheck = normaltexturecheck | 0; // condition OR logique
-                }
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, textureNormal);
-                glUniform1i(uNormalTexture, 3);
-            }
+            bindTexture(uniforms.normalTexture, NORMAL_TEXTURE_UNIT, material.normalTexture);
 
-            if (uBaseColorFactor >= 0) {
-                glUniform4f(uBaseColorFactor, (float)pbrMetallicRoughness.baseColorFactor[0], (float)pbrMetallicRoughness.baseColorFactor[1], (float)pbrMetallicRoughness.baseColorFactor[2], (float)pbrMetallicRoughness.baseColorFactor[3]);
+            if (uniforms.baseColorFactor >= 0) {
+                glUniform4fv(uniforms.baseColorFactor, 1, glm::value_ptr(material.baseColorFactor));
             }
-            if (uMetallicFactor >= 0) {
-                glUniform1f(uMetallicFactor, (float)pbrMetallicRoughness.metallicFactor);
+            if (uniforms.metallicFactor >= 0) {
+                glUniform1f(uniforms.metallicFactor, material.metallicFactor);
             }
-            if (uRoughnessFactor >= 0) {
-                glUniform1f(uRoughnessFactor, (float)pbrMetallicRoughness.roughnessFactor);
+            if (uniforms.roughnessFactor >= 0) {
+                glUniform1f(uniforms.roughnessFactor, material.roughnessFactor);
             }
-            if (uMetallicRoughnessTexture > 0) {
-                auto textureObject = 0;
-                if (pbrMetallicRoughness.metallicRoughnessTexture.index >= 0) {
-                    const auto &texture = model.textures[pbrMetallicRoughness.metallicRoughnessTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uMetallicRoughnessTexture, 1);
+            if (uniforms.normalScale >= 0) {
+                glUniform1f(uniforms.normalScale, material.normalScale);
             }
-
-            if (uEmissiveTexture > 0) {
-                auto textureObject = 0;
-                if (emissiveTexture.index >= 0) {
-                    const auto &texture = model.textures[emissiveTexture.index];
-                    if (texture.source >= 0) {
-                        textureObject = textureObjects[texture.source];
-                    }
-                }
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, textureObject);
-                glUniform1i(uEmissiveTexture, 2);
+            if (uniforms.emissiveFactor >= 0) {
+                glUniform3fv(uniforms.emissiveFactor, 1, glm::value_ptr(material.emissiveFactor));
             }
-
-            if (uEmissiveFactor >= 0) {
-                glUniform3f(uEmissiveFactor, (float)emissiveFactor[0], (float)emissiveFactor[1], (float)emissiveFactor[2]);
+            if (uniforms.alphaCutoff >= 0) {
+                glUniform1f(uniforms.alphaCutoff, material.alphaCutoff);
             }
         }
         else {
             // Apply default material
-            if (uBaseColorTexture >= 0) {
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, whiteTexture);
-                glUniform1i(uBaseColorTexture, 0);
-            }
-            if (uBaseColorFactor >= 0) {
-                glUniform4f(uBaseColorFactor, 1, 1, 1, 1);
-            }
-            if (uMetallicFactor >= 0) {
-                glUniform1f(uMetallicFactor, 1.f);
-            }
-            if (uRoughnessFactor >= 0) {
-                glUniform1f(uRoughnessFactor, 1.f);
+            if (uniforms.baseColorFactor >= 0) {
+                glUniform4f(uniforms.baseColorFactor, 1, 1, 1, 1);
             }
-            if (uMetallicRoughnessTexture > 0) {
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uMetallicRoughnessTexture, 1);
+            if (uniforms.metallicFactor >= 0) {
+                glUniform1f(uniforms.metallicFactor, 1.f);
             }
-            if (uEmissiveFactor >= 0) {
-                glUniform3f(uEmissiveFactor, 1, 1, 1);
+            if (uniforms.roughnessFactor >= 0) {
+                glUniform1f(uniforms.roughnessFactor, 1.f);
             }
-            if (uEmissiveTexture > 0) {
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uEmissiveTexture, 2);
-            }
-            if(uNormalTexture >=0) {
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, 0);
-                glUniform1i(uNormalTexture, 3);
+        }
+    };
+
+    // Boxes drawn in place of the meshes not uploaded yet, one instance each
+    const GLuint PLACEHOLDER_BOXES_BINDING = 1;
+    GLuint placeholderBuffer = 0;
+    glGenBuffers(1, &placeholderBuffer);
+    GLuint placeholderVao = 0; // Without attributes, but core profile needs one
+    glGenVertexArrays(1, &placeholderVao);
+    std::vector<glm::mat4> placeholderMatrices;
+
+    // Primitives drawn by a frame, sorted by shader variant, material and
+    // vertex array, or by depth
+    struct DrawItem {
+        ShaderVariantKey variant;
+        int material;
+        GLuint vao;
+        uint32_t flatIdx;
+        uint32_t primitiveIdx;
+        GLuint depthVao;
+        float depth; // View space distance to the center of its bounds
+    };
+    std::vector<DrawItem> drawQueue;
+    // Indices in drawQueue of the draws of the depth prepass, front to back
+    std::vector<uint32_t> prepassOrder;
+    // The draws of the blended materials, after the others: back to front,
+    // or by shader variant and material for the weighted blended
+    // transparency which does not depend on their order
+    std::vector<DrawItem> blendQueue;
+    std::vector<DrawItem> sortedBlendQueue;
+    std::vector<float> blendDepths;
+    RadixSorter blendSorter;
+    OitBuffer oitBuffer;
+
+    // Fragments shaded by the scene draws of the frame
+    const GLuint OVERDRAW_COUNTER_BINDING = 0;
+    GLuint overdrawCounterBuffer = 0;
+    glGenBuffers(1, &overdrawCounterBuffer);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, overdrawCounterBuffer);
+    glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    GLuint lightsBuffer = 0; // LightsBlock of the frame
+    glGenBuffers(1, &lightsBuffer);
+
+    // A layer of the depth array per cascade, all drawn by the same draws
+    // which the geometry shader sends to the layers of their instances. The
+    // comparison sampler filters 2x2 texels, and the border is lit.
+    const GLsizei SHADOW_MAP_SIZE = 2048;
+    // Of the depth in the shadow map, added to the slope scaled polygon offset
+    const float SHADOW_DEPTH_BIAS = 0.0005f;
+    GLuint shadowMapTexture = 0;
+    glGenTextures(1, &shadowMapTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMapTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, GLsizei(kMaxShadowCascadeCount));
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    const float shadowBorder[] = {1, 1, 1, 1};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, shadowBorder);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    GLuint shadowFramebuffer = 0;
+    glGenFramebuffers(1, &shadowFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMapTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Targets of the deferred path, sized to the frame as it is drawn
+    GBuffer gbuffer;
+
+    // CPU and GPU times of the phases of the frames, shown in their own
+    // window. Only measured while the window is shown or a trace is recorded.
+    FrameProfiler frameProfiler;
+    bool showFrameProfiler = false;
+    frameProfiler.setEnabled(globalTracer() != nullptr);
+
+    // Level of its textures a draw samples, from the screen area of its bounds
+    // and the texels its texture coordinates cover
+    const auto requestTextureLevels = [&](const RuntimePrimitive &primitive, const glm::mat4 &mvpMatrix) {
+        if (primitive.material < 0) {
+            return;
+        }
+        // Without bounds the primitive may fill the screen
+        const auto coverage = primitive.hasBounds ? getScreenCoverage(mvpMatrix, primitive.boundsMin, primitive.boundsMax) : 1.f;
+        if (coverage <= 0.f) {
+            return; // Outside of the frustum
+        }
+        const auto pixelCount = coverage * float(m_nWindowWidth) * float(m_nWindowHeight);
+        const auto &material = runtimeScene.materials[primitive.material];
+        for (const auto textureIdx : {material.baseColorTexture, material.metallicRoughnessTexture, material.normalTexture, material.emissiveTexture}) {
+            if (textureIdx >= 0) {
+                const auto size = glm::vec2(textureStreamer.size(textureIdx));
+                const auto texelCount = size.x * size.y * std::abs(primitive.uvExtent.x * primitive.uvExtent.y);
+                textureStreamer.request(textureIdx, getRequiredMipLevel(texelCount, pixelCount));
             }
         }
     };
 
+    // Projection of the whole image while its tiles are drawn, which the
+    // shadow cascades fit rather than the view of each tile: the cascades,
+    // hence the shadows, are then the same in every tile
+    const glm::mat4 *imageProjMatrix = nullptr;
+
     // Lambda function to draw the scene
     const auto drawScene = [&](const Camera &camera)
     {
+        FrameProfiler::Scope scope(&frameProfiler, "Draw scene");
         glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         const auto viewMatrix = camera.getViewMatrix();
-        //Activation ou Non de la normal map
 
-//        ActiveNormalMap = 0.f;
-//        glUniform1f(uActiveNormal,0); // si il n'y a pas de normaltexture spécifié pour le fichier gltf
-//        glUniform1f(uActiveNormal,ActiveNormalMap);
-        // Envoie lightIntensity au shader
-        if (uLightDirectionLocation >= 0) {
-            if (lightFromCamera) {  // Si lumiere camera cocher
-                glUniform3f(uLightDirectionLocation, 0, 0, 1);
+        {
+            FrameProfiler::Scope scope(&frameProfiler, "Cube draw");
+            glslCube.use();
+            ++renderCounters.programBindCount;
+            glBindVertexArray(vaocube);
+            ++renderCounters.vertexArrayBindCount;
+
+            glUniformMatrix4fv(uVMatrix, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+            glUniformMatrix4fv(uPMatrix, 1, GL_FALSE, glm::value_ptr(projMatrix));
+            for (unsigned int i = 0; i < NbCube; i++) {
+                glUniform3fv(uPosCube, 1, glm::value_ptr(posCube[i]));
+                glUniform3fv(uColor, 1, glm::value_ptr(CubeColor[i]));
+                glUniform1f(uSize_cube,sizeCube[i]);
+                glDrawArrays(GL_TRIANGLES, 0, count_vertex);
+                ++renderCounters.drawCount;
+            }
+            glBindVertexArray(0);
+        }
+
+        const auto lightVariantKey = getLightVariantKeyOfFrame();
+        const auto passVariantKey = (deferredShading ? ShaderVariantKey(ShaderFeature_GBufferPass) : lightVariantKey) | (countOverdraw ? ShaderVariantKey(ShaderFeature_CountOverdraw) : 0);
+        const auto deferredVariantKey = lightVariantKey | ShaderFeature_DeferredShading;
+        const auto blendVariantKey = lightVariantKey | (weightedBlendedOit ? ShaderVariantKey(ShaderFeature_WeightedBlendedOit) : 0) | (countOverdraw ? ShaderVariantKey(ShaderFeature_CountOverdraw) : 0);
+        {
+            FrameProfiler::Scope scope(&frameProfiler, "Scene traversal");
+            // Draw the scene referenced by gltf file
+            // The nodes are flattened in sceneGraph, with up to date world matrices
+            drawQueue.clear();
+            blendQueue.clear();
+            placeholderMatrices.clear();
+            for (size_t flatIdx = 0; flatIdx < sceneGraph.size(); ++flatIdx) {
+                const auto nodeIdx = sceneGraph.nodes[flatIdx];
+                const auto meshIdx = runtimeScene.nodeMeshes[nodeIdx];
+                if (meshIdx >= 0 && !meshReady[meshIdx]) {
+                    const auto &vaoRange = meshToVertexArrays[meshIdx];
+                    for (auto primitiveIdx = vaoRange.begin; primitiveIdx < vaoRange.begin + vaoRange.count; ++primitiveIdx) {
+                        const auto &primitive = runtimeScene.primitives[primitiveIdx];
+                        if (primitive.hasBounds) {
+                            placeholderMatrices.push_back(sceneGraph.worldMatrices[flatIdx] * glm::translate(glm::mat4(1), primitive.boundsMin) * glm::scale(glm::mat4(1), primitive.boundsMax - primitive.boundsMin));
+                        }
+                    }
+                    continue;
+                }
+
+                // If the node references a mesh (a node can also reference a
+                // camera, or a light)
+                if (meshIdx >= 0) {
+                    const auto &vaoRange = meshToVertexArrays[meshIdx];
+                    for (auto primitiveIdx = vaoRange.begin; primitiveIdx < vaoRange.begin + vaoRange.count; ++primitiveIdx) {
+                        const auto &primitive = runtimeScene.primitives[primitiveIdx];
+                        requestTextureLevels(primitive, projMatrix * viewMatrix * sceneGraph.worldMatrices[flatIdx]);
+                        const auto center = primitive.hasBounds ? 0.5f * (primitive.boundsMin + primitive.boundsMax) : glm::vec3(0);
+                        const auto depth = -(viewMatrix * sceneGraph.worldMatrices[flatIdx] * glm::vec4(center, 1)).z;
+                        if (primitive.material >= 0 && runtimeScene.materials[primitive.material].alphaMode == AlphaMode::Blend) {
+                            blendQueue.push_back({getMaterialVariantKeyOfDraw(primitive.material) | blendVariantKey, primitive.material, vertexArrayObjects[primitiveIdx], uint32_t(flatIdx), uint32_t(primitiveIdx), depthVertexArrayObjects[primitiveIdx], depth});
+                        }
+                        else {
+                            drawQueue.push_back({getMaterialVariantKeyOfDraw(primitive.material) | passVariantKey, primitive.material, vertexArrayObjects[primitiveIdx], uint32_t(flatIdx), uint32_t(primitiveIdx), depthVertexArrayObjects[primitiveIdx], depth});
+                        }
+                    }
+                }
+            }
+            if (frontToBackDraws) {
+                std::sort(begin(drawQueue), end(drawQueue), [](const DrawItem &lhs, const DrawItem &rhs) {
+                    return std::tie(lhs.depth, lhs.variant, lhs.material) < std::tie(rhs.depth, rhs.variant, rhs.material);
+                });
             }
             else {
-                const auto lightDirectionInViewSpace = glm::normalize(glm::vec3(viewMatrix * glm::vec4(lightDirection, 0.)));
-                glUniform3f(uLightDirectionLocation, lightDirectionInViewSpace[0], lightDirectionInViewSpace[1], lightDirectionInViewSpace[2]);
+                // Each variant, then each material, is bound once
+                std::sort(begin(drawQueue), end(drawQueue), [](const DrawItem &lhs, const DrawItem &rhs) {
+                    return std::tie(lhs.variant, lhs.material, lhs.vao, lhs.flatIdx) < std::tie(rhs.variant, rhs.material, rhs.vao, rhs.flatIdx);
+                });
+            }
+            if (weightedBlendedOit) {
+                std::sort(begin(blendQueue), end(blendQueue), [](const DrawItem &lhs, const DrawItem &rhs) {
+                    return std::tie(lhs.variant, lhs.material, lhs.vao, lhs.flatIdx) < std::tie(rhs.variant, rhs.material, rhs.vao, rhs.flatIdx);
+                });
+            }
+            else {
+                // Linear in the number of draws, for the scenes of many
+                // transparent objects
+                blendDepths.clear();
+                for (const auto &item : blendQueue) {
+                    blendDepths.push_back(item.depth);
+                }
+                const auto &order = blendSorter.sort(blendDepths.data(), blendDepths.size(), true);
+                sortedBlendQueue.clear();
+                for (const auto itemIdx : order) {
+                    sortedBlendQueue.push_back(blendQueue[itemIdx]);
+                }
+                blendQueue.swap(sortedBlendQueue);
+            }
+            // The prepass only binds vertex arrays, it is always front to
+            // back. The masked draws discard after the depth test, they are
+            // left out.
+            prepassOrder.clear();
+            if (depthPrepass) {
+                for (size_t itemIdx = 0; itemIdx < drawQueue.size(); ++itemIdx) {
+                    if (!(drawQueue[itemIdx].variant & ShaderFeature_AlphaMask)) {
+                        prepassOrder.push_back(uint32_t(itemIdx));
+                    }
+                }
+                std::sort(begin(prepassOrder), end(prepassOrder), [&](uint32_t lhs, uint32_t rhs) {
+                    return drawQueue[lhs].depth < drawQueue[rhs].depth;
+                });
             }
-        }
-        if (uLightIntensity >= 0) {
-            glUniform3f(uLightIntensity, lightIntensity[0], lightIntensity[1], lightIntensity[2]);
         }
 
-        ///drawCube
-        glslProgram.use();
-        for (unsigned int i = 0; i < NbCube; i++) {
-            std::string num = std::to_string(i);
-            setVec3(glslProgram, ("pointLights[" + num + "].LightPosition").c_str(), glm::vec3(viewMatrix * glm::vec4(posCube[i], 1)));
-            setVec3(glslProgram, ("pointLights[" + num + "].CubeIntensity").c_str(), CubeIntensity[i]);
-            setFloat(glslProgram, ("pointLights[" + num + "].CubeDist").c_str(), CubeDist[i]);
+        // Variants first used by this frame, after a texture streamed in or a
+        // light or the normal map switched
+        std::vector<ShaderVariantKey> newVariants;
+        for (const auto *queue : {&drawQueue, &blendQueue}) {
+            for (const auto &item : *queue) {
+                if (!forwardVariants.contains(item.variant) && std::find(begin(newVariants), end(newVariants), item.variant) == end(newVariants)) {
+                    newVariants.push_back(item.variant);
+                }
+            }
+        }
+        if (!newVariants.empty() && !shaderErrors.count("Forward")) {
+            FrameProfiler::Scope scope(&frameProfiler, "Shader variants", false);
+            try {
+                forwardVariants.build(newVariants);
+            }
+            catch (const std::runtime_error &e) {
+                // An edited shader that does not compile, the draws of the
+                // variants not built are skipped
+                shaderErrors["Forward"] = e.what();
+            }
+        }
+        if (deferredShading && !deferredVariants.contains(deferredVariantKey) && !shaderErrors.count("Deferred")) {
+            FrameProfiler::Scope scope(&frameProfiler, "Shader variants", false);
+            try {
+                deferredVariants.build({deferredVariantKey});
+            }
+            catch (const std::runtime_error &e) {
+                shaderErrors["Deferred"] = e.what();
+            }
         }
 
-        auto camPos = glm::vec3(0, 0, 0);
-        glm::vec3 spotLigthDirection;
-        if (SpotlightfromCursor) {
-            double xpos, ypos;
-            glfwGetCursorPos(m_GLFWHandle.window(), &xpos, &ypos);
-            spotLigthDirection = glm::vec3(float((xpos - m_nWindowWidth / 2) / m_nWindowWidth), float(-(ypos - m_nWindowHeight / 2) / m_nWindowHeight), -1);
+        // The shadows of the directional light, from the draws of the frame:
+        // each is culled against the cascades on the CPU, then drawn once,
+        // instanced over the cascades it crosses
+        ShadowCascades cascades;
+        if (shadowsEnabled && lightIntensity != glm::vec3(0)) {
+            FrameProfiler::Scope scope(&frameProfiler, "Shadow maps");
+            const auto worldLightDirection = lightFromCamera ? glm::vec3(glm::inverse(viewMatrix) * glm::vec4(0, 0, 1, 0)) : lightDirection;
+            cascades = computeShadowCascades(viewMatrix, imageProjMatrix ? *imageProjMatrix : projMatrix, glm::normalize(worldLightDirection), bboxMin, bboxMax, size_t(shadowCascadeCount), SHADOW_MAP_SIZE);
+
+            GLint previousFramebuffer = 0;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFramebuffer);
+            glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            // Casters between the light and the near plane of a cascade
+            // still cast
+            glEnable(GL_DEPTH_CLAMP);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.f, 4.f);
+
+            glslShadow.use();
+            ++renderCounters.programBindCount;
+            if (cascades.count > 0) {
+                glUniformMatrix4fv(shadowUniforms.cascadeViewProjMatrices, GLsizei(cascades.count), GL_FALSE, glm::value_ptr(cascades.viewProjMatrices[0]));
+            }
+            const auto allCascades = (1u << cascades.count) - 1;
+            GLuint boundVao = 0;
+            // Sorted by vertex array already
+            for (const auto &item : drawQueue) {
+                if (cascades.count == 0) {
+                    break;
+                }
+                const auto &primitive = runtimeScene.primitives[item.primitiveIdx];
+                // The geometry shader takes triangles, points and lines do
+                // not cast
+                if (primitive.mode != GL_TRIANGLES && primitive.mode != GL_TRIANGLE_STRIP && primitive.mode != GL_TRIANGLE_FAN) {
+                    continue;
+                }
+                const auto skinIdx = runtimeScene.nodeSkins[sceneGraph.nodes[item.flatIdx]];
+                const bool isSkinned = skinIdx >= 0 && !jointPalette.empty();
+                const glm::mat4 modelMatrix = isSkinned ? glm::mat4(1) : sceneGraph.worldMatrices[item.flatIdx];
+                // Skinned vertices leave the bounds of their primitive
+                const auto mask = isSkinned || !primitive.hasBounds ? allCascades : getShadowCascadeMask(cascades, modelMatrix, primitive.boundsMin, primitive.boundsMax);
+                if (mask == 0) {
+                    continue;
+                }
+                // A single draw for the range of cascades the primitive
+                // crosses, the cascades nest so it rarely has holes
+                GLint firstCascade = 0;
+                while (!(mask & (1u << firstCascade))) {
+                    ++firstCascade;
+                }
+                GLint lastCascade = GLint(cascades.count) - 1;
+                while (!(mask & (1u << lastCascade))) {
+                    --lastCascade;
+                }
+                const auto instanceCount = lastCascade - firstCascade + 1;
+
+                glUniformMatrix4fv(shadowUniforms.modelViewMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+                glUniform1i(shadowUniforms.jointOffset, isSkinned ? GLint(skins[skinIdx].paletteOffset) : -1);
+                glUniform1i(shadowUniforms.firstCascade, firstCascade);
+                bindMorphTargets(shadowUniforms, item.flatIdx, item.primitiveIdx);
+                if (item.vao != boundVao) {
+                    glBindVertexArray(item.vao);
+                    ++renderCounters.vertexArrayBindCount;
+                    boundVao = item.vao;
+                }
+                ++renderCounters.drawCount;
+                if (primitive.indexType >= 0) {
+                    glDrawElementsInstanced(primitive.mode, GLsizei(primitive.count), GLenum(primitive.indexType), (const GLvoid *)primitive.indexByteOffset, instanceCount);
+                }
+                else {
+                    glDrawArraysInstanced(primitive.mode, 0, GLsizei(primitive.count), instanceCount);
+                }
+            }
+            glBindVertexArray(0);
+
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glDisable(GL_DEPTH_CLAMP);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+            glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
         }
-        else {
-            spotLigthDirection = glm::vec3(0, 0, -1);
-        }
-        setVec3(glslProgram, "spotligth.LightPosition", camPos);
-        setVec3(glslProgram, "spotligth.LightIntensity", spotligthIntensity);
-        setVec3(glslProgram, "spotligth.LightDirection", spotLigthDirection);
-        setFloat(glslProgram, "spotligth.CutOff", glm::cos(glm::radians(spotligthCutOff)));
-        setFloat(glslProgram, "spotligth.OuterCutOff", glm::cos(glm::radians(spotligthOuterCutOff)));
-        setFloat(glslProgram, "spotligth.DistAttenuation", spotligthtDistAttenuation);
-
-        glslCube.use();
-        glBindVertexArray(vaocube);
-
-        glUniformMatrix4fv(uVMatrix, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-        glUniformMatrix4fv(uPMatrix, 1, GL_FALSE, glm::value_ptr(projMatrix));
-        for (unsigned int i = 0; i < NbCube; i++) {
-            glUniform3fv(uPosCube, 1, glm::value_ptr(posCube[i]));
-            glUniform3fv(uColor, 1, glm::value_ptr(CubeColor[i]));
-            glUniform1f(uSize_cube,sizeCube[i]);
-            glDrawArrays(GL_TRIANGLES, 0, count_vertex);
-        }
-        glBindVertexArray(0);
-
-        // The recursive function that should draw a node
-        // We use a std::function because a simple lambda cannot be recursive
-        const std::function<void(int, const glm::mat4 &)> drawNode = [&](int nodeIdx, const glm::mat4 &parentMatrix)
+
         {
-            // TODO The drawNode function
-            const auto &node = model.nodes[nodeIdx];
-            const glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
+            // The lights of the frame, read by all the variants from a
+            // single buffer
+            FrameProfiler::Scope scope(&frameProfiler, "Light uniforms");
+            LightsBlock lights;
+            // Envoie lightIntensity au shader
+            if (lightFromCamera) {  // Si lumiere camera cocher
+                lights.directionalDirection = glm::vec4(0, 0, 1, 0);
+            }
+            else {
+                lights.directionalDirection = glm::vec4(glm::normalize(glm::vec3(viewMatrix * glm::vec4(lightDirection, 0.))), 0);
+            }
+            lights.directionalIntensity = glm::vec4(lightIntensity, 0);
+            for (size_t i = 0; i < activePointLights.size(); ++i) {
+                const auto cubeIdx = activePointLights[i];
+                lights.pointLights[i].position = viewMatrix * glm::vec4(posCube[cubeIdx], 1);
+                lights.pointLights[i].intensity = glm::vec4(CubeIntensity[cubeIdx], 0);
+                const auto &intensity = CubeIntensity[cubeIdx];
+                lights.pointLights[i].attenuation = glm::vec4(CubeAttenuation[cubeIdx], getLightRadius(CubeAttenuation[cubeIdx], std::max(intensity.r, std::max(intensity.g, intensity.b))), 0);
+            }
+            glm::vec3 spotLigthDirection;
+            if (SpotlightfromCursor) {
+                double xpos, ypos;
+                glfwGetCursorPos(m_GLFWHandle.window(), &xpos, &ypos);
+                spotLigthDirection = glm::vec3(float((xpos - m_nWindowWidth / 2) / m_nWindowWidth), float(-(ypos - m_nWindowHeight / 2) / m_nWindowHeight), -1);
+            }
+            else {
+                spotLigthDirection = glm::vec3(0, 0, -1);
+            }
+            lights.spotLight.position = glm::vec4(0, 0, 0, 1); // At the camera
+            lights.spotLight.intensity = glm::vec4(spotligthIntensity, 0);
+            lights.spotLight.direction = glm::vec4(glm::normalize(spotLigthDirection), 0);
+            lights.spotLight.cone = glm::vec4(glm::cos(glm::radians(spotligthCutOff)), glm::cos(glm::radians(spotligthOuterCutOff)), 0, 0);
+            lights.spotLight.attenuation = glm::vec4(spotligthAttenuation, getLightRadius(spotligthAttenuation, std::max(spotligthIntensity.r, std::max(spotligthIntensity.g, spotligthIntensity.b))), 0);
+            if (hasEnvironment) {
+                for (size_t i = 0; i < 9; ++i) {
+                    lights.irradianceSH[i] = glm::vec4(environmentLighting.irradianceSH[i], 0);
+                }
+                lights.environment = glm::vec4(environmentIntensity, float(environmentLighting.specularLevels.size() - 1), 0, 0);
+                lights.viewToWorld = glm::inverse(viewMatrix);
+            }
+            // From view space to the [0, 1] texture coordinates and depth of
+            // the cascades, no cascade if the scene is out of the view
+            const auto shadowBiasMatrix = glm::translate(glm::mat4(1), glm::vec3(0.5f)) * glm::scale(glm::mat4(1), glm::vec3(0.5f));
+            for (size_t i = 0; i < cascades.count; ++i) {
+                lights.shadowMatrices[i] = shadowBiasMatrix * cascades.viewProjMatrices[i] * glm::inverse(viewMatrix);
+                lights.shadowSplits[i] = cascades.splitDistances[i];
+            }
+            lights.shadow = glm::vec4(float(cascades.count), SHADOW_DEPTH_BIAS, 0, 0);
+
+            glBindBuffer(GL_UNIFORM_BUFFER, lightsBuffer);
+            // Orphan the previous storage so we don't wait for draws still using it
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(lights), &lights, GL_STREAM_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, lightsBuffer);
+
+            // Shared by all the variants too, rebound each frame since the
+            // texture uploads may use any unit
+            if (hasEnvironment) {
+                glActiveTexture(GL_TEXTURE0 + SPECULAR_ENVIRONMENT_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, specularEnvironmentTexture);
+                glActiveTexture(GL_TEXTURE0 + BRDF_LUT_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, brdfLutTexture);
+                renderCounters.textureBindCount += 2;
+            }
+            if (cascades.count > 0) {
+                glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMapTexture);
+                ++renderCounters.textureBindCount;
+            }
+        }
 
-            // If the node references a mesh (a node can also reference a
-            // camera, or a light)
-            if (node.mesh >= 0) {
+        // The deferred path draws the scene in the G-buffer, the frame keeps
+        // the cubes drawn before
+        GLint frameFramebuffer = 0;
+        if (deferredShading) {
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &frameFramebuffer);
+            if (!resizeGBuffer(gbuffer, m_nWindowWidth, m_nWindowHeight)) {
+                std::cerr << "Unable to create the G-buffer, back to forward shading" << std::endl;
+                deferredShading = false;
+                return;
+            }
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gbuffer.framebuffer);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // The base color target is sRGB
+            glEnable(GL_FRAMEBUFFER_SRGB);
+        }
+        if (!prepassOrder.empty()) {
+            FrameProfiler::Scope scope(&frameProfiler, "Depth prepass");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glslDepthPrepass.use();
+            ++renderCounters.programBindCount;
+            GLuint boundVao = 0;
+            for (const auto itemIdx : prepassOrder) {
+                const auto &item = drawQueue[itemIdx];
+                // Not drawn by the shading pass either
+                if (!forwardVariants.contains(item.variant)) {
+                    continue;
+                }
+                const auto skinIdx = runtimeScene.nodeSkins[sceneGraph.nodes[item.flatIdx]];
+                const bool isSkinned = skinIdx >= 0 && !jointPalette.empty();
+                const glm::mat4 modelMatrix = isSkinned ? glm::mat4(1) : sceneGraph.worldMatrices[item.flatIdx];
+                const auto mvpMatrix = projMatrix * viewMatrix * modelMatrix;
+                glUniformMatrix4fv(depthPrepassUniforms.modelViewProjMatrix, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+                glUniform1i(depthPrepassUniforms.jointOffset, isSkinned ? GLint(skins[skinIdx].paletteOffset) : -1);
+                bindMorphTargets(depthPrepassUniforms, item.flatIdx, item.primitiveIdx);
+                if (item.depthVao != boundVao) {
+                    glBindVertexArray(item.depthVao);
+                    ++renderCounters.vertexArrayBindCount;
+                    boundVao = item.depthVao;
+                }
+                const auto &primitive = runtimeScene.primitives[item.primitiveIdx];
+                ++renderCounters.drawCount;
+                if (primitive.indexType >= 0) {
+                    glDrawElements(primitive.mode, GLsizei(primitive.count), GLenum(primitive.indexType), (const GLvoid *)primitive.indexByteOffset);
+                }
+                else {
+                    glDrawArrays(primitive.mode, 0, GLsizei(primitive.count));
+                }
+            }
+            glBindVertexArray(0);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+        if (countOverdraw) {
+            const GLuint zero = 0;
+            glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, overdrawCounterBuffer);
+            glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(zero), &zero);
+            glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+            glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, OVERDRAW_COUNTER_BINDING, overdrawCounterBuffer);
+        }
+        // Draws items in their order, the opaque ones and then the blended
+        // ones
+        const auto drawItems = [&](const std::vector<DrawItem> &items) {
+            const ShaderVariants::Variant *variant = nullptr;
+            int boundMaterial = -1;
+            GLuint boundVao = 0;
+            // After the prepass, the draws in it only pass where they wrote
+            // the depth, which they do not write again
+            bool depthEqual = false;
+            for (size_t itemIdx = 0; itemIdx < items.size(); ++itemIdx) {
+                const auto &item = items[itemIdx];
+                const bool newVariant = itemIdx == 0 || item.variant != items[itemIdx - 1].variant;
+                if (!forwardVariants.contains(item.variant)) {
+                    continue;
+                }
+                const bool inPrepass = !prepassOrder.empty() && !(item.variant & (ShaderFeature_AlphaMask | ShaderFeature_AlphaBlend));
+                if (inPrepass != depthEqual) {
+                    glDepthFunc(inPrepass ? GL_EQUAL : GL_LESS);
+                    glDepthMask(inPrepass ? GL_FALSE : GL_TRUE);
+                    depthEqual = inPrepass;
+                }
+                if (newVariant) {
+                    variant = &forwardVariants.get(item.variant);
+                    variant->program.use();
+                    ++renderCounters.programBindCount;
+                    glUniform1i(variant->uniforms.baseColorTexture, BASE_COLOR_TEXTURE_UNIT);
+                    glUniform1i(variant->uniforms.metallicRoughnessTexture, METALLIC_ROUGHNESS_TEXTURE_UNIT);
+                    glUniform1i(variant->uniforms.emissiveTexture, EMISSIVE_TEXTURE_UNIT);
+                    glUniform1i(variant->uniforms.normalTexture, NORMAL_TEXTURE_UNIT);
+                    glUniform1i(variant->uniforms.specularEnvironment, SPECULAR_ENVIRONMENT_TEXTURE_UNIT);
+                    glUniform1i(variant->uniforms.brdfLut, BRDF_LUT_TEXTURE_UNIT);
+                    glUniform1i(variant->uniforms.shadowMap, SHADOW_MAP_TEXTURE_UNIT);
+                }
+                const auto &uniforms = variant->uniforms;
+                if (newVariant || item.material != boundMaterial) {
+                    bindMaterial(uniforms, item.material);
+                    boundMaterial = item.material;
+                }
+
+                const auto skinIdx = runtimeScene.nodeSkins[sceneGraph.nodes[item.flatIdx]];
+                // Skinned vertices are brought to world space by the joint matrices
+                const bool isSkinned = skinIdx >= 0 && !jointPalette.empty();
+                const glm::mat4 modelMatrix = isSkinned ? glm::mat4(1) : sceneGraph.worldMatrices[item.flatIdx];
                 // Also called localToCamera matrix
                 const auto mvMatrix = viewMatrix * modelMatrix;
                 // Also called localToScreen matrix
@@ -881,62 +1842,213 @@ int ViewerApplication::run() {
                 // orthogonal to tangent vectors
                 const auto normalMatrix = glm::transpose(glm::inverse(mvMatrix));
 
-                glUniformMatrix4fv(modelViewProjMatrixLocation, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-                glUniformMatrix4fv(modelViewMatrixLocation, 1, GL_FALSE, glm::value_ptr(mvMatrix));
-                glUniformMatrix4fv(normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-                const auto &mesh = model.meshes[node.mesh];
-                const auto &vaoRange = meshToVertexArrays[node.mesh];
-                for (int i = 0; i < mesh.primitives.size(); ++i) {
-                    const auto vao = vertexArrayObjects[vaoRange.begin + i];
-                    const auto &primitive = mesh.primitives[i];
-
-                    bindMaterial(primitive.material);
-                    if (normaltexturecheck == 0) {
-                        glUniform1f(uActiveNormal, 0); // si il n'y a pas de normaltexture spécifié pour le fichier gltf
-                    } 
-                    else {
-                        glUniform1f(uActiveNormal, 1.0f * ActiveNormalMap);
-                    }
+                glUniformMatrix4fv(uniforms.modelViewProjMatrix, 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+                glUniformMatrix4fv(uniforms.modelViewMatrix, 1, GL_FALSE, glm::value_ptr(mvMatrix));
+                glUniformMatrix4fv(uniforms.normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+                glUniform1i(uniforms.jointOffset, isSkinned ? GLint(skins[skinIdx].paletteOffset) : -1);
 
-                    glBindVertexArray(vao);
+                bindMorphTargets(uniforms, item.flatIdx, item.primitiveIdx);
+                if (item.vao != boundVao) {
+                    glBindVertexArray(item.vao);
+                    ++renderCounters.vertexArrayBindCount;
+                    boundVao = item.vao;
+                }
 
-                    if (primitive.indices >= 0) {
-                        const auto &accessor = model.accessors[primitive.indices];
-                        const auto &bufferView = model.bufferViews[accessor.bufferView];
-                        const auto byteOffset = accessor.byteOffset + bufferView.byteOffset;
-                        glDrawElements(primitive.mode, GLsizei(accessor.count), accessor.componentType, (const GLvoid *)byteOffset);
-                    }
-                    else {  // Take first accessor to get the count
-                        const auto accessorIdx = (*begin(primitive.attributes)).second;
-                        const auto &accessor = model.accessors[accessorIdx];
-                        glDrawArrays(primitive.mode, 0, GLsizei(accessor.count));
-                    }
+                const auto &primitive = runtimeScene.primitives[item.primitiveIdx];
+                ++renderCounters.drawCount;
+                if (primitive.indexType >= 0) {
+                    glDrawElements(primitive.mode, GLsizei(primitive.count), GLenum(primitive.indexType), (const GLvoid *)primitive.indexByteOffset);
+                }
+                else {
+                    glDrawArrays(primitive.mode, 0, GLsizei(primitive.count));
                 }
             }
-            // Draw children
-            for (auto nodeChild : node.children) {
-                drawNode(nodeChild, modelMatrix);
+            glBindVertexArray(0);
+            if (depthEqual) {
+                glDepthFunc(GL_LESS);
+                glDepthMask(GL_TRUE);
             }
         };
-        // Draw the scene referenced by gltf file
-        glslProgram.use();
-        if (model.defaultScene >= 0) {
-            // TODO Draw all nodes
-            for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-                drawNode(nodeIdx, glm::mat4(1));
+        {
+            FrameProfiler::Scope scope(&frameProfiler, deferredShading ? "G-buffer" : "Scene draws");
+            drawItems(drawQueue);
+        }
+        if (deferredShading) {
+            glDisable(GL_FRAMEBUFFER_SRGB);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(frameFramebuffer));
+
+            const auto inverseProjMatrix = glm::inverse(projMatrix);
+            glActiveTexture(GL_TEXTURE0 + GBUFFER_DEPTH_TEXTURE_UNIT);
+            glBindTexture(GL_TEXTURE_2D, gbuffer.depth);
+            ++renderCounters.textureBindCount;
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TILE_LIGHTS_BINDING, gbuffer.tileLightMasks);
+            {
+                FrameProfiler::Scope scope(&frameProfiler, "Light culling");
+                glslLightCulling.use();
+                ++renderCounters.programBindCount;
+                glUniform1i(uCullingGBufferDepth, GBUFFER_DEPTH_TEXTURE_UNIT);
+                glUniformMatrix4fv(uCullingInverseProjMatrix, 1, GL_FALSE, glm::value_ptr(inverseProjMatrix));
+                glUniform1i(uCullingPointLightCount, GLint(activePointLights.size()));
+                glUniform1i(uCullingHasSpotLight, spotligthIntensity != glm::vec3(0));
+                glDispatchCompute(GLuint(gbuffer.tileCountX), GLuint(gbuffer.tileCountY), 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            }
+            if (deferredVariants.contains(deferredVariantKey)) {
+                FrameProfiler::Scope scope(&frameProfiler, "Deferred shading");
+                const auto &variant = deferredVariants.get(deferredVariantKey);
+                variant.program.use();
+                ++renderCounters.programBindCount;
+                glActiveTexture(GL_TEXTURE0 + GBUFFER_BASE_COLOR_METALLIC_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, gbuffer.baseColorMetallic);
+                glActiveTexture(GL_TEXTURE0 + GBUFFER_NORMAL_ROUGHNESS_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, gbuffer.normalRoughness);
+                glActiveTexture(GL_TEXTURE0 + GBUFFER_EMISSIVE_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, gbuffer.emissive);
+                renderCounters.textureBindCount += 3;
+                glUniform1i(variant.uniforms.gBufferBaseColorMetallic, GBUFFER_BASE_COLOR_METALLIC_TEXTURE_UNIT);
+                glUniform1i(variant.uniforms.gBufferNormalRoughness, GBUFFER_NORMAL_ROUGHNESS_TEXTURE_UNIT);
+                glUniform1i(variant.uniforms.gBufferEmissive, GBUFFER_EMISSIVE_TEXTURE_UNIT);
+                glUniform1i(variant.uniforms.gBufferDepth, GBUFFER_DEPTH_TEXTURE_UNIT);
+                glUniform1i(variant.uniforms.specularEnvironment, SPECULAR_ENVIRONMENT_TEXTURE_UNIT);
+                glUniform1i(variant.uniforms.brdfLut, BRDF_LUT_TEXTURE_UNIT);
+                glUniform1i(variant.uniforms.shadowMap, SHADOW_MAP_TEXTURE_UNIT);
+                glUniformMatrix4fv(variant.uniforms.inverseProjMatrix, 1, GL_FALSE, glm::value_ptr(inverseProjMatrix));
+                glUniform1i(variant.uniforms.tileCountX, GLint(gbuffer.tileCountX));
+                // Writes the depth of the G-buffer, tested against the cubes
+                glBindVertexArray(placeholderVao);
+                ++renderCounters.vertexArrayBindCount;
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                ++renderCounters.drawCount;
+                glBindVertexArray(0);
+            }
+        }
+
+        // Over the opaque draws, with their depth test but without writing
+        // the depth
+        if (!blendQueue.empty()) {
+            FrameProfiler::Scope scope(&frameProfiler, "Transparency");
+            glDepthMask(GL_FALSE);
+            glEnable(GL_BLEND);
+            GLint blendFramebuffer = 0, readFramebuffer = 0;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &blendFramebuffer);
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+            const auto depthFormat = weightedBlendedOit ? getDrawFramebufferDepthFormat() : GLenum(GL_NONE);
+            if (!weightedBlendedOit) {
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                drawItems(blendQueue);
+            }
+            else if (!resizeOitBuffer(oitBuffer, m_nWindowWidth, m_nWindowHeight, depthFormat)) {
+                std::cerr << "Unable to create the transparency targets, back to sorted blending" << std::endl;
+                weightedBlendedOit = false;
+            }
+            else {
+                // The depth of the opaque draws, to test the blended ones
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(blendFramebuffer));
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oitBuffer.framebuffer);
+                if (depthFormat != GL_NONE) {
+                    glBlitFramebuffer(0, 0, m_nWindowWidth, m_nWindowHeight, 0, 0, m_nWindowWidth, m_nWindowHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                }
+                const GLfloat clearAccumulation[] = {0, 0, 0, 0};
+                const GLfloat clearRevealage[] = {1, 1, 1, 1};
+                glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+                glClearBufferfv(GL_COLOR, 1, clearRevealage);
+                glBlendFunci(0, GL_ONE, GL_ONE);
+                glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+                drawItems(blendQueue);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(blendFramebuffer));
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(readFramebuffer));
+
+                glDisable(GL_DEPTH_TEST);
+                glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+                glslOitComposite.use();
+                ++renderCounters.programBindCount;
+                glActiveTexture(GL_TEXTURE0 + OIT_ACCUMULATION_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, oitBuffer.accumulation);
+                glActiveTexture(GL_TEXTURE0 + OIT_REVEALAGE_TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, oitBuffer.revealage);
+                renderCounters.textureBindCount += 2;
+                glUniform1i(uOitAccumulation, OIT_ACCUMULATION_TEXTURE_UNIT);
+                glUniform1i(uOitRevealage, OIT_REVEALAGE_TEXTURE_UNIT);
+                glBindVertexArray(placeholderVao);
+                ++renderCounters.vertexArrayBindCount;
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                ++renderCounters.drawCount;
+                glBindVertexArray(0);
+                glEnable(GL_DEPTH_TEST);
+            }
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        }
+        if (countOverdraw) {
+            // Waits for the draws, it is a debug mode
+            GLuint shadedFragmentCount = 0;
+            glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT);
+            glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, overdrawCounterBuffer);
+            glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(shadedFragmentCount), &shadedFragmentCount);
+            glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+            overdraw = float(shadedFragmentCount) / float(m_nWindowWidth * m_nWindowHeight);
+        }
+
+        if (!placeholderMatrices.empty()) {
+            FrameProfiler::Scope scope(&frameProfiler, "Placeholders");
+            glslPlaceholder.use();
+            ++renderCounters.programBindCount;
+            glUniformMatrix4fv(uPlaceholderViewProjMatrix, 1, GL_FALSE, glm::value_ptr(projMatrix * viewMatrix));
+            glUniform3f(uPlaceholderColor, 0.5f, 0.5f, 0.5f);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, placeholderBuffer);
+            // Orphan the previous storage so we don't wait for draws still using it
+            glBufferData(GL_SHADER_STORAGE_BUFFER, placeholderMatrices.size() * sizeof(glm::mat4), placeholderMatrices.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PLACEHOLDER_BOXES_BINDING, placeholderBuffer);
+            glBindVertexArray(placeholderVao);
+            ++renderCounters.vertexArrayBindCount;
+            glDrawArraysInstanced(GL_LINES, 0, 24, GLsizei(placeholderMatrices.size()));
+            ++renderCounters.drawCount;
+            glBindVertexArray(0);
+        }
+    };
+
+    // Waits for the complete scene, with the texture levels the view of
+    // camera needs, the first draw telling which
+    const auto streamCompletely = [&](const Camera &camera) {
+        while (!streamScene(camera)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        for (;;) {
+            drawScene(camera);
+            textureStreamer.update();
+            if (textureStreamer.stats().pendingUploadCount == 0 && textureStreamer.stats().pendingReadCount == 0) {
+                break; // Every texture is at its needed level, or the budget is full
+            }
+            while (textureStreamer.stats().pendingUploadCount > 0 || textureStreamer.stats().pendingReadCount > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                streamScene(camera);
             }
         }
     };
 
-    //TODO Render to image
+    // Render to image, in tiles of the larger image when supersampled: the
+    // tiles are drawn as frames of their size, their projection cropping the
+    // view of the whole image
     if (!(m_OutputPath.empty())) {
+        streamCompletely(cameraController->getCamera());
         const auto nbComponent = 3;
-        std::vector<unsigned char> pixels(m_nWindowWidth * m_nWindowHeight * nbComponent);
-        renderToImage(m_nWindowWidth, m_nWindowHeight, nbComponent, pixels.data(), [&]()
+        const auto imageWidth = m_nWindowWidth;
+        const auto imageHeight = m_nWindowHeight;
+        const auto wholeProjMatrix = projMatrix;
+        imageProjMatrix = &wholeProjMatrix;
+        std::vector<unsigned char> pixels(imageWidth * imageHeight * nbComponent);
+        renderToImageSupersampled(imageWidth, imageHeight, nbComponent, m_ViewerOptions.supersampling, pixels.data(), [&](const ImageTile &tile)
         {
+            m_nWindowWidth = GLsizei(tile.width);
+            m_nWindowHeight = GLsizei(tile.height);
+            projMatrix = getTileMatrix(tile) * wholeProjMatrix;
             drawScene(cameraController->getCamera());
-        });
+        }, m_ViewerOptions.samples);
+        m_nWindowWidth = imageWidth;
+        m_nWindowHeight = imageHeight;
+        projMatrix = wholeProjMatrix;
+        imageProjMatrix = nullptr;
         flipImageYAxis(m_nWindowWidth, m_nWindowHeight, nbComponent, pixels.data());
 
         const auto strPath = m_OutputPath.string();
@@ -944,8 +2056,218 @@ int ViewerApplication::run() {
 
         return 0;
     }
+
+    // Benchmark: the frames are rendered offscreen once the scene is
+    // completely loaded, the camera moving along its path and the animation
+    // advancing by a fixed step, so that runs are comparable
+    if (m_BenchOptions.frameCount > 0) {
+        const auto &keyframes = m_BenchOptions.keyframes;
+        const auto getBenchCamera = [&](float t) {
+            return keyframes.empty() ? getOrbitCamera(bboxMin, bboxMax, t) : getCameraPathCamera(keyframes, t);
+        };
+        // Texture levels stay those of the first view, uploads during the
+        // frames would make the runs differ
+        streamCompletely(getBenchCamera(0.f));
+
+        GLuint framebuffer = 0;
+        GLuint renderbuffers[2] = {0, 0};
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_nWindowWidth, m_nWindowHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, m_nWindowWidth, m_nWindowHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Unable to create the benchmark framebuffer" << std::endl;
+            return -1;
+        }
+
+        // Without swaps nothing limits how far the CPU runs ahead of the
+        // GPU, the frames wait on a fence like a swap chain would
+        const size_t FRAMES_IN_FLIGHT = 3;
+        std::vector<GLsync> frameFences(FRAMES_IN_FLIGHT, nullptr);
+        const auto frameCount = m_BenchOptions.frameCount;
+        const auto warmupFrameCount = m_BenchOptions.warmupFrameCount;
+        std::vector<GLuint> timeQueries(frameCount);
+        glGenQueries(GLsizei(frameCount), timeQueries.data());
+        const float FRAME_DURATION = 1.f / 60.f;
+
+        BenchResult result;
+        result.gltfFile = m_gltfFilePath;
+        result.renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+        result.width = uint32_t(m_nWindowWidth);
+        result.height = uint32_t(m_nWindowHeight);
+        result.cameraPath = keyframes.empty() ? "orbit" : "keyframes";
+        result.shading = deferredShading ? "deferred" : "forward";
+        result.depthPrepass = depthPrepass;
+        result.warmupFrameCount = warmupFrameCount;
+        result.cpuMs.reserve(frameCount);
+
+        std::chrono::steady_clock::time_point benchStart;
+        for (size_t frame = 0; frame < warmupFrameCount + frameCount; ++frame) {
+            auto &fence = frameFences[frame % FRAMES_IN_FLIGHT];
+            if (fence) {
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+                glDeleteSync(fence);
+            }
+            const auto measured = frame >= warmupFrameCount;
+            const auto measuredIdx = frame - warmupFrameCount;
+            if (frame == warmupFrameCount) {
+                benchStart = std::chrono::steady_clock::now();
+            }
+            // The warmup frames stay at the start of the path
+            const auto camera = getBenchCamera(measured && frameCount > 1 ? float(measuredIdx) / float(frameCount - 1) : 0.f);
+
+            const auto cpuStart = std::chrono::steady_clock::now();
+            if (measured) {
+                glBeginQuery(GL_TIME_ELAPSED, timeQueries[measuredIdx]);
+            }
+            renderCounters.reset();
+            if (playAnimation) {
+                animator.sample(animationTime, sceneGraph, &globalThreadPool());
+                sceneGraph.updateWorldMatrices();
+                updateJointMatrices();
+                animationTime += FRAME_DURATION;
+            }
+            drawScene(camera);
+            if (measured) {
+                glEndQuery(GL_TIME_ELAPSED);
+                result.cpuMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count());
+                result.counters += renderCounters;
+            }
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        glFinish();
+        result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - benchStart).count();
+        for (auto &fence : frameFences) {
+            glDeleteSync(fence);
+        }
+
+        for (const auto query : timeQueries) {
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            GLuint64 elapsedNs = 0;
+            if (available) {
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            }
+            result.gpuMs.push_back(available ? 1e-6 * double(elapsedNs) : std::numeric_limits<double>::quiet_NaN());
+        }
+        glDeleteQueries(GLsizei(frameCount), timeQueries.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+
+        if (!writeBenchReport(result, m_BenchOptions.reportPath)) {
+            std::cerr << "Unable to write the benchmark report " << m_BenchOptions.reportPath << std::endl;
+            return -1;
+        }
+        return 0;
+    }
     int currentcam = 0;
 
+    // Shaders edited while the viewer runs are rebuilt at the next frame, the
+    // scene and its GPU resources staying loaded. A program is replaced once
+    // its new version links, the previous one is kept on errors.
+    FileWatcher shaderWatcher(m_ShadersRootPath / m_AppName);
+    size_t shaderReloadCount = 0;
+    const auto reloadShaders = [&](const std::vector<fs::path> &changedFiles) {
+        const auto isChanged = [&](const std::vector<fs::path> &shaderPaths) {
+            return std::any_of(begin(shaderPaths), end(shaderPaths), [&](const fs::path &path) {
+                return std::any_of(begin(changedFiles), end(changedFiles), [&](const fs::path &changedFile) {
+                    return changedFile.filename() == path.filename();
+                });
+            });
+        };
+        const auto reloadProgram = [&](const std::string &name, const std::vector<fs::path> &shaderPaths, GLProgram &program) {
+            try {
+                program = programCache.load(shaderPaths);
+                shaderErrors.erase(name);
+                return true;
+            }
+            catch (const std::runtime_error &e) {
+                shaderErrors[name] = e.what();
+                return false;
+            }
+        };
+        bool reloaded = false;
+        if (isChanged(forwardShaders)) {
+            std::string error;
+            if (forwardVariants.reload(error)) {
+                shaderErrors.erase("Forward");
+            }
+            else {
+                shaderErrors["Forward"] = error;
+            }
+            reloaded = true;
+        }
+        if (isChanged(deferredShaders)) {
+            std::string error;
+            if (deferredVariants.reload(error)) {
+                shaderErrors.erase("Deferred");
+            }
+            else {
+                shaderErrors["Deferred"] = error;
+            }
+            reloaded = true;
+        }
+        if (isChanged(oitCompositeShaders)) {
+            if (reloadProgram("Transparency composite", oitCompositeShaders, glslOitComposite)) {
+                getOitCompositeLocations();
+            }
+            reloaded = true;
+        }
+        if (isChanged(lightCullingShaders)) {
+            if (reloadProgram("Light culling", lightCullingShaders, glslLightCulling)) {
+                getLightCullingLocations();
+            }
+            reloaded = true;
+        }
+        if (isChanged(depthPrepassShaders)) {
+            try {
+                glslDepthPrepass = loadDepthPrepassProgram(nullptr);
+                depthPrepassUniforms = ForwardUniforms(glslDepthPrepass);
+                shaderErrors.erase("Depth prepass");
+            }
+            catch (const std::runtime_error &e) {
+                shaderErrors["Depth prepass"] = e.what();
+            }
+            reloaded = true;
+        }
+        if (isChanged(shadowShaders)) {
+            try {
+                glslShadow = loadShadowProgram(nullptr);
+                shadowUniforms = ForwardUniforms(glslShadow);
+                shaderErrors.erase("Shadow");
+            }
+            catch (const std::runtime_error &e) {
+                shaderErrors["Shadow"] = e.what();
+            }
+            reloaded = true;
+        }
+        if (isChanged(cubeShaders)) {
+            if (reloadProgram("Cube", cubeShaders, glslCube)) {
+                getCubeLocations();
+            }
+            reloaded = true;
+        }
+        if (isChanged(placeholderShaders)) {
+            if (reloadProgram("Placeholder", placeholderShaders, glslPlaceholder)) {
+                getPlaceholderLocations();
+            }
+            reloaded = true;
+        }
+        if (reloaded) {
+            ++shaderReloadCount;
+            for (const auto &error : shaderErrors) {
+                std::cerr << error.first << " shaders not reloaded: " << error.second << std::endl;
+            }
+        }
+    };
+
     /// Loop until the user closes the window
     for (auto iterationCount = 0u; !m_GLFWHandle.shouldClose(); ++iterationCount) {
         glfwGetFramebufferSize(m_GLFWHandle.window(), &m_nWindowWidth, &m_nWindowHeight);
@@ -953,13 +2275,38 @@ int ViewerApplication::run() {
 
         const auto seconds = glfwGetTime();
         const auto camera = cameraController->getCamera();
+        frameProfiler.beginFrame();
+
+        if (playAnimation) {
+            FrameProfiler::Scope scope(&frameProfiler, "Animation");
+            animator.sample(animationTime, sceneGraph, &globalThreadPool());
+            sceneGraph.updateWorldMatrices();
+            updateJointMatrices();
+        }
+        {
+            FrameProfiler::Scope scope(&frameProfiler, "Streaming");
+            streamScene(camera);
+        }
+        const auto changedShaders = shaderWatcher.poll();
+        if (!changedShaders.empty()) {
+            FrameProfiler::Scope scope(&frameProfiler, "Shader reload", false);
+            reloadShaders(changedShaders);
+        }
         drawScene(camera);
+        {
+            FrameProfiler::Scope scope(&frameProfiler, "Texture streaming");
+            textureStreamer.update();
+        }
 
         // GUI code:
+        frameProfiler.beginScope("ImGui");
         imguiNewFrame();
         {
             ImGui::Begin("GUI");
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+            if (ImGui::Checkbox("Frame profiler", &showFrameProfiler)) {
+                frameProfiler.setEnabled(showFrameProfiler || globalTracer());
+            }
             if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
                 ImGui::Text("eye: %.3f %.3f %.3f", camera.eye().x, camera.eye().y, camera.eye().z);
                 ImGui::Text("center: %.3f %.3f %.3f", camera.center().x, camera.center().y, camera.center().z);
@@ -997,6 +2344,82 @@ int ViewerApplication::run() {
                     }
                 }
             }
+            if (ImGui::CollapsingHeader("Loading", ImGuiTreeNodeFlags_DefaultOpen)) {
+                const auto progress = loader.progress();
+                ImGui::ProgressBar(progress.requestedBytes ? float(progress.completedBytes) / progress.requestedBytes : 1.f, ImVec2(-1, 0), (std::to_string(progress.completedBytes / 1024) + " / " + std::to_string(progress.requestedBytes / 1024) + " KB").c_str());
+                ImGui::Text("Meshes: %zu / %zu", readyMeshCount, sceneMeshCount);
+                ImGui::Text("Textures: %zu / %zu", textureStreamer.stats().textureCount, sceneTextureCount);
+                ImGui::Text("Requests: %zu / %zu", progress.completedCount, progress.requestedCount);
+                const auto uploadStats = uploader.stats();
+                ImGui::Text("Uploaded %zu KB, %zu KB queued%s", uploadStats.uploadedBytes / 1024, uploadStats.queuedBytes / 1024, uploader.hasWorker() ? "" : " (main thread)");
+                ImGui::Text("Staging ring waits: %zu", uploadStats.ringWaitCount);
+                if (firstMeshLatency >= 0) {
+                    ImGui::Text("First mesh after %.1f ms", 1000. * firstMeshLatency);
+                }
+                ImGui::Text("Request latency: %.1f ms mean, %.1f ms max", 1000. * progress.meanLatency, 1000. * progress.maxLatency);
+                if (streamingDone) {
+                    ImGui::Text("Loaded in %.2f s", streamingDuration);
+                }
+                else {
+                    ImGui::Text("Loading for %.2f s", glfwGetTime() - streamingStartTime);
+                }
+            }
+            if (ImGui::CollapsingHeader("Texture streaming")) {
+                const auto stats = textureStreamer.stats();
+                const auto toMB = [](size_t bytes) {
+                    return float(bytes) / float(1 << 20);
+                };
+                static int budgetMB = int(m_ViewerOptions.textureBudget >> 20);
+                if (ImGui::SliderInt("Budget (MB)", &budgetMB, 16, 8192)) {
+                    textureStreamer.setBudget(size_t(budgetMB) << 20);
+                }
+                ImGui::ProgressBar(stats.budgetBytes ? float(stats.residentBytes) / stats.budgetBytes : 0.f, ImVec2(-1, 0), (std::to_string(int(toMB(stats.residentBytes))) + " / " + std::to_string(int(toMB(stats.budgetBytes))) + " MB").c_str());
+                ImGui::Text("Needed by the view: %.1f MB", toMB(stats.requiredBytes));
+                ImGui::Text("At the needed level: %zu / %zu textures", stats.fullyResidentCount, stats.textureCount);
+                ImGui::Text("Pending level uploads: %zu", stats.pendingUploadCount);
+                ImGui::Text("Promotions: %llu", (unsigned long long)stats.promotionCount);
+                ImGui::Text("Evictions: %llu (%.1f MB)", (unsigned long long)stats.evictionCount, toMB(stats.evictedBytes));
+                // Decoded levels in host memory, the finer ones spilled to disk beyond the budget
+                const auto imageStats = textureStreamer.images().stats();
+                static int imageBudgetMB = int(m_ViewerOptions.imageBudget >> 20);
+                if (ImGui::SliderInt("Host budget (MB)", &imageBudgetMB, 64, 32768)) {
+                    textureStreamer.images().setBudget(size_t(imageBudgetMB) << 20);
+                }
+                ImGui::ProgressBar(imageStats.budgetBytes ? float(imageStats.residentBytes) / imageStats.budgetBytes : 0.f, ImVec2(-1, 0), (std::to_string(int(toMB(imageStats.residentBytes))) + " / " + std::to_string(int(toMB(imageStats.budgetBytes))) + " MB").c_str());
+                ImGui::Text("Spilled: %zu / %zu images, %.1f MB written", imageStats.spilledCount, imageStats.imageCount, toMB(imageStats.writtenBytes));
+                ImGui::Text("Read back: %llu (%.1f MB), %zu pending", (unsigned long long)imageStats.readCount, toMB(imageStats.readBytes), imageStats.pendingReadCount);
+            }
+            if (ImGui::CollapsingHeader("Rendering")) {
+                ImGui::Checkbox("Deferred shading", &deferredShading);
+                ImGui::Checkbox("Depth prepass", &depthPrepass);
+                ImGui::Checkbox("Front to back draws", &frontToBackDraws);
+                ImGui::Checkbox("Weighted blended transparency", &weightedBlendedOit);
+                ImGui::Checkbox("Count overdraw", &countOverdraw);
+                if (countOverdraw) {
+                    ImGui::Text("%.2f shaded fragments per pixel", overdraw);
+                }
+            }
+            if (ImGui::CollapsingHeader("Shaders", shaderErrors.empty() ? 0 : ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Text("%zu forward variants, %zu deferred, %zu reloads", forwardVariants.size(), deferredVariants.size(), shaderReloadCount);
+                ImGui::Text("Edits in %s are reloaded", shaderWatcher.directory().string().c_str());
+                if (ImGui::Button("Reload all")) {
+                    auto allShaders = forwardShaders;
+                    allShaders.insert(end(allShaders), begin(cubeShaders), end(cubeShaders));
+                    allShaders.insert(end(allShaders), begin(placeholderShaders), end(placeholderShaders));
+                    allShaders.insert(end(allShaders), begin(shadowShaders), end(shadowShaders));
+                    allShaders.insert(end(allShaders), begin(depthPrepassShaders), end(depthPrepassShaders));
+                    allShaders.insert(end(allShaders), begin(deferredShaders), end(deferredShaders));
+                    allShaders.insert(end(allShaders), begin(lightCullingShaders), end(lightCullingShaders));
+                    allShaders.insert(end(allShaders), begin(oitCompositeShaders), end(oitCompositeShaders));
+                    reloadShaders(allShaders);
+                }
+                for (const auto &error : shaderErrors) {
+                    ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s shaders kept, errors:", error.first.c_str());
+                    ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0.5f, 0.5f, 1));
+                    ImGui::TextWrapped("%s", error.second.c_str());
+                    ImGui::PopStyleColor();
+                }
+            }
             if (currentcam == 0) {
                 ImGui::Text("Current cam : Trackball");
             }
@@ -1033,6 +2456,16 @@ int ViewerApplication::run() {
                 }
                 // Ajout d'une boîte à cocher
                 ImGui::Checkbox("Light from camera", &lightFromCamera);
+                ImGui::Checkbox("Shadows", &shadowsEnabled);
+                if (shadowsEnabled) {
+                    ImGui::SliderInt("Shadow cascades", &shadowCascadeCount, 2, int(kMaxShadowCascadeCount));
+                }
+                if (hasEnvironment) {
+                    ImGui::TextColored(ImVec4(1, 1, 0, 1), "Environment");
+                    if (ImGui::SliderFloat("Environment intensity", &environmentIntensity, 0, 4)) {
+                        precEnvironmentIntensity = environmentIntensity;
+                    }
+                }
                 ImGui::TextColored(ImVec4(1, 1, 0, 1), "Cube");
                 static int cubetochange = 0;
                 ImGui::TextColored(ImVec4(1, 1, 1, 1), "Choose Cube : ");
@@ -1086,6 +2519,7 @@ int ViewerApplication::run() {
                 }
                 if (ImGui::SliderFloat("Dist attenuation spotligth", &NewspotligthtDistAttenuation, 0, 150)) {
                     spotligthtDistAttenuation = NewspotligthtDistAttenuation;
+                    spotligthAttenuation = getLightAttenuation(spotligthtDistAttenuation);
                 }
 
                 if (ImGui::Button("Spot light from Cursor / centered Spot light")) {
@@ -1111,6 +2545,8 @@ int ViewerApplication::run() {
                     }
                     prelightIntensity = lightIntensity;
                     lightIntensity = off;
+                    precEnvironmentIntensity = environmentIntensity;
+                    environmentIntensity = 0;
                 }
                 else if (buttonOn) {
                     for (auto i = 0; i < NbCube; i++) {
@@ -1119,6 +2555,7 @@ int ViewerApplication::run() {
                     }
                     spotligthIntensity = precSpotligthIntensity;
                     lightIntensity = prelightIntensity;
+                    environmentIntensity = precEnvironmentIntensity;
                 }
             }
 
@@ -1140,11 +2577,64 @@ int ViewerApplication::run() {
                     ImGui::TextColored(ImVec4(1, 0, 0, 1), "No normalTexture in the gltf file ");
                 }
             }
+            if (!animator.clips().empty() && ImGui::CollapsingHeader("Animation", ImGuiTreeNodeFlags_DefaultOpen)) {
+                static int currentClip = 0;
+                const auto clipCount = int(animator.clips().size());
+                // Last entry plays every clip at once
+                const auto clipName = [&](int clipIdx) {
+                    if (clipIdx == clipCount) {
+                        return std::string("All clips");
+                    }
+                    const auto &name = animator.clips()[clipIdx].name;
+                    return name.empty() ? "clip " + std::to_string(clipIdx) : name;
+                };
+                if (ImGui::BeginCombo("Clip", clipName(currentClip).c_str())) {
+                    for (int i = 0; i <= clipCount; ++i) {
+                        if (ImGui::Selectable(clipName(i).c_str(), i == currentClip)) {
+                            currentClip = i;
+                            std::vector<size_t> activeClips;
+                            for (int j = 0; j < clipCount; ++j) {
+                                if (j == currentClip || currentClip == clipCount) {
+                                    activeClips.push_back(j);
+                                }
+                            }
+                            animator.setActiveClips(activeClips);
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+                ImGui::Checkbox("Play", &playAnimation);
+                ImGui::SliderFloat("Speed", &animationSpeed, 0.f, 4.f);
+                auto duration = 0.f;
+                for (int j = 0; j < clipCount; ++j) {
+                    if (j == currentClip || currentClip == clipCount) {
+                        duration = std::max(duration, animator.clips()[j].duration);
+                    }
+                }
+                animationTime = duration > 0.f ? std::fmod(animationTime, duration) : 0.f;
+                if (ImGui::SliderFloat("Time", &animationTime, 0.f, duration)) {
+                    animator.sample(animationTime, sceneGraph);
+                    sceneGraph.updateWorldMatrices();
+                    updateJointMatrices();
+                }
+                ImGui::Text("%zu active channels", animator.activeChannelCount());
+            }
             ImGui::End();
+            if (showFrameProfiler) {
+                frameProfiler.drawGui(&showFrameProfiler);
+                if (!showFrameProfiler) {
+                    frameProfiler.setEnabled(globalTracer() != nullptr);
+                }
+            }
         }
         imguiRenderFrame();
+        frameProfiler.endScope();
+        frameProfiler.endFrame();
         glfwPollEvents(); // Poll for and process events
         auto ellapsedTime = glfwGetTime() - seconds;
+        if (playAnimation) {
+            animationTime += animationSpeed * float(ellapsedTime);
+        }
         auto guiHasFocus = ImGui::GetIO().WantCaptureMouse || ImGui::GetIO().WantCaptureKeyboard;
         if (!guiHasFocus) {
             cameraController->update(float(ellapsedTime));
@@ -1154,20 +2644,36 @@ int ViewerApplication::run() {
     // TODO clean up allocated GL data
     glDeleteBuffers(1, &vbocube);
     glDeleteVertexArrays(1, &vaocube);
-    for (auto &it : textureObjects) {
-        glDeleteTextures(1, &it);
-    }
     for (auto &it : bufferObjects) {
         glDeleteBuffers(1, &it);
     }
+    glDeleteBuffers(GLsizei(accessorBufferObjects.size()), accessorBufferObjects.data());
     for (auto &it : vertexArrayObjects) {
         glDeleteVertexArrays(1, &it);
     }
+    glDeleteVertexArrays(GLsizei(depthVertexArrayObjects.size()), depthVertexArrayObjects.data());
+    glDeleteBuffers(1, &overdrawCounterBuffer);
+    glDeleteBuffers(1, &jointMatricesBuffer);
+    glDeleteBuffers(1, &placeholderBuffer);
+    glDeleteBuffers(1, &lightsBuffer);
+    glDeleteTextures(1, &specularEnvironmentTexture);
+    glDeleteTextures(1, &brdfLutTexture);
+    glDeleteTextures(1, &shadowMapTexture);
+    glDeleteFramebuffers(1, &shadowFramebuffer);
+    deleteGBuffer(gbuffer);
+    deleteOitBuffer(oitBuffer);
+    glDeleteVertexArrays(1, &placeholderVao);
+    glDeleteBuffers(GLsizei(morphDeltaBuffers.size()), morphDeltaBuffers.data());
+    glDeleteTextures(GLsizei(morphDeltaTextures.size()), morphDeltaTextures.data());
+    for (const auto &it : cpuMorphs) {
+        glDeleteBuffers(1, &it.second.buffer);
+        glDeleteTextures(1, &it.second.texture);
+    }
     return 0;
 }
 
-ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height, const fs::path &gltfFile, const std::vector<float> &lookatArgs, const std::string &vertexShader, const std::string &fragmentShader, const fs::path &output)
-        : m_nWindowWidth(width), m_nWindowHeight(height), m_AppPath{appPath}, m_AppName{m_AppPath.stem().string()}, m_ImGuiIniFilename{m_AppName + ".imgui.ini"}, m_ShadersRootPath{m_AppPath.parent_path() / "shaders"}, m_gltfFilePath{gltfFile}, m_OutputPath{output} {
+ViewerApplication::ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height, const fs::path &gltfFile, const std::vector<float> &lookatArgs, const std::string &vertexShader, const std::string &fragmentShader, const fs::path &output, const LoadOptions &loadOptions, const ViewerOptions &viewerOptions, const BenchOptions &benchOptions)
+        : m_nWindowWidth(width), m_nWindowHeight(height), m_AppPath{appPath}, m_AppName{m_AppPath.stem().string()}, m_ImGuiIniFilename{m_AppName + ".imgui.ini"}, m_ShadersRootPath{m_AppPath.parent_path() / "shaders"}, m_gltfFilePath{gltfFile}, m_LoadOptions{loadOptions}, m_ViewerOptions{viewerOptions}, m_OutputPath{output}, m_BenchOptions{benchOptions} {
     if (!lookatArgs.empty()) {
         m_hasUserCamera = true;
         m_userCamera = Camera { glm::vec3(lookatArgs[0], lookatArgs[1], lookatArgs[2]), glm::vec3(lookatArgs[3], lookatArgs[4], lookatArgs[5]), glm::vec3(lookatArgs[6], lookatArgs[7], lookatArgs[8])};
@@ -3,14 +3,43 @@
 #include "utils/GLFWHandle.hpp"
 #include "utils/cameras.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/gltf.hpp"
+#include "utils/loadprofiler.hpp"
+#include "utils/renderbench.hpp"
 #include "utils/shaders.hpp"
 #include "Cube.hpp"
 #include <tiny_gltf.h> // TODO Loading the glTF file
 
+// Settings of the viewer, the glTF file itself being loaded with its
+// LoadOptions
+struct ViewerOptions {
+    // Equirectangular image lighting the scene, none if empty. See
+    // loadEnvironmentLighting().
+    std::string environment;
+    // Initial shading path, the deferred one rather than the forward one.
+    // Switchable in the GUI.
+    bool deferred = false;
+    // Initial depth prepass, also switchable in the GUI
+    bool depthPrepass = false;
+    // Samples per pixel of the multisampling of the window and of the output
+    // image, 0 for none
+    size_t samples = 4;
+    // The output image is rendered this many times larger in each dimension
+    // then downsampled, see renderToImageSupersampled()
+    size_t supersampling = 1;
+    // Bytes of texture levels kept on the GPU, see TextureStreamer
+    size_t textureBudget = size_t(512) << 20;
+    // Bytes of decoded texture levels kept in host memory, see ImageStore
+    size_t imageBudget = size_t(2048) << 20;
+    // Print the cost of the load and what it built on std::clog
+    bool verbose = false;
+};
+
 class ViewerApplication {
     public:
         ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height, const fs::path &gltfFile, const std::vector<float> &lookatArgs,
-                          const std::string &vertexShader, const std::string &fragmentShader, const fs::path &output);
+                          const std::string &vertexShader, const std::string &fragmentShader, const fs::path &output,
+                          const LoadOptions &loadOptions, const ViewerOptions &viewerOptions, const BenchOptions &benchOptions = {});
 
         int run();
 
@@ -21,15 +50,14 @@ class ViewerApplication {
             GLsizei count; // Number of elements in range
         };
 
-        bool loadGltfFile(tinygltf::Model &model);
-        std::vector<GLuint> createBufferObjects(const tinygltf::Model &model);
+        bool loadGltfFile(tinygltf::Model &model, GltfSources &sources, std::pmr::memory_resource *arena);
+        GLuint createBufferObject(const tinygltf::Buffer &buffer);
+        size_t createAccessorBufferObjects(const tinygltf::Model &model, const tinygltf::Mesh &mesh, const std::vector<GLuint> &bufferObjects, std::vector<GLuint> &accessorBufferObjects);
         std::vector<GLuint> createVertexArrayObjects(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshToVertexArrays);
-        std::vector<GLuint> createVertexArrayObjects_T_B(const tinygltf::Model &model, const std::vector<GLuint> &bufferObjects, std::vector<VaoRange> &meshToVertexArrays);
-        std::vector<GLuint> createTextureObjects(const tinygltf::Model &model) const;
+        void createVertexArrayObjects_T_B(const tinygltf::Model &model, const tinygltf::Mesh &mesh, const std::vector<GLuint> &bufferObjects, const std::vector<GLuint> &accessorBufferObjects, GLuint *vertexArrayObjects, LoadProfiler *profiler);
+        void createDepthVertexArrayObjects(const tinygltf::Model &model, const tinygltf::Mesh &mesh, const std::vector<GLuint> &bufferObjects, const std::vector<GLuint> &accessorBufferObjects, GLuint *vertexArrayObjects);
         GLuint initVbocube(GLsizei count_vertex,const std::vector<glimac::ShapeVertex> &vertices);
         GLuint initVaocube(const GLuint &vbo);
-        void setVec3(const GLProgram &prog,const std::string &name,const glm::vec3 &vec);
-        void setFloat(const GLProgram &prog,const std::string &name, float value);
 
         GLsizei m_nWindowWidth = 1280;
         GLsizei m_nWindowHeight = 720;
@@ -39,6 +67,8 @@ class ViewerApplication {
         const fs::path m_ShadersRootPath;
 
         fs::path m_gltfFilePath;
+        LoadOptions m_LoadOptions;
+        ViewerOptions m_ViewerOptions;
         std::string m_vertexShader = "forward.vs.glsl";
         std::string m_vertexShader_cube = "shad3Dcube.vs.glsl";
         std::string m_fragmentShader = "pbr_directional_light.fs.glsl";
@@ -48,11 +78,12 @@ class ViewerApplication {
         Camera m_userCamera;
 
         fs::path m_OutputPath;
+        BenchOptions m_BenchOptions;
 
         // Order is important here, see comment below
         const std::string m_ImGuiIniFilename;
         // Last to be initialized, first to be destroyed:
-        GLFWHandle m_GLFWHandle { int(m_nWindowWidth), int(m_nWindowHeight), "glTF Viewer", m_OutputPath.empty() }; // show the window only if m_OutputPath is empty
+        GLFWHandle m_GLFWHandle { int(m_nWindowWidth), int(m_nWindowHeight), "glTF Viewer", m_OutputPath.empty() && m_BenchOptions.frameCount == 0, int(m_ViewerOptions.samples) }; // show the window only if m_OutputPath is empty and not benchmarking
         /*
         ! THE ORDER OF DECLARATION OF MEMBER VARIABLES IS IMPORTANT !
         - m_ImGuiIniFilename.c_str() will be used by ImGUI in ImGui::Shutdown, which
@@ -0,0 +1,270 @@
+// Micro-benchmarks of the CPU geometry kernels of the viewer, without GL
+// context: each kernel runs on synthetic data at several sizes, then on the
+// glTF files given on the command line, and its best time is printed with
+// its throughput per element. The prefiltering of the environments is
+// measured along, on all the hardware threads.
+
+#include "../utils/gltf.hpp"
+#include "../utils/environment.hpp"
+#include "../utils/images.hpp"
+
+#include <args.hxx>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+    // Results are accumulated here so that the kernels are not optimized out
+    volatile float g_Sink = 0.f;
+
+    double g_MinSeconds = 0.2; // Per measure
+
+    // Best time of repeated calls of kernel, run for at least g_MinSeconds
+    template <typename Kernel>
+    void measure(const std::string &label, const char *elementName, size_t elementCount, Kernel &&kernel) {
+        using clock = std::chrono::steady_clock;
+        kernel(); // Warm the caches and the allocator
+        double bestSeconds = std::numeric_limits<double>::max();
+        double totalSeconds = 0.;
+        size_t runCount = 0;
+        while (runCount < 3 || totalSeconds < g_MinSeconds) {
+            const auto start = clock::now();
+            kernel();
+            const auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+            bestSeconds = std::min(bestSeconds, seconds);
+            totalSeconds += seconds;
+            ++runCount;
+        }
+        std::cout << std::fixed << "  " << std::left << std::setw(48) << label << std::right << std::setw(10) << elementCount << " "
+                  << std::left << std::setw(9) << elementName << std::right << std::setprecision(3) << std::setw(10) << 1e3 * bestSeconds
+                  << " ms" << std::setprecision(2) << std::setw(10) << 1e9 * bestSeconds / double(std::max(elementCount, size_t(1)))
+                  << " ns/" << elementName << std::setw(10) << 1e-6 * double(elementCount) / bestSeconds << " M/s" << std::endl;
+    }
+
+    template <typename T>
+    int appendBufferView(tinygltf::Model &model, const std::vector<T> &values) {
+        auto &data = model.buffers[0].data;
+        tinygltf::BufferView bufferView;
+        bufferView.buffer = 0;
+        bufferView.byteOffset = data.size();
+        bufferView.byteLength = values.size() * sizeof(T);
+        data.resize(data.size() + bufferView.byteLength);
+        std::memcpy(data.data() + bufferView.byteOffset, values.data(), bufferView.byteLength);
+        model.bufferViews.push_back(bufferView);
+        return int(model.bufferViews.size() - 1);
+    }
+
+    int appendAccessor(tinygltf::Model &model, int bufferView, int componentType, int type, size_t count) {
+        tinygltf::Accessor accessor;
+        accessor.bufferView = bufferView;
+        accessor.componentType = componentType;
+        accessor.type = type;
+        accessor.count = count;
+        model.accessors.push_back(accessor);
+        return int(model.accessors.size() - 1);
+    }
+
+    // A gridSize x gridSize vertices grid, with texture coordinates and
+    // triangle indices, instanced by nodeCount root nodes with a TRS each
+    tinygltf::Model makeGridModel(size_t gridSize, size_t nodeCount) {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texCoords;
+        std::vector<uint32_t> indices;
+        for (size_t y = 0; y < gridSize; ++y) {
+            for (size_t x = 0; x < gridSize; ++x) {
+                const auto u = float(x) / float(gridSize - 1), v = float(y) / float(gridSize - 1);
+                positions.emplace_back(u, v, 0.1f * std::sin(10.f * u) * std::cos(10.f * v));
+                texCoords.emplace_back(u, v);
+                if (x + 1 < gridSize && y + 1 < gridSize) {
+                    const auto i = uint32_t(y * gridSize + x);
+                    const auto row = uint32_t(gridSize);
+                    indices.insert(end(indices), {i, i + 1, i + row, i + 1, i + row + 1, i + row});
+                }
+            }
+        }
+
+        tinygltf::Model model;
+        model.buffers.resize(1);
+        tinygltf::Primitive primitive;
+        primitive.mode = TINYGLTF_MODE_TRIANGLES;
+        primitive.attributes["POSITION"] = appendAccessor(model, appendBufferView(model, positions), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, positions.size());
+        primitive.attributes["TEXCOORD_0"] = appendAccessor(model, appendBufferView(model, texCoords), TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, texCoords.size());
+        primitive.indices = appendAccessor(model, appendBufferView(model, indices), TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, indices.size());
+        model.meshes.resize(1);
+        model.meshes[0].primitives.push_back(primitive);
+
+        model.scenes.resize(1);
+        for (size_t i = 0; i < nodeCount; ++i) {
+            tinygltf::Node node;
+            node.mesh = 0;
+            node.translation = {double(i % 32), double(i / 32 % 32), double(i / 1024)};
+            node.rotation = {0., std::sin(0.01 * double(i)), 0., std::cos(0.01 * double(i))};
+            // Alternated so that the chains of benchLocalToWorld() stay finite
+            node.scale = {1., i % 2 ? 1.001 : 1. / 1.001, 1.};
+            model.nodes.push_back(node);
+            model.scenes[0].nodes.push_back(int(i));
+        }
+        model.defaultScene = 0;
+        return model;
+    }
+
+    // Vertices computeSceneBounds() reads, through the indices if any
+    size_t getSceneVertexCount(const tinygltf::Model &model) {
+        size_t count = 0;
+        for (const auto &node : model.nodes) {
+            if (node.mesh < 0) {
+                continue;
+            }
+            for (const auto &primitive : model.meshes[node.mesh].primitives) {
+                const auto it = primitive.attributes.find("POSITION");
+                if (it != end(primitive.attributes)) {
+                    count += primitive.indices >= 0 ? model.accessors[primitive.indices].count : model.accessors[it->second].count;
+                }
+            }
+        }
+        return count;
+    }
+
+    void benchSceneBounds(const std::string &label, const tinygltf::Model &model) {
+        measure("computeSceneBounds " + label, "vertex", getSceneVertexCount(model), [&]() {
+            glm::vec3 bboxMin, bboxMax;
+            computeSceneBounds(model, bboxMin, bboxMax);
+            g_Sink = g_Sink + bboxMax.x - bboxMin.x;
+        });
+    }
+
+    void benchTangents(const std::string &label, const tinygltf::Model &model) {
+        size_t vertexCount = 0;
+        for (const auto &mesh : model.meshes) {
+            for (const auto &primitive : mesh.primitives) {
+                const auto it = primitive.attributes.find("POSITION");
+                if (it != end(primitive.attributes) && primitive.attributes.count("TEXCOORD_0") && primitive.mode == TINYGLTF_MODE_TRIANGLES) {
+                    vertexCount += model.accessors[it->second].count;
+                }
+            }
+        }
+        if (vertexCount == 0) {
+            return; // Nothing to compute the tangents of
+        }
+        measure("computeTangent " + label, "vertex", vertexCount, [&]() {
+            for (const auto &mesh : model.meshes) {
+                for (const auto &primitive : mesh.primitives) {
+                    const auto tangents = computeTangent(model, primitive);
+                    if (!tangents.empty()) {
+                        g_Sink = g_Sink + tangents.back().x;
+                    }
+                }
+            }
+        });
+    }
+
+    // A chain of nodeCount nodes, each the child of the previous one
+    void benchLocalToWorld(const std::string &label, const std::vector<tinygltf::Node> &nodes) {
+        measure("getLocalToWorldMatrix " + label, "node", nodes.size(), [&]() {
+            glm::mat4 matrix(1);
+            for (const auto &node : nodes) {
+                matrix = getLocalToWorldMatrix(node, matrix);
+            }
+            g_Sink = g_Sink + matrix[3][0];
+        });
+    }
+
+    template <typename ComponentType>
+    void benchFlipImage(const char *typeName, size_t size, size_t componentCount) {
+        std::vector<ComponentType> pixels(size * size * componentCount, ComponentType(1));
+        const auto label = "flipImageYAxis " + std::to_string(size) + "x" + std::to_string(size) + "x" + std::to_string(componentCount) + " " + typeName;
+        measure(label, "pixel", size * size, [&]() {
+            flipImageYAxis(size, size, componentCount, pixels.data());
+            g_Sink = g_Sink + float(pixels[0]);
+        });
+    }
+
+    // A sky gradient with a small bright sun, the worst case of the
+    // prefiltering of the specular levels
+    void benchPrefilterEnvironment(size_t width, size_t height) {
+        std::vector<float> pixels(width * height * 3);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                auto *pixel = &pixels[3 * (y * width + x)];
+                const auto t = float(y) / float(height);
+                const bool sun = x * 64 / width == 20 && y * 32 / height == 8;
+                pixel[0] = sun ? 1000.f : 0.2f + t;
+                pixel[1] = sun ? 1000.f : 0.5f;
+                pixel[2] = sun ? 1000.f : 1.f - t;
+            }
+        }
+        auto &pool = globalThreadPool();
+        const auto label = "prefilterEnvironment " + std::to_string(width) + "x" + std::to_string(height) + " " +
+                           std::to_string(pool.threadCount()) + " threads";
+        measure(label, "pixel", width * height, [&]() {
+            const auto lighting = prefilterEnvironment(pixels.data(), width, height, pool);
+            g_Sink = g_Sink + lighting.irradianceSH[0].x;
+        });
+    }
+}
+
+int main(int argc, char **argv) {
+    args::ArgumentParser parser {"Micro-benchmarks of the CPU geometry kernels of the glTF viewer."};
+    args::HelpFlag help {parser, "help", "Display this help menu", {'h', "help"}};
+    args::PositionalList<std::string> files {parser, "files", "glTF files whose scenes are also measured"};
+    args::ValueFlag<double> minTime {parser, "seconds", "Minimum time of each measure (default 0.2)", {"min-time"}};
+    try {
+        parser.ParseCLI(argc, argv);
+    } catch (const args::Help &) {
+        std::cout << parser;
+        return 0;
+    } catch (const args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+    if (minTime) {
+        g_MinSeconds = args::get(minTime);
+    }
+
+    std::cout << "Synthetic data (best time of each kernel):" << std::endl;
+    for (const auto gridSize : {16, 128, 1024}) {
+        const auto model = makeGridModel(gridSize, 1);
+        benchTangents(std::to_string(gridSize) + "x" + std::to_string(gridSize) + " grid", model);
+    }
+    for (const auto nodeCount : {1, 64, 4096}) {
+        const auto model = makeGridModel(32, nodeCount);
+        benchSceneBounds(std::to_string(nodeCount) + " nodes of a 32x32 grid", model);
+    }
+    for (const auto nodeCount : {16, 1024, 65536}) {
+        const auto model = makeGridModel(2, nodeCount);
+        benchLocalToWorld(std::to_string(nodeCount) + " TRS nodes", model.nodes);
+        auto matrixNodes = model.nodes;
+        for (auto &node : matrixNodes) {
+            node.matrix = {1., 0., 0., 0., 0., 1., 0., 0., 0., 0., 1., 0., node.translation[0], node.translation[1], node.translation[2], 1.};
+        }
+        benchLocalToWorld(std::to_string(nodeCount) + " matrix nodes", matrixNodes);
+    }
+    for (const auto size : {256, 1024, 4096}) {
+        benchFlipImage<unsigned char>("u8", size, 3);
+        benchFlipImage<float>("f32", size, 4);
+    }
+    benchPrefilterEnvironment(512, 256);
+    benchPrefilterEnvironment(2048, 1024);
+
+    for (const auto &file : args::get(files)) {
+        tinygltf::Model model;
+        if (!loadGltfFile(file, model)) {
+            return 1;
+        }
+        std::cout << file << ":" << std::endl;
+        benchSceneBounds("scene", model);
+        benchTangents("meshes", model);
+        std::vector<tinygltf::Node> nodes = model.nodes;
+        benchLocalToWorld("nodes", nodes);
+    }
+    std::cerr << "Checksum " << g_Sink << std::endl;
+    return 0;
+}
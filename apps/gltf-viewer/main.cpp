@@ -1,6 +1,10 @@
+#include "AnimationBenchmark.hpp"
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/images.hpp"
+#include "utils/renderbench.hpp"
+#include "utils/trace.hpp"
 
 #include <args.hxx>
 
@@ -41,6 +45,32 @@ int main(int argc, char **argv) {
                                         "Output path to render the image. If specified no window is shown. "
                                         "Only png is supported.",
                                         {"o", "output"}};
+                                    args::ValueFlag<std::string> scene{parser, "scene",
+                                        "Index or name of the scene to load (default scene if omitted)", {"scene"}};
+                                    args::ValueFlag<std::string> node{parser, "node",
+                                        "Name of a node to load alone with its subtree", {"node"}};
+                                    args::Flag keepCpuData{parser, "keep-cpu-data",
+                                        "Keep the buffers and images in memory after their upload to the GPU", {"keep-cpu-data"}};
+                                    args::ValueFlag<std::string> loadReport{parser, "file.json",
+                                        "Write the time, CPU time, memory and bytes of each load phase to a JSON file", {"load-report"}};
+                                    args::ValueFlag<std::string> trace{parser, "out.json",
+                                        "Record the load phases, the frames and the GPU times of all threads to a Chrome trace (F12 writes it while running)", {"trace"}};
+                                    args::ValueFlag<size_t> textureBudget{parser, "MB",
+                                        "GPU memory for the texture levels, in MB (default 512)", {"texture-budget"}};
+                                    args::ValueFlag<size_t> imageBudget{parser, "MB",
+                                        "Host memory for the decoded texture levels, in MB (default 2048). The finer levels beyond it are spilled to the cache directory", {"image-budget"}};
+                                    args::ValueFlag<std::string> environment{parser, "file.hdr",
+                                        "Equirectangular image lighting the scene, prefiltered once then read from the cache", {"environment"}};
+                                    args::Flag deferred{parser, "deferred",
+                                        "Shade in a G-buffer pass then once per pixel with the lights culled per tile", {"deferred"}};
+                                    args::Flag depthPrepass{parser, "depth-prepass",
+                                        "Draw the depth of the opaque primitives first, then shade each pixel once", {"depth-prepass"}};
+                                    args::ValueFlag<size_t> samples{parser, "samples",
+                                        "Samples per pixel of the multisampling of the window and of the output image (default 4, 0 disables it)", {"samples"}};
+                                    args::ValueFlag<size_t> supersampling{parser, "factor",
+                                        "Render the output image factor times larger in each dimension, in tiles, then downsample it (default 1, at most 16)", {"supersampling"}};
+                                    args::Flag verbose{parser, "verbose",
+                                        "Print the time and memory of each load phase and what the load built", {"verbose"}};
                                     parser.Parse();
 
                                     std::vector<float> lookatParams;
@@ -60,12 +90,118 @@ int main(int argc, char **argv) {
                                     uint32_t width = imageWidth ? args::get(imageWidth) : 1280;
                                     uint32_t height = imageHeight ? args::get(imageHeight) : 720;
 
+                                    LoadOptions loadOptions;
+                                    loadOptions.scene = args::get(scene);
+                                    loadOptions.node = args::get(node);
+                                    loadOptions.keepCpuData = keepCpuData;
+                                    loadOptions.reportPath = args::get(loadReport);
+
+                                    ViewerOptions viewerOptions;
+                                    viewerOptions.environment = args::get(environment);
+                                    viewerOptions.deferred = deferred;
+                                    viewerOptions.depthPrepass = depthPrepass;
+                                    viewerOptions.samples = samples ? args::get(samples) : 4;
+                                    viewerOptions.supersampling = supersampling ? args::get(supersampling) : 1;
+                                    viewerOptions.textureBudget = (textureBudget ? args::get(textureBudget) : 512) << 20;
+                                    viewerOptions.imageBudget = (imageBudget ? args::get(imageBudget) : 2048) << 20;
+                                    viewerOptions.verbose = verbose;
+                                    if (viewerOptions.supersampling < 1 || viewerOptions.supersampling > kMaxSupersamplingFactor) {
+                                        throw args::ValidationError("--supersampling must be between 1 and " + std::to_string(kMaxSupersamplingFactor));
+                                    }
+
+                                    if (trace && !startTracing(args::get(trace))) {
+                                        returnCode = 1;
+                                        return;
+                                    }
                                     ViewerApplication app{fs::path{argv[0]}, width, height, args::get(file),
                                         lookatParams, args::get(vertexShader), args::get(fragmentShader),
-                                        args::get(output)};
+                                        args::get(output), loadOptions, viewerOptions};
                                     returnCode = app.run();
+                                    stopTracing();
         }
     };
+    args::Command bench {commands, "bench", "Render frames offscreen along a camera path and report their times as JSON",
+                          [&](args::Subparser &parser) {
+                              args::Positional<std::string> file {
+                                  parser, "file", "Path to file", args::Options::Required};
+                              args::ValueFlag<std::string> cameraPath {parser, "path.txt",
+                                  "Camera keyframes, one per line in the format of --lookat (as copied by the viewer). "
+                                  "The camera orbits the scene if omitted", {"camera-path"}};
+                              args::ValueFlag<size_t> frames {parser, "frames", "Number of measured frames (default 300)",
+                                  {"frames"}};
+                              args::ValueFlag<size_t> warmup {parser, "frames", "Number of frames rendered before measuring (default 30)",
+                                  {"warmup"}};
+                              args::ValueFlag<int32_t> imageWidth{parser, "width", "Width of the frames (default 1280)",
+                                  {"w", "width"}};
+                              args::ValueFlag<int32_t> imageHeight{parser, "height", "Height of the frames (default 720)",
+                                  {"h", "height"}};
+                              args::ValueFlag<std::string> output{parser, "file.json",
+                                  "Write the report to a file rather than to the standard output", {"o", "output"}};
+                              args::ValueFlag<std::string> scene{parser, "scene",
+                                  "Index or name of the scene to load (default scene if omitted)", {"scene"}};
+                              args::ValueFlag<std::string> node{parser, "node",
+                                  "Name of a node to load alone with its subtree", {"node"}};
+                              args::ValueFlag<size_t> textureBudget{parser, "MB",
+                                  "GPU memory for the texture levels, in MB (default 512)", {"texture-budget"}};
+                              args::ValueFlag<size_t> imageBudget{parser, "MB",
+                                  "Host memory for the decoded texture levels, in MB (default 2048). The finer levels beyond it are spilled to the cache directory", {"image-budget"}};
+                              args::ValueFlag<std::string> environment{parser, "file.hdr",
+                                  "Equirectangular image lighting the scene, prefiltered once then read from the cache", {"environment"}};
+                              args::Flag deferred{parser, "deferred",
+                                  "Shade in a G-buffer pass then once per pixel with the lights culled per tile", {"deferred"}};
+                              args::Flag depthPrepass{parser, "depth-prepass",
+                                  "Draw the depth of the opaque primitives first, then shade each pixel once", {"depth-prepass"}};
+                              args::Flag verbose{parser, "verbose",
+                                  "Print the time and memory of each load phase and what the load built", {"verbose"}};
+                              parser.Parse();
+
+                              BenchOptions benchOptions;
+                              benchOptions.frameCount = frames ? std::max(args::get(frames), size_t(1)) : 300;
+                              benchOptions.warmupFrameCount = warmup ? args::get(warmup) : 30;
+                              benchOptions.reportPath = args::get(output);
+                              if (cameraPath) {
+                                  std::string error;
+                                  if (!loadCameraPath(args::get(cameraPath), benchOptions.keyframes, error)) {
+                                      throw args::ValidationError(error);
+                                  }
+                              }
+
+                              LoadOptions loadOptions;
+                              loadOptions.scene = args::get(scene);
+                              loadOptions.node = args::get(node);
+
+                              ViewerOptions viewerOptions;
+                              viewerOptions.environment = args::get(environment);
+                              viewerOptions.deferred = deferred;
+                              viewerOptions.depthPrepass = depthPrepass;
+                              viewerOptions.textureBudget = (textureBudget ? args::get(textureBudget) : 512) << 20;
+                              viewerOptions.imageBudget = (imageBudget ? args::get(imageBudget) : 2048) << 20;
+                              viewerOptions.verbose = verbose;
+
+                              // No window is shown, but GLFW still needs a display: headless machines can run it
+                              // under xvfb-run, Mesa rendering with llvmpipe
+                              ViewerApplication app{fs::path{argv[0]}, imageWidth ? uint32_t(args::get(imageWidth)) : 1280u,
+                                  imageHeight ? uint32_t(args::get(imageHeight)) : 720u, args::get(file), {}, "", "", "",
+                                  loadOptions, viewerOptions, benchOptions};
+                              returnCode = app.run();
+                          }
+    };
+    args::Command animationBench {commands, "animation-bench", "Benchmark animation sampling without GL context",
+                                  [&](args::Subparser &parser) {
+                                      args::Positional<std::string> file {parser, "file",
+                                          "Path to an animated glTF file. Synthetic clips are used if omitted"};
+                                      args::ValueFlag<size_t> clips {parser, "clips", "Number of clips to play (default 1000)",
+                                          {"clips"}};
+                                      args::ValueFlag<size_t> frames {parser, "frames", "Number of frames to sample (default 600)",
+                                          {"frames"}};
+                                      args::ValueFlag<size_t> threads {parser, "threads",
+                                          "Number of worker threads (default one per hardware thread)", {"threads"}};
+                                      parser.Parse();
+
+                                      returnCode = runAnimationBenchmark(args::get(file), clips ? args::get(clips) : 1000,
+                                          frames ? args::get(frames) : 600, args::get(threads));
+                                  }
+    };
 
     try {
         parser.ParseCLI(argc, argv);
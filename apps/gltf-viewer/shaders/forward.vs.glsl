@@ -1,9 +1,11 @@
-#version 330
+#version 430
 
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
 layout(location = 3) in vec4 aTangent;
+layout(location = 4) in uvec4 aJoints;
+layout(location = 5) in vec4 aWeights;
 
 out vec3 vViewSpacePosition;
 out vec3 vViewSpaceNormal;
@@ -14,14 +16,85 @@ uniform mat4 uModelViewProjMatrix;
 uniform mat4 uModelViewMatrix;
 uniform mat4 uNormalMatrix;
 
+// The depth prepass and the draws after it compute the same depths, tested
+// for equality
+invariant gl_Position;
+
+#ifdef SHADOW_PASS
+// Compiled with shadow.gs.glsl to render the cascades of the shadow map, see
+// utils/shadows.hpp. uModelViewMatrix is the model matrix, and instance i is
+// drawn in cascade uFirstCascade + i.
+#define MAX_SHADOW_CASCADES 4
+uniform mat4 uCascadeViewProjMatrices[MAX_SHADOW_CASCADES];
+uniform int uFirstCascade;
+flat out int vCascade;
+#endif
+
+// Joint matrices of all skins, premultiplied by their inverse bind matrix
+layout(std430, binding = 0) readonly buffer JointMatrices {
+    mat4 uJointMatrices[];
+};
+uniform int uJointOffset; // First joint of the skin of the mesh, -1 if not skinned
+
+// Morph target deltas, see MorphTargets in utils/morphing.hpp:
+// texel (target * vertexCount + vertex) * attributeCount + slot
+#define MAX_GPU_MORPH_TARGETS 8
+uniform samplerBuffer uMorphDeltas;
+uniform int uMorphTargetCount; // Number of active targets, 0 if not morphed
+uniform int uMorphTargets[MAX_GPU_MORPH_TARGETS];
+uniform float uMorphWeights[MAX_GPU_MORPH_TARGETS];
+uniform int uMorphVertexCount;
+uniform int uMorphAttributeCount;
+uniform ivec3 uMorphSlots; // Slots of position, normal and tangent deltas, -1 if not morphed
+
+vec3 morphDelta(int slot) {
+    vec3 delta = vec3(0);
+    if (slot < 0) {
+        return delta;
+    }
+    for (int i = 0; i < uMorphTargetCount; ++i) {
+        int texel = (uMorphTargets[i] * uMorphVertexCount + gl_VertexID) * uMorphAttributeCount + slot;
+        delta += uMorphWeights[i] * texelFetch(uMorphDeltas, texel).xyz;
+    }
+    return delta;
+}
+
 void main() {
-    vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-	vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+    vec4 position = vec4(aPosition, 1);
+    vec4 normal = vec4(aNormal, 0);
+    vec4 tangent = vec4(aTangent.xyz, 0);
+    if (uMorphTargetCount > 0) {
+        position.xyz += morphDelta(uMorphSlots.x);
+        normal.xyz += morphDelta(uMorphSlots.y);
+        tangent.xyz += morphDelta(uMorphSlots.z);
+    }
+    if (uJointOffset >= 0) {
+        mat4 skinMatrix = aWeights.x * uJointMatrices[uJointOffset + aJoints.x]
+                        + aWeights.y * uJointMatrices[uJointOffset + aJoints.y]
+                        + aWeights.z * uJointMatrices[uJointOffset + aJoints.z]
+                        + aWeights.w * uJointMatrices[uJointOffset + aJoints.w];
+        position = skinMatrix * position;
+        normal = skinMatrix * normal;
+        tangent = skinMatrix * tangent;
+    }
+
+#ifdef DEPTH_PREPASS
+    // Drawn with the position stream alone, see createDepthVertexArrayObjects()
+    gl_Position = uModelViewProjMatrix * position;
+    return;
+#endif
+#ifdef SHADOW_PASS
+    vCascade = uFirstCascade + gl_InstanceID;
+    gl_Position = uCascadeViewProjMatrices[vCascade] * uModelViewMatrix * position;
+    return;
+#endif
+    vViewSpacePosition = vec3(uModelViewMatrix * position);
+	vViewSpaceNormal = normalize(vec3(uNormalMatrix * normal));
 
-    vec4 vViewSpaceTangent = normalize(uNormalMatrix * aTangent);
+    vec4 vViewSpaceTangent = normalize(uNormalMatrix * vec4(tangent.xyz, aTangent.w));
     vViewSpaceTangent =  normalize(vViewSpaceTangent - dot(vViewSpaceTangent, vec4(vViewSpaceNormal, 0)) * vec4(vViewSpaceNormal, 0));
     vec3 B = cross(vViewSpaceNormal, vViewSpaceTangent.xyz) * vViewSpaceTangent.w;
     TBN = transpose(mat3(vViewSpaceTangent.xyz, B, vViewSpaceNormal)); // TBN inverse matrix
 	vTexCoords = aTexCoords;
-    gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
+    gl_Position =  uModelViewProjMatrix * position;
 }
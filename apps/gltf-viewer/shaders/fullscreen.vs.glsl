@@ -0,0 +1,8 @@
+#version 430
+
+// A triangle covering the screen, drawn without attributes: 3 vertices at
+// (-1, -1), (3, -1) and (-1, 3)
+void main() {
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2 - 1, 0, 1);
+}
@@ -0,0 +1,110 @@
+#version 430
+
+// Lights of each tile of the deferred path, see utils/gbuffer.hpp: a
+// workgroup per tile finds the depth range of its pixels in the G-buffer,
+// then tests the spheres of influence of the lights against the frustum of
+// the tile, a light per thread.
+#define LIGHT_TILE_SIZE 16
+layout(local_size_x = LIGHT_TILE_SIZE, local_size_y = LIGHT_TILE_SIZE) in;
+
+uniform sampler2D uGBufferDepth;
+uniform mat4 uInverseProjMatrix;
+uniform int uPointLightCount;
+uniform bool uHasSpotLight;
+
+// The beginning of the Lights block of pbr_directional_light.fs.glsl, the
+// radius of a light is in attenuation.z
+#define MAX_POINT_LIGHTS 4
+struct PointLight {
+    vec4 position;
+    vec4 intensity;
+    vec4 attenuation;
+};
+
+struct SpotLight {
+    vec4 position;
+    vec4 intensity;
+    vec4 direction;
+    vec4 cone;
+    vec4 attenuation;
+};
+
+layout(std140, binding = 0) uniform Lights {
+    vec4 uLightDirection;
+    vec4 uLightIntensity;
+    PointLight uPointLights[MAX_POINT_LIGHTS];
+    SpotLight uSpotLight;
+};
+
+layout(std430, binding = 2) writeonly buffer TileLights {
+    uint uTileLightMasks[];
+};
+
+// Depths are positive so their bits sort like them
+shared uint sMinDepth;
+shared uint sMaxDepth;
+shared uint sLightMask;
+
+vec3 getViewSpacePosition(vec2 uv, float depth) {
+    vec4 position = uInverseProjMatrix * vec4(vec3(uv, depth) * 2 - 1, 1);
+    return position.xyz / position.w;
+}
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) {
+        sMinDepth = 0xFFFFFFFFu;
+        sMaxDepth = 0u;
+        sLightMask = 0u;
+    }
+    barrier();
+
+    ivec2 size = textureSize(uGBufferDepth, 0);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (all(lessThan(pixel, size))) {
+        float depth = texelFetch(uGBufferDepth, pixel, 0).r;
+        if (depth < 1) {
+            atomicMin(sMinDepth, floatBitsToUint(depth));
+            atomicMax(sMaxDepth, floatBitsToUint(depth));
+        }
+    }
+    barrier();
+
+    // Nothing to shade in the tile otherwise
+    if (sMinDepth <= sMaxDepth) {
+        // Planes of the frustum of the tile through the eye, their normals
+        // inside, from the corners of the tile on the far plane
+        vec2 tileMin = vec2(gl_WorkGroupID.xy * LIGHT_TILE_SIZE) / vec2(size);
+        vec2 tileMax = vec2((gl_WorkGroupID.xy + 1) * LIGHT_TILE_SIZE) / vec2(size);
+        vec3 corners[4] = vec3[4](
+            getViewSpacePosition(tileMin, 1),
+            getViewSpacePosition(vec2(tileMax.x, tileMin.y), 1),
+            getViewSpacePosition(tileMax, 1),
+            getViewSpacePosition(vec2(tileMin.x, tileMax.y), 1));
+        vec3 planes[4];
+        for (int i = 0; i < 4; ++i) {
+            planes[i] = normalize(cross(corners[(i + 1) % 4], corners[i]));
+        }
+        float nearDistance = -getViewSpacePosition(tileMin, uintBitsToFloat(sMinDepth)).z;
+        float farDistance = -getViewSpacePosition(tileMin, uintBitsToFloat(sMaxDepth)).z;
+
+        int lightCount = uPointLightCount + (uHasSpotLight ? 1 : 0);
+        for (int i = int(gl_LocalInvocationIndex); i < lightCount; i += LIGHT_TILE_SIZE * LIGHT_TILE_SIZE) {
+            // The spot light is culled as a point light
+            bool isSpot = i == uPointLightCount;
+            vec3 center = isSpot ? uSpotLight.position.xyz : uPointLights[i].position.xyz;
+            float radius = isSpot ? uSpotLight.attenuation.z : uPointLights[i].attenuation.z;
+            bool inside = -center.z + radius >= nearDistance && -center.z - radius <= farDistance;
+            for (int p = 0; p < 4 && inside; ++p) {
+                inside = dot(planes[p], center) >= -radius;
+            }
+            if (inside) {
+                atomicOr(sLightMask, 1u << (isSpot ? MAX_POINT_LIGHTS : i));
+            }
+        }
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0) {
+        uTileLightMasks[gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x] = sLightMask;
+    }
+}
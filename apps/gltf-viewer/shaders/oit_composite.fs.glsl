@@ -0,0 +1,24 @@
+#version 430
+
+// Average color of the blended draws accumulated in the targets of the
+// weighted blended transparency, see utils/transparency.hpp. Blended over the
+// frame with (ONE_MINUS_SRC_ALPHA, SRC_ALPHA): the frame shows through by the
+// product of the transmittances.
+uniform sampler2D uAccumulation;
+uniform sampler2D uRevealage;
+
+out vec4 fColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(uRevealage, pixel, 0).r;
+    if (revealage == 1) {
+        discard; // No blended draw
+    }
+    vec4 accumulation = texelFetch(uAccumulation, pixel, 0);
+    // The half floats can overflow under many layers
+    if (isinf(max(max(accumulation.r, accumulation.g), accumulation.b))) {
+        accumulation.rgb = vec3(accumulation.a);
+    }
+    fColor = vec4(accumulation.rgb / max(accumulation.a, 1e-5), revealage);
+}
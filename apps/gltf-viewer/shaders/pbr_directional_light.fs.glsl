@@ -1,12 +1,59 @@
-#version 330
+#version 430
+
+// Variant of the shader, see utils/shadervariants.hpp: the features below are
+// compiled in by the #defines inserted after #version
+// HAS_BASE_COLOR_TEXTURE, HAS_METALLIC_ROUGHNESS_TEXTURE, HAS_NORMAL_TEXTURE:
+//   textures of the material, their factors alone otherwise
+// HAS_EMISSIVE: non zero emissive factor, HAS_EMISSIVE_TEXTURE: with a texture
+// ALPHA_MASK: fragments below uAlphaCutoff are discarded
+// ALPHA_BLEND: blended over the frame by the alpha of the base color
+// WEIGHTED_BLENDED_OIT: with ALPHA_BLEND, accumulated in the targets of
+//   utils/transparency.hpp in any order
+// HAS_DIRECTIONAL_LIGHT, HAS_SPOT_LIGHT, POINT_LIGHT_COUNT: lights of the scene
+// HAS_IMAGE_BASED_LIGHTING: lighting of the environment, see utils/environment.hpp
+// HAS_SHADOWS: cascaded shadow maps of the directional light, see utils/shadows.hpp
+// GBUFFER_PASS: the material is written to the G-buffer rather than shaded,
+//   see utils/gbuffer.hpp
+// DEFERRED_SHADING: drawn over the screen by fullscreen.vs.glsl, shades the
+//   material of the G-buffer with the lights of the tile of the pixel
+// COUNT_OVERDRAW: counts the fragments shaded, for the overdraw of the frame
+#ifndef POINT_LIGHT_COUNT
+#define POINT_LIGHT_COUNT 4
+#endif
+
+#ifdef DEFERRED_SHADING
+// Of the G-buffer
+uniform sampler2D uGBufferBaseColorMetallic;
+uniform sampler2D uGBufferNormalRoughness;
+uniform sampler2D uGBufferEmissive;
+uniform sampler2D uGBufferDepth;
+uniform mat4 uInverseProjMatrix;
+
+// Lights reaching each tile, written by light_culling.cs.glsl
+#define LIGHT_TILE_SIZE 16
+layout(std430, binding = 2) readonly buffer TileLights {
+    uint uTileLightMasks[];
+};
+uniform int uTileCountX;
+
+// Reconstructed from the depth of the pixel
+vec3 vViewSpacePosition;
+#else
+#ifdef COUNT_OVERDRAW
+// The counter would move the depth test after the shader, it stays before it
+// as without the counter unless the shader discards
+#ifndef ALPHA_MASK
+layout(early_fragment_tests) in;
+#endif
+layout(binding = 0, offset = 0) uniform atomic_uint uShadedFragmentCount;
+#endif
 
 in vec3 vViewSpacePosition;
 in vec3 vViewSpaceNormal;
 in vec2 vTexCoords;
 in mat3 TBN;
+#endif
 
-uniform vec3 uLightDirection;
-uniform vec3 uLightIntensity;
 uniform vec3 uEmissiveFactor;
 
 uniform vec4 uBaseColorFactor;
@@ -14,34 +61,64 @@ uniform vec4 uBaseColorFactor;
 uniform float uMetallicFactor;
 uniform float uRoughnessFactor;
 uniform float uNormalScale;
-uniform float uActiveNormal;// sert de boolen pour l'activation de la normal map (1 pour activer 0 sinon)
+uniform float uAlphaCutoff;
 
 uniform sampler2D uBaseColorTexture;
 uniform sampler2D uNormalTexture;
 uniform sampler2D uMetallicRoughnessTexture;
 uniform sampler2D uEmissiveTexture;
 
-///cube light
-struct PoncLigth {
-    vec3 LightPosition;
-    vec3 CubeIntensity;
-    float CubeDist; //distance d'attnuation
+// Prefiltered for the roughness level / uEnvironment.y
+uniform samplerCube uSpecularEnvironment;
+// Scale and bias of F0 for (NdotV, roughness)
+uniform sampler2D uBrdfLut;
+
+// A layer per cascade, compared to the depth of the fragment
+uniform sampler2DArrayShadow uShadowMap;
+
+// Lights of the frame, see LightsBlock in utils/lights.hpp. Positions and
+// directions are in view space, a light at distance d is attenuated by
+// 1 / (1 + Kl * d + Kd * d^2) with (Kl, Kd) in attenuation.xy.
+#define MAX_POINT_LIGHTS 4
+#define MAX_SHADOW_CASCADES 4
+struct PointLight {
+    vec4 position;
+    vec4 intensity;
+    vec4 attenuation;
 };
 
-struct SpotLigth {
-    vec3 LightPosition;
-    vec3 LightIntensity;
-    vec3 LightDirection;
-    float CutOff;
-    float OuterCutOff;
-    float DistAttenuation; //distance d'attnuation
+struct SpotLight {
+    vec4 position;
+    vec4 intensity;
+    vec4 direction; // From the light
+    vec4 cone; // Cosines of the inner and outer angles in xy
+    vec4 attenuation;
 };
 
-#define NB_PONC_LIGHTS 4
-uniform PoncLigth pointLights[NB_PONC_LIGHTS];
-uniform SpotLigth spotligth;
+layout(std140, binding = 0) uniform Lights {
+    vec4 uLightDirection; // Towards the light
+    vec4 uLightIntensity;
+    PointLight uPointLights[MAX_POINT_LIGHTS];
+    SpotLight uSpotLight;
+    vec4 uIrradianceSH[9];
+    vec4 uEnvironment; // Intensity in x, specular level of roughness 1 in y
+    mat4 uViewToWorld;
+    // From view space to the texture coordinates and depth of each cascade
+    mat4 uShadowMatrices[MAX_SHADOW_CASCADES];
+    vec4 uShadowSplits; // View space distance at which each cascade ends
+    vec4 uShadow; // Cascade count in x, depth bias in y
+};
 
-out vec3 fColor;
+#ifdef GBUFFER_PASS
+layout(location = 0) out vec4 fBaseColorMetallic;
+layout(location = 1) out vec4 fNormalRoughness;
+layout(location = 2) out vec3 fEmissive;
+#elif defined(WEIGHTED_BLENDED_OIT)
+layout(location = 0) out vec4 fAccumulation;
+layout(location = 1) out float fRevealage;
+#else
+out vec4 fColor;
+#endif
 
 // Constants
 const float GAMMA = 2.2;
@@ -66,234 +143,292 @@ vec4 SRGBtoLINEAR(vec4 srgbIn) {
 }
 
 
-vec3 getNormal() {
-    vec3 N = vec3(0, 0, 0);
-    if (uActiveNormal > 0.5) {
-        vec4 baseNormalFromTexture = texture(uNormalTexture, vTexCoords);
-        vec3 normalTexture = uNormalScale * baseNormalFromTexture.rgb;
-        N = normalize(normalTexture * 2.0 - 1.0);
-        //Spcifi dans le readme de NormalTangentTest que la composante Y(g) doit tre multipli par -1
-        N = N * vec3(1, -1, 1);
-    }
-    else {
-        N = normalize(vViewSpaceNormal);
+// Octahedral encoding of a unit vector in [-1, 1]^2, see "A Survey of
+// Efficient Representations for Independent Unit Vectors", Cigolle et al.
+vec2 encodeOctahedral(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+    return n.z >= 0 ? n.xy : (1 - abs(n.yx)) * signs;
+}
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+    if (n.z < 0) {
+        vec2 signs = vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+        n.xy = (1 - abs(n.yx)) * signs;
     }
-    return N;
+    return normalize(n);
 }
 
-vec3 directional() {
-    vec3 N = getNormal();
-    vec3 L = vec3(0, 0, 0);
-    vec3 V = vec3(0, 0, 0);
+#ifdef DEFERRED_SHADING
+vec4 getBaseColor() {
+    return vec4(texelFetch(uGBufferBaseColorMetallic, ivec2(gl_FragCoord.xy), 0).rgb, 1);
+}
 
-    if (uActiveNormal > 0.5) {
-        L = TBN * uLightDirection;
-        V = TBN * normalize(-vViewSpacePosition);
-    }
-    else {
-       	L = uLightDirection;
-        V = normalize(-vViewSpacePosition);
-    }
+vec2 getMetallicRoughness() {
+    return vec2(texelFetch(uGBufferBaseColorMetallic, ivec2(gl_FragCoord.xy), 0).a,
+        texelFetch(uGBufferNormalRoughness, ivec2(gl_FragCoord.xy), 0).z);
+}
 
-	vec3 H = normalize(L + V);
-	vec4 baseColorFromTexture = SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
-	vec4 metallicRougnessFromTexture = texture(uMetallicRoughnessTexture, vTexCoords);
-	vec4 baseColor = uBaseColorFactor * baseColorFromTexture;
-	vec3 metallic = vec3(uMetallicFactor * metallicRougnessFromTexture.b);
-  	float roughness = uRoughnessFactor * metallicRougnessFromTexture.g;
-  	vec3 dielectricSpecular = vec3(0.04, 0.04, 0.04);
-	vec3 black = vec3(0, 0, 0);
-	vec3 c_diff = mix(baseColor.rgb * (1 - dielectricSpecular.r), black, metallic);
-  	vec3 F_0 = mix(dielectricSpecular, baseColor.rgb, metallic);
-  	float alpha = roughness * roughness;
-  	float baseShlickFactor = 1 - clamp(dot(V, N), 0, 1);
-	// You need to compute baseShlickFactor first
-	float shlickFactor = baseShlickFactor * baseShlickFactor; // power 2
-	shlickFactor *= shlickFactor; // power 4
-	shlickFactor *= baseShlickFactor; // power 5
-	vec3 F = F_0 + (vec3(1) - F_0) * shlickFactor;
-	float NdotL = clamp(dot(N, L), 0, 1);
-    float NdotV = clamp(dot(N, V), 0, 1);
-    float sqrAlpha = alpha * alpha;
-    float visDen = NdotL * sqrt(NdotV * NdotV * (1 - sqrAlpha) + sqrAlpha) + NdotV * sqrt(NdotL * NdotL * (1 - sqrAlpha) + sqrAlpha);
-    float Vis =  0.5 / visDen ;
-    float NdotH = clamp(dot(N, H), 0, 1);
-	float dDen = (NdotH * NdotH * (sqrAlpha - 1) + 1);
-	float D = M_1_PI * sqrAlpha / (dDen * dDen);
-	vec3 f_specular = F * Vis * D;
-	vec3 diffuse = c_diff * M_1_PI;
-	vec3 f_diffuse = (1 - F) * diffuse;
-	return max(LINEARtoSRGB((f_diffuse + f_specular) * uLightIntensity * NdotL), vec3(0));
+// In view space
+vec3 getNormal() {
+    return decodeOctahedral(texelFetch(uGBufferNormalRoughness, ivec2(gl_FragCoord.xy), 0).xy * 2 - 1);
 }
 
-vec3 ponctual(PoncLigth ligth) {
-    vec3 N = getNormal();
+vec3 getEmissive() {
+    return texelFetch(uGBufferEmissive, ivec2(gl_FragCoord.xy), 0).rgb;
+}
 
-    vec3 L = vec3(0, 0, 0);
-    vec3 V = vec3(0, 0, 0);
+vec3 getViewSpacePosition(float depth) {
+    vec2 uv = gl_FragCoord.xy / vec2(textureSize(uGBufferDepth, 0));
+    vec4 position = uInverseProjMatrix * vec4(vec3(uv, depth) * 2 - 1, 1);
+    return position.xyz / position.w;
+}
+#else
+vec4 getBaseColor() {
+#ifdef HAS_BASE_COLOR_TEXTURE
+    return uBaseColorFactor * SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
+#else
+    return uBaseColorFactor;
+#endif
+}
 
-    if (uActiveNormal > 0.5) {
-        L = TBN * normalize(ligth.LightPosition - vViewSpacePosition);
-        V = TBN * normalize(-vViewSpacePosition);
-    }
-    else {
-        L = normalize(ligth.LightPosition - vViewSpacePosition);
-        V = normalize(-vViewSpacePosition);
-    }
+// Metallic in x, roughness in y
+vec2 getMetallicRoughness() {
+#ifdef HAS_METALLIC_ROUGHNESS_TEXTURE
+    vec4 metallicRougnessFromTexture = texture(uMetallicRoughnessTexture, vTexCoords);
+    return vec2(uMetallicFactor * metallicRougnessFromTexture.b, uRoughnessFactor * metallicRougnessFromTexture.g);
+#else
+    return vec2(uMetallicFactor, uRoughnessFactor);
+#endif
+}
 
-	vec3 H = normalize(L + V);
-	vec4 baseColorFromTexture = SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
-	vec4 metallicRougnessFromTexture = texture(uMetallicRoughnessTexture, vTexCoords);
-	vec4 baseColor = uBaseColorFactor * baseColorFromTexture;
-	vec3 metallic = vec3(uMetallicFactor * metallicRougnessFromTexture.b);
-  	float roughness = uRoughnessFactor * metallicRougnessFromTexture.g;
-  	vec3 dielectricSpecular = vec3(0.04, 0.04, 0.04);
-	vec3 black = vec3(0, 0, 0);
-	vec3 c_diff = mix(baseColor.rgb * (1 - dielectricSpecular.r), black, metallic);
-  	vec3 F_0 = mix(dielectricSpecular, baseColor.rgb, metallic);
-  	float alpha = roughness * roughness;
-  	float baseShlickFactor = 1 - clamp(dot(V, N), 0, 1);
-	// You need to compute baseShlickFactor first
-	float shlickFactor = baseShlickFactor * baseShlickFactor; // power 2
-	shlickFactor *= shlickFactor; // power 4
-	shlickFactor *= baseShlickFactor; // power 5
-	vec3 F = F_0 + (vec3(1) - F_0) * shlickFactor;
-	float NdotL = clamp(dot(N, L), 0, 1);
-    float NdotV = clamp(dot(N, V), 0, 1);
-    float sqrAlpha = alpha * alpha;
-    float visDen = NdotL * sqrt(NdotV * NdotV * (1 - sqrAlpha) + sqrAlpha) + NdotV * sqrt(NdotL * NdotL * (1 - sqrAlpha) + sqrAlpha);
-    float Vis = visDen != 0. ? 0.5 / visDen : 0.0;
+// In tangent space with a normal map, in view space otherwise
+vec3 getNormal() {
+#ifdef HAS_NORMAL_TEXTURE
+    vec4 baseNormalFromTexture = texture(uNormalTexture, vTexCoords);
+    vec3 normalTexture = uNormalScale * baseNormalFromTexture.rgb;
+    vec3 N = normalize(normalTexture * 2.0 - 1.0);
+    //Spcifi dans le readme de NormalTangentTest que la composante Y(g) doit tre multipli par -1
+    return N * vec3(1, -1, 1);
+#else
+    return normalize(vViewSpaceNormal);
+#endif
+}
 
-    float NdotH = clamp(dot(N, H), 0, 1);
-	float dDen = (NdotH * NdotH * (sqrAlpha - 1) + 1);
-	float D = M_1_PI * sqrAlpha / (dDen * dDen);
-	vec3 f_specular = F * Vis * D;
-	vec3 diffuse = c_diff * M_1_PI;
-	vec3 f_diffuse = (1 - F) * diffuse;
-	float dist = distance(ligth.LightPosition, vViewSpacePosition);
-	float Kc = 1.f, Kl, Kd;
-	if (ligth.CubeDist < 7 && ligth.CubeDist >= 0) {
-        Kl = 0.7f;
-        Kd = 1.8f;
-    }
-    else if (ligth.CubeDist < 13 && ligth.CubeDist >= 7) {
-        Kl = 0.35f;
-        Kd = 0.44f;
-    }
-    else if (ligth.CubeDist < 20 && ligth.CubeDist >= 13) {
-        Kl = 0.22f;
-        Kd = 0.20f;
-    }
-    else if (ligth.CubeDist < 32 && ligth.CubeDist >= 20) {
-        Kl = 0.14f;
-        Kd = 0.07f;
-    }
-    else if (ligth.CubeDist < 50 && ligth.CubeDist >= 32) {
-        Kl = 0.09f;
-        Kd = 0.032f;
-    }
-    else if (ligth.CubeDist < 65 && ligth.CubeDist >= 50) {
-        Kl = 0.07f;
-        Kd = 0.017f;
-    }
-    else {
-        Kl = 0.045f;
-        Kd = 0.0075f;
-    }
-    float attenuation = 1.f / (Kc + Kl * dist + Kd * dist * dist);
-	return max(LINEARtoSRGB((f_diffuse + f_specular) * ligth.CubeIntensity * NdotL * attenuation), vec3(0));
+vec3 getEmissive() {
+#ifdef HAS_EMISSIVE
+#ifdef HAS_EMISSIVE_TEXTURE
+    return uEmissiveFactor * SRGBtoLINEAR(texture(uEmissiveTexture, vTexCoords)).rgb;
+#else
+    return uEmissiveFactor;
+#endif
+#else
+    return vec3(0);
+#endif
 }
+#endif
 
-vec3 spotligthCalc(SpotLigth spotligth) {
-    vec3 N = getNormal();
-    vec3 L = vec3(0, 0, 0);
-    vec3 V = vec3(0, 0, 0);
+// View space vector in the space of getNormal()
+vec3 toShadingSpace(vec3 v) {
+#ifdef HAS_NORMAL_TEXTURE
+    return TBN * v;
+#else
+    return v;
+#endif
+}
 
-    if (uActiveNormal > 0.5) {
-        L = normalize(spotligth.LightPosition - vViewSpacePosition);
-        V = TBN * normalize(-vViewSpacePosition);
-    }
-    else {
-        L = normalize(spotligth.LightPosition - vViewSpacePosition);
-        V = normalize(-vViewSpacePosition);
-    }
+// Inverse of toShadingSpace(), TBN is orthonormal
+vec3 fromShadingSpace(vec3 v) {
+#ifdef HAS_NORMAL_TEXTURE
+    return transpose(TBN) * v;
+#else
+    return v;
+#endif
+}
 
-	vec3 H = normalize(L + V);
-	vec4 baseColorFromTexture = SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
-	vec4 metallicRougnessFromTexture = texture(uMetallicRoughnessTexture, vTexCoords);
-	vec4 baseColor = uBaseColorFactor * baseColorFromTexture;
-	vec3 metallic = vec3(uMetallicFactor * metallicRougnessFromTexture.b);
-  	float roughness = uRoughnessFactor * metallicRougnessFromTexture.g;
-  	vec3 dielectricSpecular = vec3(0.04, 0.04, 0.04);
-	vec3 black = vec3(0, 0, 0);
-	vec3 c_diff = mix(baseColor.rgb * (1 - dielectricSpecular.r), black, metallic);
-  	vec3 F_0 = mix(dielectricSpecular, baseColor.rgb, metallic);
-  	float alpha = roughness * roughness;
-  	float baseShlickFactor = 1 - clamp(dot(V, N), 0, 1);
-	// You need to compute baseShlickFactor first
-	float shlickFactor = baseShlickFactor * baseShlickFactor; // power 2
-	shlickFactor *= shlickFactor; // power 4
-	shlickFactor *= baseShlickFactor; // power 5
-	vec3 F = F_0 + (vec3(1) - F_0) * shlickFactor;
-	float NdotL = clamp(dot(N, L), 0, 1);
-    float NdotV = clamp(dot(N, V), 0, 1);
-    float sqrAlpha = alpha * alpha;
+// What the BRDF needs from the material and the view, fetched and decoded
+// once per fragment for all the lights
+struct Surface {
+    vec3 N; // In shading space
+    vec3 V;
+    float NdotV;
+    vec3 F; // Fresnel term, which only depends on V and N
+    vec3 F_0;
+    vec3 diffuse; // (1 - F) * c_diff / pi
+    float roughness;
+    float sqrAlpha;
+};
+
+Surface getSurface(vec4 baseColor) {
+    Surface surface;
+    surface.N = getNormal();
+    surface.V = toShadingSpace(normalize(-vViewSpacePosition));
+    surface.NdotV = clamp(dot(surface.N, surface.V), 0, 1);
+
+    vec2 metallicRoughness = getMetallicRoughness();
+    vec3 metallic = vec3(metallicRoughness.x);
+    float roughness = metallicRoughness.y;
+    vec3 dielectricSpecular = vec3(0.04, 0.04, 0.04);
+    vec3 black = vec3(0, 0, 0);
+    vec3 c_diff = mix(baseColor.rgb * (1 - dielectricSpecular.r), black, metallic);
+    vec3 F_0 = mix(dielectricSpecular, baseColor.rgb, metallic);
+    surface.F_0 = F_0;
+    surface.roughness = roughness;
+    float alpha = roughness * roughness;
+    surface.sqrAlpha = alpha * alpha;
+
+    float baseShlickFactor = 1 - surface.NdotV;
+    float shlickFactor = baseShlickFactor * baseShlickFactor; // power 2
+    shlickFactor *= shlickFactor; // power 4
+    shlickFactor *= baseShlickFactor; // power 5
+    surface.F = F_0 + (vec3(1) - F_0) * shlickFactor;
+    surface.diffuse = (1 - surface.F) * c_diff * M_1_PI;
+    return surface;
+}
+
+// Light reflected towards V by a light of the given radiance coming from L,
+// in shading space
+vec3 shade(Surface surface, vec3 L, vec3 radiance) {
+    vec3 H = normalize(L + surface.V);
+    float NdotL = clamp(dot(surface.N, L), 0, 1);
+    float NdotV = surface.NdotV;
+    float sqrAlpha = surface.sqrAlpha;
     float visDen = NdotL * sqrt(NdotV * NdotV * (1 - sqrAlpha) + sqrAlpha) + NdotV * sqrt(NdotL * NdotL * (1 - sqrAlpha) + sqrAlpha);
     float Vis = visDen != 0. ? 0.5 / visDen : 0.0;
+    float NdotH = clamp(dot(surface.N, H), 0, 1);
+    float dDen = (NdotH * NdotH * (sqrAlpha - 1) + 1);
+    float D = M_1_PI * sqrAlpha / (dDen * dDen);
+    vec3 f_specular = surface.F * Vis * D;
+    return max(LINEARtoSRGB((surface.diffuse + f_specular) * radiance * NdotL), vec3(0));
+}
 
-    float NdotH = clamp(dot(N, H), 0, 1);
-	float dDen = (NdotH * NdotH * (sqrAlpha - 1) + 1);
-	float D = M_1_PI * sqrAlpha / (dDen * dDen);
-	vec3 f_specular = F * Vis * D;
-	vec3 diffuse = c_diff * M_1_PI;
-	vec3 f_diffuse = (1 - F) * diffuse;
-	float dist = length(spotligth.LightPosition - vViewSpacePosition);
-	float Kc = 1.f, Kl, Kd;
-	if (spotligth.DistAttenuation < 7 && spotligth.DistAttenuation >= 0) {
-        Kl = 0.7f;
-        Kd = 1.8f;
-    }
-    else if (spotligth.DistAttenuation < 13 && spotligth.DistAttenuation >= 7) {
-        Kl = 0.35f;
-        Kd = 0.44f;
-    }
-    else if (spotligth.DistAttenuation < 20 && spotligth.DistAttenuation >= 13) {
-        Kl = 0.22f;
-        Kd = 0.20f;
-    }
-    else if (spotligth.DistAttenuation < 32 && spotligth.DistAttenuation >= 20) {
-        Kl = 0.14f;
-        Kd = 0.07f;
-    }
-    else if (spotligth.DistAttenuation < 50 && spotligth.DistAttenuation >= 32) {
-        Kl = 0.09f;
-        Kd = 0.032f;
-    }
-    else if (spotligth.DistAttenuation < 65 && spotligth.DistAttenuation >= 50) {
-        Kl = 0.07f;
-        Kd = 0.017f;
+float getAttenuation(vec4 attenuation, float dist) {
+    return 1. / (1. + attenuation.x * dist + attenuation.y * dist * dist);
+}
+
+#ifdef HAS_SHADOWS
+// Fraction of the directional light reaching the fragment, filtered over 2x2
+// texels by the comparison sampler. Lit beyond the last cascade.
+float getShadow() {
+    float distance = -vViewSpacePosition.z;
+    int cascadeCount = int(uShadow.x);
+    int cascade = 0;
+    while (cascade < cascadeCount && distance > uShadowSplits[cascade]) {
+        ++cascade;
     }
-    else {
-        Kl = 0.045f;
-        Kd = 0.0075f;
+    if (cascade == cascadeCount) {
+        return 1.;
     }
-    float attenuation = 1.f / (Kc + Kl * dist + Kd * dist * dist);
+    vec4 coords = uShadowMatrices[cascade] * vec4(vViewSpacePosition, 1);
+    return texture(uShadowMap, vec4(coords.xy, cascade, coords.z - uShadow.y));
+}
+#endif
 
-    float theta = dot(L, normalize(-spotligth.LightDirection));
-    float epsilon = spotligth.CutOff - spotligth.OuterCutOff;
-    float intensity = clamp((theta - spotligth.OuterCutOff) / epsilon, 0.0, 1.0);
+#ifdef HAS_IMAGE_BASED_LIGHTING
+// Irradiance around the world space normal n, from the SH coefficients of
+// EnvironmentLighting
+vec3 getIrradiance(vec3 n) {
+    return uIrradianceSH[0].rgb
+        + uIrradianceSH[1].rgb * n.y + uIrradianceSH[2].rgb * n.z + uIrradianceSH[3].rgb * n.x
+        + uIrradianceSH[4].rgb * (n.x * n.y) + uIrradianceSH[5].rgb * (n.y * n.z)
+        + uIrradianceSH[6].rgb * (3. * n.z * n.z - 1.) + uIrradianceSH[7].rgb * (n.x * n.z)
+        + uIrradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+}
 
-    vec3 spotlum = max(LINEARtoSRGB((f_diffuse + f_specular) * spotligth.LightIntensity * NdotL * attenuation), vec3(0));
-	return spotlum * intensity;
+// Light of the environment reflected towards V, with the split sum
+// approximation of the specular term
+vec3 shadeEnvironment(Surface surface) {
+    mat3 viewToWorld = mat3(uViewToWorld);
+    vec3 N = viewToWorld * fromShadingSpace(surface.N);
+    vec3 R = viewToWorld * fromShadingSpace(reflect(-surface.V, surface.N));
+    vec3 prefiltered = textureLod(uSpecularEnvironment, R, surface.roughness * uEnvironment.y).rgb;
+    vec2 brdf = texture(uBrdfLut, vec2(surface.NdotV, surface.roughness)).rg;
+    vec3 f_specular = prefiltered * (surface.F_0 * brdf.x + brdf.y);
+    return (surface.diffuse * getIrradiance(N) + f_specular) * uEnvironment.x;
 }
+#endif
 
 void main() {
-    vec4 emissiveTexture = SRGBtoLINEAR(texture(uEmissiveTexture, vTexCoords));
-	vec3 emissive = uEmissiveFactor * emissiveTexture.rgb;
-	vec3 result = directional() ;
-	for (int i = 0; i < NB_PONC_LIGHTS; i++) {
-        result += ponctual(pointLights[i]);
-	}
-	result += spotligthCalc(spotligth);
-	fColor = clamp(result + emissive, 0, 1);
+#ifdef COUNT_OVERDRAW
+    atomicCounterIncrement(uShadedFragmentCount);
+#endif
+#ifdef DEFERRED_SHADING
+    float depth = texelFetch(uGBufferDepth, ivec2(gl_FragCoord.xy), 0).r;
+    if (depth == 1) {
+        discard; // Nothing drawn
+    }
+    // For the draws after the shading
+    gl_FragDepth = depth;
+    vViewSpacePosition = getViewSpacePosition(depth);
+    ivec2 tile = ivec2(gl_FragCoord.xy) / LIGHT_TILE_SIZE;
+    uint lightMask = uTileLightMasks[tile.y * uTileCountX + tile.x];
+#else
+    const uint lightMask = 0xFFFFFFFFu;
+#endif
+
+    vec4 baseColor = getBaseColor();
+#ifdef ALPHA_MASK
+    if (baseColor.a < uAlphaCutoff) {
+        discard;
+    }
+#endif
+#ifdef GBUFFER_PASS
+    vec2 metallicRoughness = getMetallicRoughness();
+    fBaseColorMetallic = vec4(baseColor.rgb, metallicRoughness.x);
+    fNormalRoughness = vec4(encodeOctahedral(fromShadingSpace(getNormal())) * 0.5 + 0.5, metallicRoughness.y, 0);
+    fEmissive = getEmissive();
+#else
+    Surface surface = getSurface(baseColor);
+
+    vec3 result = getEmissive();
+#ifdef HAS_DIRECTIONAL_LIGHT
+#ifdef HAS_SHADOWS
+    vec3 lightRadiance = uLightIntensity.rgb * getShadow();
+#else
+    vec3 lightRadiance = uLightIntensity.rgb;
+#endif
+    result += shade(surface, toShadingSpace(uLightDirection.xyz), lightRadiance);
+#endif
+#if POINT_LIGHT_COUNT > 0
+    for (int i = 0; i < POINT_LIGHT_COUNT; i++) {
+        if ((lightMask & (1u << i)) == 0u) {
+            continue;
+        }
+        vec3 toLight = uPointLights[i].position.xyz - vViewSpacePosition;
+        float dist = length(toLight);
+        vec3 radiance = uPointLights[i].intensity.rgb * getAttenuation(uPointLights[i].attenuation, dist);
+        result += shade(surface, toShadingSpace(toLight / dist), radiance);
+    }
+#endif
+#ifdef HAS_SPOT_LIGHT
+    if ((lightMask & (1u << MAX_POINT_LIGHTS)) != 0u) {
+        vec3 toLight = uSpotLight.position.xyz - vViewSpacePosition;
+        float dist = length(toLight);
+        vec3 L = toLight / dist;
+        // The cone is tested in view space
+        float theta = dot(L, -uSpotLight.direction.xyz);
+        float epsilon = uSpotLight.cone.x - uSpotLight.cone.y;
+        float intensity = clamp((theta - uSpotLight.cone.y) / epsilon, 0.0, 1.0);
+        vec3 radiance = uSpotLight.intensity.rgb * getAttenuation(uSpotLight.attenuation, dist);
+        result += shade(surface, toShadingSpace(L), radiance) * intensity;
+    }
+#endif
+#ifdef HAS_IMAGE_BASED_LIGHTING
+    result += max(LINEARtoSRGB(shadeEnvironment(surface)), vec3(0));
+#endif
+    result = clamp(result, 0, 1);
+#ifdef WEIGHTED_BLENDED_OIT
+    // Weight of equation 10 of the paper, the nearer and more opaque layers
+    // count more
+    float alpha = baseColor.a;
+    float weight = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+    fAccumulation = vec4(result * alpha, alpha) * weight;
+    fRevealage = alpha;
+#elif defined(ALPHA_BLEND)
+    fColor = vec4(result, baseColor.a);
+#else
+    fColor = vec4(result, 1);
+#endif
+#endif
 }
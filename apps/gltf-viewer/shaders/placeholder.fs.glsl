@@ -0,0 +1,9 @@
+#version 430
+
+uniform vec3 uColor;
+
+out vec3 fColor;
+
+void main() {
+    fColor = uColor;
+}
@@ -0,0 +1,23 @@
+#version 430
+
+// Wireframe boxes standing for the meshes that are still loading, drawn as
+// 12 lines per instance without vertex attributes
+
+// Unit box of each instance to world space
+layout(std430, binding = 1) readonly buffer PlaceholderBoxes {
+    mat4 uBoxMatrices[];
+};
+
+uniform mat4 uViewProjMatrix;
+
+// Corners of the 12 edges, bit i of a corner is its coordinate along axis i
+const int kEdgeCorners[24] = int[24](
+    0, 1, 2, 3, 4, 5, 6, 7,
+    0, 2, 1, 3, 4, 6, 5, 7,
+    0, 4, 1, 5, 2, 6, 3, 7);
+
+void main() {
+    const int corner = kEdgeCorners[gl_VertexID];
+    const vec3 position = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+    gl_Position = uViewProjMatrix * uBoxMatrices[gl_InstanceID] * vec4(position, 1);
+}
@@ -0,0 +1,5 @@
+#version 430
+
+// Depth only, of the shadow maps and of the depth prepass
+void main() {
+}
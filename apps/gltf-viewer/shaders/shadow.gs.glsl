@@ -0,0 +1,17 @@
+#version 430
+
+// Sends each triangle of the shadow pass to the layer of the cascade of its
+// instance, see SHADOW_PASS in forward.vs.glsl
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+flat in int vCascade[];
+
+void main() {
+    for (int i = 0; i < 3; ++i) {
+        gl_Position = gl_in[i].gl_Position;
+        gl_Layer = vCascade[0];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
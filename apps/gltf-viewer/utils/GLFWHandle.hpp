@@ -16,7 +16,9 @@
 class GLFWHandle
 {
 public:
-  GLFWHandle(int width, int height, const char *title, bool visible = true)
+  // samples of the multisampling of the default framebuffer, 0 for none
+  GLFWHandle(int width, int height, const char *title, bool visible = true,
+      int samples = 4)
   {
     if (!glfwInit()) {
       std::cerr << "Unable to init GLFW.\n";
@@ -32,7 +34,7 @@ public:
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    glfwWindowHint(GLFW_SAMPLES, samples);
 
     m_pWindow =
         glfwCreateWindow(int(width), int(height), title, nullptr, nullptr);
@@ -0,0 +1,323 @@
+#include "animation.hpp"
+#include "gltf.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+
+// Below this number of active channels, sampling on the calling thread is
+// faster than waking up the workers
+const size_t kParallelChannelThreshold = 512;
+const size_t kTargetsPerTask = 64;
+
+AnimationInterpolation toInterpolation(const std::string &interpolation)
+{
+  if (interpolation == "STEP") {
+    return AnimationInterpolation::Step;
+  }
+  if (interpolation == "CUBICSPLINE") {
+    return AnimationInterpolation::CubicSpline;
+  }
+  return AnimationInterpolation::Linear;
+}
+
+bool toPath(const std::string &path, AnimationPath &outPath)
+{
+  if (path == "translation") {
+    outPath = AnimationPath::Translation;
+  } else if (path == "rotation") {
+    outPath = AnimationPath::Rotation;
+  } else if (path == "scale") {
+    outPath = AnimationPath::Scale;
+  } else if (path == "weights") {
+    outPath = AnimationPath::Weights;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Index k of the key such that times[k] <= time < times[k + 1], clamped to
+// [0, times.size() - 2]. times must have at least two keys.
+uint32_t findKey(const std::vector<float> &times, float time, uint32_t &cache)
+{
+  const auto lastSegment = uint32_t(times.size() - 2);
+  auto k = std::min(cache, lastSegment);
+  if (times[k] <= time && (time < times[k + 1] || k == lastSegment)) {
+    return k;
+  }
+  if (k < lastSegment && times[k + 1] <= time &&
+      (k + 1 == lastSegment || time < times[k + 2])) {
+    return cache = k + 1;
+  }
+  const auto it = std::upper_bound(begin(times), end(times), time);
+  k = it == begin(times) ? 0 : uint32_t(it - begin(times)) - 1;
+  return cache = std::min(k, lastSegment);
+}
+
+// Sample a track at time in out[0 .. track.components]
+void sampleTrack(const AnimationTrack &track, AnimationPath path, float time,
+    uint32_t &keyCache, float *out)
+{
+  const auto c = track.components;
+  const auto isCubic =
+      track.interpolation == AnimationInterpolation::CubicSpline;
+  const auto keyStride = isCubic ? 3 * c : c;
+  const auto valueOffset = isCubic ? c : 0; // Skip the in-tangent
+  const auto &times = track.times;
+  const auto *values = track.values.data();
+
+  const auto copyKey = [&](size_t key) {
+    std::copy_n(values + key * keyStride + valueOffset, c, out);
+  };
+  if (times.size() < 2 || time <= times.front()) {
+    copyKey(0);
+    return;
+  }
+  if (time >= times.back()) {
+    copyKey(times.size() - 1);
+    return;
+  }
+
+  const auto k = findKey(times, time, keyCache);
+  const auto t0 = times[k];
+  const auto t1 = times[k + 1];
+  const auto dt = t1 - t0;
+  const auto s = dt > 0.f ? (time - t0) / dt : 0.f;
+  const auto *v0 = values + k * keyStride + valueOffset;
+  const auto *v1 = values + (k + 1) * keyStride + valueOffset;
+
+  switch (track.interpolation) {
+  case AnimationInterpolation::Step:
+    copyKey(k);
+    return;
+  case AnimationInterpolation::Linear:
+    if (path == AnimationPath::Rotation) {
+      const auto q0 = glm::quat(v0[3], v0[0], v0[1], v0[2]);
+      const auto q1 = glm::quat(v1[3], v1[0], v1[1], v1[2]);
+      const auto q = glm::normalize(glm::slerp(q0, q1, s));
+      out[0] = q.x;
+      out[1] = q.y;
+      out[2] = q.z;
+      out[3] = q.w;
+      return;
+    }
+    for (uint32_t i = 0; i < c; ++i) {
+      out[i] = v0[i] + s * (v1[i] - v0[i]);
+    }
+    return;
+  case AnimationInterpolation::CubicSpline: {
+    // Hermite spline, see appendix C of the glTF 2.0 specification
+    const auto *b0 = v0 + c; // Out-tangent of key k
+    const auto *a1 = v1 - c; // In-tangent of key k + 1
+    const auto s2 = s * s;
+    const auto s3 = s2 * s;
+    const auto h00 = 2.f * s3 - 3.f * s2 + 1.f;
+    const auto h10 = dt * (s3 - 2.f * s2 + s);
+    const auto h01 = -2.f * s3 + 3.f * s2;
+    const auto h11 = dt * (s3 - s2);
+    for (uint32_t i = 0; i < c; ++i) {
+      out[i] = h00 * v0[i] + h10 * b0[i] + h01 * v1[i] + h11 * a1[i];
+    }
+    if (path == AnimationPath::Rotation) {
+      const auto q = glm::normalize(glm::quat(out[3], out[0], out[1], out[2]));
+      out[0] = q.x;
+      out[1] = q.y;
+      out[2] = q.z;
+      out[3] = q.w;
+    }
+    return;
+  }
+  }
+}
+
+} // namespace
+
+std::vector<AnimationClip> compileAnimations(const tinygltf::Model &model,
+    const SceneGraph &graph, std::pmr::memory_resource *arena)
+{
+  std::vector<AnimationClip> clips;
+  clips.reserve(model.animations.size());
+  for (const auto &animation : model.animations) {
+    clips.emplace_back();
+    auto &clip = clips.back();
+    clip.name = animation.name;
+
+    // Only read the samplers of channels targeting a node of the graph, the
+    // others may not even have been loaded (see loadGltfFile())
+    std::pmr::vector<uint8_t> usedSamplers(
+        animation.samplers.size(), 0, arena);
+    for (const auto &channel : animation.channels) {
+      if (channel.target_node >= 0 && channel.sampler >= 0 &&
+          size_t(channel.sampler) < usedSamplers.size() &&
+          graph.flatIndices[channel.target_node] >= 0) {
+        usedSamplers[channel.sampler] = 1;
+      }
+    }
+
+    clip.tracks.resize(animation.samplers.size());
+    for (size_t i = 0; i < animation.samplers.size(); ++i) {
+      const auto &sampler = animation.samplers[i];
+      auto &track = clip.tracks[i];
+      if (!usedSamplers[i] || sampler.input < 0 || sampler.output < 0) {
+        continue;
+      }
+      const auto &input = model.accessors[sampler.input];
+      const auto &output = model.accessors[sampler.output];
+      track.interpolation = toInterpolation(sampler.interpolation);
+
+      track.times.resize(input.count);
+      readAccessorAsFloat(model, input, track.times.data());
+
+      const auto outputComponents =
+          size_t(tinygltf::GetNumComponentsInType(output.type));
+      track.values.resize(output.count * outputComponents);
+      readAccessorAsFloat(model, output, track.values.data());
+
+      // Weights tracks are scalar accessors holding all the targets of a key
+      const auto keyValues =
+          input.count *
+          (track.interpolation == AnimationInterpolation::CubicSpline ? 3
+                                                                      : 1);
+      track.components =
+          keyValues ? uint32_t(track.values.size() / keyValues) : 0;
+      if (!track.times.empty()) {
+        clip.duration = std::max(clip.duration, track.times.back());
+      }
+    }
+
+    for (const auto &channel : animation.channels) {
+      AnimationPath path;
+      if (!toPath(channel.target_path, path)) {
+        std::cerr << "Unsupported animation path " << channel.target_path
+                  << ", skipping channel" << std::endl;
+        continue;
+      }
+      if (channel.target_node < 0 || channel.sampler < 0 ||
+          graph.flatIndices[channel.target_node] < 0) {
+        continue;
+      }
+      const auto &track = clip.tracks[channel.sampler];
+      const auto expectedComponents =
+          path == AnimationPath::Rotation
+              ? 4u
+              : path == AnimationPath::Weights ? track.components : 3u;
+      if (track.times.empty() || track.components != expectedComponents) {
+        std::cerr << "Animation sampler " << channel.sampler << " of "
+                  << animation.name << " does not match its "
+                  << channel.target_path << " target, skipping channel"
+                  << std::endl;
+        continue;
+      }
+      clip.channels.push_back({graph.flatIndices[channel.target_node], path,
+          uint32_t(channel.sampler)});
+    }
+  }
+  return clips;
+}
+
+Animator::Animator(std::vector<AnimationClip> clips) :
+    m_Clips(std::move(clips)), m_ClipTimes(m_Clips.size(), 0.f)
+{
+}
+
+void Animator::setActiveClips(const std::vector<size_t> &clipIndices)
+{
+  m_ActiveClips = clipIndices;
+  m_Bindings.clear();
+  for (const auto clipIdx : clipIndices) {
+    const auto &clip = m_Clips[clipIdx];
+    for (size_t i = 0; i < clip.channels.size(); ++i) {
+      m_Bindings.push_back({uint32_t(clipIdx), uint32_t(i)});
+    }
+  }
+  // Stable so that when several clips drive the same target, the last
+  // selected one wins, whatever the number of threads
+  std::stable_sort(begin(m_Bindings), end(m_Bindings),
+      [&](const Binding &lhs, const Binding &rhs) {
+        return m_Clips[lhs.clip].channels[lhs.channel].flatNode <
+               m_Clips[rhs.clip].channels[rhs.channel].flatNode;
+      });
+
+  m_TargetRanges.clear();
+  for (size_t i = 0; i < m_Bindings.size(); ++i) {
+    const auto &binding = m_Bindings[i];
+    const auto target = m_Clips[binding.clip].channels[binding.channel].flatNode;
+    if (i == 0) {
+      m_TargetRanges.push_back(0);
+      continue;
+    }
+    const auto &previous = m_Bindings[i - 1];
+    if (m_Clips[previous.clip].channels[previous.channel].flatNode != target) {
+      m_TargetRanges.push_back(uint32_t(i));
+    }
+  }
+  m_TargetRanges.push_back(uint32_t(m_Bindings.size()));
+  m_KeyCache.assign(m_Bindings.size(), 0);
+}
+
+void Animator::sample(float time, SceneGraph &graph, ThreadPool *pool)
+{
+  for (const auto clipIdx : m_ActiveClips) {
+    const auto duration = m_Clips[clipIdx].duration;
+    m_ClipTimes[clipIdx] = duration > 0.f ? std::fmod(time, duration) : 0.f;
+  }
+
+  if (m_Bindings.empty()) {
+    return;
+  }
+  const auto targetCount = m_TargetRanges.size() - 1;
+  if (pool && m_Bindings.size() >= kParallelChannelThreshold) {
+    pool->parallelFor(targetCount, kTargetsPerTask,
+        [&](size_t begin, size_t end) {
+          sampleTargets(begin, end, m_ClipTimes, graph);
+        });
+  } else {
+    sampleTargets(0, targetCount, m_ClipTimes, graph);
+  }
+}
+
+void Animator::sampleTargets(size_t beginTarget, size_t endTarget,
+    const std::vector<float> &clipTimes, SceneGraph &graph)
+{
+  float value[4];
+  std::vector<float> weights;
+  for (auto b = m_TargetRanges[beginTarget]; b < m_TargetRanges[endTarget];
+       ++b) {
+    const auto &binding = m_Bindings[b];
+    const auto &clip = m_Clips[binding.clip];
+    const auto &channel = clip.channels[binding.channel];
+    const auto &track = clip.tracks[channel.track];
+    const auto node = size_t(channel.flatNode);
+    const auto time = clipTimes[binding.clip];
+
+    switch (channel.path) {
+    case AnimationPath::Translation:
+      sampleTrack(track, channel.path, time, m_KeyCache[b], value);
+      graph.translations[node] = glm::vec3(value[0], value[1], value[2]);
+      break;
+    case AnimationPath::Rotation:
+      sampleTrack(track, channel.path, time, m_KeyCache[b], value);
+      graph.rotations[node] = glm::quat(value[3], value[0], value[1], value[2]);
+      break;
+    case AnimationPath::Scale:
+      sampleTrack(track, channel.path, time, m_KeyCache[b], value);
+      graph.scales[node] = glm::vec3(value[0], value[1], value[2]);
+      break;
+    case AnimationPath::Weights: {
+      weights.resize(track.components);
+      sampleTrack(track, channel.path, time, m_KeyCache[b], weights.data());
+      const auto count = std::min(graph.weightCounts[node], track.components);
+      std::copy_n(weights.data(), count,
+          graph.weights.data() + graph.weightOffsets[node]);
+      // Weights do not change world matrices
+      continue;
+    }
+    }
+    graph.markDirty(node);
+  }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "scenegraph.hpp"
+
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+enum class AnimationPath : uint8_t
+{
+  Translation,
+  Rotation,
+  Scale,
+  Weights
+};
+
+enum class AnimationInterpolation : uint8_t
+{
+  Linear,
+  Step,
+  CubicSpline
+};
+
+// Keyframes of a glTF animation sampler. Times and values are kept in
+// separate float arrays so that the key search only walks the times.
+struct AnimationTrack
+{
+  AnimationInterpolation interpolation = AnimationInterpolation::Linear;
+  uint32_t components = 0; // Floats per value (3, 4 or morph target count)
+  std::vector<float> times;
+  // components floats per key, 3 * components for CUBICSPLINE which stores
+  // (in-tangent, value, out-tangent) for each key
+  std::vector<float> values;
+};
+
+struct AnimationChannel
+{
+  int flatNode; // Index of the target in the SceneGraph
+  AnimationPath path;
+  uint32_t track; // Index in AnimationClip::tracks
+};
+
+struct AnimationClip
+{
+  std::string name;
+  float duration = 0.f;
+  std::vector<AnimationTrack> tracks;
+  std::vector<AnimationChannel> channels;
+};
+
+// Convert the animations of the model to clips targeting the nodes of graph.
+// Channels targeting nodes that are not in the graph are dropped. Temporary
+// data is allocated in arena.
+std::vector<AnimationClip> compileAnimations(const tinygltf::Model &model,
+    const SceneGraph &graph, std::pmr::memory_resource *arena = std::pmr::get_default_resource());
+
+// Plays a set of clips on a SceneGraph.
+class Animator
+{
+public:
+  Animator() = default;
+
+  explicit Animator(std::vector<AnimationClip> clips);
+
+  const std::vector<AnimationClip> &clips() const { return m_Clips; }
+
+  // Select the clips that sample() plays. Their channels are grouped by
+  // target node so that the sampling work can be split between threads
+  // without two threads writing the same node.
+  void setActiveClips(const std::vector<size_t> &clipIndices);
+
+  size_t activeChannelCount() const { return m_Bindings.size(); }
+
+  // Sample the active clips at time (each one looping over its own
+  // duration), write the results in graph and mark the targets dirty.
+  // Targets are split between the workers of pool if it is not null and
+  // there are enough channels to pay for it.
+  void sample(float time, SceneGraph &graph, ThreadPool *pool = nullptr);
+
+private:
+  void sampleTargets(size_t beginTarget, size_t endTarget,
+      const std::vector<float> &clipTimes, SceneGraph &graph);
+
+  struct Binding
+  {
+    uint32_t clip;
+    uint32_t channel;
+  };
+
+  std::vector<AnimationClip> m_Clips;
+  std::vector<size_t> m_ActiveClips;
+  std::vector<Binding> m_Bindings; // Active channels sorted by target
+  // m_Bindings[m_TargetRanges[i] .. m_TargetRanges[i + 1]] share a target
+  std::vector<uint32_t> m_TargetRanges;
+  // Last key found by each binding: playback is mostly monotonic so the next
+  // search usually ends on the same or the next key
+  std::vector<uint32_t> m_KeyCache;
+  std::vector<float> m_ClipTimes;
+};
@@ -0,0 +1,77 @@
+#include "arena.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef GLTF_VIEWER_COUNT_HEAP_ALLOCATIONS
+namespace
+{
+
+std::atomic<uint64_t> heapAllocationCount{0};
+
+} // namespace
+
+// Replacements of the global allocation functions, counting the allocations.
+// The default array forms call these ones.
+void *operator new(size_t size)
+{
+  heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+uint64_t getHeapAllocationCount()
+{
+  return heapAllocationCount.load(std::memory_order_relaxed);
+}
+
+bool isCountingHeapAllocations() { return true; }
+#else
+uint64_t getHeapAllocationCount() { return 0; }
+
+bool isCountingHeapAllocations() { return false; }
+#endif
+
+LoadArena::LoadArena(size_t initialSize) :
+    m_Arena(initialSize), m_Counter(&m_Arena)
+{
+}
+
+void LoadArena::release() { m_Arena.release(); }
+
+void *LoadArena::CountingResource::do_allocate(size_t bytes, size_t alignment)
+{
+  ++allocationCount;
+  allocatedBytes += bytes;
+  return m_Upstream->allocate(bytes, alignment);
+}
+
+void LoadArena::CountingResource::do_deallocate(
+    void *p, size_t bytes, size_t alignment)
+{
+  m_Upstream->deallocate(p, bytes, alignment);
+}
+
+bool LoadArena::CountingResource::do_is_equal(
+    const std::pmr::memory_resource &other) const noexcept
+{
+  return this == &other;
+}
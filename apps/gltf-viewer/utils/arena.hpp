@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Number of allocations made through the global operator new since the start
+// of the program, by all threads. Only counted if the program is built with
+// GLTF_VIEWER_COUNT_HEAP_ALLOCATIONS, which replaces the global operator new,
+// 0 otherwise.
+uint64_t getHeapAllocationCount();
+
+// Whether getHeapAllocationCount() counts, reports leave the figure out if not
+bool isCountingHeapAllocations();
+
+// Memory of the structures built while loading a scene and kept until its end
+// (reachability flags, traversal stacks...). Allocations are carved out of
+// large blocks and never freed one by one, everything goes away at once in
+// release() or with the arena: buffers resized or dropped during the load
+// belong on the heap.
+//
+// Not thread safe, only give resource() to code running on the loading thread.
+class LoadArena
+{
+public:
+  explicit LoadArena(size_t initialSize = 1 << 20);
+
+  LoadArena(const LoadArena &) = delete;
+  LoadArena &operator=(const LoadArena &) = delete;
+
+  std::pmr::memory_resource *resource() { return &m_Counter; }
+
+  // Allocations served by the arena instead of the heap
+  uint64_t allocationCount() const { return m_Counter.allocationCount; }
+  uint64_t allocatedBytes() const { return m_Counter.allocatedBytes; }
+
+  void release();
+
+private:
+  class CountingResource : public std::pmr::memory_resource
+  {
+  public:
+    explicit CountingResource(std::pmr::memory_resource *upstream) :
+        m_Upstream(upstream)
+    {
+    }
+
+    uint64_t allocationCount = 0;
+    uint64_t allocatedBytes = 0;
+
+  private:
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const
+        noexcept override;
+
+    std::pmr::memory_resource *m_Upstream;
+  };
+
+  std::pmr::monotonic_buffer_resource m_Arena;
+  CountingResource m_Counter;
+};
@@ -0,0 +1,581 @@
+#include "environment.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+const float kPi = 3.14159265358979f;
+
+const size_t kSpecularSize = 256;
+const size_t kSpecularLevelCount = 6; // Down to 8x8 faces
+const size_t kSpecularSampleCount = 128; // Per texel of the rough levels
+const size_t kBrdfLutSize = 64;
+const size_t kBrdfLutSampleCount = 512;
+// Width of the level of the image the irradiance is projected from, the SH
+// keep nothing of the finer details
+const size_t kIrradianceMaxWidth = 512;
+
+// To be changed along with the results of the prefiltering
+const char kMagic[8] = {'G', 'L', 'E', 'N', 'V', 'I', 'B', '1'};
+
+// Start of a cache file, followed by irradianceSH, specularLevels and brdfLut
+struct CacheHeader
+{
+  char magic[8];
+  uint32_t specularSize;
+  uint32_t specularLevelCount;
+  uint32_t brdfLutSize;
+};
+
+// Mipmaps of an equirectangular image, each level half the size of the
+// previous one
+class EquirectPyramid
+{
+public:
+  EquirectPyramid(
+      const float *pixels, size_t width, size_t height, ThreadPool &pool)
+  {
+    m_Levels.push_back({width, height, {}});
+    m_Levels[0].texels.resize(width * height);
+    std::memcpy(m_Levels[0].texels.data(), pixels,
+        width * height * sizeof(glm::vec3));
+    while (width > 1 || height > 1) {
+      const auto &src = m_Levels.back();
+      Level dst{std::max(width / 2, size_t(1)),
+          std::max(height / 2, size_t(1)), {}};
+      dst.texels.resize(dst.width * dst.height);
+      pool.parallelFor(dst.height, 16, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+          const auto y0 = std::min(2 * y, src.height - 1);
+          const auto y1 = std::min(2 * y + 1, src.height - 1);
+          for (size_t x = 0; x < dst.width; ++x) {
+            const auto x0 = std::min(2 * x, src.width - 1);
+            const auto x1 = std::min(2 * x + 1, src.width - 1);
+            dst.texels[y * dst.width + x] =
+                0.25f * (src.texels[y0 * src.width + x0] +
+                            src.texels[y0 * src.width + x1] +
+                            src.texels[y1 * src.width + x0] +
+                            src.texels[y1 * src.width + x1]);
+          }
+        }
+      });
+      width = dst.width;
+      height = dst.height;
+      m_Levels.push_back(std::move(dst));
+    }
+  }
+
+  size_t levelCount() const { return m_Levels.size(); }
+  size_t width(size_t level) const { return m_Levels[level].width; }
+  size_t height(size_t level) const { return m_Levels[level].height; }
+
+  const glm::vec3 &texel(size_t level, size_t x, size_t y) const
+  {
+    return m_Levels[level].texels[y * m_Levels[level].width + x];
+  }
+
+  // Average solid angle of a texel of the first level
+  float texelSolidAngle() const
+  {
+    return 4.f * kPi / float(m_Levels[0].width * m_Levels[0].height);
+  }
+
+  // Trilinear sample in direction, which is normalized
+  glm::vec3 sample(const glm::vec3 &direction, float lod) const
+  {
+    const auto u = 0.5f + std::atan2(direction.z, direction.x) / (2.f * kPi);
+    const auto v = std::acos(glm::clamp(direction.y, -1.f, 1.f)) / kPi;
+    const auto lastLevel = m_Levels.size() - 1;
+    lod = glm::clamp(lod, 0.f, float(lastLevel));
+    const auto level = std::min(size_t(lod), lastLevel);
+    const auto t = lod - float(level);
+    return glm::mix(sampleLevel(level, u, v),
+        sampleLevel(std::min(level + 1, lastLevel), u, v), t);
+  }
+
+private:
+  struct Level
+  {
+    size_t width, height;
+    std::vector<glm::vec3> texels;
+  };
+
+  // Bilinear sample, repeated along u and clamped along v
+  glm::vec3 sampleLevel(size_t level, float u, float v) const
+  {
+    const auto &src = m_Levels[level];
+    const auto x = u * float(src.width) - 0.5f;
+    const auto y = glm::clamp(v * float(src.height) - 0.5f, 0.f,
+        float(src.height - 1));
+    const auto fx = std::floor(x);
+    const auto tx = x - fx;
+    const auto ty = y - std::floor(y);
+    const auto width = ptrdiff_t(src.width);
+    const auto x0 = size_t((ptrdiff_t(fx) % width + width) % width);
+    const auto x1 = (x0 + 1) % src.width;
+    const auto y0 = size_t(y);
+    const auto y1 = std::min(y0 + 1, src.height - 1);
+    const auto *row0 = &src.texels[y0 * src.width];
+    const auto *row1 = &src.texels[y1 * src.width];
+    return glm::mix(glm::mix(row0[x0], row0[x1], tx),
+        glm::mix(row1[x0], row1[x1], tx), ty);
+  }
+
+  std::vector<Level> m_Levels;
+};
+
+// Direction of the texel (u, v) in [-1, 1]^2 of a face of a GL cube map
+glm::vec3 getCubeDirection(size_t face, float u, float v)
+{
+  switch (face) {
+  case 0:
+    return glm::normalize(glm::vec3(1.f, -v, -u));
+  case 1:
+    return glm::normalize(glm::vec3(-1.f, -v, u));
+  case 2:
+    return glm::normalize(glm::vec3(u, 1.f, v));
+  case 3:
+    return glm::normalize(glm::vec3(u, -1.f, -v));
+  case 4:
+    return glm::normalize(glm::vec3(u, -v, 1.f));
+  default:
+    return glm::normalize(glm::vec3(-u, -v, -1.f));
+  }
+}
+
+glm::vec2 getHammersleyPoint(uint32_t i, uint32_t count)
+{
+  auto bits = i;
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return {float(i) / float(count), float(bits) * 2.3283064365386963e-10f};
+}
+
+// Half vector of the GGX distribution of alpha for the point xi, around z
+glm::vec3 importanceSampleGGX(const glm::vec2 &xi, float alpha)
+{
+  const auto phi = 2.f * kPi * xi.x;
+  const auto cosTheta =
+      std::sqrt((1.f - xi.y) / (1.f + (alpha * alpha - 1.f) * xi.y));
+  const auto sinTheta = std::sqrt(1.f - cosTheta * cosTheta);
+  return {sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta};
+}
+
+// A light direction of the prefiltering of a texel, around z
+struct PrefilterSample
+{
+  glm::vec3 direction;
+  float weight; // NdotL, normalized over the samples
+  float lod; // Of the level whose texels cover the solid angle of the sample
+};
+
+// Samples of the GGX lobe of roughness with N = V = z. Reading the source at
+// the level matching the solid angle of each sample (filtered importance
+// sampling) avoids the noise of bright spots missed by the few samples.
+std::vector<PrefilterSample> getPrefilterSamples(
+    float roughness, float texelSolidAngle)
+{
+  const auto alpha = roughness * roughness;
+  const auto sqrAlpha = alpha * alpha;
+  std::vector<PrefilterSample> samples;
+  float totalWeight = 0.f;
+  for (uint32_t i = 0; i < kSpecularSampleCount; ++i) {
+    const auto H = importanceSampleGGX(
+        getHammersleyPoint(i, kSpecularSampleCount), alpha);
+    const auto L = 2.f * H.z * H - glm::vec3(0, 0, 1);
+    if (L.z <= 0.f) {
+      continue;
+    }
+    // pdf of L is D * NdotH / (4 * VdotH), and NdotH == VdotH
+    const auto dDen = H.z * H.z * (sqrAlpha - 1.f) + 1.f;
+    const auto pdf = sqrAlpha / (4.f * kPi * dDen * dDen);
+    const auto sampleSolidAngle = 1.f / (float(kSpecularSampleCount) * pdf);
+    const auto lod =
+        std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.f,
+            0.f);
+    samples.push_back({L, L.z, lod});
+    totalWeight += L.z;
+  }
+  for (auto &sample : samples) {
+    sample.weight /= totalWeight;
+  }
+  return samples;
+}
+
+std::vector<glm::vec3> prefilterSpecularLevel(const EquirectPyramid &source,
+    size_t level, ThreadPool &pool)
+{
+  const auto size = kSpecularSize >> level;
+  std::vector<glm::vec3> texels(6 * size * size);
+  const auto roughness = float(level) / float(kSpecularLevelCount - 1);
+  const auto samples =
+      getPrefilterSamples(roughness, source.texelSolidAngle());
+  // The mirror level reads the source at the footprint of its texels
+  const auto mirrorLod = std::max(
+      0.5f * std::log2(4.f * kPi / float(6 * size * size) /
+                       source.texelSolidAngle()),
+      0.f);
+
+  // One row of a face per iteration
+  pool.parallelFor(6 * size, 4, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row) {
+      const auto face = row / size;
+      const auto y = row % size;
+      const auto v = 2.f * (float(y) + 0.5f) / float(size) - 1.f;
+      for (size_t x = 0; x < size; ++x) {
+        const auto u = 2.f * (float(x) + 0.5f) / float(size) - 1.f;
+        const auto N = getCubeDirection(face, u, v);
+        auto &texel = texels[row * size + x];
+        if (level == 0) {
+          texel = source.sample(N, mirrorLod);
+          continue;
+        }
+        const auto up = std::abs(N.z) < 0.999f ? glm::vec3(0, 0, 1)
+                                               : glm::vec3(1, 0, 0);
+        const auto T = glm::normalize(glm::cross(up, N));
+        const auto B = glm::cross(N, T);
+        glm::vec3 sum(0);
+        for (const auto &sample : samples) {
+          const auto L = sample.direction.x * T + sample.direction.y * B +
+                         sample.direction.z * N;
+          sum += sample.weight * source.sample(L, sample.lod);
+        }
+        texel = sum;
+      }
+    }
+  });
+  return texels;
+}
+
+void projectIrradianceSH(
+    const EquirectPyramid &source, ThreadPool &pool, glm::vec3 *irradianceSH)
+{
+  size_t level = 0;
+  while (level + 1 < source.levelCount() &&
+         source.width(level) > kIrradianceMaxWidth) {
+    ++level;
+  }
+  const auto width = source.width(level);
+  const auto height = source.height(level);
+
+  // Sums of each row, added in order so that the result does not depend on
+  // the threads
+  std::vector<glm::vec3> rowSums(9 * height, glm::vec3(0));
+  pool.parallelFor(height, 8, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; ++y) {
+      const auto theta = (float(y) + 0.5f) / float(height) * kPi;
+      const auto sinTheta = std::sin(theta);
+      const auto solidAngle = 2.f * kPi / float(width) * kPi / float(height) *
+                              sinTheta;
+      auto *sums = &rowSums[9 * y];
+      for (size_t x = 0; x < width; ++x) {
+        // Inverse of the mapping of EquirectPyramid::sample()
+        const auto phi = ((float(x) + 0.5f) / float(width) - 0.5f) * 2.f * kPi;
+        const glm::vec3 d(std::cos(phi) * sinTheta, std::cos(theta),
+            std::sin(phi) * sinTheta);
+        const auto radiance = source.texel(level, x, y) * solidAngle;
+        const float basis[9] = {1.f, d.y, d.z, d.x, d.x * d.y, d.y * d.z,
+            3.f * d.z * d.z - 1.f, d.x * d.z, d.x * d.x - d.y * d.y};
+        for (size_t i = 0; i < 9; ++i) {
+          sums[i] += radiance * basis[i];
+        }
+      }
+    }
+  });
+
+  // Squared constants of the real SH basis, once to project and once to
+  // evaluate, times the convolution by the cosine lobe of each band
+  const float band0 = kPi, band1 = 2.f * kPi / 3.f, band2 = kPi / 4.f;
+  const float factors[9] = {0.282095f * 0.282095f * band0,
+      0.488603f * 0.488603f * band1, 0.488603f * 0.488603f * band1,
+      0.488603f * 0.488603f * band1, 1.092548f * 1.092548f * band2,
+      1.092548f * 1.092548f * band2, 0.315392f * 0.315392f * band2,
+      1.092548f * 1.092548f * band2, 0.546274f * 0.546274f * band2};
+  for (size_t i = 0; i < 9; ++i) {
+    glm::vec3 sum(0);
+    for (size_t y = 0; y < height; ++y) {
+      sum += rowSums[9 * y + i];
+    }
+    irradianceSH[i] = factors[i] * sum;
+  }
+}
+
+// Split sum of the specular term of shade() in pbr_directional_light.fs.glsl,
+// integrated over a white environment
+std::vector<glm::vec2> computeBrdfLut(ThreadPool &pool)
+{
+  std::vector<glm::vec2> lut(kBrdfLutSize * kBrdfLutSize);
+  pool.parallelFor(kBrdfLutSize, 4, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; ++y) {
+      const auto roughness = (float(y) + 0.5f) / float(kBrdfLutSize);
+      const auto alpha = roughness * roughness;
+      const auto sqrAlpha = alpha * alpha;
+      for (size_t x = 0; x < kBrdfLutSize; ++x) {
+        const auto NdotV = (float(x) + 0.5f) / float(kBrdfLutSize);
+        const glm::vec3 V(std::sqrt(1.f - NdotV * NdotV), 0.f, NdotV);
+        glm::vec2 sum(0);
+        for (uint32_t i = 0; i < kBrdfLutSampleCount; ++i) {
+          const auto H = importanceSampleGGX(
+              getHammersleyPoint(i, kBrdfLutSampleCount), alpha);
+          const auto VdotH = glm::dot(V, H);
+          const auto L = 2.f * VdotH * H - V;
+          const auto NdotL = L.z;
+          if (NdotL <= 0.f || VdotH <= 0.f) {
+            continue;
+          }
+          // Height correlated visibility, divided by the pdf of L
+          const auto visDen =
+              NdotL * std::sqrt(NdotV * NdotV * (1.f - sqrAlpha) + sqrAlpha) +
+              NdotV * std::sqrt(NdotL * NdotL * (1.f - sqrAlpha) + sqrAlpha);
+          const auto G = 2.f * NdotL * VdotH / (visDen * H.z);
+          const auto Fc = std::pow(1.f - VdotH, 5.f);
+          sum += glm::vec2((1.f - Fc) * G, Fc * G);
+        }
+        lut[y * kBrdfLutSize + x] = sum / float(kBrdfLutSampleCount);
+      }
+    }
+  });
+  return lut;
+}
+
+// 64-bit FNV-1a
+uint64_t hashBytes(const char *data, size_t size, uint64_t hash)
+{
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ uint64_t(uint8_t(data[i]))) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Keyed by the content of the image rather than its path, so that an image
+// replaced in place is prefiltered again
+fs::path getCachePath(
+    const fs::path &cacheDirectory, const std::vector<char> &file)
+{
+  const uint32_t parameters[] = {uint32_t(kSpecularSize),
+      uint32_t(kSpecularLevelCount), uint32_t(kSpecularSampleCount),
+      uint32_t(kBrdfLutSize), uint32_t(kBrdfLutSampleCount),
+      uint32_t(kIrradianceMaxWidth)};
+  auto hash = hashBytes(kMagic, sizeof(kMagic), 0xcbf29ce484222325ull);
+  hash = hashBytes(reinterpret_cast<const char *>(parameters),
+      sizeof(parameters), hash);
+  hash = hashBytes(file.data(), file.size(), hash);
+  std::stringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+  return cacheDirectory / name.str();
+}
+
+bool readCache(const fs::path &path, EnvironmentLighting &lighting)
+{
+  std::ifstream file(path.string(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  CacheHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.specularSize != kSpecularSize ||
+      header.specularLevelCount != kSpecularLevelCount ||
+      header.brdfLutSize != kBrdfLutSize) {
+    return false;
+  }
+  EnvironmentLighting result;
+  file.read(reinterpret_cast<char *>(result.irradianceSH),
+      sizeof(result.irradianceSH));
+  result.specularSize = kSpecularSize;
+  for (size_t level = 0; level < kSpecularLevelCount; ++level) {
+    const auto size = kSpecularSize >> level;
+    std::vector<glm::vec3> texels(6 * size * size);
+    file.read(reinterpret_cast<char *>(texels.data()),
+        texels.size() * sizeof(glm::vec3));
+    result.specularLevels.push_back(std::move(texels));
+  }
+  result.brdfLutSize = kBrdfLutSize;
+  result.brdfLut.resize(kBrdfLutSize * kBrdfLutSize);
+  file.read(reinterpret_cast<char *>(result.brdfLut.data()),
+      result.brdfLut.size() * sizeof(glm::vec2));
+  if (!file) {
+    return false;
+  }
+  lighting = std::move(result);
+  return true;
+}
+
+void writeCache(const fs::path &path, const EnvironmentLighting &lighting)
+{
+  try {
+    fs::create_directories(path.parent_path());
+  } catch (const fs::filesystem_error &e) {
+    std::cerr << "Unable to cache the environment: " << e.what() << std::endl;
+    return;
+  }
+  CacheHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.specularSize = uint32_t(lighting.specularSize);
+  header.specularLevelCount = uint32_t(lighting.specularLevels.size());
+  header.brdfLutSize = uint32_t(lighting.brdfLutSize);
+
+  // Written aside then renamed, like the program binaries
+  const auto tmpPath = path.string() + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(lighting.irradianceSH),
+        sizeof(lighting.irradianceSH));
+    for (const auto &texels : lighting.specularLevels) {
+      file.write(reinterpret_cast<const char *>(texels.data()),
+          texels.size() * sizeof(glm::vec3));
+    }
+    file.write(reinterpret_cast<const char *>(lighting.brdfLut.data()),
+        lighting.brdfLut.size() * sizeof(glm::vec2));
+    if (!file) {
+      std::cerr << "Unable to write the environment cache " << tmpPath
+                << std::endl;
+      return;
+    }
+  }
+  std::remove(path.string().c_str()); // rename() does not replace on Windows
+  if (std::rename(tmpPath.c_str(), path.string().c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+  }
+}
+
+} // namespace
+
+EnvironmentLighting prefilterEnvironment(
+    const float *pixels, size_t width, size_t height, ThreadPool &pool)
+{
+  const EquirectPyramid source(pixels, width, height, pool);
+  EnvironmentLighting lighting;
+  projectIrradianceSH(source, pool, lighting.irradianceSH);
+  lighting.specularSize = kSpecularSize;
+  for (size_t level = 0; level < kSpecularLevelCount; ++level) {
+    lighting.specularLevels.push_back(
+        prefilterSpecularLevel(source, level, pool));
+  }
+  lighting.brdfLutSize = kBrdfLutSize;
+  lighting.brdfLut = computeBrdfLut(pool);
+  return lighting;
+}
+
+bool loadEnvironmentLighting(const fs::path &path,
+    const fs::path &cacheDirectory, ThreadPool &pool,
+    EnvironmentLighting &lighting, std::string &error, bool *cacheHit)
+{
+  if (cacheHit) {
+    *cacheHit = false;
+  }
+  std::vector<char> file;
+  {
+    std::ifstream stream(path.string(), std::ios::binary | std::ios::ate);
+    if (!stream) {
+      error = "Unable to open the environment " + path.string();
+      return false;
+    }
+    file.resize(size_t(stream.tellg()));
+    stream.seekg(0);
+    if (!stream.read(file.data(), file.size())) {
+      error = "Unable to read the environment " + path.string();
+      return false;
+    }
+  }
+
+  fs::path cachePath;
+  if (!cacheDirectory.empty()) {
+    cachePath = getCachePath(cacheDirectory, file);
+    if (readCache(cachePath, lighting)) {
+      std::clog << "Loaded prefiltered environment " << cachePath << std::endl;
+      if (cacheHit) {
+        *cacheHit = true;
+      }
+      return true;
+    }
+  }
+
+  int width = 0, height = 0, componentCount = 0;
+  auto *pixels =
+      stbi_loadf_from_memory(reinterpret_cast<const stbi_uc *>(file.data()),
+          int(file.size()), &width, &height, &componentCount, 3);
+  if (!pixels) {
+    error = "Unable to decode the environment " + path.string() + ": " +
+            stbi_failure_reason();
+    return false;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  lighting = prefilterEnvironment(pixels, size_t(width), size_t(height), pool);
+  stbi_image_free(pixels);
+  std::clog << "Prefiltered environment " << path << " (" << width << "x"
+            << height << ") in "
+            << std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " ms" << std::endl;
+
+  if (!cachePath.empty()) {
+    writeCache(cachePath, lighting);
+  }
+  return true;
+}
+
+fs::path getDefaultEnvironmentCacheDirectory()
+{
+  const auto directory = getUserCacheDirectory();
+  return directory.empty() ? directory : directory / "environments";
+}
+
+GLuint createSpecularEnvironmentTexture(const EnvironmentLighting &lighting)
+{
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+  for (size_t level = 0; level < lighting.specularLevels.size(); ++level) {
+    const auto size = lighting.specularSize >> level;
+    for (size_t face = 0; face < 6; ++face) {
+      glTexImage2D(GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face), GLint(level),
+          GL_RGB16F, GLsizei(size), GLsizei(size), 0, GL_RGB, GL_FLOAT,
+          lighting.specularLevels[level].data() + face * size * size);
+    }
+  }
+  glTexParameteri(
+      GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL,
+      GLint(lighting.specularLevels.size()) - 1);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  return texture;
+}
+
+GLuint createBrdfLutTexture(const EnvironmentLighting &lighting)
+{
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, GLsizei(lighting.brdfLutSize),
+      GLsizei(lighting.brdfLutSize), 0, GL_RG, GL_FLOAT,
+      lighting.brdfLut.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "threadpool.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Image based lighting of an equirectangular environment, prefiltered on the
+// CPU for the split sum approximation of the forward shaders: irradiance in
+// spherical harmonics for the diffuse term, a GGX prefiltered cube map and a
+// BRDF lookup table for the specular term.
+struct EnvironmentLighting
+{
+  // Irradiance of the hemisphere around n, in world space: the order 2 SH
+  // coefficients of the radiance convolved by the cosine lobe and
+  // premultiplied by the constants of the basis, so that it is the sum of
+  // irradianceSH[i] times 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2 of n.
+  glm::vec3 irradianceSH[9];
+
+  size_t specularSize = 0; // Of the faces of the first level
+  // Level i of the specular cube map, prefiltered for roughness
+  // i / (level count - 1). Faces in the GL order +X, -X, +Y, -Y, +Z, -Z, each
+  // of (specularSize >> i)^2 texels in rows.
+  std::vector<std::vector<glm::vec3>> specularLevels;
+
+  size_t brdfLutSize = 0;
+  // Scale and bias of F0 of the specular reflectance, in rows of increasing
+  // roughness and columns of increasing NdotV
+  std::vector<glm::vec2> brdfLut;
+};
+
+// Prefilters the RGB image of width x height texels in rows, with longitude
+// along x and the north pole on the first row. The texels are split among
+// the threads of pool.
+EnvironmentLighting prefilterEnvironment(
+    const float *pixels, size_t width, size_t height, ThreadPool &pool);
+
+// Lighting of the image at path, any format of stb_image but preferably .hdr.
+// It is read from cacheDirectory if it was prefiltered before, prefiltered
+// then stored there otherwise, the cache is not used if cacheDirectory is
+// empty. Sets *cacheHit if not null. Returns false with a message in error if
+// the image cannot be read.
+bool loadEnvironmentLighting(const fs::path &path,
+    const fs::path &cacheDirectory, ThreadPool &pool,
+    EnvironmentLighting &lighting, std::string &error,
+    bool *cacheHit = nullptr);
+
+// The user cache directory of the platform, under gltf-viewer/environments.
+// Empty if there is none.
+fs::path getDefaultEnvironmentCacheDirectory();
+
+// Cube map of specularLevels, with its levels as mipmaps
+GLuint createSpecularEnvironmentTexture(const EnvironmentLighting &lighting);
+
+// Two channel texture of brdfLut, clamped to its edges
+GLuint createBrdfLutTexture(const EnvironmentLighting &lighting);
@@ -26,4 +26,29 @@ namespace fs =
     std::experimental::filesystem; // Shorter namespace for experimental
                                    // filesystem standard library
 #endif
-#endif
\ No newline at end of file
+#endif
+
+#include <cstdlib>
+
+// Directory of the files the viewer caches across launches, under the user
+// cache directory of the platform. Empty if there is none.
+inline fs::path getUserCacheDirectory()
+{
+#ifdef _WIN32
+  const char *base = std::getenv("LOCALAPPDATA");
+  if (!base || !*base) {
+    return {};
+  }
+  return fs::path(base) / "gltf-viewer";
+#else
+  const char *base = std::getenv("XDG_CACHE_HOME");
+  if (base && *base) {
+    return fs::path(base) / "gltf-viewer";
+  }
+  const char *home = std::getenv("HOME");
+  if (!home || !*home) {
+    return {};
+  }
+  return fs::path(home) / ".cache" / "gltf-viewer";
+#endif
+}
@@ -0,0 +1,106 @@
+#include "filewatcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+constexpr std::chrono::milliseconds FileWatcher::kScanPeriod;
+
+FileWatcher::FileWatcher(fs::path directory) :
+    m_Directory(std::move(directory))
+{
+#ifdef __linux__
+  m_InotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_InotifyFd >= 0 &&
+      inotify_add_watch(m_InotifyFd, m_Directory.string().c_str(),
+          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(m_InotifyFd);
+    m_InotifyFd = -1;
+  }
+  if (m_InotifyFd >= 0) {
+    return;
+  }
+  std::clog << "inotify not available for " << m_Directory
+            << ", scanning it instead" << std::endl;
+#endif
+  m_WriteTimes = scan();
+  m_LastScan = std::chrono::steady_clock::now();
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+  if (m_InotifyFd >= 0) {
+    close(m_InotifyFd);
+  }
+#endif
+}
+
+std::vector<fs::path> FileWatcher::poll()
+{
+  std::vector<fs::path> changedFiles;
+#ifdef __linux__
+  if (m_InotifyFd >= 0) {
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+      const auto size = read(m_InotifyFd, buffer, sizeof(buffer));
+      if (size <= 0) {
+        // EAGAIN once the events are read
+        if (size < 0 && errno != EAGAIN && errno != EINTR) {
+          std::cerr << "Unable to read the changes of " << m_Directory
+                    << std::endl;
+        }
+        break;
+      }
+      for (auto ptr = buffer; ptr < buffer + size;) {
+        const auto *event = reinterpret_cast<const inotify_event *>(ptr);
+        if (event->len > 0) {
+          auto path = m_Directory / event->name;
+          if (std::find(begin(changedFiles), end(changedFiles), path) ==
+              end(changedFiles)) {
+            changedFiles.push_back(std::move(path));
+          }
+        }
+        ptr += sizeof(inotify_event) + event->len;
+      }
+    }
+    return changedFiles;
+  }
+#endif
+  const auto now = std::chrono::steady_clock::now();
+  if (now - m_LastScan < kScanPeriod) {
+    return changedFiles;
+  }
+  m_LastScan = now;
+  auto writeTimes = scan();
+  for (const auto &it : writeTimes) {
+    const auto previous = m_WriteTimes.find(it.first);
+    if (previous == end(m_WriteTimes) || previous->second != it.second) {
+      changedFiles.push_back(it.first);
+    }
+  }
+  m_WriteTimes = std::move(writeTimes);
+  return changedFiles;
+}
+
+FileWatcher::WriteTimes FileWatcher::scan() const
+{
+  WriteTimes writeTimes;
+  try {
+    for (fs::directory_iterator it(m_Directory), end; it != end; ++it) {
+      if (fs::is_regular_file(it->path())) {
+        writeTimes[it->path()] = fs::last_write_time(it->path());
+      }
+    }
+  } catch (const fs::filesystem_error &e) {
+    // Usually a file removed while scanning, the next scan sees it gone
+    std::cerr << "Unable to scan " << m_Directory << ": " << e.what()
+              << std::endl;
+  }
+  return writeTimes;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Reports the files of a directory written since the last poll(), without
+// blocking: with inotify on Linux, by comparing their modification times
+// elsewhere or if inotify is not available.
+//
+// Only the files directly in the directory are watched. Editors saving to a
+// temporary file renamed over the original report the original.
+class FileWatcher
+{
+public:
+  explicit FileWatcher(fs::path directory);
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  // Files written, created or renamed into the directory since the previous
+  // call, each once. Without inotify the directory is scanned at most every
+  // kScanPeriod, calling it every frame is cheap.
+  std::vector<fs::path> poll();
+
+  const fs::path &directory() const { return m_Directory; }
+
+private:
+  // file_time_type is not in boost::filesystem
+  using FileTime = decltype(fs::last_write_time(fs::path()));
+  using WriteTimes = std::map<fs::path, FileTime>;
+
+  static constexpr std::chrono::milliseconds kScanPeriod{500};
+
+  WriteTimes scan() const;
+
+  fs::path m_Directory;
+  int m_InotifyFd = -1; // -1 if scanning
+  WriteTimes m_WriteTimes;
+  std::chrono::steady_clock::time_point m_LastScan;
+};
@@ -0,0 +1,357 @@
+#include "frameprofiler.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <string>
+
+namespace
+{
+
+const float kNoTime = std::numeric_limits<float>::quiet_NaN();
+
+// Stable color of a scope, from its name
+ImU32 getScopeColor(const char *name)
+{
+  const auto hash = std::hash<std::string>()(name);
+  return ImColor::HSV(float(hash % 360) / 360.f, 0.5f, 0.75f);
+}
+
+} // namespace
+
+FrameProfiler::FrameProfiler()
+{
+  Node frame;
+  frame.name = "Frame";
+  frame.parent = -1;
+  frame.depth = 0;
+  frame.gpu = true;
+  frame.cpuMs.fill(kNoTime);
+  frame.gpuMs.fill(kNoTime);
+  m_Nodes.push_back(frame);
+  m_FrameCpuSeconds.push_back(0.);
+}
+
+FrameProfiler::~FrameProfiler()
+{
+  for (auto &frameQueries : m_Queries) {
+    glDeleteQueries(
+        GLsizei(frameQueries.queries.size()), frameQueries.queries.data());
+  }
+}
+
+void FrameProfiler::setEnabled(bool enabled) { m_Enabled = enabled; }
+
+void FrameProfiler::beginFrame()
+{
+  if (m_InFrame) {
+    return;
+  }
+  if (!m_Enabled) {
+    // Results of the frames before the pause would land in the wrong slots
+    clearQueries();
+    return;
+  }
+  ++m_Frame;
+  const auto historyIdx = m_Frame % kHistorySize;
+  for (auto &node : m_Nodes) {
+    node.callCount = 0;
+    node.cpuMs[historyIdx] = kNoTime;
+    node.gpuMs[historyIdx] = kNoTime;
+  }
+  std::fill(begin(m_FrameCpuSeconds), end(m_FrameCpuSeconds), 0.);
+
+  // The slot of this frame holds the queries of kFramesInFlight frames ago
+  auto &frameQueries = m_Queries[m_Frame % kFramesInFlight];
+  resolveQueries(frameQueries);
+  frameQueries.frame = m_Frame;
+
+  m_InFrame = true;
+  m_Stack.push_back({0, clock::now(), issueQuery()});
+  m_Nodes[0].callCount = 1;
+}
+
+void FrameProfiler::endFrame()
+{
+  if (!m_InFrame) {
+    return;
+  }
+  // Scopes left open are closed with the frame
+  while (!m_Stack.empty()) {
+    endScope();
+  }
+  m_InFrame = false;
+  const auto historyIdx = m_Frame % kHistorySize;
+  for (size_t n = 0; n < m_Nodes.size(); ++n) {
+    if (m_Nodes[n].callCount > 0) {
+      m_Nodes[n].cpuMs[historyIdx] = float(1e3 * m_FrameCpuSeconds[n]);
+    }
+  }
+}
+
+void FrameProfiler::beginScope(const char *name, bool gpu)
+{
+  if (!m_InFrame) {
+    return;
+  }
+  const auto node = findOrAddNode(m_Stack.back().node, name, gpu);
+  ++m_Nodes[node].callCount;
+  m_Stack.push_back({node, clock::now(), gpu ? issueQuery() : -1});
+}
+
+void FrameProfiler::endScope()
+{
+  if (!m_InFrame || m_Stack.empty()) {
+    return;
+  }
+  const auto scope = m_Stack.back();
+  m_Stack.pop_back();
+  const auto end = clock::now();
+  m_FrameCpuSeconds[scope.node] +=
+      std::chrono::duration<double>(end - scope.start).count();
+  if (auto *tracer = globalTracer()) {
+    tracer->addEvent("frame", m_Nodes[scope.node].name, scope.start, end);
+  }
+  if (scope.beginQuery >= 0) {
+    m_Queries[m_Frame % kFramesInFlight].samples.push_back(
+        {scope.node, scope.beginQuery, issueQuery()});
+  }
+}
+
+float FrameProfiler::getPercentile(int node, bool gpu, float p) const
+{
+  const auto &history = gpu ? m_Nodes[node].gpuMs : m_Nodes[node].cpuMs;
+  std::vector<float> times;
+  times.reserve(kHistorySize);
+  std::copy_if(begin(history), end(history), std::back_inserter(times),
+      [](float time) { return !std::isnan(time); });
+  if (times.empty()) {
+    return kNoTime;
+  }
+  const auto rank = std::min(times.size() - 1,
+      size_t(std::max(0.f, std::ceil(p * float(times.size())) - 1.f)));
+  std::nth_element(begin(times), begin(times) + rank, end(times));
+  return times[rank];
+}
+
+float FrameProfiler::getMean(int node, bool gpu) const
+{
+  const auto &history = gpu ? m_Nodes[node].gpuMs : m_Nodes[node].cpuMs;
+  auto sum = 0.f;
+  size_t count = 0;
+  for (const auto time : history) {
+    if (!std::isnan(time)) {
+      sum += time;
+      ++count;
+    }
+  }
+  return count ? sum / float(count) : kNoTime;
+}
+
+void FrameProfiler::drawGui(bool *open)
+{
+  if (!ImGui::Begin("Frame profiler", open)) {
+    ImGui::End();
+    return;
+  }
+  auto enabled = m_Enabled;
+  if (ImGui::Checkbox("Enabled", &enabled)) {
+    setEnabled(enabled);
+  }
+
+  const auto cpuMedian = getPercentile(0, false, 0.5f);
+  const auto gpuMedian = getPercentile(0, true, 0.5f);
+  if (!std::isnan(cpuMedian) && !std::isnan(gpuMedian)) {
+    ImGui::Text("Median frame: CPU %.2f ms, GPU %.2f ms, %s bound", cpuMedian,
+        gpuMedian, gpuMedian > cpuMedian ? "GPU" : "CPU");
+  }
+  ImGui::Text("GPU frames dropped: %llu",
+      (unsigned long long)m_DroppedGpuFrameCount);
+
+  // History of the frame, oldest first. GPU times come kFramesInFlight
+  // frames late.
+  const auto plotHistory = [&](const char *label, bool gpu) {
+    const auto &history = gpu ? m_Nodes[0].gpuMs : m_Nodes[0].cpuMs;
+    std::array<float, kHistorySize> values;
+    for (size_t i = 0; i < kHistorySize; ++i) {
+      const auto time = history[(m_Frame + 1 + i) % kHistorySize];
+      values[i] = std::isnan(time) ? 0.f : time;
+    }
+    ImGui::PlotLines(label, values.data(), int(kHistorySize), 0, nullptr, 0.f,
+        FLT_MAX, ImVec2(0, 60));
+  };
+  plotHistory("CPU ms", false);
+  plotHistory("GPU ms", true);
+
+  // Flame graph of the mean times: each scope is under its parent, as wide
+  // as its share of the frame
+  const auto drawFlameGraph = [&](const char *label, bool gpu) {
+    const auto frameMean = getMean(0, gpu);
+    if (std::isnan(frameMean) || frameMean <= 0.f) {
+      return;
+    }
+    int maxDepth = 0;
+    for (const auto &node : m_Nodes) {
+      if (!gpu || node.gpu) {
+        maxDepth = std::max(maxDepth, node.depth);
+      }
+    }
+    const auto rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    const auto width = ImGui::GetContentRegionAvail().x;
+    ImGui::Text("%s", label);
+    const auto graphOrigin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton(label, ImVec2(width, rowHeight * (maxDepth + 1)));
+    auto *drawList = ImGui::GetWindowDrawList();
+
+    const std::function<void(int, float, float)> drawNode =
+        [&](int n, float x, float nodeWidth) {
+          const auto &node = m_Nodes[n];
+          const ImVec2 min(x, graphOrigin.y + rowHeight * node.depth);
+          const ImVec2 max(x + nodeWidth, min.y + rowHeight - 1.f);
+          drawList->AddRectFilled(min, max, getScopeColor(node.name));
+          const auto textSize = ImGui::CalcTextSize(node.name);
+          if (textSize.x + 4.f < nodeWidth) {
+            drawList->AddText(ImVec2(min.x + 2.f, min.y), IM_COL32_WHITE,
+                node.name);
+          }
+          if (ImGui::IsMouseHoveringRect(min, max)) {
+            ImGui::BeginTooltip();
+            ImGui::Text("%s", node.name);
+            ImGui::Text("mean %.3f ms, p50 %.3f, p95 %.3f, p99 %.3f",
+                getMean(n, gpu), getPercentile(n, gpu, 0.5f),
+                getPercentile(n, gpu, 0.95f), getPercentile(n, gpu, 0.99f));
+            ImGui::Text("%zu calls in the last frame", node.callCount);
+            ImGui::EndTooltip();
+          }
+          auto childX = x;
+          for (const auto child : node.children) {
+            const auto childMean = getMean(child, gpu);
+            if (std::isnan(childMean) || (gpu && !m_Nodes[child].gpu)) {
+              continue;
+            }
+            const auto childWidth = std::min(nodeWidth * childMean /
+                                                 getMean(n, gpu),
+                x + nodeWidth - childX);
+            drawNode(child, childX, childWidth);
+            childX += childWidth;
+          }
+        };
+    drawNode(0, graphOrigin.x, width);
+  };
+  drawFlameGraph("CPU", false);
+  drawFlameGraph("GPU", true);
+
+  // Percentiles of each scope, depth first
+  if (ImGui::CollapsingHeader("Scopes", ImGuiTreeNodeFlags_DefaultOpen)) {
+    ImGui::Columns(8, "scopes");
+    for (const auto *header :
+        {"Scope", "Calls", "CPU mean", "CPU p95", "CPU p99", "GPU mean",
+            "GPU p95", "GPU p99"}) {
+      ImGui::Text("%s", header);
+      ImGui::NextColumn();
+    }
+    ImGui::Separator();
+    const std::function<void(int)> printNode = [&](int n) {
+      const auto &node = m_Nodes[n];
+      ImGui::Text("%*s%s", 2 * node.depth, "", node.name);
+      ImGui::NextColumn();
+      ImGui::Text("%zu", node.callCount);
+      ImGui::NextColumn();
+      for (const auto gpu : {false, true}) {
+        for (const auto time : {getMean(n, gpu), getPercentile(n, gpu, 0.95f),
+                 getPercentile(n, gpu, 0.99f)}) {
+          if (std::isnan(time)) {
+            ImGui::Text("-");
+          } else {
+            ImGui::Text("%.3f", time);
+          }
+          ImGui::NextColumn();
+        }
+      }
+      for (const auto child : node.children) {
+        printNode(child);
+      }
+    };
+    printNode(0);
+    ImGui::Columns(1);
+  }
+  ImGui::End();
+}
+
+int FrameProfiler::findOrAddNode(int parent, const char *name, bool gpu)
+{
+  for (const auto child : m_Nodes[parent].children) {
+    if (std::strcmp(m_Nodes[child].name, name) == 0) {
+      return child;
+    }
+  }
+  Node node;
+  node.name = name;
+  node.parent = parent;
+  node.depth = m_Nodes[parent].depth + 1;
+  node.gpu = gpu;
+  node.cpuMs.fill(kNoTime);
+  node.gpuMs.fill(kNoTime);
+  const auto idx = int(m_Nodes.size());
+  m_Nodes.push_back(node);
+  m_Nodes[parent].children.push_back(idx);
+  m_FrameCpuSeconds.push_back(0.);
+  return idx;
+}
+
+int FrameProfiler::issueQuery()
+{
+  auto &frameQueries = m_Queries[m_Frame % kFramesInFlight];
+  if (frameQueries.usedQueryCount == frameQueries.queries.size()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    frameQueries.queries.push_back(query);
+  }
+  const auto idx = int(frameQueries.usedQueryCount++);
+  glQueryCounter(frameQueries.queries[idx], GL_TIMESTAMP);
+  return idx;
+}
+
+void FrameProfiler::resolveQueries(FrameQueries &frameQueries)
+{
+  if (frameQueries.usedQueryCount > 0) {
+    // Timestamps complete in order, the last one tells for all of them
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(frameQueries.queries[frameQueries.usedQueryCount - 1],
+        GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      ++m_DroppedGpuFrameCount;
+    } else if (m_Frame - frameQueries.frame < kHistorySize) {
+      const auto historyIdx = frameQueries.frame % kHistorySize;
+      auto *tracer = globalTracer();
+      for (const auto &sample : frameQueries.samples) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frameQueries.queries[sample.beginQuery],
+            GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(
+            frameQueries.queries[sample.endQuery], GL_QUERY_RESULT, &end);
+        auto &time = m_Nodes[sample.node].gpuMs[historyIdx];
+        time = (std::isnan(time) ? 0.f : time) + float(1e-6 * (end - begin));
+        if (tracer) {
+          tracer->addGpuEvent(m_Nodes[sample.node].name, begin, end);
+        }
+      }
+    }
+  }
+  frameQueries.usedQueryCount = 0;
+  frameQueries.samples.clear();
+}
+
+void FrameProfiler::clearQueries()
+{
+  for (auto &frameQueries : m_Queries) {
+    frameQueries.usedQueryCount = 0;
+    frameQueries.samples.clear();
+  }
+}
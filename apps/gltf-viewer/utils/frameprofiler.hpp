@@ -0,0 +1,146 @@
+#pragma once
+
+#include "glfw.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical CPU and GPU timings of the last frames.
+//
+// Scopes nest within a frame and form a tree, a scope being identified by
+// its name and its parent. The CPU time of a scope is measured with
+// steady_clock, its GPU time with a GL_TIMESTAMP query at each end
+// (timestamps rather than GL_TIME_ELAPSED since elapsed time queries cannot
+// nest). Queries are only read back kFramesInFlight frames later, and
+// dropped if still not available then, so that the profiler never waits for
+// the GPU.
+//
+// Scopes entered many times per frame (e.g. once per draw) should be CPU
+// only: their times are summed over the frame and a query per call would
+// cost more than what it measures.
+//
+// Disabled until setEnabled(true), its scopes then cost a branch each.
+class FrameProfiler
+{
+public:
+  static const size_t kHistorySize = 256; // Frames
+  static const size_t kFramesInFlight = 4;
+
+  struct Node
+  {
+    const char *name; // Static string
+    int parent; // -1 for the frame itself
+    int depth;
+    bool gpu;
+    std::vector<int> children;
+    size_t callCount = 0; // In the last frame
+    // Milliseconds, by frame index modulo kHistorySize. NaN for the frames
+    // the scope did not run in or whose GPU time is unknown.
+    std::array<float, kHistorySize> cpuMs;
+    std::array<float, kHistorySize> gpuMs;
+  };
+
+  // Times the enclosing block, nothing is recorded outside of a frame or if
+  // profiler is null
+  class Scope
+  {
+  public:
+    Scope(FrameProfiler *profiler, const char *name, bool gpu = true) :
+        m_Profiler(profiler)
+    {
+      if (m_Profiler) {
+        m_Profiler->beginScope(name, gpu);
+      }
+    }
+
+    ~Scope()
+    {
+      if (m_Profiler) {
+        m_Profiler->endScope();
+      }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    FrameProfiler *m_Profiler;
+  };
+
+  FrameProfiler();
+
+  ~FrameProfiler();
+
+  FrameProfiler(const FrameProfiler &) = delete;
+  FrameProfiler &operator=(const FrameProfiler &) = delete;
+
+  bool enabled() const { return m_Enabled; }
+  // Takes effect at the next frame
+  void setEnabled(bool enabled);
+
+  // The frame is the root scope
+  void beginFrame();
+  void endFrame();
+
+  // Prefer Scope, these are for blocks that cannot be wrapped in one
+  void beginScope(const char *name, bool gpu = true);
+  void endScope();
+
+  // Node 0 is the frame
+  const std::vector<Node> &nodes() const { return m_Nodes; }
+
+  // Percentile p (in [0, 1]) of the known times of a node over the history,
+  // NaN if there is none
+  float getPercentile(int node, bool gpu, float p) const;
+  float getMean(int node, bool gpu) const;
+
+  // GPU frames whose queries were not available in time
+  uint64_t droppedGpuFrameCount() const { return m_DroppedGpuFrameCount; }
+
+  // Window with the flame graphs of the mean CPU and GPU times, the history
+  // of the frame times, and the percentiles of each scope
+  void drawGui(bool *open);
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct OpenScope
+  {
+    int node;
+    clock::time_point start;
+    int beginQuery; // Index in the queries of the frame, -1 if CPU only
+  };
+
+  struct GpuSample
+  {
+    int node;
+    int beginQuery;
+    int endQuery;
+  };
+
+  // Queries of a frame still in flight
+  struct FrameQueries
+  {
+    uint64_t frame = 0;
+    std::vector<GLuint> queries; // Grown as needed, reused
+    size_t usedQueryCount = 0;
+    std::vector<GpuSample> samples;
+  };
+
+  int findOrAddNode(int parent, const char *name, bool gpu);
+  int issueQuery();
+  void resolveQueries(FrameQueries &frameQueries);
+  void clearQueries();
+
+  bool m_Enabled = false;
+  bool m_InFrame = false;
+  uint64_t m_Frame = 0;
+  uint64_t m_DroppedGpuFrameCount = 0;
+  std::vector<Node> m_Nodes;
+  std::vector<double> m_FrameCpuSeconds; // By node, summed over the calls
+  std::vector<OpenScope> m_Stack;
+  std::array<FrameQueries, kFramesInFlight> m_Queries;
+};
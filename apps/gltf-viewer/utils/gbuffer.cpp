@@ -0,0 +1,72 @@
+#include "gbuffer.hpp"
+
+namespace
+{
+
+GLuint createTarget(GLenum format, GLsizei width, GLsizei height)
+{
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+  // Read with texelFetch() only
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+} // namespace
+
+bool resizeGBuffer(GBuffer &gbuffer, GLsizei width, GLsizei height)
+{
+  if (gbuffer.framebuffer && gbuffer.width == width &&
+      gbuffer.height == height) {
+    return true;
+  }
+  deleteGBuffer(gbuffer);
+  gbuffer.width = width;
+  gbuffer.height = height;
+  gbuffer.baseColorMetallic = createTarget(GL_SRGB8_ALPHA8, width, height);
+  gbuffer.normalRoughness = createTarget(GL_RGB10_A2, width, height);
+  gbuffer.emissive = createTarget(GL_R11F_G11F_B10F, width, height);
+  gbuffer.depth = createTarget(GL_DEPTH_COMPONENT32F, width, height);
+
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGenFramebuffers(1, &gbuffer.framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gbuffer.framebuffer);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      gbuffer.baseColorMetallic, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, gbuffer.normalRoughness, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, gbuffer.emissive, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, gbuffer.depth, 0);
+  const GLenum drawBuffers[] = {
+      GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+  glDrawBuffers(3, drawBuffers);
+  const auto status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+
+  gbuffer.tileCountX = (width + kLightTileSize - 1) / kLightTileSize;
+  gbuffer.tileCountY = (height + kLightTileSize - 1) / kLightTileSize;
+  glGenBuffers(1, &gbuffer.tileLightMasks);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, gbuffer.tileLightMasks);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,
+      gbuffer.tileCountX * gbuffer.tileCountY * sizeof(GLuint), nullptr,
+      GL_DYNAMIC_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return status == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void deleteGBuffer(GBuffer &gbuffer)
+{
+  glDeleteFramebuffers(1, &gbuffer.framebuffer);
+  const GLuint textures[] = {gbuffer.baseColorMetallic,
+      gbuffer.normalRoughness, gbuffer.emissive, gbuffer.depth};
+  glDeleteTextures(4, textures);
+  glDeleteBuffers(1, &gbuffer.tileLightMasks);
+  gbuffer = GBuffer();
+}
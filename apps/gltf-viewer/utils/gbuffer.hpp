@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Side of the square tiles of the deferred path, LIGHT_TILE_SIZE of the
+// shaders
+const GLsizei kLightTileSize = 16;
+
+// Binding point of the TileLights storage buffer of the deferred shaders
+const GLuint TILE_LIGHTS_BINDING = 2;
+
+// Render targets of the deferred path: the G-buffer written by the
+// GBUFFER_PASS variants of pbr_directional_light.fs.glsl, shaded once per
+// pixel by its DEFERRED_SHADING variants. 16 bytes per pixel.
+struct GBuffer
+{
+  GLsizei width = 0;
+  GLsizei height = 0;
+  GLuint framebuffer = 0;
+  // Attachment 0, GL_SRGB8_ALPHA8: base color, metallic in alpha (linear)
+  GLuint baseColorMetallic = 0;
+  // Attachment 1, GL_RGB10_A2: octahedral encoding of the view space normal
+  // in xy, roughness in z
+  GLuint normalRoughness = 0;
+  // Attachment 2, GL_R11F_G11F_B10F
+  GLuint emissive = 0;
+  GLuint depth = 0; // GL_DEPTH_COMPONENT32F
+  // The lights reaching each tile of kLightTileSize^2 pixels, a uint per tile
+  // in rows written by light_culling.cs.glsl: bit i for point light i, bit
+  // kMaxPointLightCount for the spot light
+  GLuint tileLightMasks = 0;
+  GLsizei tileCountX = 0;
+  GLsizei tileCountY = 0;
+};
+
+// Creates the targets of gbuffer for width x height pixels, or recreates them
+// if it was created for another size. Returns false if the framebuffer is not
+// complete.
+bool resizeGBuffer(GBuffer &gbuffer, GLsizei width, GLsizei height);
+
+void deleteGBuffer(GBuffer &gbuffer);
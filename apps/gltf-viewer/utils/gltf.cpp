@@ -3,7 +3,605 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+
+using json = nlohmann::json;
+
+const json &getArray(const json &object, const char *key)
+{
+  static const json empty = json::array();
+  const auto it = object.find(key);
+  return it != object.end() && it->is_array() ? *it : empty;
+}
+
+int toIndex(const json &value)
+{
+  return value.is_number_integer() ? value.get<int>() : -1;
+}
+
+int getIndex(const json &object, const char *key)
+{
+  const auto it = object.find(key);
+  return it != object.end() ? toIndex(*it) : -1;
+}
+
+// Objects of each kind reached from the selected nodes
+struct Reachability
+{
+  std::pmr::vector<uint8_t> nodes, meshes, skins, materials, textures,
+      images, accessors, bufferViews, buffers;
+
+  Reachability(const json &document, std::pmr::memory_resource *arena) :
+      nodes(getArray(document, "nodes").size(), 0, arena),
+      meshes(getArray(document, "meshes").size(), 0, arena),
+      skins(getArray(document, "skins").size(), 0, arena),
+      materials(getArray(document, "materials").size(), 0, arena),
+      textures(getArray(document, "textures").size(), 0, arena),
+      images(getArray(document, "images").size(), 0, arena),
+      accessors(getArray(document, "accessors").size(), 0, arena),
+      bufferViews(getArray(document, "bufferViews").size(), 0, arena),
+      buffers(getArray(document, "buffers").size(), 0, arena)
+  {
+  }
+};
+
+// Returns true the first time an index is marked, false if it was already
+// marked or is out of range
+bool mark(std::pmr::vector<uint8_t> &reached, int index)
+{
+  if (index < 0 || size_t(index) >= reached.size() || reached[index]) {
+    return false;
+  }
+  reached[index] = 1;
+  return true;
+}
+
+// Materials reference textures with textureInfo objects ({"index": i}),
+// possibly nested in extensions
+void markTextureInfos(const json &value, Reachability &reach)
+{
+  if (!value.is_object() && !value.is_array()) {
+    return;
+  }
+  for (auto it = value.begin(); it != value.end(); ++it) {
+    if (value.is_object() && it->is_object() &&
+        (it.key().find("Texture") != std::string::npos ||
+            it.key().find("texture") != std::string::npos)) {
+      mark(reach.textures, getIndex(*it, "index"));
+    }
+    markTextureInfos(*it, reach);
+  }
+}
+
+// Textures reference their image with "source", extensions may add others
+void markTextureSources(const json &value, Reachability &reach)
+{
+  if (!value.is_object()) {
+    return;
+  }
+  mark(reach.images, getIndex(value, "source"));
+  for (const auto &child : value) {
+    markTextureSources(child, reach);
+  }
+}
+
+void markAccessor(const json &document, int accessorIdx, Reachability &reach)
+{
+  if (!mark(reach.accessors, accessorIdx)) {
+    return;
+  }
+  const auto &accessor = getArray(document, "accessors")[accessorIdx];
+  mark(reach.bufferViews, getIndex(accessor, "bufferView"));
+  const auto sparse = accessor.find("sparse");
+  if (sparse != accessor.end() && sparse->is_object()) {
+    for (const auto key : {"indices", "values"}) {
+      const auto it = sparse->find(key);
+      if (it != sparse->end()) {
+        mark(reach.bufferViews, getIndex(*it, "bufferView"));
+      }
+    }
+  }
+}
+
+Reachability computeReachability(
+    const json &document, int sceneIdx, std::pmr::memory_resource *arena)
+{
+  Reachability reach(document, arena);
+  const auto &nodes = getArray(document, "nodes");
+  std::pmr::vector<int> stack(arena);
+  if (sceneIdx >= 0) {
+    for (const auto &root :
+        getArray(getArray(document, "scenes")[sceneIdx], "nodes")) {
+      stack.push_back(toIndex(root));
+    }
+  }
+  while (!stack.empty()) {
+    const auto nodeIdx = stack.back();
+    stack.pop_back();
+    if (!mark(reach.nodes, nodeIdx)) {
+      continue;
+    }
+    const auto &node = nodes[nodeIdx];
+    mark(reach.meshes, getIndex(node, "mesh"));
+    mark(reach.skins, getIndex(node, "skin"));
+    for (const auto &child : getArray(node, "children")) {
+      stack.push_back(toIndex(child));
+    }
+  }
+
+  const auto &meshes = getArray(document, "meshes");
+  for (size_t i = 0; i < reach.meshes.size(); ++i) {
+    if (!reach.meshes[i]) {
+      continue;
+    }
+    for (const auto &primitive : getArray(meshes[i], "primitives")) {
+      const auto attributes = primitive.find("attributes");
+      if (attributes != primitive.end()) {
+        for (const auto &accessor : *attributes) {
+          markAccessor(document, toIndex(accessor), reach);
+        }
+      }
+      for (const auto &target : getArray(primitive, "targets")) {
+        for (const auto &accessor : target) {
+          markAccessor(document, toIndex(accessor), reach);
+        }
+      }
+      markAccessor(document, getIndex(primitive, "indices"), reach);
+      mark(reach.materials, getIndex(primitive, "material"));
+    }
+  }
+  const auto &skins = getArray(document, "skins");
+  for (size_t i = 0; i < reach.skins.size(); ++i) {
+    if (reach.skins[i]) {
+      markAccessor(document, getIndex(skins[i], "inverseBindMatrices"), reach);
+    }
+  }
+  // Only the channels animating a reached node
+  for (const auto &animation : getArray(document, "animations")) {
+    const auto &samplers = getArray(animation, "samplers");
+    for (const auto &channel : getArray(animation, "channels")) {
+      const auto target = channel.find("target");
+      const auto samplerIdx = getIndex(channel, "sampler");
+      if (target == channel.end() || samplerIdx < 0 ||
+          size_t(samplerIdx) >= samplers.size()) {
+        continue;
+      }
+      const auto nodeIdx = getIndex(*target, "node");
+      if (nodeIdx >= 0 && size_t(nodeIdx) < reach.nodes.size() &&
+          reach.nodes[nodeIdx]) {
+        markAccessor(document, getIndex(samplers[samplerIdx], "input"), reach);
+        markAccessor(document, getIndex(samplers[samplerIdx], "output"), reach);
+      }
+    }
+  }
+
+  const auto &materials = getArray(document, "materials");
+  for (size_t i = 0; i < reach.materials.size(); ++i) {
+    if (reach.materials[i]) {
+      markTextureInfos(materials[i], reach);
+    }
+  }
+  const auto &textures = getArray(document, "textures");
+  for (size_t i = 0; i < reach.textures.size(); ++i) {
+    if (reach.textures[i]) {
+      markTextureSources(textures[i], reach);
+    }
+  }
+  const auto &images = getArray(document, "images");
+  for (size_t i = 0; i < reach.images.size(); ++i) {
+    if (reach.images[i]) {
+      mark(reach.bufferViews, getIndex(images[i], "bufferView"));
+    }
+  }
+  const auto &bufferViews = getArray(document, "bufferViews");
+  for (size_t i = 0; i < reach.bufferViews.size(); ++i) {
+    if (reach.bufferViews[i]) {
+      mark(reach.buffers, getIndex(bufferViews[i], "buffer"));
+    }
+  }
+  return reach;
+}
+
+// Replace what is not reached by stubs that tinygltf loads for free: they
+// keep their index so that the rest of the document stays valid
+void pruneUnreachable(json &document, const Reachability &reach)
+{
+  for (size_t i = 0; i < reach.buffers.size(); ++i) {
+    if (!reach.buffers[i]) {
+      auto &buffer = document["buffers"][i];
+      buffer["uri"] = "data:application/octet-stream;base64,AA==";
+      buffer["byteLength"] = 1;
+    }
+  }
+  for (size_t i = 0; i < reach.bufferViews.size(); ++i) {
+    auto &bufferView = document["bufferViews"][i];
+    const auto bufferIdx = getIndex(bufferView, "buffer");
+    if (!reach.bufferViews[i] && bufferIdx >= 0 &&
+        size_t(bufferIdx) < reach.buffers.size() && !reach.buffers[bufferIdx]) {
+      bufferView["byteOffset"] = 0;
+      bufferView["byteLength"] = 1;
+      bufferView.erase("byteStride");
+    }
+  }
+  // Accessors without bufferView read as zeros
+  for (size_t i = 0; i < reach.accessors.size(); ++i) {
+    if (!reach.accessors[i]) {
+      document["accessors"][i].erase("bufferView");
+      document["accessors"][i].erase("sparse");
+    }
+  }
+  for (size_t i = 0; i < reach.meshes.size(); ++i) {
+    if (!reach.meshes[i]) {
+      document["meshes"][i]["primitives"] = json::array();
+    }
+  }
+  for (size_t i = 0; i < reach.skins.size(); ++i) {
+    if (!reach.skins[i]) {
+      document["skins"][i].erase("joints");
+      document["skins"][i].erase("inverseBindMatrices");
+    }
+  }
+  for (size_t i = 0; i < reach.images.size(); ++i) {
+    if (!reach.images[i]) {
+      auto &image = document["images"][i];
+      image.erase("bufferView");
+      image["uri"] = "data:image/png;base64,AA==";
+    }
+  }
+}
+
+// Image loader skipping the images that are not reached, user data is
+// the Reachability of the document
+bool loadReachableImage(tinygltf::Image *image, const int imageIdx,
+    std::string *err, std::string *warn, int reqWidth, int reqHeight,
+    const unsigned char *bytes, int size, void *userData)
+{
+  const auto &reach = *(const Reachability *)userData;
+  if (imageIdx >= 0 && size_t(imageIdx) < reach.images.size() &&
+      !reach.images[imageIdx]) {
+    return true;
+  }
+  return tinygltf::LoadImageData(image, imageIdx, err, warn, reqWidth,
+      reqHeight, bytes, size, nullptr);
+}
+
+// Compare names in place, json::value() would copy every name
+bool hasName(const json &object, const std::string &name)
+{
+  const auto it = object.find("name");
+  return it != object.end() && it->is_string() &&
+         it->get_ref<const std::string &>() == name;
+}
+
+// Image loader used when the images are streamed later
+bool skipImage(tinygltf::Image *, const int, std::string *, std::string *, int,
+    int, const unsigned char *, int, void *)
+{
+  return true;
+}
+
+// Record where the bytes of the reached buffers and images are, then replace
+// all of them by stubs
+void extractSources(
+    json &document, const Reachability &reach, GltfSources &sources)
+{
+  sources.buffers.assign(reach.buffers.size(), DataSource{});
+  for (size_t i = 0; i < reach.buffers.size(); ++i) {
+    auto &buffer = document["buffers"][i];
+    if (reach.buffers[i]) {
+      sources.buffers[i].uri = buffer.value("uri", "");
+      sources.buffers[i].byteLength = buffer.value("byteLength", size_t(0));
+    }
+    buffer["uri"] = "data:application/octet-stream;base64,AA==";
+    buffer["byteLength"] = 1;
+  }
+  sources.images.assign(reach.images.size(), DataSource{});
+  for (size_t i = 0; i < reach.images.size(); ++i) {
+    auto &image = document["images"][i];
+    if (reach.images[i]) {
+      sources.images[i].uri = image.value("uri", "");
+      sources.images[i].bufferView = getIndex(image, "bufferView");
+    }
+    image.erase("bufferView");
+    image["uri"] = "data:image/png;base64,AA==";
+  }
+}
+
+// Index of the scene named or numbered scene, -1 if there is none
+int findScene(const json &document, const std::string &scene)
+{
+  const auto &scenes = getArray(document, "scenes");
+  if (scene.empty()) {
+    const auto defaultScene = getIndex(document, "scene");
+    return defaultScene >= 0 ? defaultScene : (scenes.empty() ? -1 : 0);
+  }
+  if (std::all_of(begin(scene), end(scene),
+          [](unsigned char c) { return std::isdigit(c); })) {
+    try {
+      const auto sceneIdx = std::stoul(scene);
+      return sceneIdx < scenes.size() ? int(sceneIdx) : -1;
+    } catch (const std::out_of_range &) {
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    if (hasName(scenes[i], scene)) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+int findNode(const json &document, const std::string &name)
+{
+  const auto &nodes = getArray(document, "nodes");
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (hasName(nodes[i], name)) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+float toFloat(const json &value)
+{
+  return value.is_number() ? value.get<float>() : 0.f;
+}
+
+// Local matrix of a node of the document, as getLocalToWorldMatrix() of its
+// tinygltf::Node
+glm::mat4 getLocalMatrix(const json &node)
+{
+  const auto &matrix = getArray(node, "matrix");
+  if (matrix.size() == 16) {
+    glm::mat4 localMatrix;
+    for (size_t i = 0; i < 16; ++i) {
+      localMatrix[i / 4][i % 4] = toFloat(matrix[i]);
+    }
+    return localMatrix;
+  }
+  glm::mat4 localMatrix(1.f);
+  const auto &translation = getArray(node, "translation");
+  if (translation.size() == 3) {
+    localMatrix = glm::translate(localMatrix,
+        glm::vec3(toFloat(translation[0]), toFloat(translation[1]),
+            toFloat(translation[2])));
+  }
+  const auto &rotation = getArray(node, "rotation");
+  if (rotation.size() == 4) {
+    localMatrix *= glm::mat4_cast(glm::quat(toFloat(rotation[3]),
+        toFloat(rotation[0]), toFloat(rotation[1]), toFloat(rotation[2])));
+  }
+  const auto &scale = getArray(node, "scale");
+  if (scale.size() == 3) {
+    localMatrix = glm::scale(localMatrix,
+        glm::vec3(toFloat(scale[0]), toFloat(scale[1]), toFloat(scale[2])));
+  }
+  return localMatrix;
+}
+
+// Product of the local matrices of the ancestors of a node, identity for a
+// root. Their animations are not applied.
+glm::mat4 getParentMatrix(const json &document, int nodeIdx)
+{
+  const auto &nodes = getArray(document, "nodes");
+  std::vector<int> parents(nodes.size(), -1);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    for (const auto &child : getArray(nodes[i], "children")) {
+      const auto childIdx = toIndex(child);
+      if (childIdx >= 0 && size_t(childIdx) < nodes.size() &&
+          parents[childIdx] < 0) {
+        parents[childIdx] = int(i);
+      }
+    }
+  }
+  glm::mat4 parentMatrix(1.f);
+  // At most one step per node, the hierarchy of an invalid file may loop
+  auto parent = parents[nodeIdx];
+  for (size_t depth = 0; parent >= 0 && depth < nodes.size(); ++depth) {
+    parentMatrix = getLocalMatrix(nodes[parent]) * parentMatrix;
+    parent = parents[parent];
+  }
+  return parentMatrix;
+}
+
+size_t countReached(const std::pmr::vector<uint8_t> &reached)
+{
+  return size_t(std::count(begin(reached), end(reached), 1));
+}
+
+bool loadDocument(const fs::path &gltfFilePath, tinygltf::Model &model,
+    const LoadOptions &options, std::pmr::memory_resource *arena,
+    GltfSources *pSources)
+{
+  std::clog << "Loading file " << gltfFilePath << std::endl;
+  std::ifstream file(gltfFilePath.string(), std::ios::binary);
+  if (!file) {
+    std::cerr << "Unable to open " << gltfFilePath << std::endl;
+    return false;
+  }
+  // Read the text in one go, it is dropped once parsed
+  std::vector<char> text;
+  file.seekg(0, std::ios::end);
+  const auto fileSize = file.tellg();
+  file.seekg(0, std::ios::beg);
+  if (fileSize < 0) {
+    std::cerr << "Unable to read " << gltfFilePath << std::endl;
+    return false;
+  }
+  text.resize(size_t(fileSize));
+  file.read(text.data(), std::streamsize(text.size()));
+  json document;
+  try {
+    document = json::parse(begin(text), end(text));
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to parse glTF file: " << e.what() << std::endl;
+    return false;
+  }
+
+  // The selection becomes the default scene, a node being loaded as the root
+  // of a scene of its own
+  auto sceneIdx = findScene(document, options.scene);
+  if (!options.scene.empty() && sceneIdx < 0) {
+    std::cerr << "No scene " << options.scene << " in " << gltfFilePath
+              << std::endl;
+    return false;
+  }
+  if (!options.node.empty()) {
+    const auto nodeIdx = findNode(document, options.node);
+    if (nodeIdx < 0) {
+      std::cerr << "No node named " << options.node << " in " << gltfFilePath
+                << std::endl;
+      return false;
+    }
+    // The transforms of its ancestors are baked in a root of its own, so
+    // that the node stays in place
+    auto rootIdx = nodeIdx;
+    const auto parentMatrix = getParentMatrix(document, nodeIdx);
+    if (parentMatrix != glm::mat4(1.f)) {
+      auto matrix = json::array();
+      for (size_t i = 0; i < 16; ++i) {
+        matrix.push_back(parentMatrix[i / 4][i % 4]);
+      }
+      rootIdx = int(getArray(document, "nodes").size());
+      document["nodes"].push_back(
+          {{"name", options.node + " ancestors"}, {"matrix", matrix},
+              {"children", {nodeIdx}}});
+    }
+    sceneIdx = int(getArray(document, "scenes").size());
+    document["scenes"].push_back(
+        {{"name", options.node}, {"nodes", {rootIdx}}});
+  }
+  if (sceneIdx >= 0) {
+    document["scene"] = sceneIdx;
+  }
+
+  const auto reach = computeReachability(document, sceneIdx, arena);
+  size_t totalBytes = 0, reachedBytes = 0;
+  const auto &buffers = getArray(document, "buffers");
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    const auto byteLength = buffers[i].value("byteLength", size_t(0));
+    totalBytes += byteLength;
+    reachedBytes += reach.buffers[i] ? byteLength : 0;
+  }
+  std::clog << "Scene " << sceneIdx << ": " << countReached(reach.nodes)
+            << "/" << reach.nodes.size() << " nodes, "
+            << countReached(reach.buffers) << "/" << reach.buffers.size()
+            << " buffers (" << reachedBytes << "/" << totalBytes << " bytes), "
+            << countReached(reach.images) << "/" << reach.images.size()
+            << " images" << std::endl;
+  pruneUnreachable(document, reach);
+
+  tinygltf::TinyGLTF loader;
+  loader.SetImageLoader(loadReachableImage, (void *)&reach);
+  if (pSources) {
+    pSources->baseDir = gltfFilePath.parent_path();
+    extractSources(document, reach, *pSources);
+    loader.SetImageLoader(skipImage, nullptr);
+  }
+  std::string err;
+  std::string warn;
+
+  const auto prunedDocument = document.dump();
+  bool ret = loader.LoadASCIIFromString(&model, &err, &warn,
+      prunedDocument.c_str(), (unsigned int)prunedDocument.size(),
+      gltfFilePath.parent_path().string());
+
+  if (!warn.empty()) {
+    std::cerr << warn << std::endl;
+  }
+
+  if (!err.empty()) {
+    std::cerr << err << std::endl;
+  }
+
+  if (!ret) {
+    std::cerr << "Failed to parse glTF file" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool loadGltfFile(const fs::path &gltfFilePath, tinygltf::Model &model,
+    const LoadOptions &options, std::pmr::memory_resource *arena)
+{
+  return loadDocument(gltfFilePath, model, options, arena, nullptr);
+}
+
+bool loadGltfStructure(const fs::path &gltfFilePath, tinygltf::Model &model,
+    GltfSources &sources, const LoadOptions &options,
+    std::pmr::memory_resource *arena)
+{
+  return loadDocument(gltfFilePath, model, options, arena, &sources);
+}
+
+bool getPositionBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax)
+{
+  const auto positionIt = primitive.attributes.find("POSITION");
+  if (positionIt == end(primitive.attributes) || positionIt->second < 0) {
+    return false;
+  }
+  const auto &accessor = model.accessors[positionIt->second];
+  if (accessor.minValues.size() != 3 || accessor.maxValues.size() != 3) {
+    return false;
+  }
+  bboxMin = glm::vec3(
+      accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+  bboxMax = glm::vec3(
+      accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+  return true;
+}
+
+bool getTexCoordBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec2 &uvMin, glm::vec2 &uvMax)
+{
+  const auto texCoordIt = primitive.attributes.find("TEXCOORD_0");
+  if (texCoordIt == end(primitive.attributes) || texCoordIt->second < 0) {
+    return false;
+  }
+  const auto &accessor = model.accessors[texCoordIt->second];
+  // Normalized integer coordinates have their bounds in the integer range
+  if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+      accessor.minValues.size() != 2 || accessor.maxValues.size() != 2) {
+    return false;
+  }
+  uvMin = glm::vec2(accessor.minValues[0], accessor.minValues[1]);
+  uvMax = glm::vec2(accessor.maxValues[0], accessor.maxValues[1]);
+  return true;
+}
+
+void getAccessorBuffers(const tinygltf::Model &model, int accessorIdx,
+    std::pmr::vector<int> &outBuffers)
+{
+  if (accessorIdx < 0) {
+    return;
+  }
+  const auto &accessor = model.accessors[accessorIdx];
+  for (const auto bufferViewIdx : {accessor.bufferView,
+           accessor.sparse.isSparse ? accessor.sparse.indices.bufferView : -1,
+           accessor.sparse.isSparse ? accessor.sparse.values.bufferView : -1}) {
+    if (bufferViewIdx >= 0) {
+      outBuffers.push_back(model.bufferViews[bufferViewIdx].buffer);
+    }
+  }
+}
 
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix)
@@ -49,7 +647,9 @@ void computeSceneBounds(
           const auto &node = model.nodes[nodeIdx];
           const glm::mat4 modelMatrix =
               getLocalToWorldMatrix(node, parentMatrix);
-          if (node.mesh >= 0) {
+          // Skinned meshes ignore the transform of their node, their
+          // bounds depend on the pose (see computeSkinnedBounds())
+          if (node.mesh >= 0 && node.skin < 0) {
             const auto &mesh = model.meshes[node.mesh];
             for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
               const auto &primitive = mesh.primitives[pIdx];
@@ -65,6 +665,26 @@ void computeSceneBounds(
                           << std::endl;
                 continue;
               }
+              // Resolve sparse accessors and accessors without bufferView,
+              // the bounds then include all the vertices
+              const auto isIndexAccessorDense =
+                  primitive.indices < 0 ||
+                  (model.accessors[primitive.indices].bufferView >= 0 &&
+                      !model.accessors[primitive.indices].sparse.isSparse);
+              if (positionAccessor.bufferView < 0 ||
+                  positionAccessor.sparse.isSparse || !isIndexAccessorDense) {
+                std::vector<glm::vec3> positions(positionAccessor.count);
+                if (!positions.empty()) {
+                  readAccessorAsFloat(model, positionAccessor, &positions[0].x);
+                }
+                for (const auto &localPosition : positions) {
+                  const auto worldPosition =
+                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
+                  bboxMin = glm::min(bboxMin, worldPosition);
+                  bboxMax = glm::max(bboxMax, worldPosition);
+                }
+                continue;
+              }
               const auto &positionBufferView =
                   model.bufferViews[positionAccessor.bufferView];
               const auto byteOffset =
@@ -150,4 +770,286 @@ void computeSceneBounds(
       updateBounds(nodeIdx, glm::mat4(1));
     }
   }
-}
\ No newline at end of file
+}
+
+std::vector<glm::vec4> computeTangent(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+  const auto positionIt = primitive.attributes.find("POSITION");
+  const auto texCoordIt = primitive.attributes.find("TEXCOORD_0");
+  if (primitive.mode != TINYGLTF_MODE_TRIANGLES ||
+      positionIt == end(primitive.attributes) ||
+      texCoordIt == end(primitive.attributes)) {
+    return {};
+  }
+  const auto &positionAccessor = model.accessors[positionIt->second];
+  const auto &texCoordAccessor = model.accessors[texCoordIt->second];
+  if (positionAccessor.type != TINYGLTF_TYPE_VEC3 ||
+      texCoordAccessor.type != TINYGLTF_TYPE_VEC2 ||
+      positionAccessor.count == 0 ||
+      texCoordAccessor.count < positionAccessor.count) {
+    return {};
+  }
+  std::vector<glm::vec3> positions(positionAccessor.count);
+  std::vector<glm::vec2> texCoords(texCoordAccessor.count);
+  readAccessorAsFloat(model, positionAccessor, &positions[0].x);
+  readAccessorAsFloat(model, texCoordAccessor, &texCoords[0].x);
+  std::vector<uint32_t> indices;
+  if (primitive.indices >= 0) {
+    indices.resize(model.accessors[primitive.indices].count);
+    if (!indices.empty()) {
+      readAccessorAsUint(
+          model, model.accessors[primitive.indices], indices.data());
+    }
+  } else {
+    indices.resize(positions.size());
+    std::iota(begin(indices), end(indices), 0);
+  }
+
+  // Sum the tangents of the triangles sharing a vertex
+  std::vector<glm::vec4> tangents(positions.size(), glm::vec4(0));
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const auto i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+    if (i0 >= positions.size() || i1 >= positions.size() ||
+        i2 >= positions.size()) {
+      continue;
+    }
+    const auto edge1 = positions[i1] - positions[i0];
+    const auto edge2 = positions[i2] - positions[i0];
+    const auto deltaUV1 = texCoords[i1] - texCoords[i0];
+    const auto deltaUV2 = texCoords[i2] - texCoords[i0];
+    const auto det = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+    if (std::abs(det) < 1e-12f) {
+      continue;
+    }
+    const auto tangent = (deltaUV2.y * edge1 - deltaUV1.y * edge2) / det;
+    for (const auto v : {i0, i1, i2}) {
+      tangents[v] += glm::vec4(tangent, 0);
+    }
+  }
+  for (auto &tangent : tangents) {
+    const auto length = glm::length(glm::vec3(tangent));
+    tangent = length > 0 ? glm::vec4(glm::vec3(tangent) / length, 1)
+                         : glm::vec4(1, 0, 0, 1);
+  }
+  return tangents;
+}
+
+size_t getAccessorByteStride(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor)
+{
+  const auto elementSize =
+      size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+             tinygltf::GetNumComponentsInType(accessor.type));
+  if (accessor.bufferView < 0) {
+    return elementSize;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  return bufferView.byteStride ? bufferView.byteStride : elementSize;
+}
+
+namespace
+{
+
+template <typename OutType>
+OutType readComponent(const unsigned char *pSrc, int componentType,
+    bool normalized)
+{
+  switch (componentType) {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return OutType(*(const float *)pSrc);
+  case TINYGLTF_COMPONENT_TYPE_BYTE: {
+    const auto value = *(const int8_t *)pSrc;
+    return normalized ? OutType(std::max(value / 127.f, -1.f)) : OutType(value);
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+    const auto value = *(const uint8_t *)pSrc;
+    return normalized ? OutType(value / 255.f) : OutType(value);
+  }
+  case TINYGLTF_COMPONENT_TYPE_SHORT: {
+    const auto value = *(const int16_t *)pSrc;
+    return normalized ? OutType(std::max(value / 32767.f, -1.f))
+                      : OutType(value);
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+    const auto value = *(const uint16_t *)pSrc;
+    return normalized ? OutType(value / 65535.f) : OutType(value);
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return OutType(*(const uint32_t *)pSrc);
+  }
+  std::cerr << "Accessor with bad componentType " << componentType
+            << ", reading 0" << std::endl;
+  return OutType(0);
+}
+
+// Read the elements stored in the bufferView of accessor, ignoring its
+// sparse substitution
+template <typename OutType>
+void readDenseAccessor(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, OutType *outValues)
+{
+  const auto numComponents =
+      size_t(tinygltf::GetNumComponentsInType(accessor.type));
+  if (accessor.bufferView < 0) {
+    // No data, all elements are zero
+    std::fill(outValues, outValues + accessor.count * numComponents, 0);
+    return;
+  }
+  const auto &bufferView = model.bufferViews[accessor.bufferView];
+  const auto &buffer = model.buffers[bufferView.buffer];
+  const auto byteStride = getAccessorByteStride(model, accessor);
+  const auto componentSize =
+      size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType));
+  const auto *pData =
+      buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+
+  if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT &&
+      std::is_same<OutType, float>::value &&
+      byteStride == numComponents * sizeof(float)) {
+    // Tightly packed floats, fast path
+    std::memcpy(outValues, pData, accessor.count * byteStride);
+    return;
+  }
+
+  for (size_t i = 0; i < accessor.count; ++i) {
+    const auto *pElement = pData + i * byteStride;
+    for (size_t c = 0; c < numComponents; ++c) {
+      outValues[i * numComponents + c] = readComponent<OutType>(
+          pElement + c * componentSize, accessor.componentType,
+          accessor.normalized);
+    }
+  }
+}
+
+// The indices and values of a sparse accessor are tightly packed accessors of
+// their own
+tinygltf::Accessor getSparseIndicesAccessor(const tinygltf::Accessor &accessor)
+{
+  tinygltf::Accessor indices;
+  indices.bufferView = accessor.sparse.indices.bufferView;
+  indices.byteOffset = size_t(accessor.sparse.indices.byteOffset);
+  indices.componentType = accessor.sparse.indices.componentType;
+  indices.type = TINYGLTF_TYPE_SCALAR;
+  indices.count = size_t(std::max(accessor.sparse.count, 0));
+  return indices;
+}
+
+tinygltf::Accessor getSparseValuesAccessor(const tinygltf::Accessor &accessor)
+{
+  auto values = accessor;
+  values.bufferView = accessor.sparse.values.bufferView;
+  values.byteOffset = size_t(accessor.sparse.values.byteOffset);
+  values.count = size_t(std::max(accessor.sparse.count, 0));
+  values.sparse.isSparse = false;
+  return values;
+}
+
+template <typename OutType>
+void readAccessor(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, OutType *outValues)
+{
+  readDenseAccessor(model, accessor, outValues);
+  if (!accessor.sparse.isSparse) {
+    return;
+  }
+  const auto numComponents =
+      size_t(tinygltf::GetNumComponentsInType(accessor.type));
+  const auto indicesAccessor = getSparseIndicesAccessor(accessor);
+  std::vector<uint32_t> indices(indicesAccessor.count);
+  std::vector<OutType> values(indicesAccessor.count * numComponents);
+  readDenseAccessor(model, indicesAccessor, indices.data());
+  readDenseAccessor(model, getSparseValuesAccessor(accessor), values.data());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (indices[i] < accessor.count) {
+      std::copy_n(values.data() + i * numComponents, numComponents,
+          outValues + indices[i] * numComponents);
+    }
+  }
+}
+
+} // namespace
+
+void readAccessorAsFloat(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, float *outValues)
+{
+  readAccessor(model, accessor, outValues);
+}
+
+void readAccessorAsUint(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, uint32_t *outValues)
+{
+  readAccessor(model, accessor, outValues);
+}
+
+std::vector<SparseAccessorRange> resolveSparseAccessor(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor,
+    size_t maxGap)
+{
+  std::vector<SparseAccessorRange> ranges;
+  if (!accessor.sparse.isSparse) {
+    return ranges;
+  }
+  const auto indicesAccessor = getSparseIndicesAccessor(accessor);
+  std::vector<uint32_t> indices(indicesAccessor.count);
+  readDenseAccessor(model, indicesAccessor, indices.data());
+
+  // Indices must be strictly increasing, sort them anyway to merge ranges
+  std::vector<uint32_t> order(indices.size());
+  std::iota(begin(order), end(order), 0);
+  std::sort(begin(order), end(order),
+      [&](uint32_t lhs, uint32_t rhs) { return indices[lhs] < indices[rhs]; });
+
+  const auto elementSize =
+      size_t(tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+             tinygltf::GetNumComponentsInType(accessor.type));
+  const auto byteStride = getAccessorByteStride(model, accessor);
+  const unsigned char *pBase = nullptr;
+  if (accessor.bufferView >= 0) {
+    const auto &bufferView = model.bufferViews[accessor.bufferView];
+    pBase = model.buffers[bufferView.buffer].data.data() +
+            bufferView.byteOffset + accessor.byteOffset;
+  }
+  const unsigned char *pValues = nullptr;
+  if (accessor.sparse.values.bufferView >= 0) {
+    const auto &bufferView =
+        model.bufferViews[accessor.sparse.values.bufferView];
+    pValues = model.buffers[bufferView.buffer].data.data() +
+              bufferView.byteOffset + accessor.sparse.values.byteOffset;
+  }
+  if (!pValues) {
+    return ranges;
+  }
+
+  size_t i = 0;
+  while (i < order.size()) {
+    const auto first = size_t(indices[order[i]]);
+    if (first >= accessor.count) {
+      break; // Sorted, all the next ones are out of range too
+    }
+    // Extend the range while the next sparse element is close enough
+    auto j = i + 1;
+    while (j < order.size() && indices[order[j]] < accessor.count &&
+           indices[order[j]] - indices[order[j - 1]] <= maxGap + 1) {
+      ++j;
+    }
+    const auto last = size_t(indices[order[j - 1]]);
+
+    SparseAccessorRange range;
+    range.firstElement = first;
+    range.elementCount = last - first + 1;
+    // Copy on write of the base bufferView, including interleaved bytes
+    range.data.resize((range.elementCount - 1) * byteStride + elementSize, 0);
+    if (pBase) {
+      std::memcpy(range.data.data(), pBase + first * byteStride,
+          range.data.size());
+    }
+    for (auto k = i; k < j; ++k) {
+      std::memcpy(range.data.data() + (indices[order[k]] - first) * byteStride,
+          pValues + order[k] * elementSize, elementSize);
+    }
+    ranges.push_back(std::move(range));
+    i = j;
+  }
+  return ranges;
+}
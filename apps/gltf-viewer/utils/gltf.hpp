@@ -1,10 +1,124 @@
 #pragma once
 
+#include "filesystem.hpp"
+
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Part of a glTF file to load
+struct LoadOptions
+{
+  std::string scene; // Index or name of the scene, empty for the default one
+  std::string node; // Name of a node to load alone with its subtree
+  // Keep buffers and images on the CPU once uploaded, see releaseBulkData()
+  bool keepCpuData = false;
+  // JSON file the viewer writes its LoadProfiler report to, none if empty
+  std::string reportPath;
+};
+
+// Load a .gltf file, printing warnings and errors on std::cerr.
+//
+// The selected scene, or a new scene whose only root is the selected node,
+// becomes model.defaultScene. The buffers, bufferViews, accessors and images
+// it does not reach are replaced by empty stubs before tinygltf parses the
+// file, so they are neither read from disk, decoded nor uploaded.
+//
+// The structures living until the end of the load, such as the objects
+// reached from the selection, are allocated from arena (see LoadArena). The
+// model itself and the scratch buffers use the heap.
+bool loadGltfFile(const fs::path &gltfFilePath, tinygltf::Model &model,
+    const LoadOptions &options = {},
+    std::pmr::memory_resource *arena = std::pmr::get_default_resource());
+
+// Where the bytes of a buffer or an image are, for loaders reading them
+// outside of tinygltf
+struct DataSource
+{
+  std::string uri; // Data URI or path relative to the glTF file
+  int bufferView = -1; // Images only, -1 if the image has an uri
+  size_t byteLength = 0; // Buffers only
+};
+
+// Sources of the buffers and images of a glTF file, indexed like the model.
+// Those not reached by the selected scene have neither uri nor bufferView.
+struct GltfSources
+{
+  fs::path baseDir;
+  std::vector<DataSource> buffers;
+  std::vector<DataSource> images;
+};
+
+// Same selection as loadGltfFile, but only the document is parsed: every
+// buffer of model holds a single byte and every image is empty. sources tells
+// where to read them from later (see StreamingLoader).
+bool loadGltfStructure(const fs::path &gltfFilePath, tinygltf::Model &model,
+    GltfSources &sources, const LoadOptions &options = {},
+    std::pmr::memory_resource *arena = std::pmr::get_default_resource());
+
+// Local bounds of a primitive from the min and max of its POSITION accessor,
+// false if they are missing. Does not read any buffer.
+bool getPositionBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax);
+
+// Range of the TEXCOORD_0 of a primitive from the min and max of its
+// accessor, which are optional: false if they are missing
+bool getTexCoordBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec2 &uvMin, glm::vec2 &uvMax);
+
+// Append the buffers read by an accessor (its bufferView and the sparse
+// indices and values) to outBuffers
+void getAccessorBuffers(const tinygltf::Model &model, int accessorIdx,
+    std::pmr::vector<int> &outBuffers);
+
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix);
 
 void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
\ No newline at end of file
+    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+
+// Per vertex tangents of a triangle list, from its POSITION and TEXCOORD_0,
+// with w = 1. Empty if the primitive has no texture coordinates or is not a
+// triangle list.
+std::vector<glm::vec4> computeTangent(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive);
+
+// Byte stride between two elements of an accessor (the size of an element if
+// the bufferView is tightly packed)
+size_t getAccessorByteStride(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor);
+
+// Read the accessor.count elements of an accessor in outValues, converted to
+// float (normalized integers are mapped to [0, 1] or [-1, 1]), with the
+// substitution of sparse accessors applied. outValues must have room for
+// accessor.count * number of components floats.
+void readAccessorAsFloat(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, float *outValues);
+
+// Same for integer accessors (indices, joints). outValues must have room for
+// accessor.count * number of components integers.
+void readAccessorAsUint(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, uint32_t *outValues);
+
+// A range of consecutive elements of a sparse accessor, densified. data holds
+// elementCount elements laid out with getAccessorByteStride(): a copy of the
+// base bufferView (zeros if the accessor has none) with the sparse elements
+// written over it.
+struct SparseAccessorRange
+{
+  size_t firstElement;
+  size_t elementCount;
+  std::vector<unsigned char> data;
+};
+
+// Densify only the elements substituted by a sparse accessor, sparse elements
+// at most maxGap elements apart sharing the same range. The size of the
+// ranges is proportional to accessor.sparse.count, not to accessor.count.
+// Returns no range if the accessor is not sparse.
+std::vector<SparseAccessorRange> resolveSparseAccessor(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor,
+    size_t maxGap = 16);
@@ -1,65 +1,123 @@
 #include "images.hpp"
+#include "threadpool.hpp"
 
-#include <cassert>
+#include <algorithm>
+#include <cstdint>
 #include <glad/glad.h>
 #include <iostream>
+#include <vector>
 
-void renderToImage(size_t width, size_t height, size_t numComponents,
-    unsigned char *outPixels, std::function<void()> drawScene)
-{
-  GLint previousTextureObject = 0;
-  GLint previousFramebufferObject = 0;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-  // Save previous GL state that we will change in order to put it back after
-  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextureObject);
-  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebufferObject);
+namespace
+{
 
-  GLuint textureObject = 0;
+// Side of the tiles of renderToImageSupersampled() at most, their targets
+// taking about as much memory as those of a window
+const size_t kMaxTileSize = 2048;
 
-  glGenTextures(1, &textureObject);
+// Targets the scene is drawn in, and those it is resolved to if multisampled
+struct ImageFramebuffer
+{
+  GLuint framebuffer = 0;
+  GLuint renderbuffers[2] = {0, 0}; // Color and depth
+  GLuint resolveFramebuffer = 0;
+  GLuint resolveRenderbuffer = 0;
+};
 
-  glBindTexture(GL_TEXTURE_2D, textureObject);
+// GL state changed by the render to image, put back by restore()
+struct SavedState
+{
+  GLint drawFramebuffer = 0;
+  GLint readFramebuffer = 0;
+  GLint renderbuffer = 0;
+  GLint packAlignment = 4;
 
-  // Lets avoid warnings
-  const auto w = GLsizei(width);
-  const auto h = GLsizei(height);
+  SavedState()
+  {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+  }
 
-  // if we want better quality, we can use multisampling, but for testing
-  // purpose it is useless todo replace with glTexStorage2DMultisample (in that
-  // case need to todo glBlitFramebuffer in another one in order to be able to
-  // glGetTexImage)
-  // https://stackoverflow.com/questions/14019910/how-does-glteximage2dmultisample-work
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+  void restore() const
+  {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(drawFramebuffer));
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(readFramebuffer));
+    glBindRenderbuffer(GL_RENDERBUFFER, GLuint(renderbuffer));
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+  }
+};
 
-  GLuint depthTexture;
-  glGenTextures(1, &depthTexture);
+GLsizei getSampleCount(size_t samples)
+{
+  if (samples <= 1) {
+    return 0;
+  }
+  GLint maxSamples = 0;
+  glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+  return std::min(GLsizei(samples), GLsizei(maxSamples));
+}
 
-  glBindTexture(GL_TEXTURE_2D, depthTexture);
+void deleteImageFramebuffer(ImageFramebuffer &buffer)
+{
+  glDeleteFramebuffers(1, &buffer.framebuffer);
+  glDeleteRenderbuffers(2, buffer.renderbuffers);
+  glDeleteFramebuffers(1, &buffer.resolveFramebuffer);
+  glDeleteRenderbuffers(1, &buffer.resolveRenderbuffer);
+  buffer = ImageFramebuffer{};
+}
 
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, w, h);
+// Leaves buffer.framebuffer bound to GL_DRAW_FRAMEBUFFER
+bool createImageFramebuffer(
+    ImageFramebuffer &buffer, GLsizei width, GLsizei height, GLsizei samples)
+{
+  // RGBA8 as the default framebuffer of the window, the multisampled colors
+  // are averaged the same way by the resolve
+  glGenRenderbuffers(2, buffer.renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, buffer.renderbuffers[0]);
+  glRenderbufferStorageMultisample(
+      GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, buffer.renderbuffers[1]);
+  glRenderbufferStorageMultisample(
+      GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT32F, width, height);
 
-  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
+  auto complete = true;
+  if (samples > 0) {
+    glGenRenderbuffers(1, &buffer.resolveRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, buffer.resolveRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
 
-  GLuint framebufferObject = 0;
-  glGenFramebuffers(1, &framebufferObject);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebufferObject);
+    glGenFramebuffers(1, &buffer.resolveFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buffer.resolveFramebuffer);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, buffer.resolveRenderbuffer);
+    complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) ==
+               GL_FRAMEBUFFER_COMPLETE;
+  }
 
-  glFramebufferTexture(
-      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureObject, 0);
-  glFramebufferTexture(
-      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+  glGenFramebuffers(1, &buffer.framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buffer.framebuffer);
+  glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER, buffer.renderbuffers[0]);
+  glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+      GL_RENDERBUFFER, buffer.renderbuffers[1]);
 
   GLenum drawBuffers[1] = {GL_COLOR_ATTACHMENT0};
   glDrawBuffers(1, drawBuffers);
 
-  const auto framebufferStatus = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
-  assert(framebufferStatus == GL_FRAMEBUFFER_COMPLETE);
-
-  drawScene();
+  return complete && glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) ==
+                         GL_FRAMEBUFFER_COMPLETE;
+}
 
+void warnIfFramebufferChanged(const ImageFramebuffer &buffer)
+{
   GLint currentlyBoundFBO = 0;
   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &currentlyBoundFBO);
-  if (currentlyBoundFBO != framebufferObject) {
+  if (GLuint(currentlyBoundFBO) != buffer.framebuffer) {
     // Display a warning on clog
     // It may not be an error because the drawScene() function might have render
     // to the framebuffer but unbound it after.
@@ -68,11 +126,185 @@ void renderToImage(size_t width, size_t height, size_t numComponents,
            "changed during drawScene. It might lead to unexpected behavior."
         << std::endl;
   }
+}
 
-  glBindTexture(GL_TEXTURE_2D, textureObject);
-  glGetTexImage(GL_TEXTURE_2D, 0, numComponents == 3 ? GL_RGB : GL_RGBA,
+// Reads the width x height pixels at the bottom left of buffer, resolved
+// first if multisampled
+void readImage(const ImageFramebuffer &buffer, GLsizei width, GLsizei height,
+    size_t numComponents, unsigned char *outPixels)
+{
+  auto readFramebuffer = buffer.framebuffer;
+  if (buffer.resolveFramebuffer) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, buffer.framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buffer.resolveFramebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    readFramebuffer = buffer.resolveFramebuffer;
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  // Rows of 3 components are not 4 bytes aligned
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, numComponents == 3 ? GL_RGB : GL_RGBA,
       GL_UNSIGNED_BYTE, outPixels);
+}
+
+// sums[i] += row[i], eight sums per instruction with SSE2
+void addRow(const unsigned char *row, size_t length, uint16_t *sums)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  const auto zero = _mm_setzero_si128();
+  for (; i + 16 <= length; i += 16) {
+    const auto bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    auto *pSums = reinterpret_cast<__m128i *>(sums + i);
+    _mm_storeu_si128(pSums,
+        _mm_add_epi16(_mm_loadu_si128(pSums), _mm_unpacklo_epi8(bytes, zero)));
+    _mm_storeu_si128(pSums + 1, _mm_add_epi16(_mm_loadu_si128(pSums + 1),
+                                    _mm_unpackhi_epi8(bytes, zero)));
+  }
+#endif
+  for (; i < length; ++i) {
+    sums[i] += row[i];
+  }
+}
+
+} // namespace
+
+void renderToImage(size_t width, size_t height, size_t numComponents,
+    unsigned char *outPixels, std::function<void()> drawScene, size_t samples)
+{
+  // Save previous GL state that we will change in order to put it back after
+  const SavedState state;
+
+  // Lets avoid warnings
+  const auto w = GLsizei(width);
+  const auto h = GLsizei(height);
+
+  ImageFramebuffer buffer;
+  if (!createImageFramebuffer(buffer, w, h, getSampleCount(samples))) {
+    std::cerr << "Unable to create the framebuffer of the image" << std::endl;
+    deleteImageFramebuffer(buffer);
+    state.restore();
+    return;
+  }
+
+  drawScene();
+
+  warnIfFramebufferChanged(buffer);
+  readImage(buffer, w, h, numComponents, outPixels);
+
+  deleteImageFramebuffer(buffer);
+  state.restore();
+}
+
+glm::mat4 getTileMatrix(const ImageTile &tile)
+{
+  // Scales the tile to the size of the clip space then moves its center to
+  // the origin, in clip coordinates so translations are multiplied by w
+  const auto imageSize = glm::vec2(tile.imageWidth, tile.imageHeight);
+  const auto tileSize = glm::vec2(tile.width, tile.height);
+  const auto tileOrigin = glm::vec2(tile.x, tile.y);
+  glm::mat4 matrix(1.f);
+  matrix[0][0] = imageSize.x / tileSize.x;
+  matrix[1][1] = imageSize.y / tileSize.y;
+  const auto translation = (imageSize - 2.f * tileOrigin - tileSize) / tileSize;
+  matrix[3][0] = translation.x;
+  matrix[3][1] = translation.y;
+  return matrix;
+}
+
+void renderToImageSupersampled(size_t width, size_t height,
+    size_t numComponents, size_t factor, unsigned char *outPixels,
+    std::function<void(const ImageTile &)> drawTile, size_t samples)
+{
+  factor = std::max(size_t(1), std::min(factor, kMaxSupersamplingFactor));
+  if (factor == 1) {
+    renderToImage(width, height, numComponents, outPixels,
+        [&]() { drawTile({0, 0, width, height, width, height}); }, samples);
+    return;
+  }
+
+  const SavedState state;
+
+  GLint maxRenderbufferSize = 0;
+  GLint maxViewportDims[2] = {0, 0};
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+  glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+  // Tiles are whole blocks of factor x factor pixels, downsampled alone
+  const auto maxTileSize = std::min({kMaxTileSize, size_t(maxRenderbufferSize),
+                               size_t(maxViewportDims[0]),
+                               size_t(maxViewportDims[1])}) /
+                           factor * factor;
+  const auto imageWidth = width * factor;
+  const auto imageHeight = height * factor;
+  const auto tileWidth = std::min(maxTileSize, imageWidth);
+  const auto tileHeight = std::min(maxTileSize, imageHeight);
+
+  ImageFramebuffer buffer;
+  if (!createImageFramebuffer(buffer, GLsizei(tileWidth), GLsizei(tileHeight),
+          getSampleCount(samples))) {
+    std::cerr << "Unable to create the framebuffer of the image" << std::endl;
+    deleteImageFramebuffer(buffer);
+    state.restore();
+    return;
+  }
+
+  std::vector<unsigned char> tilePixels(tileWidth * tileHeight * numComponents);
+  for (size_t y = 0; y < imageHeight; y += tileHeight) {
+    for (size_t x = 0; x < imageWidth; x += tileWidth) {
+      const ImageTile tile{x, y, std::min(tileWidth, imageWidth - x),
+          std::min(tileHeight, imageHeight - y), imageWidth, imageHeight};
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buffer.framebuffer);
+      drawTile(tile);
+
+      warnIfFramebufferChanged(buffer);
+      readImage(buffer, GLsizei(tile.width), GLsizei(tile.height),
+          numComponents, tilePixels.data());
+      downsampleImage(tile.width, tile.height, numComponents, factor,
+          tilePixels.data(),
+          outPixels + ((y / factor) * width + x / factor) * numComponents,
+          width * numComponents);
+    }
+  }
+
+  deleteImageFramebuffer(buffer);
+  state.restore();
+}
+
+void downsampleImage(size_t width, size_t height, size_t numComponents,
+    size_t factor, const unsigned char *pixels, unsigned char *outPixels,
+    size_t outRowLength)
+{
+  const auto rowLength = width * numComponents;
+  const auto outWidth = width / factor;
+  const auto outHeight = height / factor;
+  // The sums of factor^2 bytes fit in 16 bits
+  const auto weight = 1.f / float(factor * factor);
+
+  globalThreadPool().parallelFor(outHeight, 8, [&](size_t begin, size_t end) {
+    std::vector<uint16_t> sums(rowLength);
+    for (size_t outY = begin; outY < end; ++outY) {
+      // Sums of the columns of the block rows, then of the blocks
+      std::fill(sums.begin(), sums.end(), uint16_t(0));
+      const auto *pBlockRow = pixels + outY * factor * rowLength;
+      for (size_t row = 0; row < factor; ++row) {
+        addRow(pBlockRow + row * rowLength, rowLength, sums.data());
+      }
 
-  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebufferObject);
-}
\ No newline at end of file
+      auto *pOut = outPixels + outY * outRowLength;
+      for (size_t outX = 0; outX < outWidth; ++outX) {
+        const auto *pSums = sums.data() + outX * factor * numComponents;
+        for (size_t c = 0; c < numComponents; ++c) {
+          uint32_t sum = 0;
+          for (size_t i = 0; i < factor; ++i) {
+            sum += pSums[i * numComponents + c];
+          }
+          pOut[outX * numComponents + c] =
+              (unsigned char)(float(sum) * weight + 0.5f);
+        }
+      }
+    }
+  });
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
+#include <glm/glm.hpp>
 
 template <typename ComponentType>
 void flipImageYAxis(
@@ -18,7 +20,8 @@ void flipImageYAxis(
 }
 
 void renderToImage(size_t width, size_t height, size_t numComponents,
-    unsigned char *outPixels, std::function<void()> drawScene);
+    unsigned char *outPixels, std::function<void()> drawScene,
+    size_t samples = 0);
 // Setup GL state in order to render in texture, call drawScene() then get the
 // texture from the GPU and store it on outPixels[0 : width * height *
 // numComponent]. Then restore the previous GL state.
@@ -27,4 +30,44 @@ void renderToImage(size_t width, size_t height, size_t numComponents,
 // GL_DRAW_FRAMEBUFFER.
 // It means that if drawScene change GL_DRAW_FRAMEBUFFER, in must restore it
 // before doing final rendering (for example for deferred rendering,
-// GL_DRAW_FRAMEBUFFER must be restored before the shading pass).
\ No newline at end of file
+// GL_DRAW_FRAMEBUFFER must be restored before the shading pass).
+//
+// With samples > 1 the scene is drawn in multisampled renderbuffers (at most
+// GL_MAX_SAMPLES samples), resolved with glBlitFramebuffer() before the read.
+
+// Rectangle of an image rendered in tiles, in pixels from its bottom left
+// corner
+struct ImageTile
+{
+  size_t x;
+  size_t y;
+  size_t width;
+  size_t height;
+  size_t imageWidth;
+  size_t imageHeight;
+};
+
+// Matrix to apply to the clip space of the whole image so that tile covers
+// the viewport: getTileMatrix(tile) * projMatrix
+glm::mat4 getTileMatrix(const ImageTile &tile);
+
+// Largest supersampling factor of renderToImageSupersampled()
+const size_t kMaxSupersamplingFactor = 16;
+
+// renderToImage() of an image factor times larger in each dimension, then
+// downsampled to width x height. The large image is drawn in tiles that fit
+// in the GL limits: drawTile(tile) must draw it on the currently bound
+// GL_DRAW_FRAMEBUFFER in a viewport of tile.width x tile.height, with its
+// projection multiplied by getTileMatrix(tile). Each tile is downsampled by
+// the global thread pool once read.
+void renderToImageSupersampled(size_t width, size_t height,
+    size_t numComponents, size_t factor, unsigned char *outPixels,
+    std::function<void(const ImageTile &)> drawTile, size_t samples = 0);
+
+// Box filter of the blocks of factor x factor pixels of pixels, rows of
+// width * numComponents bytes, into the rows of outRowLength bytes of
+// outPixels. width and height are multiples of factor, factor is at most
+// kMaxSupersamplingFactor.
+void downsampleImage(size_t width, size_t height, size_t numComponents,
+    size_t factor, const unsigned char *pixels, unsigned char *outPixels,
+    size_t outRowLength);
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "imagestore.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace
+{
+
+const char *const kFileExtension = ".levels";
+
+// Files left by the stores of processes which did not end normally
+void removeStaleFiles(const fs::path &directory)
+{
+  const auto expiration =
+      fs::file_time_type::clock::now() - std::chrono::hours(24);
+  for (const auto &file : fs::directory_iterator(directory)) {
+    if (file.path().extension() == kFileExtension &&
+        fs::last_write_time(file.path()) < expiration) {
+      fs::remove(file.path());
+    }
+  }
+}
+
+} // namespace
+
+ImageStore::ImageStore(fs::path directory, size_t budgetBytes) :
+    m_Directory(std::move(directory)), m_BudgetBytes(budgetBytes)
+{
+  if (m_Directory.empty()) {
+    return;
+  }
+  try {
+    fs::create_directories(m_Directory);
+    removeStaleFiles(m_Directory);
+  } catch (const fs::filesystem_error &e) {
+    std::cerr << "Image spilling disabled: " << e.what() << std::endl;
+    m_Directory.clear();
+    return;
+  }
+  std::random_device device;
+  std::ostringstream prefix;
+  prefix << std::hex << device() << device();
+  m_FilePrefix = prefix.str();
+}
+
+ImageStore::~ImageStore()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_IoMutex);
+    m_IoCondition.wait(lock, [&]() { return m_PendingIoCount == 0; });
+  }
+  applyIoResults();
+  for (ImageId image = 0; image < m_Entries.size(); ++image) {
+    if (m_Entries[image].file == FileState::Written ||
+        m_Entries[image].file == FileState::Failed) {
+      std::remove(getPath(image).string().c_str());
+    }
+  }
+}
+
+fs::path ImageStore::getDefaultDirectory()
+{
+  const auto directory = getUserCacheDirectory();
+  return directory.empty() ? directory : directory / "images";
+}
+
+ImageStore::ImageId ImageStore::add(StreamedImage image, int keptLevel)
+{
+  Entry entry;
+  entry.keptLevel = keptLevel;
+  entry.byteSize = image.data.size();
+  entry.fineByteSize = image.levelOffsets[keptLevel];
+  entry.kept = std::make_shared<const Bytes>(
+      begin(image.data) + entry.fineByteSize, end(image.data));
+  if (entry.fineByteSize > 0) {
+    entry.fine = std::make_shared<const Bytes>(std::move(image.data));
+  }
+  image.data = Bytes();
+  entry.layout = std::move(image);
+  entry.lastUseFrame = m_Frame;
+  m_ResidentBytes += entry.byteSize;
+  m_Entries.push_back(std::move(entry));
+  return m_Entries.size() - 1;
+}
+
+size_t ImageStore::getLevelsBytes(ImageId image, int level) const
+{
+  const auto &entry = m_Entries[image];
+  return size_t(level) < entry.layout.levelCount()
+             ? entry.byteSize - entry.layout.levelOffsets[level]
+             : 0;
+}
+
+bool ImageStore::lock(ImageId image)
+{
+  applyIoResults();
+  auto &entry = m_Entries[image];
+  entry.lastUseFrame = m_Frame;
+  if (entry.fine || entry.fineByteSize == 0) {
+    return true;
+  }
+  // Dropped but not freed yet
+  if ((entry.fine = entry.droppedFine.lock())) {
+    m_ResidentBytes += entry.fineByteSize;
+    return true;
+  }
+  if (!entry.reading) {
+    startRead(image);
+  }
+  return false;
+}
+
+const unsigned char *ImageStore::getLevel(ImageId image, int level,
+    std::shared_ptr<const void> &keepAlive) const
+{
+  const auto &entry = m_Entries[image];
+  const auto offset = entry.layout.levelOffsets[level];
+  if (level >= entry.keptLevel) {
+    keepAlive = entry.kept;
+    return entry.kept->data() + offset - entry.fineByteSize;
+  }
+  keepAlive = entry.fine;
+  return entry.fine ? entry.fine->data() + offset : nullptr;
+}
+
+void ImageStore::update()
+{
+  applyIoResults();
+  if (m_ResidentBytes > m_BudgetBytes && !m_Directory.empty()) {
+    std::vector<std::pair<uint64_t, ImageId>> victims;
+    for (ImageId image = 0; image < m_Entries.size(); ++image) {
+      const auto &entry = m_Entries[image];
+      if (entry.fine && entry.lastUseFrame < m_Frame &&
+          entry.file != FileState::Failed) {
+        victims.emplace_back(entry.lastUseFrame, image);
+      }
+    }
+    std::sort(begin(victims), end(victims));
+    // Levels are only dropped once in their file, those being written are
+    // dropped in a later frame
+    size_t writingBytes = 0;
+    for (const auto &victim : victims) {
+      if (m_ResidentBytes <= m_BudgetBytes + writingBytes) {
+        break;
+      }
+      auto &entry = m_Entries[victim.second];
+      if (entry.file == FileState::None) {
+        startWrite(victim.second);
+      }
+      if (entry.file == FileState::Writing) {
+        writingBytes += entry.fineByteSize;
+        continue;
+      }
+      entry.droppedFine = entry.fine;
+      entry.fine.reset();
+      m_ResidentBytes -= entry.fineByteSize;
+    }
+  }
+  ++m_Frame;
+}
+
+ImageStore::Stats ImageStore::stats() const
+{
+  auto stats = m_Stats;
+  stats.budgetBytes = m_BudgetBytes;
+  stats.residentBytes = m_ResidentBytes;
+  stats.imageCount = m_Entries.size();
+  for (const auto &entry : m_Entries) {
+    if (!entry.fine && entry.fineByteSize > 0) {
+      ++stats.spilledCount;
+    }
+    if (entry.reading) {
+      ++stats.pendingReadCount;
+    }
+  }
+  return stats;
+}
+
+fs::path ImageStore::getPath(ImageId image) const
+{
+  return m_Directory /
+         (m_FilePrefix + '-' + std::to_string(image) + kFileExtension);
+}
+
+void ImageStore::startWrite(ImageId image)
+{
+  auto &entry = m_Entries[image];
+  entry.file = FileState::Writing;
+  {
+    std::lock_guard<std::mutex> lock(m_IoMutex);
+    ++m_PendingIoCount;
+  }
+  globalThreadPool().submit([this, image, path = getPath(image),
+                                bytes = entry.fine,
+                                size = entry.fineByteSize]() {
+    std::ofstream file(path.string(), std::ios::binary);
+    file.write(reinterpret_cast<const char *>(bytes->data()),
+        std::streamsize(size));
+    file.close();
+    if (!file) {
+      std::cerr << "Unable to spill image levels to " << path << std::endl;
+    }
+    endIo({image, false, bool(file), nullptr});
+  });
+}
+
+void ImageStore::startRead(ImageId image)
+{
+  auto &entry = m_Entries[image];
+  entry.reading = true;
+  {
+    std::lock_guard<std::mutex> lock(m_IoMutex);
+    ++m_PendingIoCount;
+  }
+  globalThreadPool().submit(
+      [this, image, path = getPath(image), size = entry.fineByteSize]() {
+        auto bytes = std::make_shared<Bytes>(size);
+        std::ifstream file(path.string(), std::ios::binary);
+        const bool ok = bool(file.read(
+            reinterpret_cast<char *>(bytes->data()), std::streamsize(size)));
+        if (!ok) {
+          std::cerr << "Unable to read image levels back from " << path
+                    << std::endl;
+        }
+        endIo({image, true, ok, ok ? std::move(bytes) : nullptr});
+      });
+}
+
+void ImageStore::endIo(IoResult result)
+{
+  std::lock_guard<std::mutex> lock(m_IoMutex);
+  m_IoResults.push_back(std::move(result));
+  --m_PendingIoCount;
+  m_IoCondition.notify_all();
+}
+
+void ImageStore::applyIoResults()
+{
+  std::vector<IoResult> results;
+  {
+    std::lock_guard<std::mutex> lock(m_IoMutex);
+    results.swap(m_IoResults);
+  }
+  for (auto &result : results) {
+    auto &entry = m_Entries[result.image];
+    if (!result.read) {
+      entry.file = result.ok ? FileState::Written : FileState::Failed;
+      if (result.ok) {
+        m_Stats.writtenBytes += entry.fineByteSize;
+      }
+      continue;
+    }
+    // A failed read is tried again at the next lock()
+    entry.reading = false;
+    if (result.ok && !entry.fine) {
+      entry.fine = std::move(result.bytes);
+      m_ResidentBytes += entry.fineByteSize;
+      ++m_Stats.readCount;
+      m_Stats.readBytes += entry.fineByteSize;
+      // Kept for the frame of its promotion
+      entry.lastUseFrame = m_Frame;
+    }
+  }
+}
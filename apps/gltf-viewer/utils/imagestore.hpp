@@ -0,0 +1,143 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "streaming.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Decoded images of the TextureStreamer, within a host memory budget.
+//
+// The coarse levels of an image, from its kept level to the last one, always
+// stay in memory. Its finer levels, the bulk of it, are dropped when the
+// store exceeds its budget, least recently used first: they are written once
+// to a file of the spill directory, then read back by lock() when a texture
+// needs them again. The files are written and read by the global thread
+// pool, the store never waits for them but in its destructor.
+class ImageStore
+{
+public:
+  using ImageId = size_t;
+
+  struct Stats
+  {
+    size_t budgetBytes = 0;
+    size_t residentBytes = 0;
+    size_t imageCount = 0;
+    size_t spilledCount = 0; // Images whose finer levels are only on disk
+    size_t pendingReadCount = 0;
+    uint64_t writtenBytes = 0;
+    uint64_t readCount = 0;
+    uint64_t readBytes = 0;
+  };
+
+  // The finer levels are spilled to files of directory, created if needed.
+  // They are never dropped if directory is empty or cannot be created.
+  ImageStore(fs::path directory, size_t budgetBytes);
+
+  // Waits for the pending writes and reads, then removes the files
+  ~ImageStore();
+
+  ImageStore(const ImageStore &) = delete;
+  ImageStore &operator=(const ImageStore &) = delete;
+
+  // The user cache directory of the platform, under gltf-viewer/images.
+  // Empty if there is none.
+  static fs::path getDefaultDirectory();
+
+  void setBudget(size_t budgetBytes) { m_BudgetBytes = budgetBytes; }
+  size_t budget() const { return m_BudgetBytes; }
+
+  // Take a decoded image, whose levels [keptLevel, last] always stay in
+  // memory
+  ImageId add(StreamedImage image, int keptLevel);
+
+  // Sizes and offsets of the levels of an image. Its data is empty, see
+  // getLevel().
+  const StreamedImage &layout(ImageId image) const
+  {
+    return m_Entries[image].layout;
+  }
+
+  int keptLevel(ImageId image) const { return m_Entries[image].keptLevel; }
+
+  // Bytes of the levels [level, last] of an image
+  size_t getLevelsBytes(ImageId image, int level) const;
+
+  // True if all the levels of an image are in memory, they then stay there
+  // until the next update(). Otherwise starts reading its finer levels back
+  // and returns false: lock() is called again in later frames until they
+  // are.
+  bool lock(ImageId image);
+
+  // Pixels of a level in memory, a kept one or any one once the image is
+  // locked. keepAlive holds them, e.g. until their upload.
+  const unsigned char *getLevel(ImageId image, int level,
+      std::shared_ptr<const void> &keepAlive) const;
+
+  // Drop the finer levels of the images used least recently until the store
+  // fits in its budget, and start a new frame
+  void update();
+
+  Stats stats() const;
+
+private:
+  using Bytes = std::vector<unsigned char>;
+
+  enum class FileState
+  {
+    None,
+    Writing,
+    Written,
+    Failed // The finer levels stay in memory
+  };
+
+  struct Entry
+  {
+    StreamedImage layout;
+    int keptLevel;
+    size_t byteSize; // Of all the levels
+    size_t fineByteSize; // Of the levels before keptLevel
+    std::shared_ptr<const Bytes> kept; // The levels [keptLevel, last]
+    // Starts with the levels before keptLevel, null when they are dropped
+    std::shared_ptr<const Bytes> fine;
+    // Still alive while an upload holds the dropped levels
+    std::weak_ptr<const Bytes> droppedFine;
+    FileState file = FileState::None;
+    bool reading = false;
+    uint64_t lastUseFrame = 0;
+  };
+
+  // A write or a read of the thread pool, applied by the main thread
+  struct IoResult
+  {
+    ImageId image;
+    bool read;
+    bool ok;
+    std::shared_ptr<const Bytes> bytes; // Read ones
+  };
+
+  fs::path getPath(ImageId image) const;
+  void startWrite(ImageId image);
+  void startRead(ImageId image);
+  void endIo(IoResult result);
+  void applyIoResults();
+
+  fs::path m_Directory; // Empty if nothing is spilled
+  std::string m_FilePrefix; // Unique to the store
+  size_t m_BudgetBytes;
+  size_t m_ResidentBytes = 0;
+  uint64_t m_Frame = 1;
+  std::vector<Entry> m_Entries; // By ImageId
+  Stats m_Stats;
+
+  std::mutex m_IoMutex;
+  std::condition_variable m_IoCondition;
+  size_t m_PendingIoCount = 0;
+  std::vector<IoResult> m_IoResults;
+};
@@ -0,0 +1,43 @@
+#include "lights.hpp"
+
+#include <cmath>
+#include <limits>
+
+glm::vec2 getLightAttenuation(float range)
+{
+  // Upper bound of the range of each row, then its (Kl, Kd)
+  static const struct
+  {
+    float range;
+    glm::vec2 attenuation;
+  } table[] = {{7.f, {0.7f, 1.8f}}, {13.f, {0.35f, 0.44f}},
+      {20.f, {0.22f, 0.20f}}, {32.f, {0.14f, 0.07f}}, {50.f, {0.09f, 0.032f}},
+      {65.f, {0.07f, 0.017f}}};
+
+  if (range >= 0.f) {
+    for (const auto &row : table) {
+      if (range < row.range) {
+        return row.attenuation;
+      }
+    }
+  }
+  return {0.045f, 0.0075f};
+}
+
+float getLightRadius(const glm::vec2 &attenuation, float intensity)
+{
+  // Half a step once gamma encoded
+  static const float threshold = std::pow(0.5f / 255.f, 2.2f);
+  if (intensity <= threshold) {
+    return 0.f;
+  }
+  // Root of Kd d^2 + Kl d + 1 - intensity / threshold
+  const auto c = 1.f - intensity / threshold;
+  if (attenuation.y <= 0.f) {
+    return attenuation.x > 0.f ? -c / attenuation.x
+                               : std::numeric_limits<float>::max();
+  }
+  const auto discriminant =
+      attenuation.x * attenuation.x - 4.f * attenuation.y * c;
+  return (-attenuation.x + std::sqrt(discriminant)) / (2.f * attenuation.y);
+}
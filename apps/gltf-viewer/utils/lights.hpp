@@ -0,0 +1,65 @@
+#pragma once
+
+#include "shadows.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+const size_t kMaxPointLightCount = 4; // Of the forward shaders
+
+// Binding point of the Lights uniform block of the forward shaders
+const GLuint LIGHTS_BLOCK_BINDING = 0;
+
+// Linear and quadratic terms of the attenuation 1 / (1 + Kl d + Kd d^2) of a
+// light reaching about range, from a table of usual values. Resolved when the
+// light changes rather than for each fragment.
+glm::vec2 getLightAttenuation(float range);
+
+// Distance at which a light of the given intensity, its largest component,
+// adds less than half a step of an 8 bit channel through attenuation: where
+// the deferred path culls it. The shaders gamma encode the light of each
+// light, so it reaches much further than where the intensity falls to 1/255.
+float getLightRadius(const glm::vec2 &attenuation, float intensity);
+
+// Lights of a frame, in the std140 layout of the Lights uniform block of
+// pbr_directional_light.fs.glsl. Positions and directions are in view space,
+// the attenuation terms of getLightAttenuation() are in attenuation.xy and
+// the radius of getLightRadius() in attenuation.z. The
+// image based lighting is in world space, see EnvironmentLighting. The shadows
+// of the directional light are those of ShadowCascades.
+struct LightsBlock
+{
+  struct PointLight
+  {
+    glm::vec4 position;
+    glm::vec4 intensity;
+    glm::vec4 attenuation;
+  };
+
+  struct SpotLight
+  {
+    glm::vec4 position;
+    glm::vec4 intensity;
+    glm::vec4 direction; // Normalized, from the light
+    glm::vec4 cone; // Cosines of the inner and outer angles in xy
+    glm::vec4 attenuation;
+  };
+
+  glm::vec4 directionalDirection; // Normalized, towards the light
+  glm::vec4 directionalIntensity;
+  // The shaders read the first POINT_LIGHT_COUNT of their variant
+  PointLight pointLights[kMaxPointLightCount];
+  SpotLight spotLight;
+
+  glm::vec4 irradianceSH[9]; // EnvironmentLighting::irradianceSH in xyz
+  glm::vec4 environment; // Intensity in x, specular level of roughness 1 in y
+  glm::mat4 viewToWorld;
+
+  // From view space to the texture coordinates and depth of each cascade
+  glm::mat4 shadowMatrices[kMaxShadowCascadeCount];
+  // ShadowCascades::splitDistances, only the first count are read
+  glm::vec4 shadowSplits;
+  glm::vec4 shadow; // Cascade count in x, depth bias in y
+};
@@ -0,0 +1,321 @@
+#include "loadprofiler.hpp"
+#include "arena.hpp"
+#include "trace.hpp"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+namespace
+{
+
+const char *const kPhaseNames[] = {"shader_compile", "json_parse",
+    "buffer_read", "image_decode", "bounds", "tangent_generation",
+    "vao_creation", "buffer_upload", "texture_upload", "environment"};
+
+static_assert(sizeof(kPhaseNames) / sizeof(kPhaseNames[0]) ==
+                  size_t(LoadPhase::Count),
+    "One name per load phase");
+
+#ifdef _WIN32
+
+double toSeconds(const FILETIME &time)
+{
+  // In units of 100 ns
+  return 1e-7 * double((uint64_t(time.dwHighDateTime) << 32) |
+                       time.dwLowDateTime);
+}
+
+double getThreadCpuSeconds()
+{
+  FILETIME creation, exit, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+    return 0.;
+  }
+  return toSeconds(kernel) + toSeconds(user);
+}
+
+double getProcessCpuSeconds()
+{
+  FILETIME creation, exit, kernel, user;
+  if (!GetProcessTimes(
+          GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+    return 0.;
+  }
+  return toSeconds(kernel) + toSeconds(user);
+}
+
+int64_t getPeakRss()
+{
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!K32GetProcessMemoryInfo(
+          GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return int64_t(counters.PeakWorkingSetSize);
+}
+
+#else
+
+double getCpuSeconds(clockid_t clock)
+{
+  timespec time;
+  if (clock_gettime(clock, &time) != 0) {
+    return 0.;
+  }
+  return double(time.tv_sec) + 1e-9 * double(time.tv_nsec);
+}
+
+double getThreadCpuSeconds()
+{
+  return getCpuSeconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+double getProcessCpuSeconds()
+{
+  return getCpuSeconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+int64_t getPeakRss()
+{
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return int64_t(usage.ru_maxrss); // Bytes
+#else
+  return int64_t(usage.ru_maxrss) * 1024; // Kilobytes
+#endif
+}
+
+#endif
+
+// Innermost scope of each thread
+thread_local LoadProfiler::Scope *t_CurrentScope = nullptr;
+
+uint64_t getArenaAllocationCount(const LoadArena *arena)
+{
+  return arena ? arena->allocationCount() : 0;
+}
+
+nlohmann::json toJson(const LoadProfiler::Phase &phase)
+{
+  return {{"scopes", phase.scopeCount}, {"wallSeconds", phase.wallSeconds},
+      {"spanSeconds", phase.spanSeconds}, {"cpuSeconds", phase.cpuSeconds},
+      {"peakRssDeltaBytes", phase.peakRssDelta}, {"bytes", phase.bytes},
+      {"heapAllocations", isCountingHeapAllocations()
+                              ? nlohmann::json(phase.heapAllocations)
+                              : nlohmann::json()},
+      {"arenaAllocations", phase.arenaAllocations}};
+}
+
+} // namespace
+
+const char *getLoadPhaseName(LoadPhase phase)
+{
+  return size_t(phase) < size_t(LoadPhase::Count) ? kPhaseNames[size_t(phase)]
+                                                  : "unknown";
+}
+
+LoadProfiler::Scope::Scope(
+    LoadProfiler *profiler, LoadPhase phase, uint64_t bytes) :
+    m_Profiler(profiler), m_Phase(phase), m_Bytes(bytes)
+{
+  if (!m_Profiler) {
+    return;
+  }
+  m_Parent = t_CurrentScope;
+  t_CurrentScope = this;
+  m_CpuStart = getThreadCpuSeconds();
+  m_PeakRssStart = getPeakRss();
+  m_HeapAllocationsStart = getHeapAllocationCount();
+  if (m_Profiler->countsArena()) {
+    m_ArenaAllocationsStart = getArenaAllocationCount(m_Profiler->m_Arena);
+  }
+  m_Start = clock::now();
+}
+
+LoadProfiler::Scope::~Scope()
+{
+  if (!m_Profiler) {
+    return;
+  }
+  const auto end = clock::now();
+  Phase cost;
+  cost.scopeCount = 1;
+  cost.wallSeconds = std::chrono::duration<double>(end - m_Start).count();
+  cost.cpuSeconds = getThreadCpuSeconds() - m_CpuStart;
+  cost.peakRssDelta = getPeakRss() - m_PeakRssStart;
+  cost.bytes = m_Bytes;
+  cost.heapAllocations = getHeapAllocationCount() - m_HeapAllocationsStart;
+  if (m_Profiler->countsArena()) {
+    cost.arenaAllocations =
+        getArenaAllocationCount(m_Profiler->m_Arena) - m_ArenaAllocationsStart;
+  }
+  t_CurrentScope = m_Parent;
+  if (m_Parent) {
+    m_Parent->m_ChildCost.wallSeconds += cost.wallSeconds;
+    m_Parent->m_ChildCost.cpuSeconds += cost.cpuSeconds;
+    m_Parent->m_ChildCost.peakRssDelta += cost.peakRssDelta;
+    m_Parent->m_ChildCost.heapAllocations += cost.heapAllocations;
+    m_Parent->m_ChildCost.arenaAllocations += cost.arenaAllocations;
+  }
+  cost.wallSeconds -= m_ChildCost.wallSeconds;
+  cost.cpuSeconds -= m_ChildCost.cpuSeconds;
+  cost.peakRssDelta -= m_ChildCost.peakRssDelta;
+  cost.heapAllocations -= m_ChildCost.heapAllocations;
+  cost.arenaAllocations -= m_ChildCost.arenaAllocations;
+  m_Profiler->record(m_Phase, m_Start, end, cost);
+  if (auto *tracer = globalTracer()) {
+    tracer->addEvent("load", getLoadPhaseName(m_Phase), m_Start, end);
+  }
+}
+
+LoadProfiler::LoadProfiler(const LoadArena *arena) :
+    m_Arena(arena),
+    m_ArenaThread(std::this_thread::get_id()),
+    m_Start(clock::now()),
+    m_CpuStart(getProcessCpuSeconds()),
+    m_PeakRssStart(getPeakRss()),
+    m_HeapAllocationsStart(getHeapAllocationCount()),
+    m_ArenaAllocationsStart(getArenaAllocationCount(arena))
+{
+  m_FirstStarts.fill(std::numeric_limits<double>::max());
+  m_LastEnds.fill(0.);
+}
+
+void LoadProfiler::finish()
+{
+  const auto total = this->total();
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Total = total;
+  m_Finished = true;
+}
+
+LoadProfiler::Phase LoadProfiler::phase(LoadPhase phase) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Phases[size_t(phase)];
+}
+
+void LoadProfiler::countProgram(bool cacheHit)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  ++(cacheHit ? m_ProgramCacheHits : m_ProgramCacheMisses);
+}
+
+LoadProfiler::Phase LoadProfiler::total() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_Finished) {
+    return m_Total;
+  }
+  Phase total;
+  total.scopeCount = 1;
+  total.wallSeconds =
+      std::chrono::duration<double>(clock::now() - m_Start).count();
+  total.spanSeconds = total.wallSeconds;
+  total.cpuSeconds = getProcessCpuSeconds() - m_CpuStart;
+  total.peakRssDelta = getPeakRss() - m_PeakRssStart;
+  total.bytes = m_Phases[size_t(LoadPhase::BufferRead)].bytes +
+                m_Phases[size_t(LoadPhase::ImageDecode)].bytes;
+  total.heapAllocations = getHeapAllocationCount() - m_HeapAllocationsStart;
+  if (countsArena()) {
+    total.arenaAllocations =
+        getArenaAllocationCount(m_Arena) - m_ArenaAllocationsStart;
+  }
+  return total;
+}
+
+void LoadProfiler::print(std::ostream &out) const
+{
+  out << "Load profile:" << std::endl;
+  out << "  " << std::left << std::setw(20) << "phase" << std::right
+      << std::setw(7) << "scopes" << std::setw(11) << "wall ms"
+      << std::setw(11) << "span ms" << std::setw(11) << "cpu ms"
+      << std::setw(13) << "peak RSS KB" << std::setw(11) << "MB"
+      << std::setw(13) << "heap allocs" << std::setw(14) << "arena allocs"
+      << std::endl;
+  const auto printPhase = [&](const char *name, const Phase &phase) {
+    out << "  " << std::left << std::setw(20) << name << std::right
+        << std::setw(7) << phase.scopeCount << std::fixed
+        << std::setprecision(2) << std::setw(11) << 1e3 * phase.wallSeconds
+        << std::setw(11) << 1e3 * phase.spanSeconds << std::setw(11)
+        << 1e3 * phase.cpuSeconds << std::setw(13) << phase.peakRssDelta / 1024
+        << std::setw(11) << double(phase.bytes) / (1 << 20) << std::setw(13);
+    if (isCountingHeapAllocations()) {
+      out << phase.heapAllocations;
+    } else {
+      out << "n/a";
+    }
+    out << std::setw(14) << phase.arenaAllocations << std::endl;
+  };
+  for (size_t p = 0; p < size_t(LoadPhase::Count); ++p) {
+    printPhase(getLoadPhaseName(LoadPhase(p)), phase(LoadPhase(p)));
+  }
+  printPhase("total", total());
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  out << "  program cache: " << m_ProgramCacheHits << " hits, "
+      << m_ProgramCacheMisses << " misses" << std::endl;
+}
+
+bool LoadProfiler::writeJson(
+    const fs::path &path, const fs::path &gltfFile) const
+{
+  nlohmann::json phases = nlohmann::json::object();
+  for (size_t p = 0; p < size_t(LoadPhase::Count); ++p) {
+    phases[getLoadPhaseName(LoadPhase(p))] = toJson(phase(LoadPhase(p)));
+  }
+  nlohmann::json report = {{"file", gltfFile.string()},
+      {"total", toJson(total())}, {"phases", phases}};
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    report["programCache"] = {
+        {"hits", m_ProgramCacheHits}, {"misses", m_ProgramCacheMisses}};
+  }
+
+  std::ofstream file(path.string());
+  if (!file) {
+    return false;
+  }
+  file << std::setw(2) << report << std::endl;
+  return bool(file);
+}
+
+void LoadProfiler::record(LoadPhase phase, clock::time_point start,
+    clock::time_point end, const Phase &cost)
+{
+  const auto relativeStart =
+      std::chrono::duration<double>(start - m_Start).count();
+  const auto relativeEnd = std::chrono::duration<double>(end - m_Start).count();
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const auto p = size_t(phase);
+  auto &sum = m_Phases[p];
+  sum.scopeCount += cost.scopeCount;
+  sum.wallSeconds += cost.wallSeconds;
+  sum.cpuSeconds += cost.cpuSeconds;
+  sum.peakRssDelta += cost.peakRssDelta;
+  sum.bytes += cost.bytes;
+  sum.heapAllocations += cost.heapAllocations;
+  sum.arenaAllocations += cost.arenaAllocations;
+  m_FirstStarts[p] = std::min(m_FirstStarts[p], relativeStart);
+  m_LastEnds[p] = std::max(m_LastEnds[p], relativeEnd);
+  sum.spanSeconds = m_LastEnds[p] - m_FirstStarts[p];
+}
+
+bool LoadProfiler::countsArena() const
+{
+  return m_Arena && std::this_thread::get_id() == m_ArenaThread;
+}
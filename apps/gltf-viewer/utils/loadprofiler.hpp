@@ -0,0 +1,139 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+class LoadArena;
+
+// Phases of a load. Buffer reads and image decodes run on the loader
+// workers, uploads on the uploader thread, the others on the main one.
+enum class LoadPhase
+{
+  ShaderCompile,
+  JsonParse,
+  BufferRead,
+  ImageDecode,
+  Bounds,
+  TangentGeneration,
+  VaoCreation,
+  BufferUpload,
+  TextureUpload,
+  Environment, // Image based lighting, read or prefiltered
+  Count
+};
+
+// Identifier of a phase in the reports, e.g. "json_parse"
+const char *getLoadPhaseName(LoadPhase phase);
+
+// Cost of each phase of a load, summed over the scopes timing it on any
+// thread.
+//
+// Wall and CPU times are those of the thread running a scope, so a phase
+// spread over several workers can add up to more than the load itself; its
+// span (first start to last end) tells how long it really lasted. The peak
+// resident set and the heap allocations are process-wide: a scope gets what
+// all threads did while it ran, which is exact for a phase running alone
+// and an upper bound otherwise. Arena allocations are only counted on the
+// thread which created the profiler, the one owning the arena.
+class LoadProfiler
+{
+public:
+  struct Phase
+  {
+    size_t scopeCount = 0;
+    double wallSeconds = 0.;
+    double spanSeconds = 0.;
+    double cpuSeconds = 0.;
+    int64_t peakRssDelta = 0; // Bytes the peak resident set grew by
+    uint64_t bytes = 0; // Processed, e.g. read, decoded or uploaded
+    uint64_t heapAllocations = 0; // See getHeapAllocationCount()
+    uint64_t arenaAllocations = 0; // Would have been heap allocations
+  };
+
+  // Times the enclosing block as a phase, from any thread. Scopes nest: the
+  // cost of an inner scope is only counted in its own phase.
+  class Scope
+  {
+  public:
+    // profiler may be null, nothing is recorded then
+    Scope(LoadProfiler *profiler, LoadPhase phase, uint64_t bytes = 0);
+
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void addBytes(uint64_t bytes) { m_Bytes += bytes; }
+
+  private:
+    LoadProfiler *m_Profiler;
+    LoadPhase m_Phase;
+    uint64_t m_Bytes;
+    std::chrono::steady_clock::time_point m_Start;
+    double m_CpuStart = 0.;
+    int64_t m_PeakRssStart = 0;
+    uint64_t m_HeapAllocationsStart = 0;
+    uint64_t m_ArenaAllocationsStart = 0;
+    Scope *m_Parent = nullptr; // Enclosing scope of the same thread
+    Phase m_ChildCost; // Of the inner scopes, to exclude from this one
+  };
+
+  // Starts the total. arena is the one whose allocations are reported, may
+  // be null.
+  explicit LoadProfiler(const LoadArena *arena = nullptr);
+
+  LoadProfiler(const LoadProfiler &) = delete;
+  LoadProfiler &operator=(const LoadProfiler &) = delete;
+
+  // End of the load, stops the total. Scopes ending later are still
+  // recorded in their phase.
+  void finish();
+
+  Phase phase(LoadPhase phase) const;
+
+  // A program of the load, read from the ProgramCache or compiled
+  void countProgram(bool cacheHit);
+
+  // The whole load: wall time, CPU time of the process, and growth of the
+  // peak resident set and of the allocations. Its bytes are those read from
+  // the buffers and decoded from the images.
+  Phase total() const;
+
+  // Table of the phases and the total, meant for stderr
+  void print(std::ostream &out) const;
+
+  // Same figures as a JSON document, false if the file cannot be written
+  bool writeJson(const fs::path &path, const fs::path &gltfFile) const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  void record(LoadPhase phase, clock::time_point start, clock::time_point end,
+      const Phase &cost);
+  bool countsArena() const;
+
+  const LoadArena *m_Arena;
+  const std::thread::id m_ArenaThread;
+  const clock::time_point m_Start;
+  const double m_CpuStart;
+  const int64_t m_PeakRssStart;
+  const uint64_t m_HeapAllocationsStart;
+  const uint64_t m_ArenaAllocationsStart;
+
+  mutable std::mutex m_Mutex;
+  std::array<Phase, size_t(LoadPhase::Count)> m_Phases;
+  // Relative to m_Start, to compute the spans
+  std::array<double, size_t(LoadPhase::Count)> m_FirstStarts;
+  std::array<double, size_t(LoadPhase::Count)> m_LastEnds;
+  bool m_Finished = false;
+  Phase m_Total;
+  size_t m_ProgramCacheHits = 0;
+  size_t m_ProgramCacheMisses = 0;
+};
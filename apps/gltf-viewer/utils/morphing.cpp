@@ -0,0 +1,139 @@
+#include "morphing.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+
+const char *const kMorphedAttributes[] = {"POSITION", "NORMAL", "TANGENT"};
+
+// Read the deltas of a target attribute as vec3 (TANGENT deltas are VEC3 as
+// well). Sparse deltas without bufferView are zero except at sparse indices.
+bool readDeltas(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, size_t vertexCount,
+    std::vector<glm::vec3> &outDeltas)
+{
+  if (accessor.type != TINYGLTF_TYPE_VEC3 || accessor.count < vertexCount) {
+    return false;
+  }
+  outDeltas.resize(accessor.count);
+  readAccessorAsFloat(model, accessor, &outDeltas[0].x);
+  outDeltas.resize(vertexCount);
+  return true;
+}
+
+} // namespace
+
+MorphTargets compileMorphTargets(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive)
+{
+  MorphTargets targets;
+  const auto positionIt = primitive.attributes.find("POSITION");
+  if (primitive.targets.empty() || positionIt == end(primitive.attributes)) {
+    return targets;
+  }
+  targets.vertexCount = uint32_t(model.accessors[positionIt->second].count);
+
+  // Union of the attributes morphed by the targets, only if the primitive
+  // has them
+  int *slots[] = {
+      &targets.positionSlot, &targets.normalSlot, &targets.tangentSlot};
+  for (size_t a = 0; a < 3; ++a) {
+    const auto morphed = std::any_of(begin(primitive.targets),
+        end(primitive.targets), [&](const std::map<std::string, int> &target) {
+          return target.count(kMorphedAttributes[a]) > 0;
+        });
+    if (morphed && primitive.attributes.count(kMorphedAttributes[a])) {
+      *slots[a] = int(targets.attributeCount++);
+    }
+  }
+  if (targets.attributeCount == 0 || targets.vertexCount == 0) {
+    return targets;
+  }
+  targets.targetCount = uint32_t(primitive.targets.size());
+
+  const auto vertexCount = size_t(targets.vertexCount);
+  const auto attributeCount = size_t(targets.attributeCount);
+  const auto targetStride = vertexCount * attributeCount;
+  targets.deltas.assign(targets.targetCount * targetStride, glm::vec3(0));
+
+  std::vector<glm::vec3> attributeDeltas;
+  for (size_t t = 0; t < targets.targetCount; ++t) {
+    auto *pTarget = targets.deltas.data() + t * targetStride;
+    for (size_t a = 0; a < 3; ++a) {
+      const auto slot = *slots[a];
+      const auto it = primitive.targets[t].find(kMorphedAttributes[a]);
+      if (slot < 0 || it == end(primitive.targets[t]) || it->second < 0) {
+        continue;
+      }
+      if (!readDeltas(model, model.accessors[it->second], vertexCount,
+              attributeDeltas)) {
+        std::cerr << "Morph target " << t << " has invalid "
+                  << kMorphedAttributes[a] << " deltas, ignoring them"
+                  << std::endl;
+        continue;
+      }
+      for (size_t v = 0; v < vertexCount; ++v) {
+        pTarget[v * attributeCount + slot] = attributeDeltas[v];
+      }
+    }
+
+    // Keep the vertices moved by the target for the CPU path
+    targets.sparseOffsets.push_back(uint32_t(targets.sparseIndices.size()));
+    for (size_t v = 0; v < vertexCount; ++v) {
+      const auto *pVertex = pTarget + v * attributeCount;
+      if (std::any_of(pVertex, pVertex + attributeCount,
+              [](const glm::vec3 &d) { return d != glm::vec3(0); })) {
+        targets.sparseIndices.push_back(uint32_t(v));
+        targets.sparseDeltas.insert(
+            end(targets.sparseDeltas), pVertex, pVertex + attributeCount);
+      }
+    }
+  }
+  targets.sparseOffsets.push_back(uint32_t(targets.sparseIndices.size()));
+  return targets;
+}
+
+void getActiveMorphTargets(const MorphTargets &targets, const float *weights,
+    size_t weightCount, std::vector<uint32_t> &activeTargets)
+{
+  activeTargets.clear();
+  const auto count = std::min(weightCount, size_t(targets.targetCount));
+  for (size_t t = 0; t < count; ++t) {
+    if (weights[t] != 0.f) {
+      activeTargets.push_back(uint32_t(t));
+    }
+  }
+}
+
+MorphPath chooseMorphPath(const MorphTargets &targets,
+    const std::vector<uint32_t> &activeTargets)
+{
+  if (activeTargets.empty() || targets.targetCount == 0) {
+    return MorphPath::None;
+  }
+  return activeTargets.size() <= kMaxGpuMorphTargets ? MorphPath::GPU
+                                                     : MorphPath::CPU;
+}
+
+void blendMorphTargets(const MorphTargets &targets, const float *weights,
+    const std::vector<uint32_t> &activeTargets,
+    std::vector<glm::vec3> &blended)
+{
+  const auto attributeCount = size_t(targets.attributeCount);
+  blended.assign(targets.vertexCount * attributeCount, glm::vec3(0));
+  for (const auto t : activeTargets) {
+    const auto weight = weights[t];
+    const auto begin = targets.sparseOffsets[t];
+    const auto end = targets.sparseOffsets[t + 1];
+    for (auto s = begin; s < end; ++s) {
+      auto *pOut = blended.data() + targets.sparseIndices[s] * attributeCount;
+      const auto *pDelta = targets.sparseDeltas.data() + s * attributeCount;
+      for (size_t a = 0; a < attributeCount; ++a) {
+        pOut[a] += weight * pDelta[a];
+      }
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Maximum number of active targets blended by the vertex shader, must match
+// MAX_GPU_MORPH_TARGETS in forward.vs.glsl
+const size_t kMaxGpuMorphTargets = 8;
+
+// Morph targets of a primitive, with up to three morphed attributes
+// (POSITION, NORMAL, TANGENT) stored in slots [0, attributeCount).
+//
+// Deltas are kept in two forms:
+// - dense for the GPU path, uploaded in a texture buffer:
+//   deltas[(target * vertexCount + vertex) * attributeCount + slot]
+// - sparse for the CPU path, only the vertices moved by each target: target
+//   t moves sparseIndices[sparseOffsets[t] .. sparseOffsets[t + 1]], each
+//   sparse vertex having attributeCount consecutive sparseDeltas.
+struct MorphTargets
+{
+  uint32_t vertexCount = 0;
+  uint32_t targetCount = 0;
+  uint32_t attributeCount = 0;
+  int positionSlot = -1; // -1 if the attribute is not morphed
+  int normalSlot = -1;
+  int tangentSlot = -1;
+
+  std::vector<glm::vec3> deltas;
+
+  std::vector<uint32_t> sparseOffsets;
+  std::vector<uint32_t> sparseIndices;
+  std::vector<glm::vec3> sparseDeltas;
+};
+
+enum class MorphPath
+{
+  None, // No active target
+  GPU, // Targets blended in the vertex shader
+  CPU // Targets blended by blendMorphTargets() and uploaded as one target
+};
+
+// targetCount == 0 if the primitive has no morph target. The deltas of each
+// attribute are read in a scratch buffer before being interleaved.
+MorphTargets compileMorphTargets(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive);
+
+// Indices of the targets with a non zero weight. Missing weights are zero.
+void getActiveMorphTargets(const MorphTargets &targets, const float *weights,
+    size_t weightCount, std::vector<uint32_t> &activeTargets);
+
+// The vertex shader fetches every delta of every active target for all
+// vertices, while the CPU only touches the vertices moved by the active
+// targets but has to upload the result. Few active targets stay on the GPU,
+// many (e.g. facial animation) are blended on the CPU.
+MorphPath chooseMorphPath(const MorphTargets &targets,
+    const std::vector<uint32_t> &activeTargets);
+
+// Sum of weights[t] * deltas of t for all active targets, in the layout of a
+// single dense target: blended[vertex * attributeCount + slot]. Only the
+// sparse deltas of the active targets are read.
+void blendMorphTargets(const MorphTargets &targets, const float *weights,
+    const std::vector<uint32_t> &activeTargets,
+    std::vector<glm::vec3> &blended);
@@ -0,0 +1,231 @@
+#include "programcache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+const char kMagic[8] = {'G', 'L', 'P', 'R', 'O', 'G', 'B', '1'};
+const uint32_t kMaxBinarySize = 64 << 20; // Larger sizes are corrupted files
+
+// Start of a cache file, followed by the binary
+struct BinaryHeader
+{
+  char magic[8];
+  uint32_t format; // GLenum given by glGetProgramBinary
+  uint32_t size;
+};
+
+// 64-bit FNV-1a
+uint64_t hashString(const std::string &str, uint64_t hash)
+{
+  for (const auto c : str) {
+    hash = (hash ^ uint64_t(uint8_t(c))) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::string getGLString(GLenum name)
+{
+  const auto *str = reinterpret_cast<const char *>(glGetString(name));
+  return str ? str : "";
+}
+
+} // namespace
+
+ProgramCache::ProgramCache(fs::path directory) :
+    m_Directory(std::move(directory))
+{
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  if (formatCount == 0) {
+    m_Directory.clear();
+  }
+  if (m_Directory.empty()) {
+    return;
+  }
+  try {
+    fs::create_directories(m_Directory);
+  } catch (const fs::filesystem_error &e) {
+    std::cerr << "Program cache disabled: " << e.what() << std::endl;
+    m_Directory.clear();
+    return;
+  }
+  m_DriverId = getGLString(GL_VENDOR) + '\n' + getGLString(GL_RENDERER) +
+               '\n' + getGLString(GL_VERSION) + '\n';
+}
+
+fs::path ProgramCache::getDefaultDirectory()
+{
+  const auto directory = getUserCacheDirectory();
+  return directory.empty() ? directory : directory / "programs";
+}
+
+GLProgram ProgramCache::load(
+    const std::vector<fs::path> &shaderPaths, bool *hit)
+{
+  size_t hitCount = 0;
+  auto programs = loadVariants(shaderPaths, {{}}, &hitCount);
+  if (hit) {
+    *hit = hitCount > 0;
+  }
+  return std::move(programs.front());
+}
+
+std::vector<GLProgram> ProgramCache::loadVariants(
+    const std::vector<fs::path> &shaderPaths,
+    const std::vector<std::vector<std::string>> &definesList,
+    size_t *hitCount)
+{
+  // A program missing from the cache, compiled and linked without waiting
+  struct PendingProgram
+  {
+    size_t index;
+    fs::path binaryPath;
+    std::vector<GLShader> shaders;
+  };
+  std::vector<GLProgram> programs(definesList.size());
+  std::vector<PendingProgram> pendingPrograms;
+  for (size_t i = 0; i < definesList.size(); ++i) {
+    std::vector<std::string> sources;
+    for (const auto &path : shaderPaths) {
+      sources.push_back(loadShaderSource(path, definesList[i]));
+    }
+    fs::path binaryPath;
+    if (enabled()) {
+      binaryPath = getBinaryPath(shaderPaths, sources);
+      if (loadBinary(binaryPath, programs[i])) {
+        ++m_Stats.hitCount;
+        if (hitCount) {
+          ++*hitCount;
+        }
+        continue;
+      }
+      glProgramParameteri(
+          programs[i].glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    ++m_Stats.missCount;
+    PendingProgram pending{i, binaryPath, {}};
+    for (size_t j = 0; j < shaderPaths.size(); ++j) {
+      const auto &type = getShaderType(shaderPaths[j]);
+      std::clog << "Compiling " << type.second << " shader " << shaderPaths[j]
+                << "\n";
+      GLShader shader{type.first};
+      shader.setSource(sources[j]);
+      glCompileShader(shader.glId());
+      programs[i].attachShader(shader);
+      pending.shaders.push_back(std::move(shader));
+    }
+    pendingPrograms.push_back(std::move(pending));
+  }
+  for (const auto &pending : pendingPrograms) {
+    glLinkProgram(programs[pending.index].glId());
+  }
+
+  // Statuses are read last, reading one waits for its compilation
+  for (const auto &pending : pendingPrograms) {
+    for (size_t j = 0; j < shaderPaths.size(); ++j) {
+      const auto &shader = pending.shaders[j];
+      if (!shader.getCompileStatus()) {
+        const auto message = "Shader compilation error in " +
+                             shaderPaths[j].filename().string() + ":\n" +
+                             shader.getInfoLog();
+        std::cerr << message << std::endl;
+        throw std::runtime_error(message);
+      }
+    }
+    const auto &program = programs[pending.index];
+    if (!program.getLinkStatus()) {
+      std::cerr << "Program link error:" << program.getInfoLog() << std::endl;
+      throw std::runtime_error("Program link error:" + program.getInfoLog());
+    }
+    if (enabled()) {
+      storeBinary(pending.binaryPath, program);
+    }
+  }
+  return programs;
+}
+
+fs::path ProgramCache::getBinaryPath(const std::vector<fs::path> &shaderPaths,
+    const std::vector<std::string> &sources) const
+{
+  auto hash = hashString(m_DriverId, 0xcbf29ce484222325ull);
+  for (size_t i = 0; i < shaderPaths.size(); ++i) {
+    // The type of a shader comes from its name
+    hash = hashString(shaderPaths[i].filename().string() + '\n', hash);
+    hash = hashString(sources[i] + '\n', hash);
+  }
+  std::stringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+  return m_Directory / name.str();
+}
+
+bool ProgramCache::loadBinary(const fs::path &path, const GLProgram &program)
+{
+  std::ifstream file(path.string(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  BinaryHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.size > kMaxBinarySize) {
+    return false;
+  }
+  std::vector<char> binary(header.size);
+  if (!file.read(binary.data(), binary.size())) {
+    return false;
+  }
+  glProgramBinary(
+      program.glId(), header.format, binary.data(), GLsizei(binary.size()));
+  if (!program.getLinkStatus()) {
+    // Usually a driver update keeping its version string
+    ++m_Stats.rejectedCount;
+    std::clog << "Program binary " << path << " rejected, recompiling"
+              << std::endl;
+    return false;
+  }
+  std::clog << "Loaded program binary " << path << std::endl;
+  return true;
+}
+
+void ProgramCache::storeBinary(
+    const fs::path &path, const GLProgram &program) const
+{
+  GLint size = 0;
+  glGetProgramiv(program.glId(), GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0) {
+    return;
+  }
+  std::vector<char> binary(size);
+  GLenum format = 0;
+  glGetProgramBinary(program.glId(), size, &size, &format, binary.data());
+
+  BinaryHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.format = format;
+  header.size = uint32_t(size);
+
+  // Written aside then renamed, so that a concurrent launch never reads a
+  // partial file
+  const auto tmpPath = path.string() + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(binary.data(), size);
+    if (!file) {
+      std::cerr << "Unable to write the program binary " << tmpPath
+                << std::endl;
+      return;
+    }
+  }
+  std::remove(path.string().c_str()); // rename() does not replace on Windows
+  if (std::rename(tmpPath.c_str(), path.string().c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+  }
+}
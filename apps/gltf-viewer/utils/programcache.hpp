@@ -0,0 +1,65 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "shaders.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Linked programs stored on disk with glGetProgramBinary, so that the next
+// launches skip the compilation of their shaders.
+//
+// A binary is keyed by a hash of the sources given to the compiler, which
+// include the defines of the shaders, and of the GL vendor, renderer and
+// version strings: editing a shader or updating the driver makes a new key.
+// Drivers may still reject a binary, which is then recompiled from source
+// and stored again.
+class ProgramCache
+{
+public:
+  struct Stats
+  {
+    size_t hitCount = 0;
+    size_t missCount = 0; // Including the rejected binaries
+    size_t rejectedCount = 0; // Found but refused by glProgramBinary
+  };
+
+  // Binaries are stored in directory, created if needed. The cache is
+  // disabled if directory is empty, cannot be created, or if the driver has
+  // no binary format. Needs a current GL context.
+  explicit ProgramCache(fs::path directory);
+
+  // The user cache directory of the platform, under gltf-viewer/programs.
+  // Empty if there is none.
+  static fs::path getDefaultDirectory();
+
+  bool enabled() const { return !m_Directory.empty(); }
+
+  // Program linked from the shaders of shaderPaths (see getShaderType() for
+  // their types) with the sources read from them, from the cache if
+  // possible. Sets *hit if not null. Throws like compileProgram() on
+  // compilation errors.
+  GLProgram load(const std::vector<fs::path> &shaderPaths, bool *hit = nullptr);
+
+  // Programs of the shaders of shaderPaths, one for each list of defines of
+  // definesList (see loadShaderSource()). The shaders missing from the cache
+  // are all compiled and linked before the status of any is read, so that
+  // drivers compiling in background threads build them concurrently. Adds
+  // the number of programs read from the cache to *hitCount if not null.
+  std::vector<GLProgram> loadVariants(const std::vector<fs::path> &shaderPaths,
+      const std::vector<std::vector<std::string>> &definesList,
+      size_t *hitCount = nullptr);
+
+  const Stats &stats() const { return m_Stats; }
+
+private:
+  fs::path getBinaryPath(const std::vector<fs::path> &shaderPaths,
+      const std::vector<std::string> &sources) const;
+  bool loadBinary(const fs::path &path, const GLProgram &program);
+  void storeBinary(const fs::path &path, const GLProgram &program) const;
+
+  fs::path m_Directory;
+  std::string m_DriverId; // Vendor, renderer and version strings
+  Stats m_Stats;
+};
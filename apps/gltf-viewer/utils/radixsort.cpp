@@ -0,0 +1,59 @@
+#include "radixsort.hpp"
+
+#include <cstring>
+
+namespace
+{
+
+// Same order as the float: the sign bit flipped for positive floats, all the
+// bits for negative ones whose magnitude sorts the other way
+uint32_t getSortableBits(float key)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &key, sizeof(bits));
+  return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+} // namespace
+
+const std::vector<uint32_t> &RadixSorter::sort(
+    const float *keys, size_t count, bool descending)
+{
+  m_Keys.resize(count);
+  m_SwapKeys.resize(count);
+  m_Indices.resize(count);
+  m_SwapIndices.resize(count);
+
+  // The histograms of all the passes in one read of the keys
+  size_t histograms[4][256] = {};
+  for (size_t i = 0; i < count; ++i) {
+    const auto bits = getSortableBits(keys[i]);
+    m_Keys[i] = descending ? ~bits : bits;
+    m_Indices[i] = uint32_t(i);
+    for (int pass = 0; pass < 4; ++pass) {
+      ++histograms[pass][(m_Keys[i] >> (8 * pass)) & 0xFF];
+    }
+  }
+
+  for (int pass = 0; pass < 4; ++pass) {
+    auto &histogram = histograms[pass];
+    // All the keys have the same digit, the pass would not move them
+    if (count == 0 || histogram[(m_Keys[0] >> (8 * pass)) & 0xFF] == count) {
+      continue;
+    }
+    size_t offset = 0;
+    for (auto &bucket : histogram) {
+      const auto bucketCount = bucket;
+      bucket = offset;
+      offset += bucketCount;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      const auto destination = histogram[(m_Keys[i] >> (8 * pass)) & 0xFF]++;
+      m_SwapKeys[destination] = m_Keys[i];
+      m_SwapIndices[destination] = m_Indices[i];
+    }
+    m_Keys.swap(m_SwapKeys);
+    m_Indices.swap(m_SwapIndices);
+  }
+  return m_Indices;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sorts indices by float keys with a least significant digit radix sort: up to
+// 4 passes of 8 bits over the keys mapped to integers of the same order,
+// linear in their number where std::sort is n log n. The buffers are kept
+// from one sort to the next, sorting each frame does not allocate once they
+// are large enough.
+class RadixSorter
+{
+public:
+  // Indices of keys[0, count) by increasing key, or decreasing if descending,
+  // equal keys in the order of their indices. Valid until the next sort.
+  const std::vector<uint32_t> &sort(
+      const float *keys, size_t count, bool descending = false);
+
+private:
+  std::vector<uint32_t> m_Keys;
+  std::vector<uint32_t> m_SwapKeys;
+  std::vector<uint32_t> m_Indices;
+  std::vector<uint32_t> m_SwapIndices;
+};
@@ -0,0 +1,184 @@
+#include "renderbench.hpp"
+
+#include <glm/gtc/constants.hpp>
+#include <json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+bool parseCamera(std::string line, Camera &camera)
+{
+  std::replace(begin(line), end(line), ',', ' ');
+  std::istringstream in(line);
+  float values[9];
+  for (auto &value : values) {
+    if (!(in >> value)) {
+      return false;
+    }
+  }
+  std::string rest;
+  if (in >> rest) {
+    return false;
+  }
+  const glm::vec3 eye(values[0], values[1], values[2]);
+  const glm::vec3 center(values[3], values[4], values[5]);
+  const glm::vec3 up(values[6], values[7], values[8]);
+  // Camera asserts on an up vector along the view direction
+  if (eye == center || glm::cross(up, center - eye) == glm::vec3(0)) {
+    return false;
+  }
+  camera = Camera(eye, center, up);
+  return true;
+}
+
+// Nearest rank percentile of sorted values
+double getPercentile(const std::vector<double> &sorted, double p)
+{
+  const auto rank = size_t(std::ceil(p * double(sorted.size())));
+  return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+nlohmann::json getTimeStats(const std::vector<double> &times)
+{
+  std::vector<double> sorted;
+  for (const auto time : times) {
+    if (!std::isnan(time)) {
+      sorted.push_back(time);
+    }
+  }
+  if (sorted.empty()) {
+    return nullptr;
+  }
+  std::sort(begin(sorted), end(sorted));
+  double sum = 0.;
+  for (const auto time : sorted) {
+    sum += time;
+  }
+  return {{"min", sorted.front()}, {"avg", sum / double(sorted.size())},
+      {"p50", getPercentile(sorted, 0.5)}, {"p95", getPercentile(sorted, 0.95)},
+      {"p99", getPercentile(sorted, 0.99)}, {"max", sorted.back()},
+      {"samples", sorted.size()}};
+}
+
+} // namespace
+
+bool loadCameraPath(
+    const fs::path &path, std::vector<Camera> &keyframes, std::string &error)
+{
+  std::ifstream file(path.string());
+  if (!file) {
+    error = "Unable to open the camera path " + path.string();
+    return false;
+  }
+  keyframes.clear();
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+    const auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    line = line.substr(first);
+    const std::string prefix = "--lookat";
+    if (line.compare(0, prefix.size(), prefix) == 0) {
+      line = line.substr(prefix.size());
+    }
+    Camera camera;
+    if (!parseCamera(line, camera)) {
+      error = path.string() + ":" + std::to_string(lineNumber) +
+              ": expected eye, center and up as 9 numbers";
+      return false;
+    }
+    keyframes.push_back(camera);
+  }
+  if (keyframes.empty()) {
+    error = "No camera in " + path.string();
+    return false;
+  }
+  return true;
+}
+
+Camera getCameraPathCamera(const std::vector<Camera> &keyframes, float t)
+{
+  if (keyframes.size() == 1) {
+    return keyframes.front();
+  }
+  const auto position = glm::clamp(t, 0.f, 1.f) * float(keyframes.size() - 1);
+  const auto segment = std::min(size_t(position), keyframes.size() - 2);
+  const auto &from = keyframes[segment];
+  const auto &to = keyframes[segment + 1];
+  const auto alpha = position - float(segment);
+  const auto eye = glm::mix(from.eye(), to.eye(), alpha);
+  const auto center = glm::mix(from.center(), to.center(), alpha);
+  const auto up = glm::mix(from.up(), to.up(), alpha);
+  // Opposite up vectors or a view direction along up, keep the last good one
+  if (eye == center || glm::cross(up, center - eye) == glm::vec3(0)) {
+    return alpha < 0.5f ? from : to;
+  }
+  return Camera(eye, center, up);
+}
+
+Camera getOrbitCamera(
+    const glm::vec3 &bboxMin, const glm::vec3 &bboxMax, float t)
+{
+  const auto diag = bboxMax - bboxMin;
+  const auto center = 0.5f * (bboxMax + bboxMin);
+  const auto up = glm::vec3(0, 1, 0);
+  const auto offset = diag.z > 0 ? diag : 2.f * glm::cross(diag, up);
+  const auto rotation =
+      glm::rotate(glm::mat4(1), 2.f * glm::pi<float>() * t, up);
+  const auto eye = center + glm::vec3(rotation * glm::vec4(offset, 0));
+  return Camera(eye, center, up);
+}
+
+RenderCounters &RenderCounters::operator+=(const RenderCounters &other)
+{
+  drawCount += other.drawCount;
+  programBindCount += other.programBindCount;
+  vertexArrayBindCount += other.vertexArrayBindCount;
+  materialBindCount += other.materialBindCount;
+  textureBindCount += other.textureBindCount;
+  return *this;
+}
+
+bool writeBenchReport(const BenchResult &result, const fs::path &path)
+{
+  const auto frameCount = result.cpuMs.size();
+  const auto perFrame = [&](uint64_t count) {
+    return frameCount ? double(count) / double(frameCount) : 0.;
+  };
+  const nlohmann::json report = {{"file", result.gltfFile.string()},
+      {"renderer", result.renderer}, {"width", result.width},
+      {"height", result.height}, {"cameraPath", result.cameraPath},
+      {"shading", result.shading}, {"depthPrepass", result.depthPrepass},
+      {"frames", frameCount}, {"warmupFrames", result.warmupFrameCount},
+      {"wallSeconds", result.wallSeconds},
+      {"fps", result.wallSeconds > 0. ? double(frameCount) / result.wallSeconds
+                                      : 0.},
+      {"cpuMs", getTimeStats(result.cpuMs)},
+      {"gpuMs", getTimeStats(result.gpuMs)},
+      {"perFrame",
+          {{"draws", perFrame(result.counters.drawCount)},
+              {"programBinds", perFrame(result.counters.programBindCount)},
+              {"vertexArrayBinds",
+                  perFrame(result.counters.vertexArrayBindCount)},
+              {"materialBinds", perFrame(result.counters.materialBindCount)},
+              {"textureBinds", perFrame(result.counters.textureBindCount)}}}};
+
+  if (path.empty()) {
+    std::cout << std::setw(2) << report << std::endl;
+    return bool(std::cout);
+  }
+  std::ofstream file(path.string());
+  if (!file) {
+    return false;
+  }
+  file << std::setw(2) << report << std::endl;
+  return bool(file);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "cameras.hpp"
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Options of the bench command, which renders frameCount frames offscreen
+// once the scene is completely loaded, the camera moving along a path
+struct BenchOptions
+{
+  size_t frameCount = 0; // Not benchmarking if 0
+  size_t warmupFrameCount = 30; // Rendered before the measured frames
+  std::vector<Camera> keyframes; // Orbit around the scene if empty
+  fs::path reportPath; // Standard output if empty
+};
+
+// Keyframes of a camera path file, one camera per line in the format of
+// --lookat: "eye_x,eye_y,eye_z,center_x,center_y,center_z,up_x,up_y,up_z".
+// A leading "--lookat", as copied by the viewer, is skipped, as well as empty
+// lines and lines starting with '#'. Returns false with a message in error
+// on failure.
+bool loadCameraPath(
+    const fs::path &path, std::vector<Camera> &keyframes, std::string &error);
+
+// Camera at t in [0, 1] along keyframes, linearly interpolated, each segment
+// taking the same time
+Camera getCameraPathCamera(const std::vector<Camera> &keyframes, float t);
+
+// Camera at t in [0, 1] of a turn around the vertical axis of the bounds,
+// starting from the default camera of the viewer
+Camera getOrbitCamera(
+    const glm::vec3 &bboxMin, const glm::vec3 &bboxMax, float t);
+
+// Counts of the GL calls of the frames
+struct RenderCounters
+{
+  uint64_t drawCount = 0;
+  uint64_t programBindCount = 0;
+  uint64_t vertexArrayBindCount = 0;
+  uint64_t materialBindCount = 0;
+  uint64_t textureBindCount = 0;
+
+  void reset() { *this = RenderCounters(); }
+  RenderCounters &operator+=(const RenderCounters &other);
+};
+
+struct BenchResult
+{
+  fs::path gltfFile;
+  std::string renderer; // GL_RENDERER
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::string cameraPath; // "orbit" or "keyframes"
+  std::string shading; // "forward" or "deferred"
+  bool depthPrepass = false;
+  size_t warmupFrameCount = 0;
+  double wallSeconds = 0.; // Of the measured frames
+  std::vector<double> cpuMs; // By measured frame
+  std::vector<double> gpuMs; // NaN if the query failed
+  RenderCounters counters; // Summed over the measured frames
+};
+
+// Writes the result as JSON: min, mean, p50, p95, p99 and max of the CPU and
+// GPU frame times, and the counters per frame. Returns false if the file
+// cannot be written.
+bool writeBenchReport(const BenchResult &result, const fs::path &path);
@@ -0,0 +1,93 @@
+#include "runtimescene.hpp"
+#include "gltf.hpp"
+
+#include <numeric>
+
+RuntimeScene extractRuntimeScene(const tinygltf::Model &model)
+{
+  RuntimeScene scene;
+  scene.nodeMeshes.reserve(model.nodes.size());
+  scene.nodeSkins.reserve(model.nodes.size());
+  scene.primitives.reserve(std::accumulate(begin(model.meshes),
+      end(model.meshes), size_t(0),
+      [](size_t count, const tinygltf::Mesh &mesh) {
+        return count + mesh.primitives.size();
+      }));
+  scene.materials.reserve(model.materials.size());
+  for (const auto &node : model.nodes) {
+    scene.nodeMeshes.push_back(node.mesh);
+    scene.nodeSkins.push_back(node.skin);
+  }
+
+  for (const auto &mesh : model.meshes) {
+    for (const auto &primitive : mesh.primitives) {
+      RuntimePrimitive runtimePrimitive;
+      runtimePrimitive.mode = primitive.mode;
+      runtimePrimitive.material = primitive.material;
+      runtimePrimitive.indexType = -1;
+      runtimePrimitive.count = 0;
+      runtimePrimitive.indexByteOffset = 0;
+      runtimePrimitive.hasBounds = getPositionBounds(model, primitive,
+          runtimePrimitive.boundsMin, runtimePrimitive.boundsMax);
+      glm::vec2 uvMin, uvMax;
+      runtimePrimitive.uvExtent =
+          getTexCoordBounds(model, primitive, uvMin, uvMax) ? uvMax - uvMin
+                                                             : glm::vec2(1);
+      if (primitive.indices >= 0) {
+        const auto &accessor = model.accessors[primitive.indices];
+        runtimePrimitive.indexType = accessor.componentType;
+        runtimePrimitive.count = uint32_t(accessor.count);
+        if (accessor.bufferView >= 0) {
+          runtimePrimitive.indexByteOffset =
+              accessor.byteOffset +
+              model.bufferViews[accessor.bufferView].byteOffset;
+        }
+      } else if (!primitive.attributes.empty()) {
+        // Take first accessor to get the count
+        const auto accessorIdx = begin(primitive.attributes)->second;
+        runtimePrimitive.count = uint32_t(model.accessors[accessorIdx].count);
+      }
+      scene.primitives.push_back(runtimePrimitive);
+    }
+  }
+
+  for (const auto &material : model.materials) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    RuntimeMaterial runtimeMaterial;
+    runtimeMaterial.baseColorFactor =
+        glm::vec4(pbr.baseColorFactor[0], pbr.baseColorFactor[1],
+            pbr.baseColorFactor[2], pbr.baseColorFactor[3]);
+    runtimeMaterial.metallicFactor = float(pbr.metallicFactor);
+    runtimeMaterial.roughnessFactor = float(pbr.roughnessFactor);
+    runtimeMaterial.emissiveFactor = glm::vec3(material.emissiveFactor[0],
+        material.emissiveFactor[1], material.emissiveFactor[2]);
+    runtimeMaterial.normalScale = float(material.normalTexture.scale);
+    runtimeMaterial.baseColorTexture = pbr.baseColorTexture.index;
+    runtimeMaterial.metallicRoughnessTexture =
+        pbr.metallicRoughnessTexture.index;
+    runtimeMaterial.normalTexture = material.normalTexture.index;
+    runtimeMaterial.emissiveTexture = material.emissiveTexture.index;
+    runtimeMaterial.alphaMode = material.alphaMode == "MASK"
+                                    ? AlphaMode::Mask
+                                    : material.alphaMode == "BLEND"
+                                          ? AlphaMode::Blend
+                                          : AlphaMode::Opaque;
+    runtimeMaterial.alphaCutoff = float(material.alphaCutoff);
+    scene.materials.push_back(runtimeMaterial);
+  }
+  return scene;
+}
+
+size_t releaseBulkData(tinygltf::Model &model)
+{
+  size_t releasedBytes = 0;
+  for (auto &buffer : model.buffers) {
+    releasedBytes += buffer.data.capacity();
+    std::vector<unsigned char>().swap(buffer.data);
+  }
+  for (auto &image : model.images) {
+    releasedBytes += image.image.capacity();
+    std::vector<unsigned char>().swap(image.image);
+  }
+  return releasedBytes;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// What drawing a glTF scene needs once its buffers and images are on the GPU:
+// a few counts, offsets and material factors. The tinygltf::Model, with all
+// its bulk data, can be released after extractRuntimeScene(). Only the
+// document is read, so the model may still be streaming its buffers.
+struct RuntimePrimitive
+{
+  int mode; // GL primitive mode
+  int material; // -1 for the default material
+  int indexType; // GL type of the indices, -1 if not indexed
+  uint32_t count; // Number of indices, or of vertices if not indexed
+  size_t indexByteOffset; // Offset of the indices in their bufferView's buffer
+  // Local bounds from the POSITION accessor, hasBounds is false if the
+  // accessor has no min/max
+  bool hasBounds;
+  glm::vec3 boundsMin;
+  glm::vec3 boundsMax;
+  // Size of the range of TEXCOORD_0 from its accessor min/max, (1, 1) if
+  // they are missing
+  glm::vec2 uvExtent;
+};
+
+enum class AlphaMode
+{
+  Opaque,
+  Mask, // Discarded below alphaCutoff
+  Blend
+};
+
+struct RuntimeMaterial
+{
+  glm::vec4 baseColorFactor;
+  float metallicFactor;
+  float roughnessFactor;
+  glm::vec3 emissiveFactor;
+  float normalScale;
+  // Texture indices, -1 if the material has none
+  int baseColorTexture;
+  int metallicRoughnessTexture;
+  int normalTexture;
+  int emissiveTexture;
+  AlphaMode alphaMode;
+  float alphaCutoff;
+};
+
+struct RuntimeScene
+{
+  std::vector<int> nodeMeshes; // Mesh of each glTF node, -1 if none
+  std::vector<int> nodeSkins; // Skin of each glTF node, -1 if none
+  // Primitives of all meshes, mesh after mesh
+  std::vector<RuntimePrimitive> primitives;
+  std::vector<RuntimeMaterial> materials;
+};
+
+// The scene outlives the load, its arrays are on the heap and allocated once
+RuntimeScene extractRuntimeScene(const tinygltf::Model &model);
+
+// Free the data of the buffers and the decoded images of model, the rest of
+// the model stays valid. Returns the number of bytes released.
+size_t releaseBulkData(tinygltf::Model &model);
@@ -0,0 +1,113 @@
+#include "scenegraph.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <functional>
+#include <iostream>
+
+glm::mat4 SceneGraph::localMatrix(size_t flatIdx) const
+{
+  if (hasMatrix[flatIdx]) {
+    return matrices[flatIdx];
+  }
+  // T * R * S, as in getLocalToWorldMatrix()
+  const auto T = glm::translate(glm::mat4(1), translations[flatIdx]);
+  const auto TR = T * glm::mat4_cast(rotations[flatIdx]);
+  return glm::scale(TR, scales[flatIdx]);
+}
+
+size_t SceneGraph::updateWorldMatrices()
+{
+  size_t updateCount = 0;
+  size_t i = 0;
+  while (i < size()) {
+    if (!dirty[i]) {
+      ++i;
+      continue;
+    }
+    // The whole subtree depends on this node. Parents come first in the
+    // flat order so a single forward pass is enough.
+    const auto end = size_t(subtreeEnd[i]);
+    for (auto j = i; j < end; ++j) {
+      const auto parent = parents[j];
+      worldMatrices[j] = parent >= 0 ? worldMatrices[parent] * localMatrix(j)
+                                     : localMatrix(j);
+      dirty[j] = 0;
+    }
+    updateCount += end - i;
+    i = end;
+  }
+  return updateCount;
+}
+
+SceneGraph buildSceneGraph(const tinygltf::Model &model, int sceneIdx)
+{
+  SceneGraph graph;
+  graph.flatIndices.resize(model.nodes.size(), -1);
+  if (sceneIdx < 0 || sceneIdx >= int(model.scenes.size())) {
+    return graph;
+  }
+
+  const std::function<void(int, int)> addNode = [&](int nodeIdx, int parent) {
+    if (graph.flatIndices[nodeIdx] >= 0) {
+      std::cerr << "Node " << nodeIdx
+                << " has several parents, ignoring all but the first one"
+                << std::endl;
+      return;
+    }
+    const auto flatIdx = int(graph.nodes.size());
+    const auto &node = model.nodes[nodeIdx];
+    graph.flatIndices[nodeIdx] = flatIdx;
+    graph.nodes.push_back(nodeIdx);
+    graph.parents.push_back(parent);
+    graph.subtreeEnd.push_back(flatIdx + 1);
+
+    graph.hasMatrix.push_back(node.matrix.size() == 16);
+    graph.matrices.emplace_back(1);
+    if (graph.hasMatrix.back()) {
+      for (size_t c = 0; c < 16; ++c) {
+        glm::value_ptr(graph.matrices.back())[c] = float(node.matrix[c]);
+      }
+    }
+    graph.translations.push_back(node.translation.size() == 3
+                                     ? glm::vec3(node.translation[0],
+                                           node.translation[1],
+                                           node.translation[2])
+                                     : glm::vec3(0));
+    graph.rotations.push_back(node.rotation.size() == 4
+                                  ? glm::quat(float(node.rotation[3]),
+                                        float(node.rotation[0]),
+                                        float(node.rotation[1]),
+                                        float(node.rotation[2]))
+                                  : glm::quat(1, 0, 0, 0));
+    graph.scales.push_back(node.scale.size() == 3
+                               ? glm::vec3(node.scale[0], node.scale[1],
+                                     node.scale[2])
+                               : glm::vec3(1));
+
+    // Node weights override the default weights of the mesh
+    const auto *pWeights = &node.weights;
+    if (pWeights->empty() && node.mesh >= 0) {
+      pWeights = &model.meshes[node.mesh].weights;
+    }
+    graph.weightOffsets.push_back(uint32_t(graph.weights.size()));
+    graph.weightCounts.push_back(uint32_t(pWeights->size()));
+    for (const auto w : *pWeights) {
+      graph.weights.push_back(float(w));
+    }
+
+    for (const auto child : node.children) {
+      addNode(child, flatIdx);
+    }
+    graph.subtreeEnd[flatIdx] = int(graph.nodes.size());
+  };
+  for (const auto nodeIdx : model.scenes[sceneIdx].nodes) {
+    addNode(nodeIdx, -1);
+  }
+
+  graph.worldMatrices.resize(graph.size(), glm::mat4(1));
+  graph.dirty.resize(graph.size(), 1);
+  graph.updateWorldMatrices();
+  return graph;
+}
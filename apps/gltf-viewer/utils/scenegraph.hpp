@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+// Flattened node hierarchy of a glTF scene.
+//
+// Nodes are stored in depth first order so that a parent always comes before
+// its children and the descendants of a node are contiguous:
+// [i, subtreeEnd[i]) is the subtree rooted at i. Local transforms are stored
+// as separate arrays (structure of arrays) so that animation can write
+// translation, rotation or scale without touching the rest.
+//
+// Writers of local transforms must call markDirty(); updateWorldMatrices()
+// then only recomputes the world matrices of dirty subtrees.
+struct SceneGraph
+{
+  std::vector<int> nodes; // glTF node index of each flat node
+  std::vector<int> parents; // Flat index of the parent, -1 for roots
+  std::vector<int> subtreeEnd; // One past the last descendant
+  std::vector<int> flatIndices; // glTF node index -> flat index, -1 if absent
+
+  std::vector<glm::vec3> translations;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  // Nodes defined by a matrix keep it here and ignore translations,
+  // rotations and scales (glTF forbids animating them)
+  std::vector<glm::mat4> matrices;
+  std::vector<uint8_t> hasMatrix;
+
+  // Morph target weights of all nodes, node i owns
+  // weights[weightOffsets[i] .. weightOffsets[i] + weightCounts[i]]
+  std::vector<float> weights;
+  std::vector<uint32_t> weightOffsets;
+  std::vector<uint32_t> weightCounts;
+
+  std::vector<glm::mat4> worldMatrices;
+  std::vector<uint8_t> dirty;
+
+  size_t size() const { return nodes.size(); }
+
+  void markDirty(size_t flatIdx) { dirty[flatIdx] = 1; }
+
+  glm::mat4 localMatrix(size_t flatIdx) const;
+
+  // Returns the number of world matrices that have been recomputed
+  size_t updateWorldMatrices();
+};
+
+// Build the flattened graph of model.scenes[sceneIdx], world matrices are
+// up to date when it returns. An invalid sceneIdx gives an empty graph.
+SceneGraph buildSceneGraph(const tinygltf::Model &model, int sceneIdx);
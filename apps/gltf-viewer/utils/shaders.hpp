@@ -1,6 +1,7 @@
 #pragma once
 
 #include "filesystem.hpp"
+#include <algorithm>
 #include <fstream>
 #include <glad/glad.h>
 #include <iostream>
@@ -9,6 +10,7 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 
 class GLShader
@@ -66,7 +68,10 @@ public:
   }
 };
 
-inline std::string loadShaderSource(const fs::path &filepath)
+// Source of a shader file. Each of defines, "NAME" or "NAME VALUE", is
+// inserted as a #define after the #version line.
+inline std::string loadShaderSource(
+    const fs::path &filepath, const std::vector<std::string> &defines = {})
 {
   std::ifstream input(filepath.string());
   if (!input) {
@@ -78,7 +83,27 @@ inline std::string loadShaderSource(const fs::path &filepath)
   std::stringstream buffer;
   buffer << input.rdbuf();
 
-  return buffer.str();
+  auto source = buffer.str();
+  if (defines.empty()) {
+    return source;
+  }
+  size_t insertPos = 0;
+  const auto versionPos = source.find("#version");
+  if (versionPos != std::string::npos) {
+    const auto eolPos = source.find('\n', versionPos);
+    insertPos = eolPos != std::string::npos ? eolPos + 1 : source.size();
+  }
+  // A #version on the last line without end of line
+  std::string header =
+      insertPos > 0 && source[insertPos - 1] != '\n' ? "\n" : "";
+  for (const auto &define : defines) {
+    header += "#define " + define + "\n";
+  }
+  // Compilation errors keep the line numbers of the file
+  const auto lineNumber =
+      std::count(begin(source), begin(source) + insertPos, '\n') + 1;
+  header += "#line " + std::to_string(lineNumber) + "\n";
+  return source.insert(insertPos, header);
 }
 
 template <typename StringType>
@@ -93,12 +118,13 @@ GLShader compileShader(GLenum type, StringType &&src)
   return shader;
 }
 
-// Load and compile a shader according to the following naming convention:
+// Type and type name of a shader, from the naming convention:
 // *.vs.glsl -> vertex shader
 // *.fs.glsl -> fragment shader
 // *.gs.glsl -> geometry shader
 // *.cs.glsl -> compute shader
-inline GLShader loadShader(const fs::path &shaderPath)
+inline const std::pair<GLenum, std::string> &getShaderType(
+    const fs::path &shaderPath)
 {
   static auto extToShaderType =
       std::unordered_map<std::string, std::pair<GLenum, std::string>>(
@@ -113,12 +139,19 @@ inline GLShader loadShader(const fs::path &shaderPath)
     std::cerr << "Unrecognized shader extension " << ext << std::endl;
     throw std::runtime_error("Unrecognized shader extension " + ext.string());
   }
+  return (*it).second;
+}
 
-  std::clog << "Compiling " << (*it).second.second << " shader " << shaderPath
-            << "\n";
+// Compile the source of a shader whose type follows the naming convention of
+// getShaderType()
+inline GLShader compileShaderFile(
+    const fs::path &shaderPath, const std::string &source)
+{
+  const auto &type = getShaderType(shaderPath);
+  std::clog << "Compiling " << type.second << " shader " << shaderPath << "\n";
 
-  GLShader shader{(*it).second.first};
-  shader.setSource(loadShaderSource(shaderPath));
+  GLShader shader{type.first};
+  shader.setSource(source);
   shader.compile();
   if (!shader.getCompileStatus()) {
     std::cerr << "Shader compilation error:" << shader.getInfoLog()
@@ -128,6 +161,12 @@ inline GLShader loadShader(const fs::path &shaderPath)
   return shader;
 }
 
+// Load and compile a shader, see getShaderType() for the naming convention
+inline GLShader loadShader(const fs::path &shaderPath)
+{
+  return compileShaderFile(shaderPath, loadShaderSource(shaderPath));
+}
+
 class GLProgram
 {
   GLuint m_GLId;
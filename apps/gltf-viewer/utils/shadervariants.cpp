@@ -0,0 +1,177 @@
+#include "shadervariants.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+const uint32_t kPointLightCountShift = 16;
+
+GLint getLocation(const GLProgram &program, const std::string &name)
+{
+  return glGetUniformLocation(program.glId(), name.c_str());
+}
+
+} // namespace
+
+ShaderVariantKey getLightVariantKey(bool directionalLight,
+    size_t pointLightCount, bool spotLight, bool imageBasedLighting,
+    bool shadows)
+{
+  ShaderVariantKey key =
+      ShaderVariantKey(std::min(pointLightCount, kMaxPointLightCount))
+      << kPointLightCountShift;
+  if (directionalLight) {
+    key |= ShaderFeature_DirectionalLight;
+  }
+  if (spotLight) {
+    key |= ShaderFeature_SpotLight;
+  }
+  if (imageBasedLighting) {
+    key |= ShaderFeature_ImageBasedLighting;
+  }
+  if (directionalLight && shadows) {
+    key |= ShaderFeature_Shadows;
+  }
+  return key;
+}
+
+size_t getPointLightCount(ShaderVariantKey key)
+{
+  return size_t(key >> kPointLightCountShift);
+}
+
+std::vector<std::string> getShaderVariantDefines(ShaderVariantKey key)
+{
+  static const std::pair<ShaderFeature, const char *> featureDefines[] = {
+      {ShaderFeature_BaseColorTexture, "HAS_BASE_COLOR_TEXTURE"},
+      {ShaderFeature_MetallicRoughnessTexture,
+          "HAS_METALLIC_ROUGHNESS_TEXTURE"},
+      {ShaderFeature_NormalTexture, "HAS_NORMAL_TEXTURE"},
+      {ShaderFeature_Emissive, "HAS_EMISSIVE"},
+      {ShaderFeature_EmissiveTexture, "HAS_EMISSIVE_TEXTURE"},
+      {ShaderFeature_AlphaMask, "ALPHA_MASK"},
+      {ShaderFeature_AlphaBlend, "ALPHA_BLEND"},
+      {ShaderFeature_DirectionalLight, "HAS_DIRECTIONAL_LIGHT"},
+      {ShaderFeature_SpotLight, "HAS_SPOT_LIGHT"},
+      {ShaderFeature_ImageBasedLighting, "HAS_IMAGE_BASED_LIGHTING"},
+      {ShaderFeature_Shadows, "HAS_SHADOWS"},
+      {ShaderFeature_GBufferPass, "GBUFFER_PASS"},
+      {ShaderFeature_DeferredShading, "DEFERRED_SHADING"},
+      {ShaderFeature_CountOverdraw, "COUNT_OVERDRAW"},
+      {ShaderFeature_WeightedBlendedOit, "WEIGHTED_BLENDED_OIT"}};
+
+  std::vector<std::string> defines;
+  for (const auto &featureDefine : featureDefines) {
+    if (key & featureDefine.first) {
+      defines.emplace_back(featureDefine.second);
+    }
+  }
+  defines.push_back(
+      "POINT_LIGHT_COUNT " + std::to_string(getPointLightCount(key)));
+  return defines;
+}
+
+ForwardUniforms::ForwardUniforms(const GLProgram &program) :
+    modelViewProjMatrix(getLocation(program, "uModelViewProjMatrix")),
+    modelViewMatrix(getLocation(program, "uModelViewMatrix")),
+    normalMatrix(getLocation(program, "uNormalMatrix")),
+    jointOffset(getLocation(program, "uJointOffset")),
+    morphDeltas(getLocation(program, "uMorphDeltas")),
+    morphTargetCount(getLocation(program, "uMorphTargetCount")),
+    morphTargets(getLocation(program, "uMorphTargets")),
+    morphWeights(getLocation(program, "uMorphWeights")),
+    morphVertexCount(getLocation(program, "uMorphVertexCount")),
+    morphAttributeCount(getLocation(program, "uMorphAttributeCount")),
+    morphSlots(getLocation(program, "uMorphSlots")),
+    baseColorTexture(getLocation(program, "uBaseColorTexture")),
+    baseColorFactor(getLocation(program, "uBaseColorFactor")),
+    metallicRoughnessTexture(
+        getLocation(program, "uMetallicRoughnessTexture")),
+    metallicFactor(getLocation(program, "uMetallicFactor")),
+    roughnessFactor(getLocation(program, "uRoughnessFactor")),
+    normalTexture(getLocation(program, "uNormalTexture")),
+    normalScale(getLocation(program, "uNormalScale")),
+    emissiveTexture(getLocation(program, "uEmissiveTexture")),
+    emissiveFactor(getLocation(program, "uEmissiveFactor")),
+    alphaCutoff(getLocation(program, "uAlphaCutoff")),
+    specularEnvironment(getLocation(program, "uSpecularEnvironment")),
+    brdfLut(getLocation(program, "uBrdfLut")),
+    shadowMap(getLocation(program, "uShadowMap")),
+    cascadeViewProjMatrices(getLocation(program, "uCascadeViewProjMatrices")),
+    firstCascade(getLocation(program, "uFirstCascade")),
+    gBufferBaseColorMetallic(
+        getLocation(program, "uGBufferBaseColorMetallic")),
+    gBufferNormalRoughness(getLocation(program, "uGBufferNormalRoughness")),
+    gBufferEmissive(getLocation(program, "uGBufferEmissive")),
+    gBufferDepth(getLocation(program, "uGBufferDepth")),
+    inverseProjMatrix(getLocation(program, "uInverseProjMatrix")),
+    tileCountX(getLocation(program, "uTileCountX"))
+{
+}
+
+ShaderVariants::ShaderVariants(
+    ProgramCache &cache, std::vector<fs::path> shaderPaths) :
+    m_Cache(cache),
+    m_ShaderPaths(std::move(shaderPaths))
+{
+}
+
+size_t ShaderVariants::build(
+    const std::vector<ShaderVariantKey> &keys, size_t *hitCount)
+{
+  std::vector<ShaderVariantKey> newKeys;
+  for (const auto key : keys) {
+    if (!contains(key) &&
+        std::find(begin(newKeys), end(newKeys), key) == end(newKeys)) {
+      newKeys.push_back(key);
+    }
+  }
+  if (newKeys.empty()) {
+    return 0;
+  }
+  std::vector<std::vector<std::string>> definesList;
+  for (const auto key : newKeys) {
+    definesList.push_back(getShaderVariantDefines(key));
+  }
+  auto programs = m_Cache.loadVariants(m_ShaderPaths, definesList, hitCount);
+  for (size_t i = 0; i < newKeys.size(); ++i) {
+    const ForwardUniforms uniforms(programs[i]);
+    m_Variants[newKeys[i]] = std::unique_ptr<Variant>(
+        new Variant{std::move(programs[i]), uniforms});
+  }
+  return newKeys.size();
+}
+
+const ShaderVariants::Variant &ShaderVariants::get(ShaderVariantKey key)
+{
+  auto it = m_Variants.find(key);
+  if (it == end(m_Variants)) {
+    build({key});
+    it = m_Variants.find(key);
+  }
+  return *it->second;
+}
+
+bool ShaderVariants::reload(std::string &error)
+{
+  std::vector<ShaderVariantKey> keys;
+  std::vector<std::vector<std::string>> definesList;
+  for (const auto &it : m_Variants) {
+    keys.push_back(it.first);
+    definesList.push_back(getShaderVariantDefines(it.first));
+  }
+  std::vector<GLProgram> programs;
+  try {
+    programs = m_Cache.loadVariants(m_ShaderPaths, definesList);
+  } catch (const std::runtime_error &e) {
+    error = e.what();
+    return false;
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const ForwardUniforms uniforms(programs[i]);
+    m_Variants[keys[i]] = std::unique_ptr<Variant>(
+        new Variant{std::move(programs[i]), uniforms});
+  }
+  return true;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "lights.hpp"
+#include "programcache.hpp"
+#include "runtimescene.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Variants of the forward shaders, with the features of a draw compiled in by
+// #defines instead of tested on uniforms: a material without textures, or a
+// scene with its lights off, costs fewer texture fetches and less ALU per
+// fragment.
+//
+// A variant is keyed by the ShaderFeature bits of its material and lights,
+// and by its number of point lights.
+using ShaderVariantKey = uint32_t;
+
+enum ShaderFeature : ShaderVariantKey
+{
+  // Material features
+  ShaderFeature_BaseColorTexture = 1 << 0,
+  ShaderFeature_MetallicRoughnessTexture = 1 << 1,
+  ShaderFeature_NormalTexture = 1 << 2,
+  ShaderFeature_Emissive = 1 << 3, // Non zero emissive factor
+  ShaderFeature_EmissiveTexture = 1 << 4, // Along with Emissive
+  ShaderFeature_AlphaMask = 1 << 5,
+  ShaderFeature_AlphaBlend = 1 << 6,
+  // Light features, point lights are counted by getPointLightCount()
+  ShaderFeature_DirectionalLight = 1 << 8,
+  ShaderFeature_SpotLight = 1 << 9,
+  ShaderFeature_ImageBasedLighting = 1 << 10,
+  ShaderFeature_Shadows = 1 << 11, // Of the directional light
+  // Passes of the deferred path, see utils/gbuffer.hpp: the material bits
+  // alone for the G-buffer, the light bits alone for the shading
+  ShaderFeature_GBufferPass = 1 << 12,
+  ShaderFeature_DeferredShading = 1 << 13,
+  // Debug counter of the fragments shaded, not with DeferredShading
+  ShaderFeature_CountOverdraw = 1 << 14,
+  // Blended draws accumulated in utils/transparency.hpp rather than sorted
+  ShaderFeature_WeightedBlendedOit = 1 << 15,
+};
+
+// Material bits of the key of a draw, with the normal map if normalMapping.
+// hasTexture(textureIdx) tells whether a texture can be bound: a texture not
+// streamed in yet is compiled out rather than sampled as a placeholder.
+template <typename HasTexture>
+ShaderVariantKey getMaterialVariantKey(const RuntimeMaterial &material,
+    bool normalMapping, HasTexture &&hasTexture)
+{
+  ShaderVariantKey key = 0;
+  if (hasTexture(material.baseColorTexture)) {
+    key |= ShaderFeature_BaseColorTexture;
+  }
+  if (hasTexture(material.metallicRoughnessTexture)) {
+    key |= ShaderFeature_MetallicRoughnessTexture;
+  }
+  if (normalMapping && hasTexture(material.normalTexture)) {
+    key |= ShaderFeature_NormalTexture;
+  }
+  if (material.emissiveFactor != glm::vec3(0)) {
+    key |= ShaderFeature_Emissive;
+    if (hasTexture(material.emissiveTexture)) {
+      key |= ShaderFeature_EmissiveTexture;
+    }
+  }
+  if (material.alphaMode == AlphaMode::Mask) {
+    key |= ShaderFeature_AlphaMask;
+  }
+  else if (material.alphaMode == AlphaMode::Blend) {
+    key |= ShaderFeature_AlphaBlend;
+  }
+  return key;
+}
+
+// Light bits of the key, pointLightCount is at most kMaxPointLightCount.
+// shadows only applies to the directional light.
+ShaderVariantKey getLightVariantKey(bool directionalLight,
+    size_t pointLightCount, bool spotLight, bool imageBasedLighting = false,
+    bool shadows = false);
+
+size_t getPointLightCount(ShaderVariantKey key);
+
+// Defines of the variant for loadShaderSource()
+std::vector<std::string> getShaderVariantDefines(ShaderVariantKey key);
+
+// Uniform locations of a variant of the forward shaders, -1 for those it
+// compiled out. The lights are in a uniform buffer shared by all variants,
+// see LightsBlock.
+struct ForwardUniforms
+{
+  GLint modelViewProjMatrix;
+  GLint modelViewMatrix;
+  GLint normalMatrix;
+  GLint jointOffset;
+  GLint morphDeltas;
+  GLint morphTargetCount;
+  GLint morphTargets;
+  GLint morphWeights;
+  GLint morphVertexCount;
+  GLint morphAttributeCount;
+  GLint morphSlots;
+
+  GLint baseColorTexture;
+  GLint baseColorFactor;
+  GLint metallicRoughnessTexture;
+  GLint metallicFactor;
+  GLint roughnessFactor;
+  GLint normalTexture;
+  GLint normalScale;
+  GLint emissiveTexture;
+  GLint emissiveFactor;
+  GLint alphaCutoff;
+
+  GLint specularEnvironment;
+  GLint brdfLut;
+  GLint shadowMap;
+
+  // Of the shadow pass, see SHADOW_PASS in forward.vs.glsl
+  GLint cascadeViewProjMatrices;
+  GLint firstCascade;
+
+  // Of the deferred shading
+  GLint gBufferBaseColorMetallic;
+  GLint gBufferNormalRoughness;
+  GLint gBufferEmissive;
+  GLint gBufferDepth;
+  GLint inverseProjMatrix;
+  GLint tileCountX;
+
+  explicit ForwardUniforms(const GLProgram &program);
+};
+
+// Programs of the variants, built from the program cache on first use
+class ShaderVariants
+{
+public:
+  struct Variant
+  {
+    GLProgram program;
+    ForwardUniforms uniforms;
+  };
+
+  // shaderPaths are given to ProgramCache::loadVariants()
+  ShaderVariants(ProgramCache &cache, std::vector<fs::path> shaderPaths);
+
+  // Builds the variants of keys not built yet, all together so that the
+  // driver may compile them in parallel. Returns the number of variants
+  // built, and adds those read from the cache to *hitCount if not null.
+  size_t build(
+      const std::vector<ShaderVariantKey> &keys, size_t *hitCount = nullptr);
+
+  // Variant of key, built first if needed
+  const Variant &get(ShaderVariantKey key);
+
+  // Rebuilds the variants built so far from the current sources of the
+  // shaders, all replaced only if all of them compile and link. Returns false
+  // with the errors in error otherwise, the previous programs staying in use.
+  bool reload(std::string &error);
+
+  bool contains(ShaderVariantKey key) const
+  {
+    return m_Variants.count(key) > 0;
+  }
+
+  size_t size() const { return m_Variants.size(); }
+
+private:
+  ProgramCache &m_Cache;
+  std::vector<fs::path> m_ShaderPaths;
+  // Pointers so that variants stay in place as others are built
+  std::unordered_map<ShaderVariantKey, std::unique_ptr<Variant>> m_Variants;
+};
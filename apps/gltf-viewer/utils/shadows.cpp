@@ -0,0 +1,147 @@
+#include "shadows.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+// Weight of the logarithmic split over the uniform one, the logarithmic split
+// alone gives too small a first cascade
+const float kSplitLambda = 0.75f;
+
+glm::vec3 getBoxCorner(
+    const glm::vec3 &boxMin, const glm::vec3 &boxMax, int corner)
+{
+  return {(corner & 1) ? boxMax.x : boxMin.x,
+      (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z};
+}
+
+} // namespace
+
+ShadowCascades computeShadowCascades(const glm::mat4 &viewMatrix,
+    const glm::mat4 &projMatrix, const glm::vec3 &lightDirection,
+    const glm::vec3 &sceneMin, const glm::vec3 &sceneMax, size_t cascadeCount,
+    size_t resolution)
+{
+  ShadowCascades cascades;
+
+  // Range of the projection, clipped to the distances of the scene
+  const auto cameraNear = projMatrix[3][2] / (projMatrix[2][2] - 1.f);
+  const auto cameraFar = projMatrix[3][2] / (projMatrix[2][2] + 1.f);
+  auto sceneNear = std::numeric_limits<float>::max();
+  auto sceneFar = std::numeric_limits<float>::lowest();
+  for (int corner = 0; corner < 8; ++corner) {
+    const auto distance =
+        -(viewMatrix * glm::vec4(getBoxCorner(sceneMin, sceneMax, corner), 1))
+             .z;
+    sceneNear = std::min(sceneNear, distance);
+    sceneFar = std::max(sceneFar, distance);
+  }
+  const auto nearDistance = std::max(cameraNear, sceneNear);
+  const auto farDistance = std::min(cameraFar, sceneFar);
+  if (farDistance <= nearDistance) {
+    return cascades;
+  }
+  cascades.count = std::min(std::max(cascadeCount, size_t(1)),
+      kMaxShadowCascadeCount);
+
+  // View space directions of the edges of the frustum, at a distance of 1
+  const auto invProjMatrix = glm::inverse(projMatrix);
+  glm::vec3 edges[4];
+  for (int i = 0; i < 4; ++i) {
+    const auto corner = invProjMatrix * glm::vec4((i & 1) ? 1.f : -1.f,
+                                            (i & 2) ? 1.f : -1.f, -1.f, 1.f);
+    edges[i] = glm::vec3(corner) / -corner.z;
+  }
+  const auto invViewMatrix = glm::inverse(viewMatrix);
+
+  // Constant rotation of the views of the light, only their translations
+  // follow the camera
+  const auto up = std::abs(lightDirection.y) < 0.99f ? glm::vec3(0, 1, 0)
+                                                     : glm::vec3(0, 0, 1);
+  const auto lightViewMatrix = glm::lookAt(glm::vec3(0), -lightDirection, up);
+  auto sceneLightMin = std::numeric_limits<float>::max();
+  auto sceneLightMax = std::numeric_limits<float>::lowest();
+  for (int corner = 0; corner < 8; ++corner) {
+    const auto z =
+        (lightViewMatrix *
+            glm::vec4(getBoxCorner(sceneMin, sceneMax, corner), 1))
+            .z;
+    sceneLightMin = std::min(sceneLightMin, z);
+    sceneLightMax = std::max(sceneLightMax, z);
+  }
+
+  auto sliceNear = nearDistance;
+  for (size_t i = 0; i < cascades.count; ++i) {
+    const auto t = float(i + 1) / float(cascades.count);
+    const auto logSplit =
+        nearDistance * std::pow(farDistance / nearDistance, t);
+    const auto uniformSplit = nearDistance + (farDistance - nearDistance) * t;
+    const auto sliceFar = i + 1 == cascades.count
+                              ? farDistance
+                              : glm::mix(uniformSplit, logSplit, kSplitLambda);
+    cascades.splitDistances[i] = sliceFar;
+
+    glm::vec3 corners[8];
+    glm::vec3 center(0);
+    for (int j = 0; j < 8; ++j) {
+      const auto distance = j < 4 ? sliceNear : sliceFar;
+      corners[j] =
+          glm::vec3(invViewMatrix * glm::vec4(edges[j % 4] * distance, 1));
+      center += corners[j] / 8.f;
+    }
+    // The radius only depends on the shape of the slice, so it stays the same
+    // as the camera turns. Rounded up to an eighth of an octave, the slices
+    // clipped by the scene change it in steps as the camera moves.
+    float radius = 0.f;
+    for (const auto &corner : corners) {
+      radius = std::max(radius, glm::distance(corner, center));
+    }
+    radius = std::exp2(std::ceil(std::log2(radius) * 8.f) / 8.f);
+
+    // Snapped to the texels of the shadow map
+    const auto texelSize = 2.f * radius / float(resolution);
+    auto lightCenter = glm::vec3(lightViewMatrix * glm::vec4(center, 1));
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    // The light looks along -z
+    const auto zNear = -std::max(sceneLightMax, lightCenter.z + radius);
+    const auto zFar = -std::min(sceneLightMin, lightCenter.z - radius);
+    const auto cascadeProjMatrix = glm::ortho(lightCenter.x - radius,
+        lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+        zNear, zFar);
+    cascades.viewProjMatrices[i] = cascadeProjMatrix * lightViewMatrix;
+    sliceNear = sliceFar;
+  }
+  return cascades;
+}
+
+uint32_t getShadowCascadeMask(const ShadowCascades &cascades,
+    const glm::mat4 &modelMatrix, const glm::vec3 &boundsMin,
+    const glm::vec3 &boundsMax)
+{
+  const auto center = glm::vec4(0.5f * (boundsMin + boundsMax), 1);
+  const auto extent = 0.5f * (boundsMax - boundsMin);
+  uint32_t mask = 0;
+  for (size_t i = 0; i < cascades.count; ++i) {
+    // Orthographic, w stays 1
+    const auto matrix = cascades.viewProjMatrices[i] * modelMatrix;
+    const auto clipCenter = glm::vec3(matrix * center);
+    bool inside = true;
+    for (int axis = 0; axis < 2 && inside; ++axis) {
+      const auto clipExtent = std::abs(matrix[0][axis]) * extent.x +
+                              std::abs(matrix[1][axis]) * extent.y +
+                              std::abs(matrix[2][axis]) * extent.z;
+      inside = std::abs(clipCenter[axis]) - clipExtent <= 1.f;
+    }
+    if (inside) {
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t kMaxShadowCascadeCount = 4; // Of the forward shaders
+
+// Cascaded shadow maps of the directional light: the view frustum, clipped to
+// the bounds of the scene, is split in depth slices, each covered by the
+// orthographic view of the light of a cascade. The near slices, small on
+// screen, get as many texels as the far ones.
+struct ShadowCascades
+{
+  size_t count = 0; // 0 if the scene is not in the view
+  // From world space to the clip space of each cascade
+  glm::mat4 viewProjMatrices[kMaxShadowCascadeCount];
+  // View space distance at which each cascade ends
+  float splitDistances[kMaxShadowCascadeCount];
+};
+
+// Cascades of a light coming from lightDirection (normalized, towards the
+// light) for the camera of viewMatrix and projMatrix, a perspective
+// projection, each with a resolution x resolution shadow map.
+//
+// The slices end at the bounds of the scene [sceneMin, sceneMax], which also
+// bound the depth range of the cascades so that casters out of the view still
+// cast. Each cascade covers the bounding sphere of its slice and only moves by
+// whole texels, so that the edges of the shadows do not shimmer as the camera
+// moves or turns.
+ShadowCascades computeShadowCascades(const glm::mat4 &viewMatrix,
+    const glm::mat4 &projMatrix, const glm::vec3 &lightDirection,
+    const glm::vec3 &sceneMin, const glm::vec3 &sceneMax, size_t cascadeCount,
+    size_t resolution);
+
+// Bit i set if the box [boundsMin, boundsMax] transformed by modelMatrix
+// crosses the view of cascade i, along its width and height only: casters
+// before or after its depth range are drawn with depth clamping.
+uint32_t getShadowCascadeMask(const ShadowCascades &cascades,
+    const glm::mat4 &modelMatrix, const glm::vec3 &boundsMin,
+    const glm::vec3 &boundsMax);
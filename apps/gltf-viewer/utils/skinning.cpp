@@ -0,0 +1,233 @@
+#include "skinning.hpp"
+#include "gltf.hpp"
+#include "threadpool.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GLTF_VIEWER_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Below this number of joints the palettes are computed on the calling thread
+const size_t kParallelJointThreshold = 4096;
+
+void skinPositionsScalar(size_t count, const glm::vec3 *positions,
+    const glm::uvec4 *joints, const glm::vec4 *weights,
+    const glm::mat4 *palette, glm::vec3 *outPositions)
+{
+  for (size_t v = 0; v < count; ++v) {
+    const auto &j = joints[v];
+    const auto &w = weights[v];
+    const auto skinMatrix = w.x * palette[j.x] + w.y * palette[j.y] +
+                            w.z * palette[j.z] + w.w * palette[j.w];
+    outPositions[v] = glm::vec3(skinMatrix * glm::vec4(positions[v], 1.f));
+  }
+}
+
+#ifdef GLTF_VIEWER_AVX2_DISPATCH
+// A mat4 is two __m256: columns (0, 1) and columns (2, 3). The blended matrix
+// is accumulated with FMAs, then applied to the position with a single
+// horizontal add.
+__attribute__((target("avx2,fma"))) void skinPositionsAVX2(size_t count,
+    const glm::vec3 *positions, const glm::uvec4 *joints,
+    const glm::vec4 *weights, const glm::mat4 *palette,
+    glm::vec3 *outPositions)
+{
+  const auto *pPalette = glm::value_ptr(palette[0]);
+  for (size_t v = 0; v < count; ++v) {
+    const auto &j = joints[v];
+    const auto &w = weights[v];
+    const auto *m0 = pPalette + 16 * j.x;
+    const auto *m1 = pPalette + 16 * j.y;
+    const auto *m2 = pPalette + 16 * j.z;
+    const auto *m3 = pPalette + 16 * j.w;
+
+    auto cols01 = _mm256_mul_ps(_mm256_set1_ps(w.x), _mm256_loadu_ps(m0));
+    auto cols23 = _mm256_mul_ps(_mm256_set1_ps(w.x), _mm256_loadu_ps(m0 + 8));
+    cols01 = _mm256_fmadd_ps(_mm256_set1_ps(w.y), _mm256_loadu_ps(m1), cols01);
+    cols23 =
+        _mm256_fmadd_ps(_mm256_set1_ps(w.y), _mm256_loadu_ps(m1 + 8), cols23);
+    cols01 = _mm256_fmadd_ps(_mm256_set1_ps(w.z), _mm256_loadu_ps(m2), cols01);
+    cols23 =
+        _mm256_fmadd_ps(_mm256_set1_ps(w.z), _mm256_loadu_ps(m2 + 8), cols23);
+    cols01 = _mm256_fmadd_ps(_mm256_set1_ps(w.w), _mm256_loadu_ps(m3), cols01);
+    cols23 =
+        _mm256_fmadd_ps(_mm256_set1_ps(w.w), _mm256_loadu_ps(m3 + 8), cols23);
+
+    const auto &p = positions[v];
+    const auto xy = _mm256_mul_ps(
+        cols01, _mm256_setr_ps(p.x, p.x, p.x, p.x, p.y, p.y, p.y, p.y));
+    const auto sum = _mm256_fmadd_ps(cols23,
+        _mm256_setr_ps(p.z, p.z, p.z, p.z, 1.f, 1.f, 1.f, 1.f), xy);
+    const auto result = _mm_add_ps(
+        _mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+
+    alignas(16) float out[4];
+    _mm_store_ps(out, result);
+    outPositions[v] = glm::vec3(out[0], out[1], out[2]);
+  }
+}
+
+bool cpuHasAVX2()
+{
+  static const bool hasAVX2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return hasAVX2;
+}
+#endif
+
+} // namespace
+
+std::vector<Skin> compileSkins(
+    const tinygltf::Model &model, const SceneGraph &graph)
+{
+  std::vector<Skin> skins(model.skins.size());
+  uint32_t paletteOffset = 0;
+  for (size_t i = 0; i < model.skins.size(); ++i) {
+    const auto &gltfSkin = model.skins[i];
+    auto &skin = skins[i];
+    skin.paletteOffset = paletteOffset;
+    paletteOffset += uint32_t(gltfSkin.joints.size());
+
+    for (const auto joint : gltfSkin.joints) {
+      skin.joints.push_back(graph.flatIndices[joint]);
+    }
+    skin.inverseBindMatrices.resize(gltfSkin.joints.size(), glm::mat4(1));
+    if (gltfSkin.inverseBindMatrices >= 0) {
+      const auto &accessor = model.accessors[gltfSkin.inverseBindMatrices];
+      if (accessor.type != TINYGLTF_TYPE_MAT4 ||
+          accessor.count < gltfSkin.joints.size()) {
+        std::cerr << "Skin " << i
+                  << " has invalid inverseBindMatrices, using identity"
+                  << std::endl;
+        continue;
+      }
+      std::vector<float> values(accessor.count * 16);
+      readAccessorAsFloat(model, accessor, values.data());
+      for (size_t j = 0; j < gltfSkin.joints.size(); ++j) {
+        skin.inverseBindMatrices[j] = glm::make_mat4(values.data() + 16 * j);
+      }
+    }
+  }
+  return skins;
+}
+
+size_t getPaletteSize(const std::vector<Skin> &skins)
+{
+  return skins.empty() ? 0
+                       : skins.back().paletteOffset + skins.back().joints.size();
+}
+
+void computeJointPalettes(const std::vector<Skin> &skins,
+    const SceneGraph &graph, std::vector<glm::mat4> &palette,
+    ThreadPool *pool)
+{
+  const auto paletteSize = getPaletteSize(skins);
+  palette.resize(paletteSize);
+
+  const auto computeSkins = [&](size_t begin, size_t end) {
+    for (auto s = begin; s < end; ++s) {
+      const auto &skin = skins[s];
+      auto *pOut = palette.data() + skin.paletteOffset;
+      for (size_t j = 0; j < skin.joints.size(); ++j) {
+        const auto joint = skin.joints[j];
+        pOut[j] = joint >= 0
+                      ? graph.worldMatrices[joint] * skin.inverseBindMatrices[j]
+                      : skin.inverseBindMatrices[j];
+      }
+    }
+  };
+  if (pool && paletteSize >= kParallelJointThreshold) {
+    // Split by skins so that the grain adapts to the average skin size
+    const auto jointsPerSkin = paletteSize / skins.size();
+    pool->parallelFor(skins.size(),
+        std::max(size_t(1), 1024 / std::max(size_t(1), jointsPerSkin)),
+        computeSkins);
+  } else {
+    computeSkins(0, skins.size());
+  }
+}
+
+void skinPositions(size_t count, const glm::vec3 *positions,
+    const glm::uvec4 *joints, const glm::vec4 *weights,
+    const glm::mat4 *palette, glm::vec3 *outPositions)
+{
+#ifdef GLTF_VIEWER_AVX2_DISPATCH
+  if (cpuHasAVX2()) {
+    skinPositionsAVX2(count, positions, joints, weights, palette, outPositions);
+    return;
+  }
+#endif
+  skinPositionsScalar(count, positions, joints, weights, palette, outPositions);
+}
+
+void computeSkinnedBounds(const tinygltf::Model &model,
+    const SceneGraph &graph, const std::vector<Skin> &skins,
+    const std::vector<glm::mat4> &palette, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax)
+{
+  // Scratch buffers, reused by the primitives
+  std::vector<glm::vec3> positions, skinnedPositions;
+  std::vector<glm::uvec4> joints;
+  std::vector<glm::vec4> weights;
+
+  for (size_t flatIdx = 0; flatIdx < graph.size(); ++flatIdx) {
+    const auto &node = model.nodes[graph.nodes[flatIdx]];
+    if (node.mesh < 0 || node.skin < 0) {
+      continue;
+    }
+    const auto &skin = skins[node.skin];
+    if (skin.joints.empty()) {
+      continue;
+    }
+    for (const auto &primitive : model.meshes[node.mesh].primitives) {
+      const auto positionIt = primitive.attributes.find("POSITION");
+      const auto jointsIt = primitive.attributes.find("JOINTS_0");
+      const auto weightsIt = primitive.attributes.find("WEIGHTS_0");
+      if (positionIt == end(primitive.attributes) ||
+          jointsIt == end(primitive.attributes) ||
+          weightsIt == end(primitive.attributes)) {
+        continue;
+      }
+      const auto &positionAccessor = model.accessors[positionIt->second];
+      const auto &jointsAccessor = model.accessors[jointsIt->second];
+      const auto &weightsAccessor = model.accessors[weightsIt->second];
+      const auto count = positionAccessor.count;
+      if (positionAccessor.type != TINYGLTF_TYPE_VEC3 ||
+          jointsAccessor.type != TINYGLTF_TYPE_VEC4 ||
+          weightsAccessor.type != TINYGLTF_TYPE_VEC4 ||
+          jointsAccessor.count < count || weightsAccessor.count < count) {
+        continue;
+      }
+      positions.resize(count);
+      joints.resize(jointsAccessor.count);
+      weights.resize(weightsAccessor.count);
+      skinnedPositions.resize(count);
+      readAccessorAsFloat(model, positionAccessor, &positions[0].x);
+      readAccessorAsUint(model, jointsAccessor, &joints[0].x);
+      readAccessorAsFloat(model, weightsAccessor, &weights[0].x);
+
+      // Guard against out of range joint indices, the palette of the skin is
+      // addressed relatively to its offset
+      const auto jointCount = uint32_t(skin.joints.size());
+      for (auto &j : joints) {
+        j = glm::min(j, glm::uvec4(jointCount - 1)) +
+            glm::uvec4(skin.paletteOffset);
+      }
+
+      skinPositions(count, positions.data(), joints.data(), weights.data(),
+          palette.data(), skinnedPositions.data());
+      for (const auto &p : skinnedPositions) {
+        bboxMin = glm::min(bboxMin, p);
+        bboxMax = glm::max(bboxMax, p);
+      }
+    }
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "scenegraph.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+struct Skin
+{
+  std::vector<int> joints; // Flat indices of the joints, -1 if not in graph
+  std::vector<glm::mat4> inverseBindMatrices;
+  uint32_t paletteOffset = 0; // First matrix of the skin in the palette
+};
+
+// Convert model.skins, the palettes of all skins are packed one after the
+// other: skins[i] owns palette[paletteOffset .. paletteOffset + joints.size()]
+std::vector<Skin> compileSkins(
+    const tinygltf::Model &model, const SceneGraph &graph);
+
+size_t getPaletteSize(const std::vector<Skin> &skins);
+
+// palette[skin.paletteOffset + j] = world(joint j) * inverseBind(j) for all
+// skins, using the workers of pool if not null. The matrices bring bind pose
+// vertices to world space directly: as required by glTF, the transform of the
+// node instancing a skinned mesh is ignored.
+void computeJointPalettes(const std::vector<Skin> &skins,
+    const SceneGraph &graph, std::vector<glm::mat4> &palette,
+    ThreadPool *pool = nullptr);
+
+// Linear blend skinning of count positions on the CPU. Uses AVX2/FMA when the
+// CPU supports it.
+void skinPositions(size_t count, const glm::vec3 *positions,
+    const glm::uvec4 *joints, const glm::vec4 *weights,
+    const glm::mat4 *palette, glm::vec3 *outPositions);
+
+// Extend [bboxMin, bboxMax] with the skinned positions of all the skinned
+// meshes of graph, posed with palette. computeSceneBounds() ignores these
+// meshes since their node transform does not apply to them.
+void computeSkinnedBounds(const tinygltf::Model &model,
+    const SceneGraph &graph, const std::vector<Skin> &skins,
+    const std::vector<glm::mat4> &palette, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax);
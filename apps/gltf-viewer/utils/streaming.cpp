@@ -0,0 +1,292 @@
+#include "streaming.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+namespace
+{
+
+template <typename ComponentType>
+void downsample(const ComponentType *src, int srcWidth, int srcHeight,
+    ComponentType *dst, int dstWidth, int dstHeight)
+{
+  for (int y = 0; y < dstHeight; ++y) {
+    const auto y0 = std::min(2 * y, srcHeight - 1);
+    const auto y1 = std::min(2 * y + 1, srcHeight - 1);
+    for (int x = 0; x < dstWidth; ++x) {
+      const auto x0 = std::min(2 * x, srcWidth - 1);
+      const auto x1 = std::min(2 * x + 1, srcWidth - 1);
+      for (int c = 0; c < 4; ++c) {
+        const auto sum = uint32_t(src[(y0 * srcWidth + x0) * 4 + c]) +
+                         src[(y0 * srcWidth + x1) * 4 + c] +
+                         src[(y1 * srcWidth + x0) * 4 + c] +
+                         src[(y1 * srcWidth + x1) * 4 + c];
+        dst[(y * dstWidth + x) * 4 + c] = ComponentType((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+bool readFile(const fs::path &path, std::vector<unsigned char> &outBytes)
+{
+  std::ifstream file(path.string(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  file.seekg(0, std::ios::end);
+  const auto size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  if (size < 0) {
+    return false;
+  }
+  outBytes.resize(size_t(size));
+  file.read((char *)outBytes.data(), std::streamsize(outBytes.size()));
+  return bool(file);
+}
+
+} // namespace
+
+void buildMipChain(const tinygltf::Image &image, StreamedImage &outImage)
+{
+  const auto componentSize = image.bits == 16 ? size_t(2) : size_t(1);
+  const auto pixelSize = 4 * componentSize;
+  outImage.pixelType = image.pixel_type;
+  outImage.levelWidths.clear();
+  outImage.levelHeights.clear();
+  outImage.levelOffsets.clear();
+
+  auto width = image.width;
+  auto height = image.height;
+  size_t byteSize = 0;
+  for (;;) {
+    outImage.levelWidths.push_back(width);
+    outImage.levelHeights.push_back(height);
+    outImage.levelOffsets.push_back(byteSize);
+    byteSize += size_t(width) * height * pixelSize;
+    if (width == 1 && height == 1) {
+      break;
+    }
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+
+  outImage.data.resize(byteSize);
+  const auto level0Size = size_t(image.width) * image.height * pixelSize;
+  std::copy_n(image.image.data(), std::min(image.image.size(), level0Size),
+      outImage.data.data());
+  for (size_t l = 1; l < outImage.levelCount(); ++l) {
+    const auto *src = outImage.data.data() + outImage.levelOffsets[l - 1];
+    auto *dst = outImage.data.data() + outImage.levelOffsets[l];
+    if (componentSize == 2) {
+      downsample((const uint16_t *)src, outImage.levelWidths[l - 1],
+          outImage.levelHeights[l - 1], (uint16_t *)dst,
+          outImage.levelWidths[l], outImage.levelHeights[l]);
+    } else {
+      downsample(src, outImage.levelWidths[l - 1],
+          outImage.levelHeights[l - 1], dst, outImage.levelWidths[l],
+          outImage.levelHeights[l]);
+    }
+  }
+}
+
+float getScreenCoverage(const glm::mat4 &mvpMatrix, const glm::vec3 &bboxMin,
+    const glm::vec3 &bboxMax)
+{
+  glm::vec2 ndcMin(std::numeric_limits<float>::max());
+  glm::vec2 ndcMax(std::numeric_limits<float>::lowest());
+  size_t behindCount = 0;
+  for (int corner = 0; corner < 8; ++corner) {
+    const glm::vec3 position((corner & 1) ? bboxMax.x : bboxMin.x,
+        (corner & 2) ? bboxMax.y : bboxMin.y,
+        (corner & 4) ? bboxMax.z : bboxMin.z);
+    const auto clip = mvpMatrix * glm::vec4(position, 1);
+    if (clip.w <= 1e-6f) {
+      ++behindCount;
+      continue;
+    }
+    const auto ndc = glm::vec2(clip) / clip.w;
+    ndcMin = glm::min(ndcMin, ndc);
+    ndcMax = glm::max(ndcMax, ndc);
+  }
+  if (behindCount == 8) {
+    return 0.f;
+  }
+  if (behindCount > 0) {
+    return 1.f;
+  }
+  const auto extent =
+      glm::max(glm::min(ndcMax, glm::vec2(1)) - glm::max(ndcMin, glm::vec2(-1)),
+          glm::vec2(0));
+  return 0.25f * extent.x * extent.y;
+}
+
+StreamingLoader::StreamingLoader(
+    GltfSources sources, size_t threadCount, LoadProfiler *profiler) :
+    m_Sources(std::move(sources)), m_Profiler(profiler),
+    m_Pool(threadCount, "Loader")
+{
+}
+
+StreamingLoader::~StreamingLoader()
+{
+  // The workers then return as soon as their current request is done
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Cancelled = true;
+  m_Pending.clear();
+}
+
+void StreamingLoader::requestBuffers(const std::vector<float> &priorities)
+{
+  for (size_t i = 0; i < m_Sources.buffers.size(); ++i) {
+    if (!m_Sources.buffers[i].uri.empty()) {
+      submit({ItemKind::Buffer, int(i),
+          i < priorities.size() ? priorities[i] : 0.f, {}, clock::now()});
+    }
+  }
+}
+
+void StreamingLoader::requestImage(
+    int imageIdx, float priority, std::vector<unsigned char> encoded)
+{
+  submit({ItemKind::Image, imageIdx, priority, std::move(encoded),
+      clock::now()});
+}
+
+void StreamingLoader::setPriorities(
+    ItemKind kind, const std::vector<float> &priorities)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for (auto &request : m_Pending) {
+    if (request.kind == kind && size_t(request.index) < priorities.size()) {
+      request.priority = priorities[request.index];
+    }
+  }
+}
+
+void StreamingLoader::takeCompleted(std::vector<Item> &outItems)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  std::move(begin(m_Completed), end(m_Completed), std::back_inserter(outItems));
+  m_Completed.clear();
+}
+
+bool StreamingLoader::idle() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Pending.empty() && m_InProgress == 0 && m_Completed.empty();
+}
+
+StreamingLoader::Progress StreamingLoader::progress() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Progress;
+}
+
+void StreamingLoader::submit(Request request)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Progress.requestedCount;
+    if (request.kind == ItemKind::Buffer) {
+      m_Progress.requestedBytes += m_Sources.buffers[request.index].byteLength;
+    }
+    m_Pending.push_back(std::move(request));
+  }
+  // Each task serves whichever request is the most important when it starts
+  m_Pool.submit([this]() { processNext(); });
+}
+
+void StreamingLoader::processNext()
+{
+  Request request;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Cancelled || m_Pending.empty()) {
+      return;
+    }
+    const auto it = std::max_element(begin(m_Pending), end(m_Pending),
+        [](const Request &lhs, const Request &rhs) {
+          return lhs.priority < rhs.priority;
+        });
+    request = std::move(*it);
+    m_Pending.erase(it);
+    ++m_InProgress;
+  }
+
+  Item item;
+  item.kind = request.kind;
+  item.index = request.index;
+  item.ok = request.kind == ItemKind::Buffer
+                ? readBuffer(request.index, item)
+                : readImage(request.index, request.encoded, item);
+  item.latency =
+      std::chrono::duration<double>(clock::now() - request.requestTime)
+          .count();
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  --m_InProgress;
+  ++m_Progress.completedCount;
+  m_Progress.completedBytes += item.data.size();
+  m_TotalLatency += item.latency;
+  m_Progress.meanLatency = m_TotalLatency / m_Progress.completedCount;
+  m_Progress.maxLatency = std::max(m_Progress.maxLatency, item.latency);
+  m_Completed.push_back(std::move(item));
+}
+
+bool StreamingLoader::readBuffer(int bufferIdx, Item &item) const
+{
+  const auto &source = m_Sources.buffers[bufferIdx];
+  LoadProfiler::Scope scope(m_Profiler, LoadPhase::BufferRead);
+  if (tinygltf::IsDataURI(source.uri)) {
+    std::string mimeType;
+    if (!tinygltf::DecodeDataURI(
+            &item.data, mimeType, source.uri, source.byteLength, true)) {
+      item.error = "Failed to decode data URI of buffer " +
+                   std::to_string(bufferIdx);
+      return false;
+    }
+  } else if (!readFile(m_Sources.baseDir / source.uri, item.data)) {
+    item.error = "Unable to read " + (m_Sources.baseDir / source.uri).string();
+    return false;
+  }
+  if (item.data.size() < source.byteLength) {
+    item.error = "Buffer " + std::to_string(bufferIdx) + " is too short";
+    return false;
+  }
+  item.data.resize(source.byteLength);
+  scope.addBytes(item.data.size());
+  return true;
+}
+
+bool StreamingLoader::readImage(
+    int imageIdx, std::vector<unsigned char> &encoded, Item &item) const
+{
+  const auto &source = m_Sources.images[imageIdx];
+  // Reading the file of the image is part of its decode
+  LoadProfiler::Scope scope(m_Profiler, LoadPhase::ImageDecode);
+  if (encoded.empty()) {
+    if (tinygltf::IsDataURI(source.uri)) {
+      std::string mimeType;
+      if (!tinygltf::DecodeDataURI(&encoded, mimeType, source.uri, 0, false)) {
+        item.error = "Failed to decode data URI of image " +
+                     std::to_string(imageIdx);
+        return false;
+      }
+    } else if (!readFile(m_Sources.baseDir / source.uri, encoded)) {
+      item.error =
+          "Unable to read " + (m_Sources.baseDir / source.uri).string();
+      return false;
+    }
+  }
+  tinygltf::Image image;
+  std::string warn;
+  if (!tinygltf::LoadImageData(&image, imageIdx, &item.error, &warn, 0, 0,
+          encoded.data(), int(encoded.size()), nullptr)) {
+    return false;
+  }
+  buildMipChain(image, item.image);
+  scope.addBytes(item.image.data.size());
+  return true;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "gltf.hpp"
+#include "loadprofiler.hpp"
+#include "threadpool.hpp"
+
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// An RGBA image with its whole mip chain, level 0 first: level l is
+// levelWidths[l] x levelHeights[l] pixels stored at data[levelOffsets[l]].
+struct StreamedImage
+{
+  int pixelType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE; // Or UNSIGNED_SHORT
+  std::vector<int> levelWidths;
+  std::vector<int> levelHeights;
+  std::vector<size_t> levelOffsets;
+  std::vector<unsigned char> data;
+
+  size_t levelCount() const { return levelOffsets.size(); }
+};
+
+// Build the mip chain of an image decoded by tinygltf (4 components of 8 or
+// 16 bits) with a 2x2 box filter
+void buildMipChain(const tinygltf::Image &image, StreamedImage &outImage);
+
+// Fraction of the viewport covered by the box [bboxMin, bboxMax] transformed
+// by mvpMatrix: 0 if it is outside of the frustum, 1 if it crosses the near
+// plane.
+float getScreenCoverage(const glm::mat4 &mvpMatrix, const glm::vec3 &bboxMin,
+    const glm::vec3 &bboxMax);
+
+// Reads the buffers and decodes the images of a glTF file loaded with
+// loadGltfStructure() on worker threads, so that the render loop never waits
+// for I/O. Workers always start the pending request of highest priority, and
+// priorities can be updated while loading (e.g. from the screen coverage of
+// what each buffer holds).
+class StreamingLoader
+{
+public:
+  enum class ItemKind
+  {
+    Buffer,
+    Image
+  };
+
+  struct Item
+  {
+    ItemKind kind;
+    int index;
+    bool ok;
+    std::string error;
+    std::vector<unsigned char> data; // Bytes of a buffer
+    StreamedImage image;
+    double latency; // Seconds between the request and the completion
+  };
+
+  struct Progress
+  {
+    size_t requestedCount = 0;
+    size_t completedCount = 0;
+    size_t requestedBytes = 0; // Of buffers, images sizes are unknown
+    size_t completedBytes = 0;
+    double meanLatency = 0.;
+    double maxLatency = 0.;
+  };
+
+  // threadCount == 0 means one worker per hardware thread. Reads and decodes
+  // are timed in profiler if it is not null.
+  explicit StreamingLoader(GltfSources sources, size_t threadCount = 0,
+      LoadProfiler *profiler = nullptr);
+
+  // Drop the pending requests and wait for the ones in progress
+  ~StreamingLoader();
+
+  StreamingLoader(const StreamingLoader &) = delete;
+  StreamingLoader &operator=(const StreamingLoader &) = delete;
+
+  const GltfSources &sources() const { return m_Sources; }
+
+  // Request the buffers having a source, priorities being indexed by buffer
+  void requestBuffers(const std::vector<float> &priorities);
+
+  // Request an image. Images stored in a bufferView are given encoded since
+  // the loader does not own the buffers.
+  void requestImage(
+      int imageIdx, float priority, std::vector<unsigned char> encoded = {});
+
+  // Change the priority of the pending requests of a kind, priorities being
+  // indexed like the buffers or the images
+  void setPriorities(ItemKind kind, const std::vector<float> &priorities);
+
+  // Move the completed items at the end of outItems, without waiting
+  void takeCompleted(std::vector<Item> &outItems);
+
+  // True once every request has completed and been taken
+  bool idle() const;
+
+  Progress progress() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct Request
+  {
+    ItemKind kind;
+    int index;
+    float priority;
+    std::vector<unsigned char> encoded;
+    clock::time_point requestTime;
+  };
+
+  void submit(Request request);
+  void processNext();
+  bool readBuffer(int bufferIdx, Item &item) const;
+  bool readImage(int imageIdx, std::vector<unsigned char> &encoded,
+      Item &item) const;
+
+  const GltfSources m_Sources;
+  LoadProfiler *const m_Profiler;
+
+  mutable std::mutex m_Mutex;
+  std::vector<Request> m_Pending;
+  std::vector<Item> m_Completed;
+  size_t m_InProgress = 0;
+  bool m_Cancelled = false;
+  Progress m_Progress;
+  double m_TotalLatency = 0.;
+
+  // Last member so that the workers are joined first
+  ThreadPool m_Pool;
+};
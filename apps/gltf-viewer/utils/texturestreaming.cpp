@@ -0,0 +1,279 @@
+#include "texturestreaming.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+float getRequiredMipLevel(float texelCount, float pixelCount)
+{
+  if (pixelCount <= 0.f) {
+    return std::numeric_limits<float>::max();
+  }
+  // Each level has 4 times less texels than the previous one
+  return 0.5f * std::log2(std::max(texelCount, 1.f) / pixelCount);
+}
+
+TextureStreamer::TextureStreamer(GpuUploader &uploader, size_t budgetBytes,
+    const fs::path &spillDirectory, size_t hostBudgetBytes) :
+    m_Uploader(uploader),
+    m_Images(spillDirectory, hostBudgetBytes),
+    m_BudgetBytes(budgetBytes)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  for (const auto &entry : m_Textures) {
+    glDeleteTextures(1, &entry.second.texture);
+  }
+}
+
+ImageStore::ImageId TextureStreamer::addImage(StreamedImage image)
+{
+  // Its tail is always resident, so always in memory
+  const auto levelCount = int(image.levelCount());
+  auto tailLevel = levelCount - 1;
+  for (int level = 0; level < levelCount; ++level) {
+    if (std::max(image.levelWidths[level], image.levelHeights[level]) <=
+        kTailSize) {
+      tailLevel = level;
+      break;
+    }
+  }
+  return m_Images.add(std::move(image), tailLevel);
+}
+
+void TextureStreamer::addTexture(
+    size_t textureIdx, ImageStore::ImageId image, const Sampler &sampler)
+{
+  auto &texture = m_Textures[textureIdx];
+  texture.image = image;
+  texture.sampler = sampler;
+  const auto levelCount = int(m_Images.layout(image).levelCount());
+  texture.tailLevel = m_Images.keptLevel(image);
+  // Nothing allocated nor uploaded yet
+  texture.residentLevel = levelCount;
+  texture.sampledLevel = levelCount;
+  texture.requestedLevel = float(texture.tailLevel);
+  setResidentLevel(textureIdx, texture.tailLevel);
+}
+
+GLuint TextureStreamer::texture(size_t textureIdx) const
+{
+  const auto it = m_Textures.find(textureIdx);
+  return it != end(m_Textures) && it->second.visible ? it->second.texture : 0;
+}
+
+glm::ivec2 TextureStreamer::size(size_t textureIdx) const
+{
+  const auto it = m_Textures.find(textureIdx);
+  if (it == end(m_Textures)) {
+    return glm::ivec2(0);
+  }
+  const auto &image = m_Images.layout(it->second.image);
+  return glm::ivec2(image.levelWidths[0], image.levelHeights[0]);
+}
+
+void TextureStreamer::request(size_t textureIdx, float level)
+{
+  const auto it = m_Textures.find(textureIdx);
+  if (it == end(m_Textures)) {
+    return;
+  }
+  auto &texture = it->second;
+  if (texture.lastUseFrame != m_Frame) {
+    texture.lastUseFrame = m_Frame;
+    texture.requestedLevel = level;
+  } else {
+    texture.requestedLevel = std::min(texture.requestedLevel, level);
+  }
+}
+
+void TextureStreamer::update()
+{
+  // Promote the textures that are the furthest from the level they need
+  // first. Only a few megabytes are started per frame, the uploader would
+  // queue them anyway and the budget decisions are better with fresh
+  // requests.
+  const size_t MAX_PROMOTION_BYTES = 64 << 20;
+  std::vector<std::pair<int, size_t>> candidates;
+  for (const auto &entry : m_Textures) {
+    const auto &texture = entry.second;
+    const auto neededLevel = getNeededLevel(texture);
+    if (texture.pendingUploads == 0 && neededLevel < texture.residentLevel) {
+      candidates.emplace_back(texture.residentLevel - neededLevel, entry.first);
+    }
+  }
+  std::sort(begin(candidates), end(candidates),
+      [](const std::pair<int, size_t> &lhs, const std::pair<int, size_t> &rhs) {
+        return lhs.first > rhs.first;
+      });
+  size_t promotedBytes = 0;
+  for (const auto &candidate : candidates) {
+    const auto textureIdx = candidate.second;
+    const auto &texture = m_Textures[textureIdx];
+    // Promoted once its finer levels are back in memory
+    if (!m_Images.lock(texture.image)) {
+      continue;
+    }
+    const auto residentBytes = getLevelsBytes(texture, texture.residentLevel);
+    // Settle for a coarser level than needed if the budget is too small
+    for (auto level = getNeededLevel(texture); level < texture.residentLevel;
+         ++level) {
+      const auto extraBytes = getLevelsBytes(texture, level) - residentBytes;
+      if (promotedBytes > 0 &&
+          promotedBytes + extraBytes > MAX_PROMOTION_BYTES) {
+        continue;
+      }
+      if (makeRoom(extraBytes, textureIdx)) {
+        setResidentLevel(textureIdx, level);
+        promotedBytes += extraBytes;
+        break;
+      }
+    }
+  }
+  // The budget may have been lowered
+  makeRoom(0, std::numeric_limits<size_t>::max());
+  m_Images.update();
+  ++m_Frame;
+}
+
+bool TextureStreamer::uploadCompleted(GpuUploader::Ticket ticket)
+{
+  const auto uploadIt = m_Uploads.find(ticket);
+  if (uploadIt == end(m_Uploads)) {
+    return false;
+  }
+  const auto upload = uploadIt->second;
+  m_Uploads.erase(uploadIt);
+  auto &texture = m_Textures[upload.textureIdx];
+  --texture.pendingUploads;
+  if (texture.texture != upload.texture) {
+    return true;
+  }
+  // Levels are uploaded from the coarsest to the finest
+  texture.sampledLevel = upload.level;
+  texture.visible = true;
+  glBindTexture(GL_TEXTURE_2D, texture.texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL,
+      texture.sampledLevel - texture.residentLevel);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return true;
+}
+
+TextureStreamer::Stats TextureStreamer::stats() const
+{
+  auto stats = m_Stats;
+  stats.budgetBytes = m_BudgetBytes;
+  stats.residentBytes = m_ResidentBytes;
+  stats.textureCount = m_Textures.size();
+  stats.pendingUploadCount = m_Uploads.size();
+  stats.pendingReadCount = m_Images.stats().pendingReadCount;
+  for (const auto &entry : m_Textures) {
+    const auto &texture = entry.second;
+    const auto neededLevel = getNeededLevel(texture);
+    stats.requiredBytes += getLevelsBytes(texture, neededLevel);
+    if (texture.sampledLevel <= neededLevel) {
+      ++stats.fullyResidentCount;
+    }
+  }
+  return stats;
+}
+
+size_t TextureStreamer::getLevelsBytes(
+    const StreamedTexture &texture, int level) const
+{
+  return m_Images.getLevelsBytes(texture.image, level);
+}
+
+int TextureStreamer::getNeededLevel(const StreamedTexture &texture) const
+{
+  // Textures requested neither in the current frame nor in the previous one
+  // only need their tail
+  if (texture.lastUseFrame + 1 < m_Frame) {
+    return texture.tailLevel;
+  }
+  const auto level = std::floor(
+      std::min(texture.requestedLevel, float(texture.tailLevel)));
+  return std::max(0, int(level));
+}
+
+void TextureStreamer::setResidentLevel(size_t textureIdx, int level)
+{
+  auto &texture = m_Textures[textureIdx];
+  const auto &image = m_Images.layout(texture.image);
+  const auto levelCount = int(image.levelCount());
+  const auto oldTexture = texture.texture;
+  const auto oldResidentLevel = texture.residentLevel;
+
+  glGenTextures(1, &texture.texture);
+  glBindTexture(GL_TEXTURE_2D, texture.texture);
+  glTexStorage2D(GL_TEXTURE_2D, levelCount - level,
+      image.pixelType == GL_UNSIGNED_SHORT ? GL_RGBA16 : GL_RGBA8,
+      image.levelWidths[level], image.levelHeights[level]);
+  glTexParameteri(
+      GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture.sampler.minFilter);
+  glTexParameteri(
+      GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture.sampler.magFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture.sampler.wrapS);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture.sampler.wrapT);
+
+  // The uploaded levels in common are copied on the GPU
+  const auto keptLevel = std::max(level, texture.sampledLevel);
+  for (auto l = keptLevel; l < levelCount && oldTexture; ++l) {
+    glCopyImageSubData(oldTexture, GL_TEXTURE_2D, l - oldResidentLevel, 0, 0,
+        0, texture.texture, GL_TEXTURE_2D, l - level, 0, 0, 0,
+        image.levelWidths[l], image.levelHeights[l], 1);
+  }
+  texture.sampledLevel = oldTexture ? keptLevel : levelCount;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL,
+      std::min(texture.sampledLevel, levelCount - 1) - level);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDeleteTextures(1, &oldTexture);
+
+  // The missing ones are uploaded from the ImageStore, where they were locked
+  for (auto l = texture.sampledLevel - 1; l >= level; --l) {
+    std::shared_ptr<const void> keepAlive;
+    const auto *data = m_Images.getLevel(texture.image, l, keepAlive);
+    const auto ticket = m_Uploader.uploadTextureLevel(texture.texture,
+        l - level, image.levelWidths[l], image.levelHeights[l],
+        GLenum(image.pixelType), data, std::move(keepAlive));
+    m_Uploads[ticket] = {textureIdx, texture.texture, l};
+    ++texture.pendingUploads;
+  }
+
+  const auto oldBytes = getLevelsBytes(texture, oldResidentLevel);
+  const auto newBytes = getLevelsBytes(texture, level);
+  m_ResidentBytes = m_ResidentBytes + newBytes - oldBytes;
+  if (oldTexture && level > oldResidentLevel) {
+    ++m_Stats.evictionCount;
+    m_Stats.evictedBytes += oldBytes - newBytes;
+  } else if (oldTexture) {
+    ++m_Stats.promotionCount;
+  }
+  texture.residentLevel = level;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, size_t except)
+{
+  if (m_ResidentBytes + bytes <= m_BudgetBytes) {
+    return true;
+  }
+  // Least recently used first, each one cut down to the level it needs
+  std::vector<std::pair<uint64_t, size_t>> victims;
+  for (const auto &entry : m_Textures) {
+    const auto &texture = entry.second;
+    if (entry.first != except && texture.pendingUploads == 0 &&
+        getNeededLevel(texture) > texture.residentLevel) {
+      victims.emplace_back(texture.lastUseFrame, entry.first);
+    }
+  }
+  std::sort(begin(victims), end(victims));
+  for (const auto &victim : victims) {
+    if (m_ResidentBytes + bytes <= m_BudgetBytes) {
+      break;
+    }
+    setResidentLevel(victim.second, getNeededLevel(m_Textures[victim.second]));
+  }
+  return m_ResidentBytes + bytes <= m_BudgetBytes;
+}
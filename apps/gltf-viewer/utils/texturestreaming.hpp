@@ -0,0 +1,142 @@
+#pragma once
+
+#include "glfw.hpp"
+#include "imagestore.hpp"
+#include "streaming.hpp"
+#include "uploader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Mip level to sample so that a texel maps to about a pixel, for a texture of
+// texelCount texels at level 0 spread over pixelCount pixels of the screen.
+// Not clamped, negative when the texture is magnified.
+float getRequiredMipLevel(float texelCount, float pixelCount);
+
+// Keeps the texture levels needed by the last frames on the GPU, within a
+// memory budget.
+//
+// The decoded images are kept by an ImageStore, within a host memory budget,
+// and their textures only hold the levels from their finest resident one to
+// the last. The smallest levels (up to kTailSize pixels wide) are always
+// resident, on the GPU and in the store. Draws tell which level they
+// need with request(), then update() moves each texture towards it: finer
+// levels are streamed in through the GpuUploader, and when the budget is
+// exceeded the least recently used textures are cut down to the level they
+// need, or to their tail if no draw used them in the frame.
+//
+// Changing the resident levels reallocates the texture with glTexStorage2D
+// and copies the levels it keeps with glCopyImageSubData, so that the
+// memory really is released.
+class TextureStreamer
+{
+public:
+  static const int kTailSize = 64;
+
+  struct Sampler
+  {
+    GLint minFilter;
+    GLint magFilter;
+    GLint wrapS;
+    GLint wrapT;
+  };
+
+  struct Stats
+  {
+    size_t budgetBytes = 0;
+    size_t residentBytes = 0;
+    size_t requiredBytes = 0; // If every texture had the level it needs
+    size_t textureCount = 0;
+    size_t fullyResidentCount = 0; // Textures at the level they need
+    size_t pendingUploadCount = 0;
+    size_t pendingReadCount = 0; // Images read back from the ImageStore files
+    uint64_t evictionCount = 0;
+    uint64_t evictedBytes = 0;
+    uint64_t promotionCount = 0;
+  };
+
+  // The images are stored in host memory within hostBudgetBytes, their
+  // finer levels being spilled to spillDirectory, see ImageStore
+  TextureStreamer(GpuUploader &uploader, size_t budgetBytes,
+      const fs::path &spillDirectory, size_t hostBudgetBytes);
+
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  void setBudget(size_t budgetBytes) { m_BudgetBytes = budgetBytes; }
+  size_t budget() const { return m_BudgetBytes; }
+
+  ImageStore &images() { return m_Images; }
+  const ImageStore &images() const { return m_Images; }
+
+  // Hand a decoded image over to the store, to add the textures sampling it
+  ImageStore::ImageId addImage(StreamedImage image);
+
+  // Start streaming the texture textureIdx from an image of addImage(),
+  // uploading its tail. The image can be shared by several textures.
+  void addTexture(
+      size_t textureIdx, ImageStore::ImageId image, const Sampler &sampler);
+
+  // Texture object to sample for textureIdx, 0 until its tail is uploaded.
+  // Changes when the resident levels do, so it must be fetched every frame.
+  GLuint texture(size_t textureIdx) const;
+
+  // Size of level 0 of a texture, (0, 0) if it is unknown
+  glm::ivec2 size(size_t textureIdx) const;
+
+  // A draw of the current frame samples textureIdx around level
+  void request(size_t textureIdx, float level);
+
+  // Apply the requests of the frame and start a new one
+  void update();
+
+  // Notify a completed upload, false if it is not one of this streamer
+  bool uploadCompleted(GpuUploader::Ticket ticket);
+
+  Stats stats() const;
+
+private:
+  struct StreamedTexture
+  {
+    ImageStore::ImageId image;
+    Sampler sampler;
+    GLuint texture = 0; // Holds the levels [residentLevel, tailLevel...]
+    int residentLevel; // Finest level allocated in texture
+    int sampledLevel; // Finest level uploaded, the base level of texture
+    int tailLevel;
+    size_t pendingUploads = 0;
+    float requestedLevel; // Finest level requested in the current frame
+    uint64_t lastUseFrame = 0;
+    bool visible = false; // Its tail is uploaded
+  };
+
+  struct LevelUpload
+  {
+    size_t textureIdx;
+    GLuint texture;
+    int level;
+  };
+
+  // Bytes of the levels [level, last] of a texture
+  size_t getLevelsBytes(const StreamedTexture &texture, int level) const;
+  int getNeededLevel(const StreamedTexture &texture) const;
+  // Reallocate the texture with level as its finest one, keeping the
+  // resident levels in common and uploading the missing ones
+  void setResidentLevel(size_t textureIdx, int level);
+  // Cut textures used least recently until bytes more fit in the budget,
+  // never touching except. False if they cannot fit.
+  bool makeRoom(size_t bytes, size_t except);
+
+  GpuUploader &m_Uploader;
+  ImageStore m_Images;
+  size_t m_BudgetBytes;
+  size_t m_ResidentBytes = 0;
+  uint64_t m_Frame = 1;
+  std::map<size_t, StreamedTexture> m_Textures;
+  std::map<GpuUploader::Ticket, LevelUpload> m_Uploads;
+  Stats m_Stats;
+};
@@ -0,0 +1,118 @@
+#include "threadpool.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadCount, const char *name)
+{
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  m_Workers.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    m_Workers.emplace_back([this, name]() {
+      setTraceThreadName(name);
+      workerLoop();
+    });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+  m_Condition.notify_all();
+  for (auto &worker : m_Workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Tasks.emplace_back(std::move(task));
+  }
+  m_Condition.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Condition.wait(lock, [&]() { return m_Stop || !m_Tasks.empty(); });
+      if (m_Stop && m_Tasks.empty()) {
+        return;
+      }
+      task = std::move(m_Tasks.front());
+      m_Tasks.pop_front();
+    }
+    TraceScope scope("pool", "Task");
+    task();
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize,
+    const std::function<void(size_t, size_t)> &fn)
+{
+  if (count == 0) {
+    return;
+  }
+  grainSize = std::max(size_t(1), grainSize);
+  const auto chunkCount = (count + grainSize - 1) / grainSize;
+  if (chunkCount == 1 || m_Workers.empty()) {
+    fn(0, count);
+    return;
+  }
+
+  // Shared with the helper tasks, which may start after this call returned
+  // if all chunks were already processed by other threads.
+  struct State
+  {
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> doneChunks{0};
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  const auto state = std::make_shared<State>();
+  const auto *pFn = &fn;
+
+  // Only dereferences pFn after having grabbed a chunk, which can only
+  // happen before this function returns
+  const auto work = [state, pFn, count, grainSize, chunkCount]() {
+    for (;;) {
+      const auto chunk = state->nextChunk.fetch_add(1);
+      if (chunk >= chunkCount) {
+        return;
+      }
+      const auto begin = chunk * grainSize;
+      (*pFn)(begin, std::min(count, begin + grainSize));
+      if (state->doneChunks.fetch_add(1) + 1 == chunkCount) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done.notify_all();
+      }
+    }
+  };
+
+  const auto helperCount = std::min(m_Workers.size(), chunkCount - 1);
+  for (size_t i = 0; i < helperCount; ++i) {
+    submit(work);
+  }
+  work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(
+      lock, [&]() { return state->doneChunks.load() == chunkCount; });
+}
+
+ThreadPool &globalThreadPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads.
+//
+// Tasks are executed in submission order by the first available worker.
+// parallelFor() lets the calling thread take part in the work, so it can be
+// called from inside a task without dead-locking the pool.
+class ThreadPool
+{
+public:
+  // threadCount == 0 means one worker per hardware thread. The workers are
+  // called name in the traces, their tasks are traced.
+  explicit ThreadPool(size_t threadCount = 0, const char *name = "Worker");
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t threadCount() const { return m_Workers.size(); }
+
+  void submit(std::function<void()> task);
+
+  // Call fn(begin, end) on chunks of [0, count) of at most grainSize
+  // elements, using the workers and the calling thread. Returns when every
+  // chunk has been processed.
+  void parallelFor(size_t count, size_t grainSize,
+      const std::function<void(size_t, size_t)> &fn);
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> m_Workers;
+  std::deque<std::function<void()>> m_Tasks;
+  std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+  bool m_Stop = false;
+};
+
+// Pool shared by the whole application, created on first use.
+ThreadPool &globalThreadPool();
@@ -0,0 +1,205 @@
+#include "trace.hpp"
+#include "glfw.hpp"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+
+std::atomic<Tracer *> g_Tracer{nullptr};
+
+thread_local const char *t_ThreadName = nullptr;
+
+// Names are static strings of the program, only quotes and backslashes
+// could break the JSON
+void writeJsonString(std::ostream &out, const char *str)
+{
+  out << '"';
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      out << '\\';
+    }
+    out << *str;
+  }
+  out << '"';
+}
+
+} // namespace
+
+thread_local const Tracer *Tracer::s_ThreadTracer = nullptr;
+thread_local Tracer::ThreadBuffer *Tracer::s_ThreadBuffer = nullptr;
+
+Tracer::Tracer(std::ofstream file) :
+    m_Start(clock::now()), m_File(std::move(file))
+{
+  m_GpuBuffer.reset(new ThreadBuffer{0, "GPU"});
+  m_GpuBuffer->head = m_GpuBuffer->tail = new Chunk;
+  m_File << "{\"traceEvents\":[" << std::fixed << std::setprecision(3);
+}
+
+void Tracer::addEvent(const char *category, const char *name,
+    clock::time_point start, clock::time_point end)
+{
+  if (!m_Recording.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (s_ThreadTracer != this) {
+    s_ThreadBuffer = registerBuffer(t_ThreadName);
+    s_ThreadTracer = this;
+  }
+  push(*s_ThreadBuffer,
+      {category, name,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_Start)
+              .count(),
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+              .count()});
+}
+
+void Tracer::addGpuEvent(
+    const char *name, uint64_t gpuStartNs, uint64_t gpuEndNs)
+{
+  if (!m_Recording.load(std::memory_order_relaxed) ||
+      !m_GpuCalibrated.load(std::memory_order_acquire)) {
+    return;
+  }
+  push(*m_GpuBuffer,
+      {"gpu", name, int64_t(gpuStartNs) - m_GpuOffsetNs.load(),
+          int64_t(gpuEndNs - gpuStartNs)});
+}
+
+void Tracer::calibrateGpuClock()
+{
+  GLint64 gpuNow = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+  const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock::now() - m_Start)
+                       .count();
+  m_GpuOffsetNs.store(int64_t(gpuNow) - now);
+  m_GpuCalibrated.store(true, std::memory_order_release);
+}
+
+void Tracer::flush()
+{
+  std::vector<ThreadBuffer *> buffers;
+  {
+    std::lock_guard<std::mutex> lock(m_BuffersMutex);
+    for (const auto &buffer : m_Buffers) {
+      buffers.push_back(buffer.get());
+    }
+  }
+  buffers.push_back(m_GpuBuffer.get());
+
+  std::lock_guard<std::mutex> lock(m_FileMutex);
+  if (!m_File.is_open()) {
+    return;
+  }
+  for (auto *buffer : buffers) {
+    if (!buffer->named) {
+      buffer->named = true;
+      m_File << (m_FirstEvent ? "\n" : ",\n")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+             << buffer->threadId << ",\"args\":{\"name\":";
+      writeJsonString(m_File, buffer->threadName.c_str());
+      m_File << "}}";
+      m_FirstEvent = false;
+    }
+    for (;;) {
+      auto *chunk = buffer->head;
+      const auto count = chunk->count.load(std::memory_order_acquire);
+      for (auto i = buffer->flushedCount; i < count; ++i) {
+        writeEvent(*buffer, chunk->events[i]);
+      }
+      buffer->flushedCount = count;
+      // The recording thread moved to the next chunk and will not come back
+      auto *next = chunk->next.load(std::memory_order_acquire);
+      if (count < Chunk::kCapacity || !next) {
+        break;
+      }
+      delete chunk;
+      buffer->head = next;
+      buffer->flushedCount = 0;
+    }
+  }
+  m_File.flush();
+}
+
+Tracer::ThreadBuffer *Tracer::registerBuffer(const char *threadName)
+{
+  std::lock_guard<std::mutex> lock(m_BuffersMutex);
+  const auto threadId = uint32_t(m_Buffers.size() + 1);
+  m_Buffers.emplace_back(new ThreadBuffer{threadId,
+      threadName ? threadName : "Thread " + std::to_string(threadId)});
+  auto *buffer = m_Buffers.back().get();
+  buffer->head = buffer->tail = new Chunk;
+  return buffer;
+}
+
+void Tracer::push(ThreadBuffer &buffer, const Event &event)
+{
+  auto *chunk = buffer.tail;
+  const auto count = chunk->count.load(std::memory_order_relaxed);
+  if (count < Chunk::kCapacity) {
+    chunk->events[count] = event;
+    chunk->count.store(count + 1, std::memory_order_release);
+    return;
+  }
+  auto *next = new Chunk;
+  next->events[0] = event;
+  next->count.store(1, std::memory_order_relaxed);
+  chunk->next.store(next, std::memory_order_release);
+  buffer.tail = next;
+}
+
+void Tracer::writeEvent(const ThreadBuffer &buffer, const Event &event)
+{
+  m_File << (m_FirstEvent ? "\n" : ",\n") << "{\"name\":";
+  writeJsonString(m_File, event.name);
+  m_File << ",\"cat\":";
+  writeJsonString(m_File, event.category);
+  m_File << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.threadId
+         << ",\"ts\":" << 1e-3 * double(event.startNs)
+         << ",\"dur\":" << 1e-3 * double(event.durationNs) << "}";
+  m_FirstEvent = false;
+}
+
+void Tracer::close()
+{
+  m_Recording.store(false);
+  flush();
+  std::lock_guard<std::mutex> lock(m_FileMutex);
+  m_File << "\n]}" << std::endl;
+  m_File.close();
+}
+
+bool startTracing(const fs::path &path)
+{
+  std::ofstream file(path.string());
+  if (!file) {
+    std::cerr << "Unable to create the trace " << path << std::endl;
+    return false;
+  }
+  stopTracing();
+  auto *tracer = new Tracer(std::move(file));
+  if (!t_ThreadName) {
+    t_ThreadName = "Main";
+  }
+  g_Tracer.store(tracer);
+  // Also written if the program exits without stopping it
+  static const auto registered = std::atexit(stopTracing);
+  (void)registered;
+  return true;
+}
+
+void stopTracing()
+{
+  auto *tracer = g_Tracer.exchange(nullptr);
+  if (tracer) {
+    tracer->close();
+  }
+}
+
+Tracer *globalTracer() { return g_Tracer.load(std::memory_order_acquire); }
+
+void setTraceThreadName(const char *name) { t_ThreadName = name; }
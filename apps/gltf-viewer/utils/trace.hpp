@@ -0,0 +1,143 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Writes timed events of every thread to a file in the Chrome Trace Event
+// format, to be opened in chrome://tracing or Perfetto.
+//
+// Each thread records its events in its own buffer, a list of fixed size
+// chunks it appends to without any lock: a chunk publishes its event count
+// with a release store, which flush() reads to append the new events to the
+// file. Chunks are only freed by flush(), once full and written. Buffers are
+// registered under a lock at the first event of their thread.
+//
+// Event names and categories are not copied, they must be static strings.
+class Tracer
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  // A CPU event of the calling thread
+  void addEvent(const char *category, const char *name, clock::time_point start,
+      clock::time_point end);
+
+  // A GPU event, from GL_TIMESTAMP values. Only called by the thread owning
+  // the GL context, after calibrateGpuClock().
+  void addGpuEvent(const char *name, uint64_t gpuStartNs, uint64_t gpuEndNs);
+
+  // Match the GPU clock to the CPU one, with a GL context current
+  void calibrateGpuClock();
+
+  // Append the events recorded since the last flush to the file. The file
+  // can be opened after any flush, the trace format tolerating an
+  // unterminated array.
+  void flush();
+
+private:
+  struct Event
+  {
+    const char *category;
+    const char *name;
+    int64_t startNs; // Since the start of the trace
+    int64_t durationNs;
+  };
+
+  struct Chunk
+  {
+    static const size_t kCapacity = 4096;
+
+    Event events[kCapacity];
+    std::atomic<size_t> count{0};
+    std::atomic<Chunk *> next{nullptr};
+  };
+
+  struct ThreadBuffer
+  {
+    uint32_t threadId;
+    std::string threadName;
+    bool named = false; // Its name was written
+    // Oldest chunk not entirely written, owned by flush()
+    Chunk *head = nullptr;
+    size_t flushedCount = 0; // Events of head already written
+    Chunk *tail = nullptr; // Owned by the recording thread
+  };
+
+  friend bool startTracing(const fs::path &path);
+  friend void stopTracing();
+
+  // Never destroyed, threads may still hold it when the trace stops
+  explicit Tracer(std::ofstream file);
+
+  ThreadBuffer *registerBuffer(const char *threadName);
+  static void push(ThreadBuffer &buffer, const Event &event);
+  void writeEvent(const ThreadBuffer &buffer, const Event &event);
+  void close();
+
+  const clock::time_point m_Start;
+  std::atomic<bool> m_Recording{true};
+  std::atomic<int64_t> m_GpuOffsetNs{0}; // GPU time minus trace time
+  std::atomic<bool> m_GpuCalibrated{false};
+
+  std::mutex m_BuffersMutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> m_Buffers;
+  std::unique_ptr<ThreadBuffer> m_GpuBuffer;
+
+  std::mutex m_FileMutex;
+  std::ofstream m_File;
+  bool m_FirstEvent = true;
+
+  // Buffer of the calling thread, valid if registered by s_ThreadTracer
+  static thread_local const Tracer *s_ThreadTracer;
+  static thread_local ThreadBuffer *s_ThreadBuffer;
+};
+
+// Start writing a trace to path, false if the file cannot be created
+bool startTracing(const fs::path &path);
+
+// Flush the trace and close its file, later events are dropped
+void stopTracing();
+
+// The running trace, null if there is none
+Tracer *globalTracer();
+
+// Name of the calling thread in the traces, can be set before tracing starts
+void setTraceThreadName(const char *name);
+
+// Records the enclosing block as an event of the calling thread
+class TraceScope
+{
+public:
+  TraceScope(const char *category, const char *name) :
+      m_Tracer(globalTracer()),
+      m_Category(category),
+      m_Name(name),
+      m_Start(m_Tracer ? Tracer::clock::now() : Tracer::clock::time_point())
+  {
+  }
+
+  ~TraceScope()
+  {
+    if (m_Tracer) {
+      m_Tracer->addEvent(m_Category, m_Name, m_Start, Tracer::clock::now());
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  Tracer *m_Tracer;
+  const char *m_Category;
+  const char *m_Name;
+  Tracer::clock::time_point m_Start;
+};
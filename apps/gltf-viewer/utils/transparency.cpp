@@ -0,0 +1,111 @@
+#include "transparency.hpp"
+
+namespace
+{
+
+GLuint createTarget(GLenum format, GLsizei width, GLsizei height)
+{
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+  // Read with texelFetch() only
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+} // namespace
+
+bool resizeOitBuffer(
+    OitBuffer &buffer, GLsizei width, GLsizei height, GLenum depthFormat)
+{
+  if (buffer.framebuffer && buffer.width == width &&
+      buffer.height == height && buffer.depthFormat == depthFormat) {
+    return true;
+  }
+  deleteOitBuffer(buffer);
+  buffer.width = width;
+  buffer.height = height;
+  buffer.depthFormat = depthFormat;
+  buffer.accumulation = createTarget(GL_RGBA16F, width, height);
+  buffer.revealage = createTarget(GL_R16F, width, height);
+
+  GLint previousFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  glGenFramebuffers(1, &buffer.framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buffer.framebuffer);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, buffer.accumulation, 0);
+  glFramebufferTexture(
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, buffer.revealage, 0);
+  if (depthFormat != GL_NONE) {
+    glGenRenderbuffers(1, &buffer.depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, buffer.depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    const bool hasStencil = depthFormat == GL_DEPTH24_STENCIL8 ||
+                            depthFormat == GL_DEPTH32F_STENCIL8;
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER,
+        hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, buffer.depth);
+  }
+  const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+  const auto status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previousFramebuffer));
+  return status == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void deleteOitBuffer(OitBuffer &buffer)
+{
+  glDeleteFramebuffers(1, &buffer.framebuffer);
+  const GLuint textures[] = {buffer.accumulation, buffer.revealage};
+  glDeleteTextures(2, textures);
+  glDeleteRenderbuffers(1, &buffer.depth);
+  buffer = OitBuffer();
+}
+
+GLenum getDrawFramebufferDepthFormat()
+{
+  GLint framebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+  // The default framebuffer names its buffers rather than attachments
+  const GLenum depthAttachment = framebuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+  const GLenum stencilAttachment =
+      framebuffer ? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+
+  GLint objectType = GL_NONE;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment,
+      GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &objectType);
+  if (objectType == GL_NONE) {
+    return GL_NONE;
+  }
+  GLint depthSize = 0;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment,
+      GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthSize);
+  GLint componentType = GL_NONE;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depthAttachment,
+      GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+  GLint stencilType = GL_NONE;
+  glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+      stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencilType);
+  GLint stencilSize = 0;
+  if (stencilType != GL_NONE) {
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER,
+        stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE,
+        &stencilSize);
+  }
+
+  if (componentType == GL_FLOAT) {
+    return stencilSize ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+  }
+  if (depthSize > 24) {
+    return GL_DEPTH_COMPONENT32;
+  }
+  if (depthSize > 16) {
+    return stencilSize ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+  }
+  return GL_DEPTH_COMPONENT16;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Targets of the weighted blended order independent transparency (McGuire and
+// Bavoil 2013) of the WEIGHTED_BLENDED_OIT variants of
+// pbr_directional_light.fs.glsl: the blended draws add up their colors,
+// weighted by their alpha and depth, and multiply their transmittance in any
+// order. oit_composite.fs.glsl then blends the average color over the frame.
+struct OitBuffer
+{
+  GLsizei width = 0;
+  GLsizei height = 0;
+  GLenum depthFormat = GL_NONE;
+  GLuint framebuffer = 0;
+  // Attachment 0, GL_RGBA16F: sum of the weighted premultiplied colors, and
+  // of the weighted alphas in alpha. Cleared to 0, blended with (ONE, ONE).
+  GLuint accumulation = 0;
+  // Attachment 1, GL_R16F: product of 1 - alpha. Cleared to 1, blended with
+  // (ZERO, ONE_MINUS_SRC_COLOR).
+  GLuint revealage = 0;
+  // Renderbuffer of depthFormat, the depth of the opaque draws is copied to
+  // it. None if depthFormat is GL_NONE.
+  GLuint depth = 0;
+};
+
+// Creates the targets of buffer for width x height pixels, or recreates them
+// if it was created for another size or depth format. Returns false if the
+// framebuffer is not complete.
+bool resizeOitBuffer(
+    OitBuffer &buffer, GLsizei width, GLsizei height, GLenum depthFormat);
+
+void deleteOitBuffer(OitBuffer &buffer);
+
+// Sized internal format of the depth of the bound draw framebuffer, the
+// default one included, GL_NONE if it has none. glBlitFramebuffer() only
+// copies depth between the same formats.
+GLenum getDrawFramebufferDepthFormat();
@@ -0,0 +1,263 @@
+#include "uploader.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+
+// Offsets in the ring are aligned for any pixel type
+const size_t kStagingAlignment = 16;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+GpuUploader::GpuUploader(
+    GLFWwindow *mainWindow, size_t stagingSize, LoadProfiler *profiler) :
+    m_StagingSize(stagingSize), m_Profiler(profiler)
+{
+  // The window hints of the main window are still set, only its visibility
+  // changes, and back to its default for the windows created later
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  m_UploadWindow = glfwCreateWindow(1, 1, "upload", nullptr, mainWindow);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  if (!m_UploadWindow) {
+    std::cerr << "Unable to create a shared GL context, uploading on the "
+                 "main thread"
+              << std::endl;
+    initStaging();
+    return;
+  }
+  m_Worker = std::thread([this]() {
+    setTraceThreadName("Uploader");
+    glfwMakeContextCurrent(m_UploadWindow);
+    initStaging();
+    workerLoop();
+    releaseStaging();
+    glfwMakeContextCurrent(nullptr);
+  });
+}
+
+GpuUploader::~GpuUploader()
+{
+  if (m_Worker.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Stop = true;
+    }
+    m_Condition.notify_one();
+    m_Worker.join();
+    // GLFW windows can only be destroyed by the main thread
+    glfwDestroyWindow(m_UploadWindow);
+  } else {
+    releaseStaging();
+  }
+  for (const auto &fence : m_Fences) {
+    glDeleteSync(fence.sync);
+  }
+}
+
+GpuUploader::Ticket GpuUploader::uploadBuffer(GLuint buffer,
+    size_t byteOffset, const void *data, size_t byteSize,
+    std::shared_ptr<const void> keepAlive)
+{
+  return submit({0, buffer, -1, byteOffset, 0, 0, 0,
+      (const unsigned char *)data, byteSize, std::move(keepAlive)});
+}
+
+GpuUploader::Ticket GpuUploader::uploadTextureLevel(GLuint texture,
+    GLint level, GLsizei width, GLsizei height, GLenum type, const void *data,
+    std::shared_ptr<const void> keepAlive)
+{
+  const auto componentSize = type == GL_UNSIGNED_SHORT ? 2 : 1;
+  return submit({0, texture, level, 0, width, height, type,
+      (const unsigned char *)data,
+      size_t(width) * height * 4 * componentSize, std::move(keepAlive)});
+}
+
+void GpuUploader::poll(std::vector<Ticket> &outCompleted)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  // Fences signal in order, stop at the first one still pending
+  while (!m_Fences.empty()) {
+    const auto status = glClientWaitSync(m_Fences.front().sync, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(m_Fences.front().sync);
+    outCompleted.push_back(m_Fences.front().ticket);
+    m_Fences.pop_front();
+  }
+}
+
+GpuUploader::Stats GpuUploader::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Stats;
+}
+
+GpuUploader::Ticket GpuUploader::submit(Job job)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    job.ticket = m_NextTicket++;
+    m_Stats.queuedBytes += job.byteSize;
+  }
+  const auto ticket = job.ticket;
+  if (!m_Worker.joinable()) {
+    process(job);
+    return ticket;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Jobs.push_back(std::move(job));
+  }
+  m_Condition.notify_one();
+  return ticket;
+}
+
+void GpuUploader::workerLoop()
+{
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Condition.wait(lock, [&]() { return m_Stop || !m_Jobs.empty(); });
+      if (m_Stop) {
+        return;
+      }
+      job = std::move(m_Jobs.front());
+      m_Jobs.pop_front();
+    }
+    process(job);
+  }
+}
+
+void GpuUploader::initStaging()
+{
+  glGenBuffers(1, &m_Staging);
+  glBindBuffer(GL_COPY_READ_BUFFER, m_Staging);
+  const GLbitfield flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glBufferStorage(GL_COPY_READ_BUFFER, m_StagingSize, nullptr, flags);
+  m_StagingPtr = (unsigned char *)glMapBufferRange(
+      GL_COPY_READ_BUFFER, 0, m_StagingSize, flags);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void GpuUploader::releaseStaging()
+{
+  for (const auto &range : m_InFlight) {
+    glClientWaitSync(range.sync, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+    glDeleteSync(range.sync);
+  }
+  m_InFlight.clear();
+  glBindBuffer(GL_COPY_READ_BUFFER, m_Staging);
+  glUnmapBuffer(GL_COPY_READ_BUFFER);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glDeleteBuffers(1, &m_Staging);
+}
+
+void GpuUploader::process(const Job &job)
+{
+  // Time spent by this thread, the copies themselves run on the GPU
+  LoadProfiler::Scope scope(m_Profiler,
+      job.level < 0 ? LoadPhase::BufferUpload : LoadPhase::TextureUpload,
+      job.byteSize);
+  // Large uploads go through the ring in chunks of at most half of it, so
+  // that a chunk can be written while the previous one is being copied
+  const auto maxChunkSize = m_StagingSize / 2;
+  if (job.level < 0) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, job.object);
+    glBindBuffer(GL_COPY_READ_BUFFER, m_Staging);
+    for (size_t done = 0; done < job.byteSize;) {
+      const auto chunkSize = std::min(maxChunkSize, job.byteSize - done);
+      const auto offset = allocateStaging(chunkSize);
+      std::copy_n(job.data + done, chunkSize, m_StagingPtr + offset);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset,
+          job.byteOffset + done, chunkSize);
+      retireStaging(offset, offset + chunkSize);
+      done += chunkSize;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  } else {
+    glBindTexture(GL_TEXTURE_2D, job.object);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Staging);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Tightly packed rows
+    const auto rowSize = job.height ? job.byteSize / job.height : 0;
+    const auto rowsPerChunk = GLsizei(
+        std::max(size_t(1), maxChunkSize / std::max(rowSize, size_t(1))));
+    for (GLsizei row = 0; row < job.height; row += rowsPerChunk) {
+      const auto rowCount = std::min(rowsPerChunk, job.height - row);
+      const auto chunkSize = rowCount * rowSize;
+      const auto offset = allocateStaging(chunkSize);
+      std::copy_n(job.data + row * rowSize, chunkSize, m_StagingPtr + offset);
+      glTexSubImage2D(GL_TEXTURE_2D, job.level, 0, row, job.width, rowCount,
+          GL_RGBA, job.type, (const GLvoid *)offset);
+      retireStaging(offset, offset + chunkSize);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  // Flushed so that the fence signals even if this context stays idle
+  const auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Fences.push_back({job.ticket, sync});
+  m_Stats.queuedBytes -= job.byteSize;
+  m_Stats.uploadedBytes += job.byteSize;
+}
+
+size_t GpuUploader::allocateStaging(size_t byteSize)
+{
+  // Forget the ranges already copied, without waiting
+  while (!m_InFlight.empty()) {
+    const auto status = glClientWaitSync(m_InFlight.front().sync, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(m_InFlight.front().sync);
+    m_InFlight.pop_front();
+  }
+
+  auto begin = alignUp(m_StagingHead, kStagingAlignment);
+  if (begin + byteSize > m_StagingSize) {
+    begin = 0;
+  }
+  const auto end = begin + byteSize;
+  // After a wrap, the oldest ranges may lie past the old head and not
+  // overlap the new one while newer ones do. Fences signal in order, so
+  // waiting on the newest overlapping range frees it and all the older ones.
+  size_t overlappedCount = 0;
+  for (size_t i = 0; i < m_InFlight.size(); ++i) {
+    if (m_InFlight[i].begin < end && begin < m_InFlight[i].end) {
+      overlappedCount = i + 1;
+    }
+  }
+  if (overlappedCount > 0) {
+    glClientWaitSync(m_InFlight[overlappedCount - 1].sync,
+        GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+    for (size_t i = 0; i < overlappedCount; ++i) {
+      glDeleteSync(m_InFlight.front().sync);
+      m_InFlight.pop_front();
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Stats.ringWaitCount;
+  }
+  m_StagingHead = end;
+  return begin;
+}
+
+void GpuUploader::retireStaging(size_t begin, size_t end)
+{
+  m_InFlight.push_back(
+      {begin, end, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "glfw.hpp"
+#include "loadprofiler.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Copies data into buffer and texture objects from a worker thread owning a
+// GL context shared with the main one, so that the render loop never pays
+// for a transfer. Data goes through a persistently mapped staging buffer
+// used as a ring, and each upload is followed by a fence that poll() checks
+// without waiting: once an upload is reported complete, the main thread can
+// use the object it wrote.
+//
+// The destination objects are created by the caller with immutable storage
+// (glBufferStorage, glTexStorage2D), only their content is uploaded here.
+// If the shared context cannot be created, uploads are done by submit()
+// itself on the calling thread.
+class GpuUploader
+{
+public:
+  using Ticket = uint64_t;
+
+  struct Stats
+  {
+    size_t queuedBytes = 0; // Submitted but not copied to the staging ring yet
+    size_t uploadedBytes = 0;
+    size_t ringWaitCount = 0; // Times the ring was full of pending copies
+  };
+
+  // Must be called from the thread owning mainWindow's context. Uploads are
+  // timed in profiler if it is not null.
+  GpuUploader(GLFWwindow *mainWindow, size_t stagingSize = 32 << 20,
+      LoadProfiler *profiler = nullptr);
+
+  // Drop the queued uploads and wait for the one in progress
+  ~GpuUploader();
+
+  GpuUploader(const GpuUploader &) = delete;
+  GpuUploader &operator=(const GpuUploader &) = delete;
+
+  bool hasWorker() const { return m_Worker.joinable(); }
+
+  // Copy byteSize bytes of data at byteOffset in buffer. data must stay
+  // valid until the upload is complete, keepAlive may own it.
+  Ticket uploadBuffer(GLuint buffer, size_t byteOffset, const void *data,
+      size_t byteSize, std::shared_ptr<const void> keepAlive = nullptr);
+
+  // Copy a level of an RGBA 2D texture, tightly packed rows
+  Ticket uploadTextureLevel(GLuint texture, GLint level, GLsizei width,
+      GLsizei height, GLenum type, const void *data,
+      std::shared_ptr<const void> keepAlive = nullptr);
+
+  // Append the tickets of the uploads completed since the last call to
+  // outCompleted, in submission order. Never waits for the GPU.
+  void poll(std::vector<Ticket> &outCompleted);
+
+  Stats stats() const;
+
+private:
+  struct Job
+  {
+    Ticket ticket;
+    GLuint object;
+    GLint level; // -1 for a buffer
+    size_t byteOffset;
+    GLsizei width;
+    GLsizei height;
+    GLenum type;
+    const unsigned char *data;
+    size_t byteSize;
+    std::shared_ptr<const void> keepAlive;
+  };
+
+  struct Fence
+  {
+    Ticket ticket;
+    GLsync sync;
+  };
+
+  // Range of the ring read by copies that may still be in flight
+  struct RingRange
+  {
+    size_t begin;
+    size_t end;
+    GLsync sync;
+  };
+
+  Ticket submit(Job job);
+  void workerLoop();
+  void initStaging();
+  void releaseStaging();
+  void process(const Job &job);
+  // Offset of byteSize free bytes of the ring, waiting for the copies
+  // reading them if needed
+  size_t allocateStaging(size_t byteSize);
+  void retireStaging(size_t begin, size_t end);
+
+  GLFWwindow *m_UploadWindow = nullptr;
+  const size_t m_StagingSize;
+  LoadProfiler *const m_Profiler;
+
+  // Owned by the thread processing the jobs
+  GLuint m_Staging = 0;
+  unsigned char *m_StagingPtr = nullptr;
+  size_t m_StagingHead = 0;
+  std::deque<RingRange> m_InFlight;
+
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+  std::deque<Job> m_Jobs;
+  std::deque<Fence> m_Fences; // Of processed jobs, in submission order
+  Ticket m_NextTicket = 1;
+  bool m_Stop = false;
+  Stats m_Stats;
+
+  std::thread m_Worker;
+};